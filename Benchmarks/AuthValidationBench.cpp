@@ -0,0 +1,141 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <map>
+#include <stdexcept>
+#include "AuthAddressLogic.h"
+#include "Bench.h"
+#include "BtcUtils.h"
+
+// Auth address validation over address histories dominated by outpoints
+// that do not come from a validation address.
+//
+// size: unrelated outpoints in the user address history (10000)
+// iterations: getValidPaths runs (100)
+
+namespace {
+   const size_t kValidationAddresses = 10;
+   const size_t kVettingsPerAddress = 1000;
+
+   bs::Address syntheticAddress(uint32_t id)
+   {
+      BinaryWriter bwId;
+      bwId.put_uint32_t(id);
+
+      BinaryWriter bw;
+      bw.put_uint8_t(SCRIPT_PREFIX_P2WPKH);
+      bw.put_BinaryData(BtcUtils::getHash160(bwId.getData()));
+      return bs::Address::fromHash(bw.getData());
+   }
+
+   OutpointData syntheticOutpoint(const BinaryData &txHash, unsigned height
+      , const BinaryData &spenderHash = {})
+   {
+      OutpointData result;
+      result.txHash_ = txHash;
+      result.txOutIndex_ = 0;
+      result.txHeight_ = height;
+      result.txIndex_ = 0;
+      result.value_ = 1000;
+      result.isSpent_ = !spenderHash.empty();
+      result.spenderHash_ = spenderHash;
+      return result;
+   }
+
+   // Serves fixed address histories, the bench calls ValidationAddressManager::update() once
+   // so height and ZC cutoffs are not applied
+   class HistoryArmory : public ArmoryConnection
+   {
+   public:
+      HistoryArmory()
+         : ArmoryConnection(bs::bench::logger())
+      {
+         state_ = ArmoryState::Ready;
+         topBlock_ = 1000;
+      }
+
+      bool getOutpointsFor(const std::vector<BinaryData> &addrs
+         , const std::function<void(const OutpointBatch &)> &cb, unsigned int, unsigned int) override
+      {
+         OutpointBatch batch;
+         batch.heightCutoff_ = topBlock_;
+         batch.zcIndexCutoff_ = 0;
+         for (const auto &addr : addrs) {
+            const auto itHistory = history_.find(addr);
+            if (itHistory != history_.end()) {
+               batch.outpoints_[addr] = itHistory->second;
+            }
+         }
+         cb(batch);
+         return true;
+      }
+
+      std::map<BinaryData, std::vector<OutpointData>> history_;
+   };
+
+   void runValidPaths(const bs::bench::Params &params)
+   {
+      const auto nbUnrelated = params.sizeOr(10000);
+      const auto nbRuns = params.iterationsOr(100);
+
+      auto armory = std::make_shared<HistoryArmory>();
+      ValidationAddressManager vam(armory);
+
+      // every validation address is funded once and vets kVettingsPerAddress user addresses
+      BinaryData userVetting;
+      for (uint32_t i = 0; i < kValidationAddresses; ++i) {
+         const auto validationAddr = syntheticAddress(i);
+         vam.addValidationAddress(validationAddr);
+
+         auto &history = armory->history_[validationAddr.prefixed()];
+         history.push_back(syntheticOutpoint(CryptoPRNG::generateRandom(32), 1));
+         for (size_t j = 0; j < kVettingsPerAddress; ++j) {
+            history.push_back(syntheticOutpoint(CryptoPRNG::generateRandom(32), 2
+               , CryptoPRNG::generateRandom(32)));
+         }
+         userVetting = history.back().spenderHash_;
+      }
+
+      LatencyStats updateStats(1);
+      {
+         LatencyTimer timer(updateStats);
+         timer.setItems(vam.update());
+      }
+
+      // user address history: one vetting output among unrelated payments
+      std::vector<OutpointData> userHistory;
+      userHistory.reserve(nbUnrelated + 1);
+      for (size_t i = 0; i < nbUnrelated; ++i) {
+         userHistory.push_back(syntheticOutpoint(CryptoPRNG::generateRandom(32), 3));
+      }
+      userHistory.insert(userHistory.begin() + nbUnrelated / 2, syntheticOutpoint(userVetting, 3));
+
+      if (vam.getValidationAddressForTxHash(userVetting) == nullptr) {
+         throw std::runtime_error("vetting tx missing from the spender index");
+      }
+
+      /*
+      Validation addresses are not marked valid without goOnline() (it needs
+      a BDV), so the vetting outpoint is rejected after its index hit. The
+      per outpoint lookup measured here is the same either way.
+      */
+      const auto pathStats = bs::bench::measure(nbRuns, [&vam, &userHistory] {
+         AuthAddressLogic::getValidPaths(vam, userHistory);
+         return userHistory.size();
+      });
+
+      bs::bench::report("auth.vam.update", updateStats.summary(), "outpoints");
+      bs::bench::report("auth.validPaths", pathStats, "outpoints");
+   }
+
+   const bs::bench::Registrar validPathsCase("auth.validPaths"
+      , "Validation address spender index update and auth path lookup over unrelated outpoints"
+      , runValidPaths);
+}
@@ -0,0 +1,103 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "Bench.h"
+
+#include <iomanip>
+#include <iostream>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_sinks.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace bs::bench;
+
+namespace {
+   std::vector<Case> &registry()
+   {
+      static std::vector<Case> instance;
+      return instance;
+   }
+
+   double toMs(std::chrono::microseconds value)
+   {
+      return value.count() / 1000.0;
+   }
+}
+
+Registrar::Registrar(const std::string &name, const std::string &description, const BenchFunc &func)
+{
+   registry().push_back({ name, description, func });
+}
+
+const std::vector<Case> &bs::bench::cases()
+{
+   return registry();
+}
+
+std::shared_ptr<spdlog::logger> bs::bench::logger()
+{
+   static const auto instance = [] {
+      auto result = spdlog::stderr_logger_mt("bench");
+      result->set_level(spdlog::level::warn);
+      return result;
+   }();
+   return instance;
+}
+
+size_t bs::bench::peakRssKb()
+{
+#ifdef WIN32
+   PROCESS_MEMORY_COUNTERS counters;
+   if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+      return 0;
+   }
+   return counters.PeakWorkingSetSize / 1024;
+#else
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) != 0) {
+      return 0;
+   }
+#ifdef __APPLE__
+   return usage.ru_maxrss / 1024;   // bytes on macOS
+#else
+   return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void bs::bench::report(const std::string &name, const LatencyStats::Summary &summary
+   , const std::string &itemName)
+{
+   std::cout << std::fixed << std::setprecision(3)
+      << name << ": " << summary.count << " run(s), " << summary.items << " " << itemName
+      << ", " << std::setprecision(1) << summary.throughput() << " " << itemName << "/s"
+      << std::setprecision(3)
+      << ", p50 " << toMs(summary.p50) << " ms, p90 " << toMs(summary.p90)
+      << " ms, p99 " << toMs(summary.p99) << " ms, max " << toMs(summary.max)
+      << " ms, peak RSS " << peakRssKb() / 1024 << " MiB" << std::endl;
+}
+
+LatencyStats::Summary bs::bench::measure(size_t iterations, const std::function<uint64_t()> &func)
+{
+   LatencyStats stats(iterations);
+   for (size_t i = 0; i < iterations; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      const auto items = func();
+      stats.add(std::chrono::duration_cast<std::chrono::microseconds>(
+         std::chrono::steady_clock::now() - start), items);
+   }
+   return stats.summary();
+}
@@ -0,0 +1,72 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#ifndef __BS_BENCH_H__
+#define __BS_BENCH_H__
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "LatencyStats.h"
+
+namespace spdlog {
+   class logger;
+}
+
+namespace bs {
+   namespace bench {
+
+      // Common command line parameters, each case documents how it uses them.
+      // Zero means "case default".
+      struct Params
+      {
+         size_t   size{};
+         size_t   iterations{};
+         unsigned threads{};
+
+         size_t sizeOr(size_t value) const { return size ? size : value; }
+         size_t iterationsOr(size_t value) const { return iterations ? iterations : value; }
+         unsigned threadsOr(unsigned value) const { return threads ? threads : value; }
+      };
+
+      using BenchFunc = std::function<void(const Params &)>;
+
+      struct Case
+      {
+         std::string name;
+         std::string description;
+         BenchFunc   func;
+      };
+
+      // Cases register themselves at static initialization, one Registrar per case
+      struct Registrar
+      {
+         Registrar(const std::string &name, const std::string &description, const BenchFunc &);
+      };
+      const std::vector<Case> &cases();
+
+      std::shared_ptr<spdlog::logger> logger();
+
+      // Peak resident set size of the process in KiB (0 if unavailable)
+      size_t peakRssKb();
+
+      // Prints one result line: runs, items, throughput, latency percentiles and peak RSS
+      void report(const std::string &name, const LatencyStats::Summary &
+         , const std::string &itemName = "items");
+
+      // Runs func the given number of times and records each run, func returns number of items processed
+      LatencyStats::Summary measure(size_t iterations, const std::function<uint64_t()> &func);
+
+   }  //namespace bench
+}  //namespace bs
+
+#endif // __BS_BENCH_H__
@@ -0,0 +1,937 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bench.h"
+#include "BinaryData.h"
+#include "BtcUtils.h"
+#include "ColoredCoinBatcher.h"
+#include "ColoredCoinLogic.h"
+#include "ColoredCoinServer.h"
+#include "XBTAmount.h"
+
+// Replays a synthetic CC graph (origin funding, user transfers, revocations)
+// with ZC churn and reorgs through ColoredCoinTracker. Armory is replaced with
+// an in-memory ledger answering the tracker queries synchronously, so results
+// measure tracker processing only, not DB or network latency.
+//
+// cc.replay - tracker sync, block, ZC and reorg processing
+// cc.publish - snapshot updates of the replayed tracker sent by CcSnapshotPublisher
+//    to 1000 subscribed clients, with delta updates and with full snapshots only;
+//    messages are counted, not sent
+//    size: number of CC holders (1000), iterations: live blocks replayed (100)
+// cc.batch - per-block update latency of 1, 2, 4... concurrently updated trackers
+//    (one CC each) querying Armory directly and through ColoredCoinQueryBatcher;
+//    every Armory request costs a 1 ms round trip and requests are served serially
+//    size: CC holders per tracker (200), iterations: live blocks per tracker count (20),
+//    threads: maximum number of trackers (32)
+
+namespace {
+   const uint64_t kCoinsPerShare = 1000;
+   const uint64_t kSharesPerUser = 100;
+   const uint64_t kRevocationFunds = 100000000;
+   const uint64_t kRevocationValue = 1000;
+
+   const size_t kUsersPerDistribution = 100;
+   const size_t kHistoryBlocks = 50;
+   const size_t kTransfersPerBlock = 50;
+   const size_t kZcPerRound = 20;
+   const size_t kZcDropPercent = 10;
+   const size_t kRevocationInterval = 10;
+   const size_t kReorgInterval = 25;
+   const unsigned kReorgDepth = 3;
+
+   const std::chrono::microseconds kBatchRoundTrip{ 1000 };
+
+   const size_t kPublishClients = 1000;
+   // every n-th client acks late and falls back to full snapshots at times
+   const size_t kLaggingClientInterval = 100;
+   const size_t kLaggingAckInterval = 20;
+
+   using Outpoint = std::pair<BinaryData, unsigned>;
+
+   struct Payment
+   {
+      bs::Address address;
+      uint64_t    value;
+      bool        cc;
+   };
+
+   bs::Address syntheticAddress(uint32_t id)
+   {
+      BinaryWriter bwId;
+      bwId.put_uint32_t(id);
+
+      BinaryWriter bw;
+      bw.put_uint8_t(SCRIPT_PREFIX_P2WPKH);
+      bw.put_BinaryData(BtcUtils::getHash160(bwId.getData()));
+      return bs::Address::fromHash(bw.getData());
+   }
+
+   BinaryData randomHash(std::mt19937_64 &rng)
+   {
+      BinaryWriter bw;
+      for (int i = 0; i < 4; ++i) {
+         bw.put_uint64_t(rng());
+      }
+      return bw.getData();
+   }
+
+   // In-memory chain and mempool served through the ArmoryConnection queries
+   // used by ColoredCoinTracker. Transactions enter as ZC and get confirmed by
+   // mineBlock(), reorged blocks return their transactions to the mempool.
+   class ReplayArmory : public ArmoryConnection
+   {
+   public:
+      struct Output
+      {
+         BinaryData  scrAddr;
+         uint64_t    value;
+         bool        cc;
+         BinaryData  spender;
+      };
+
+      ReplayArmory()
+         : ArmoryConnection(bs::bench::logger())
+      {
+         state_ = ArmoryState::Ready;
+         blocks_.emplace_back();    // genesis
+      }
+
+      bool getTXsByHash(const std::set<BinaryData> &hashes, const TXsCb &cb, bool) override
+      {
+         const auto lock = serve();
+         AsyncClient::TxBatchResult result;
+         for (const auto &hash : hashes) {
+            const auto itTx = txs_.find(hash);
+            if (itTx != txs_.end()) {
+               result[hash] = itTx->second.tx;
+            }
+         }
+         cb(result, nullptr);
+         return true;
+      }
+
+      bool getOutpointsForAddresses(const std::set<BinaryData> &addrs
+         , const std::function<void(const OutpointBatch &, std::exception_ptr)> &cb
+         , unsigned int height, unsigned int zcIndex) override
+      {
+         // the tracker asks for either confirmed (zcIndex UINT32_MAX) or ZC (height UINT32_MAX) changes
+         const bool zc = (height == UINT32_MAX);
+         const auto lock = serve();
+
+         OutpointBatch batch;
+         batch.heightCutoff_ = topBlock_;
+         batch.zcIndexCutoff_ = nextZcIndex_;
+
+         for (const auto &addr : addrs) {
+            const auto itAddr = outputsByAddr_.find(addr);
+            if (itAddr == outputsByAddr_.end()) {
+               continue;
+            }
+            std::vector<OutpointData> outpoints;
+            for (const auto &op : itAddr->second) {
+               const auto &rec = txs_.at(op.first);
+               const auto &output = rec.outputs[op.second];
+               const TxRecord *spender = output.spender.empty() ? nullptr : &txs_.at(output.spender);
+
+               bool spent = false;
+               bool include = false;
+               if (zc) {
+                  spent = (spender != nullptr) && spender->isZc();
+                  include = (rec.isZc() && (rec.index >= zcIndex)) || (spent && (spender->index >= zcIndex));
+               }
+               else {
+                  spent = (spender != nullptr) && !spender->isZc();
+                  include = !rec.isZc() && ((rec.height >= height) || (spent && (spender->height >= height)));
+               }
+               if (!include) {
+                  continue;
+               }
+
+               OutpointData opData;
+               opData.txHash_ = op.first;
+               opData.txOutIndex_ = op.second;
+               opData.txHeight_ = rec.height;
+               opData.txIndex_ = rec.index;
+               opData.value_ = output.value;
+               opData.isSpent_ = spent;
+               if (spent) {
+                  opData.spenderHash_ = output.spender;
+               }
+               outpoints.emplace_back(std::move(opData));
+            }
+            if (!outpoints.empty()) {
+               batch.outpoints_[addr] = std::move(outpoints);
+            }
+         }
+         cb(batch, nullptr);
+         return true;
+      }
+
+      bool getSpentnessForOutputs(const std::map<BinaryData, std::set<unsigned>> &outputs
+         , const SpentnessCb &cb) override
+      {
+         const auto lock = serve();
+         cb(spentness(outputs, false), nullptr);
+         return true;
+      }
+
+      bool getSpentnessForZcOutputs(const std::map<BinaryData, std::set<unsigned>> &outputs
+         , const SpentnessCb &cb) override
+      {
+         const auto lock = serve();
+         cb(spentness(outputs, true), nullptr);
+         return true;
+      }
+
+      // Adds a ZC spending the inputs, inputs not in the ledger act as external funding
+      BinaryData addTx(const std::vector<Outpoint> &inputs, const std::vector<Payment> &payments)
+      {
+         BinaryWriter bw;
+         bw.put_uint32_t(1);
+         bw.put_var_int(inputs.size());
+         for (const auto &input : inputs) {
+            bw.put_BinaryData(input.first);
+            bw.put_uint32_t(input.second);
+            bw.put_var_int(0);
+            bw.put_uint32_t(UINT32_MAX);
+         }
+         bw.put_var_int(payments.size());
+         for (const auto &payment : payments) {
+            bw.put_BinaryData(payment.address.getRecipient(bs::XBTAmount{ payment.value })->getSerializedScript());
+         }
+         bw.put_uint32_t(nonce_++);    // lock time, keeps otherwise identical transfers apart
+
+         TxRecord rec;
+         rec.raw = bw.getData();
+         rec.inputs = inputs;
+         rec.index = nextZcIndex_++;
+
+         const Tx tx(rec.raw);
+         const auto hash = tx.getThisHash();
+         for (unsigned i = 0; i < tx.getNumTxOut(); ++i) {
+            const auto txOut = tx.getTxOutCopy(i);
+            rec.outputs.push_back({ txOut.getScrAddressStr(), txOut.getValue(), payments[i].cc, {} });
+         }
+
+         for (const auto &input : inputs) {
+            const auto itParent = txs_.find(input.first);
+            if (itParent == txs_.end()) {
+               continue;
+            }
+            auto &output = itParent->second.outputs.at(input.second);
+            if (!output.spender.empty()) {
+               throw std::logic_error("double spend in replay ledger");
+            }
+            output.spender = hash;
+            ccOutputs_.erase(input);
+         }
+         for (unsigned i = 0; i < rec.outputs.size(); ++i) {
+            outputsByAddr_[rec.outputs[i].scrAddr].push_back({ hash, i });
+            if (rec.outputs[i].cc) {
+               ccOutputs_.insert({ hash, i });
+            }
+         }
+
+         auto &stored = txs_[hash];
+         stored = std::move(rec);
+         stamp(stored);
+         mempool_.push_back(hash);
+         return hash;
+      }
+
+      // Confirms all ZCs, returns the number of transactions mined
+      size_t mineBlock()
+      {
+         const unsigned height = static_cast<unsigned>(blocks_.size());
+         std::vector<BinaryData> block;
+         block.swap(mempool_);
+         for (unsigned i = 0; i < block.size(); ++i) {
+            auto &rec = txs_.at(block[i]);
+            rec.height = height;
+            rec.index = i;
+         }
+         for (const auto &hash : block) {
+            stamp(txs_.at(hash));
+         }
+         const auto nbTxs = block.size();
+         blocks_.emplace_back(std::move(block));
+         topBlock_ = height;
+         return nbTxs;
+      }
+
+      // Drops a ZC with all of its descendants
+      void dropZc(const BinaryData &hash)
+      {
+         removeTx(hash);
+      }
+
+      // Returns transactions of the top blocks to the mempool, ahead of current ZCs
+      void reorg(unsigned depth)
+      {
+         std::vector<BinaryData> unconfirmed;
+         while ((depth-- > 0) && (blocks_.size() > 1)) {
+            unconfirmed.insert(unconfirmed.begin(), blocks_.back().begin(), blocks_.back().end());
+            blocks_.pop_back();
+         }
+         unconfirmed.insert(unconfirmed.end(), mempool_.begin(), mempool_.end());
+         mempool_.clear();
+
+         for (const auto &hash : unconfirmed) {
+            auto &rec = txs_.at(hash);
+            rec.height = UINT32_MAX;
+            rec.index = nextZcIndex_++;
+         }
+         for (const auto &hash : unconfirmed) {
+            stamp(txs_.at(hash));
+         }
+         mempool_ = std::move(unconfirmed);
+         topBlock_ = static_cast<unsigned>(blocks_.size() - 1);
+      }
+
+      const std::vector<BinaryData> &mempool() const { return mempool_; }
+      size_t nbTxs() const { return txs_.size(); }
+
+      // Requests are served one at a time, each waiting for the round trip
+      // first, as over a single Armory connection
+      void setRoundTrip(std::chrono::microseconds roundTrip) { roundTrip_ = roundTrip; }
+      uint64_t requests() const { return requests_; }
+
+      const Output &output(const Outpoint &op) const
+      {
+         return txs_.at(op.first).outputs.at(op.second);
+      }
+
+      // Picks an unspent output tagged as CC, empty hash if none
+      Outpoint randomCcOutput(std::mt19937_64 &rng) const
+      {
+         if (ccOutputs_.empty()) {
+            return {};
+         }
+         // tx hashes are uniformly distributed, so is the successor of a random key
+         auto itOp = ccOutputs_.lower_bound({ randomHash(rng), 0 });
+         if (itOp == ccOutputs_.end()) {
+            itOp = ccOutputs_.begin();
+         }
+         return *itOp;
+      }
+
+      // Picks the largest unspent output of the address, empty hash if none
+      Outpoint largestUnspent(const bs::Address &addr) const
+      {
+         Outpoint result;
+         uint64_t value = 0;
+         const auto itAddr = outputsByAddr_.find(addr.prefixed());
+         if (itAddr == outputsByAddr_.end()) {
+            return result;
+         }
+         for (const auto &op : itAddr->second) {
+            const auto &out = output(op);
+            if (out.spender.empty() && (out.value > value)) {
+               value = out.value;
+               result = op;
+            }
+         }
+         return result;
+      }
+
+   private:
+      std::unique_lock<std::mutex> serve() const
+      {
+         std::unique_lock<std::mutex> lock(requestMutex_);
+         ++requests_;
+         if (roundTrip_.count() > 0) {
+            std::this_thread::sleep_for(roundTrip_);
+         }
+         return lock;
+      }
+
+      struct TxRecord
+      {
+         BinaryData  raw;
+         std::shared_ptr<const Tx>  tx;
+         std::vector<Outpoint>      inputs;
+         std::vector<Output>        outputs;
+         unsigned height{ UINT32_MAX };
+         unsigned index{};          // position in block, or ZC index if unconfirmed
+
+         bool isZc() const { return (height == UINT32_MAX); }
+      };
+
+      // Handed out Tx objects are immutable, metadata changes create a new one
+      void stamp(TxRecord &rec) const
+      {
+         auto tx = std::make_shared<Tx>(rec.raw);
+         tx->setTxHeight(rec.height);
+         tx->setTxIndex(rec.index);
+
+         //confirmed txs refer to parent heights, ZCs to parent ZC indices
+         for (const auto &input : rec.inputs) {
+            const auto itParent = txs_.find(input.first);
+            if (itParent == txs_.end()) {
+               continue;
+            }
+            if (!rec.isZc()) {
+               tx->pushBackOpId(itParent->second.height);
+            }
+            else if (itParent->second.isZc()) {
+               tx->pushBackOpId(itParent->second.index);
+            }
+         }
+         rec.tx = tx;
+      }
+
+      std::map<BinaryData, std::map<unsigned int, SpentnessResult>> spentness(
+         const std::map<BinaryData, std::set<unsigned>> &outputs, bool zc) const
+      {
+         std::map<BinaryData, std::map<unsigned int, SpentnessResult>> result;
+         for (const auto &outputsPair : outputs) {
+            auto &txResult = result[outputsPair.first];
+            const auto itTx = txs_.find(outputsPair.first);
+            for (const auto index : outputsPair.second) {
+               auto &spentness = txResult[index];
+               if ((itTx == txs_.end()) || (index >= itTx->second.outputs.size())) {
+                  continue;
+               }
+               const auto &spender = itTx->second.outputs[index].spender;
+               if (!spender.empty() && (txs_.at(spender).isZc() == zc)) {
+                  spentness.spender_ = spender;
+               }
+            }
+         }
+         return result;
+      }
+
+      void removeTx(const BinaryData &hash)
+      {
+         const auto itTx = txs_.find(hash);
+         if (itTx == txs_.end()) {
+            return;
+         }
+         for (size_t i = 0; i < itTx->second.outputs.size(); ++i) {
+            const auto spender = itTx->second.outputs[i].spender;
+            if (!spender.empty()) {
+               removeTx(spender);
+            }
+         }
+
+         const auto &rec = itTx->second;
+         for (const auto &input : rec.inputs) {
+            const auto itParent = txs_.find(input.first);
+            if (itParent == txs_.end()) {
+               continue;
+            }
+            auto &output = itParent->second.outputs[input.second];
+            output.spender.clear();
+            if (output.cc) {
+               ccOutputs_.insert(input);
+            }
+         }
+         for (unsigned i = 0; i < rec.outputs.size(); ++i) {
+            auto &addrOutputs = outputsByAddr_[rec.outputs[i].scrAddr];
+            addrOutputs.erase(std::remove(addrOutputs.begin(), addrOutputs.end()
+               , Outpoint{ hash, i }), addrOutputs.end());
+            ccOutputs_.erase({ hash, i });
+         }
+
+         auto &txList = rec.isZc() ? mempool_ : blocks_.at(rec.height);
+         txList.erase(std::remove(txList.begin(), txList.end(), hash), txList.end());
+         txs_.erase(itTx);
+      }
+
+   private:
+      std::map<BinaryData, TxRecord>   txs_;
+      std::map<BinaryData, std::vector<Outpoint>>  outputsByAddr_;
+      std::set<Outpoint>               ccOutputs_;
+      std::vector<std::vector<BinaryData>>   blocks_;
+      std::vector<BinaryData>          mempool_;
+      unsigned nextZcIndex_ = 1;
+      uint32_t nonce_ = 0;
+
+      std::chrono::microseconds  roundTrip_{};
+      mutable std::mutex         requestMutex_;
+      mutable uint64_t           requests_{};
+   };
+
+   // Generates CC activity on the replay ledger
+   class ReplayScenario
+   {
+   public:
+      // Each CC gets its own origin, revocation and holder addresses
+      ReplayScenario(const std::shared_ptr<ReplayArmory> &armory, size_t nbUsers, uint32_t ccIndex = 0)
+         : armory_(armory)
+         , rng_(42 + ccIndex)  // fixed seed keeps runs comparable
+         , origin_(syntheticAddress(addressBase(nbUsers, ccIndex)))
+         , revocation_(syntheticAddress(addressBase(nbUsers, ccIndex) + 1))
+      {
+         users_.reserve(nbUsers);
+         for (size_t i = 0; i < nbUsers; ++i) {
+            users_.push_back(syntheticAddress(addressBase(nbUsers, ccIndex) + static_cast<uint32_t>(i + 2)));
+         }
+      }
+
+      const bs::Address &origin() const { return origin_; }
+      const bs::Address &revocation() const { return revocation_; }
+
+      // Funds origin and revocation addresses, then hands out shares to all users
+      void bootstrap()
+      {
+         armory_->addTx({ { randomHash(rng_), 0 } }, {
+            { origin_, users_.size() * kSharesPerUser * kCoinsPerShare, false },
+            { revocation_, kRevocationFunds, false } });
+         armory_->mineBlock();
+
+         for (size_t start = 0; start < users_.size(); start += kUsersPerDistribution) {
+            const auto funding = armory_->largestUnspent(origin_);
+            const auto fundingValue = armory_->output(funding).value;
+
+            std::vector<Payment> payments;
+            uint64_t total = 0;
+            for (size_t i = start; (i < users_.size()) && (i < start + kUsersPerDistribution); ++i) {
+               payments.push_back({ users_[i], kSharesPerUser * kCoinsPerShare, true });
+               total += kSharesPerUser * kCoinsPerShare;
+            }
+            if (fundingValue > total) {
+               payments.push_back({ origin_, fundingValue - total, false });
+            }
+            armory_->addTx({ funding }, payments);
+            armory_->mineBlock();
+         }
+      }
+
+      // Moves a random amount of shares from a random holder, returns false if nothing to spend
+      bool transfer()
+      {
+         const auto op = armory_->randomCcOutput(rng_);
+         if (op.first.empty()) {
+            return false;
+         }
+         const auto &output = armory_->output(op);
+         const auto shares = output.value / kCoinsPerShare;
+         const auto sent = (1 + rng_() % shares) * kCoinsPerShare;
+
+         std::vector<Payment> payments{ { users_[rng_() % users_.size()], sent, true } };
+         if (sent < output.value) {
+            payments.push_back({ bs::Address::fromHash(output.scrAddr), output.value - sent, true });
+         }
+         armory_->addTx({ op }, payments);
+         return true;
+      }
+
+      // Revokes a random user
+      void revoke()
+      {
+         const auto funding = armory_->largestUnspent(revocation_);
+         if (funding.first.empty()) {
+            return;
+         }
+         const auto fundingValue = armory_->output(funding).value;
+         armory_->addTx({ funding }, {
+            { users_[rng_() % users_.size()], kRevocationValue, false },
+            { revocation_, fundingValue - kRevocationValue, false } });
+      }
+
+      size_t transfers(size_t count)
+      {
+         size_t result = 0;
+         for (size_t i = 0; i < count; ++i) {
+            if (transfer()) {
+               ++result;
+            }
+         }
+         return result;
+      }
+
+      // Evicts a share of the mempool (double spends, expiry), descendants included
+      void churn()
+      {
+         const auto nbDrops = armory_->mempool().size() * kZcDropPercent / 100;
+         for (size_t i = 0; (i < nbDrops) && !armory_->mempool().empty(); ++i) {
+            const auto &mempool = armory_->mempool();
+            armory_->dropZc(BinaryData(mempool[rng_() % mempool.size()]));
+         }
+      }
+
+   private:
+      static uint32_t addressBase(size_t nbUsers, uint32_t ccIndex)
+      {
+         return ccIndex * static_cast<uint32_t>(nbUsers + 2);
+      }
+
+      std::shared_ptr<ReplayArmory> armory_;
+      std::mt19937_64   rng_;
+      const bs::Address origin_;
+      const bs::Address revocation_;
+      std::vector<bs::Address>   users_;
+   };
+
+   class ReplayTracker : public ColoredCoinTracker
+   {
+   public:
+      using ColoredCoinTracker::ColoredCoinTracker;
+
+      // Same sequence as ColoredCoinACT for the matching notifications
+      void onNewBlock() { update(); }
+      void onZc() { zcUpdate(); }
+      void onReorg()
+      {
+         reorg(true);
+         update();
+         zcUpdate();
+      }
+      void sync()
+      {
+         update();
+         zcUpdate();
+      }
+   };
+
+   // CC history up to the live blocks, the first ZC round is left in the mempool
+   void buildHistory(ReplayArmory &armory, std::vector<ReplayScenario> &scenarios)
+   {
+      for (auto &scenario : scenarios) {
+         scenario.bootstrap();
+      }
+      for (size_t i = 0; i < kHistoryBlocks; ++i) {
+         for (auto &scenario : scenarios) {
+            scenario.transfers(kTransfersPerBlock);
+            if ((i % kRevocationInterval) == 0) {
+               scenario.revoke();
+            }
+         }
+         armory.mineBlock();
+      }
+      for (auto &scenario : scenarios) {
+         scenario.transfers(kZcPerRound);
+      }
+   }
+
+   // Live block activity: ZC round seen by the tracker, mempool churn, the rest
+   // of the block and either a new block or a reorg every kReorgInterval blocks
+   struct LiveBlockCbs
+   {
+      std::function<void(size_t nbZc)>    onZc;
+      std::function<void(size_t nbMined)> onNewBlock;
+      std::function<void()>               onReorg;
+   };
+
+   void liveBlock(size_t index, ReplayArmory &armory, std::vector<ReplayScenario> &scenarios
+      , const LiveBlockCbs &cbs)
+   {
+      size_t nbZc = 0;
+      for (auto &scenario : scenarios) {
+         nbZc += scenario.transfers(kZcPerRound);
+      }
+      cbs.onZc(nbZc);
+      scenarios.front().churn();
+
+      //the rest of the block was never seen as ZC
+      for (auto &scenario : scenarios) {
+         scenario.transfers(kTransfersPerBlock - kZcPerRound);
+         if ((index % kRevocationInterval) == 0) {
+            scenario.revoke();
+         }
+      }
+
+      if ((index % kReorgInterval) == 0) {
+         armory.reorg(kReorgDepth);
+         scenarios.front().churn();
+         armory.mineBlock();
+         for (unsigned j = 0; j < kReorgDepth; ++j) {
+            armory.mineBlock();
+         }
+         cbs.onReorg();
+      }
+      else {
+         cbs.onNewBlock(armory.mineBlock());
+      }
+   }
+
+   void runReplay(const bs::bench::Params &params)
+   {
+      const auto nbUsers = params.sizeOr(1000);
+      const auto nbBlocks = params.iterationsOr(100);
+
+      auto armory = std::make_shared<ReplayArmory>();
+      std::vector<ReplayScenario> scenarios;
+      scenarios.emplace_back(armory, nbUsers);
+      buildHistory(*armory, scenarios);
+      const auto &scenario = scenarios.front();
+
+      ReplayTracker tracker(kCoinsPerShare, armory);
+      tracker.addOriginAddress(scenario.origin());
+      tracker.addRevocationAddress(scenario.revocation());
+
+      LatencyStats syncStats(1);
+      {
+         LatencyTimer timer(syncStats);
+         timer.setItems(armory->nbTxs());
+         tracker.sync();
+      }
+      const auto snapshot = tracker.snapshot();
+      if (!snapshot || snapshot->utxoSet_.empty()) {
+         throw std::runtime_error("replay produced no CC outputs");
+      }
+
+      LatencyStats blockStats(nbBlocks);
+      LatencyStats zcStats(nbBlocks);
+      LatencyStats reorgStats(nbBlocks / kReorgInterval + 1);
+      LiveBlockCbs cbs;
+      cbs.onZc = [&](size_t nbZc) {
+         LatencyTimer timer(zcStats);
+         timer.setItems(nbZc);
+         tracker.onZc();
+      };
+      cbs.onNewBlock = [&](size_t nbMined) {
+         LatencyTimer timer(blockStats);
+         timer.setItems(nbMined);
+         tracker.onNewBlock();
+      };
+      cbs.onReorg = [&] {
+         LatencyTimer timer(reorgStats);
+         timer.setItems(armory->nbTxs());
+         tracker.onReorg();
+      };
+      for (size_t i = 1; i <= nbBlocks; ++i) {
+         liveBlock(i, *armory, scenarios, cbs);
+      }
+
+      bs::bench::report("cc.replay.sync", syncStats.summary(), "tx");
+      bs::bench::report("cc.replay.block", blockStats.summary(), "tx");
+      bs::bench::report("cc.replay.zc", zcStats.summary(), "tx");
+      bs::bench::report("cc.replay.reorg", reorgStats.summary(), "tx");
+   }
+
+   // Tracker clients of one CcSnapshotPublisher, acks are sent right after
+   // each update except for the lagging ones
+   class PublishedClients
+   {
+   public:
+      PublishedClients(bool deltaUpdates, size_t nbBlocks, const std::shared_ptr<ColoredCoinSnapshot> &snapshot)
+         : publisher_([](const std::string &, const std::string &) {})
+         , stats_(nbBlocks)
+      {
+         // clients register after the initial sync, as with a running server
+         publisher_.publish(snapshot);
+         for (size_t i = 0; i < kPublishClients; ++i) {
+            publisher_.addClient({ "client" + std::to_string(i), 1 }, deltaUpdates);
+         }
+      }
+
+      void publish(const std::shared_ptr<ColoredCoinSnapshot> &snapshot, size_t block)
+      {
+         const auto prevBytes = publisher_.stats().fullBytes + publisher_.stats().deltaBytes;
+         {
+            LatencyTimer timer(stats_);
+            publisher_.publish(snapshot);
+            timer.setItems(publisher_.stats().fullBytes + publisher_.stats().deltaBytes - prevBytes);
+         }
+         for (size_t i = 0; i < kPublishClients; ++i) {
+            if (((i % kLaggingClientInterval) != 0) || ((block % kLaggingAckInterval) == 0)) {
+               publisher_.ack({ "client" + std::to_string(i), 1 }, publisher_.version());
+            }
+         }
+      }
+
+      void publishZc(const std::shared_ptr<ColoredCoinZCSnapshot> &snapshot)
+      {
+         const auto prevBytes = publisher_.stats().zcBytes;
+         publisher_.publishZc(snapshot);
+         zcBytes_ += publisher_.stats().zcBytes - prevBytes;
+      }
+
+      void report(const std::string &name) const
+      {
+         const auto summary = stats_.summary();
+         const auto &stats = publisher_.stats();
+         bs::bench::report(name, summary, "bytes");
+         std::cout << name << ": " << kPublishClients << " clients, "
+            << (summary.count ? summary.items / summary.count : 0) << " bytes per block ("
+            << stats.fullSent - kPublishClients << " full, " << stats.deltaSent << " delta updates sent), ZC snapshots: "
+            << (summary.count ? zcBytes_ / summary.count : 0) << " bytes per block" << std::endl;
+      }
+
+   private:
+      CcSnapshotPublisher  publisher_;
+      LatencyStats         stats_;
+      uint64_t             zcBytes_{};
+   };
+
+   void runPublish(const bs::bench::Params &params)
+   {
+      const auto nbUsers = params.sizeOr(1000);
+      const auto nbBlocks = params.iterationsOr(100);
+
+      auto armory = std::make_shared<ReplayArmory>();
+      std::vector<ReplayScenario> scenarios;
+      scenarios.emplace_back(armory, nbUsers);
+      buildHistory(*armory, scenarios);
+      const auto &scenario = scenarios.front();
+
+      ReplayTracker tracker(kCoinsPerShare, armory);
+      tracker.addOriginAddress(scenario.origin());
+      tracker.addRevocationAddress(scenario.revocation());
+      tracker.sync();
+
+      PublishedClients deltaClients(true, nbBlocks, tracker.snapshot());
+      PublishedClients fullClients(false, nbBlocks, tracker.snapshot());
+
+      size_t block = 0;
+      const auto publish = [&] {
+         deltaClients.publish(tracker.snapshot(), block);
+         fullClients.publish(tracker.snapshot(), block);
+      };
+      LiveBlockCbs cbs;
+      cbs.onZc = [&](size_t) {
+         tracker.onZc();
+         deltaClients.publishZc(tracker.zcSnapshot());
+         fullClients.publishZc(tracker.zcSnapshot());
+      };
+      cbs.onNewBlock = [&](size_t) {
+         tracker.onNewBlock();
+         publish();
+      };
+      cbs.onReorg = [&] {
+         tracker.onReorg();
+         publish();
+      };
+      for (block = 1; block <= nbBlocks; ++block) {
+         liveBlock(block, *armory, scenarios, cbs);
+      }
+
+      deltaClients.report("cc.publish.delta");
+      fullClients.report("cc.publish.full");
+   }
+
+   using Trackers = std::vector<std::unique_ptr<ReplayTracker>>;
+
+   // One thread per tracker, as every tracker is updated from its own ColoredCoinACT
+   void updateAll(Trackers &trackers, void (ReplayTracker::*func)())
+   {
+      std::vector<std::thread> threads;
+      for (auto &tracker : trackers) {
+         threads.emplace_back([tracker = tracker.get(), func] {
+            (tracker->*func)();
+         });
+      }
+      for (auto &thread : threads) {
+         thread.join();
+      }
+   }
+
+   Trackers createTrackers(const std::shared_ptr<ReplayArmory> &armory
+      , const std::vector<ReplayScenario> &scenarios
+      , const std::shared_ptr<ColoredCoinQueryBatcher> &batcher)
+   {
+      Trackers result;
+      for (const auto &scenario : scenarios) {
+         auto tracker = std::make_unique<ReplayTracker>(kCoinsPerShare, armory);
+         tracker->addOriginAddress(scenario.origin());
+         tracker->addRevocationAddress(scenario.revocation());
+         if (batcher) {
+            tracker->setQueryBatcher(batcher);
+         }
+         result.push_back(std::move(tracker));
+      }
+      return result;
+   }
+
+   void runBatch(const bs::bench::Params &params)
+   {
+      const auto nbUsers = params.sizeOr(200);
+      const auto nbBlocks = params.iterationsOr(20);
+      const auto maxTrackers = params.threadsOr(32);
+
+      for (unsigned nbTrackers = 1; nbTrackers <= maxTrackers; nbTrackers *= 2) {
+         auto armory = std::make_shared<ReplayArmory>();
+         std::vector<ReplayScenario> scenarios;
+         for (unsigned i = 0; i < nbTrackers; ++i) {
+            scenarios.emplace_back(armory, nbUsers, i);
+         }
+         buildHistory(*armory, scenarios);
+
+         // both sets of trackers process the same blocks
+         const auto batcher = std::make_shared<ColoredCoinQueryBatcher>(bs::bench::logger(), armory);
+         auto directTrackers = createTrackers(armory, scenarios, nullptr);
+         auto batchedTrackers = createTrackers(armory, scenarios, batcher);
+         updateAll(directTrackers, &ReplayTracker::sync);
+         updateAll(batchedTrackers, &ReplayTracker::sync);
+         armory->setRoundTrip(kBatchRoundTrip);
+
+         LatencyStats directStats(nbBlocks);
+         LatencyStats batchedStats(nbBlocks);
+         uint64_t directRequests = 0;
+         uint64_t batchedRequests = 0;
+         const auto timedUpdate = [&armory](Trackers &trackers, LatencyStats &stats
+            , uint64_t &requests, size_t nbMined) {
+            const auto prevRequests = armory->requests();
+            {
+               LatencyTimer timer(stats);
+               timer.setItems(nbMined);
+               updateAll(trackers, &ReplayTracker::onNewBlock);
+            }
+            requests += armory->requests() - prevRequests;
+         };
+
+         LiveBlockCbs cbs;
+         cbs.onZc = [&](size_t) {
+            updateAll(directTrackers, &ReplayTracker::onZc);
+            updateAll(batchedTrackers, &ReplayTracker::onZc);
+         };
+         cbs.onNewBlock = [&](size_t nbMined) {
+            timedUpdate(directTrackers, directStats, directRequests, nbMined);
+            timedUpdate(batchedTrackers, batchedStats, batchedRequests, nbMined);
+         };
+         cbs.onReorg = [&] {
+            updateAll(directTrackers, &ReplayTracker::onReorg);
+            updateAll(batchedTrackers, &ReplayTracker::onReorg);
+         };
+         for (size_t i = 1; i <= nbBlocks; ++i) {
+            liveBlock(i, *armory, scenarios, cbs);
+         }
+
+         const auto directSummary = directStats.summary();
+         const auto batchedSummary = batchedStats.summary();
+         const auto suffix = ".trackers" + std::to_string(nbTrackers);
+         bs::bench::report("cc.batch.direct" + suffix, directSummary, "tx");
+         bs::bench::report("cc.batch.batched" + suffix, batchedSummary, "tx");
+         std::cout << "cc.batch" << suffix << ": Armory requests per block: "
+            << (directSummary.count ? directRequests / directSummary.count : 0) << " direct, "
+            << (batchedSummary.count ? batchedRequests / batchedSummary.count : 0) << " batched" << std::endl;
+
+         if ((nbTrackers < maxTrackers) && (nbTrackers * 2 > maxTrackers)) {
+            nbTrackers = maxTrackers / 2;   // always finish with maxTrackers
+         }
+      }
+   }
+
+   const bs::bench::Registrar replayCase("cc.replay"
+      , "ColoredCoinTracker sync, block, ZC and reorg processing over a synthetic CC graph"
+      , runReplay);
+   const bs::bench::Registrar publishCase("cc.publish"
+      , "Snapshot update bytes sent to 1000 tracker clients per block, delta and full"
+      , runPublish);
+   const bs::bench::Registrar batchCase("cc.batch"
+      , "Per-block latency of concurrent trackers with and without the query batcher"
+      , runBatch);
+}
@@ -0,0 +1,183 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include "Bench.h"
+#include "BinaryData.h"
+#include "Wallets/SyncHistoryStream.h"
+
+// Scrolls through a synthetic ledger with HistoryStream, measuring time to
+// the first page, per page wait and the number of entries kept in memory.
+// Pages are decoded on a single server thread after a fixed round trip.
+//
+// size: ledger entries (100000), iterations: full scrolls per cache mode (3)
+
+using namespace bs::sync;
+
+namespace {
+   const size_t kPageSize = 100;
+   const size_t kPrefetchPages = 2;
+   const size_t kCachedPages = 8;
+   const auto kRoundTrip = std::chrono::microseconds(1000);
+   const auto kConsumeTime = std::chrono::microseconds(500);
+
+   class PageServer
+   {
+   public:
+      explicit PageServer(size_t nbEntries)
+         : nbEntries_(nbEntries)
+         , thread_([this] { process(); })
+      {}
+
+      ~PageServer()
+      {
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+         }
+         cv_.notify_one();
+         thread_.join();
+      }
+
+      bool fetch(uint32_t id, const HistoryStream::PageCb &cb)
+      {
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests_.push_back({ id, cb });
+         }
+         cv_.notify_one();
+         return true;
+      }
+
+   private:
+      void process()
+      {
+         while (true) {
+            std::pair<uint32_t, HistoryStream::PageCb> request;
+            {
+               std::unique_lock<std::mutex> lock(mutex_);
+               cv_.wait(lock, [this] { return stopped_ || !requests_.empty(); });
+               if (stopped_) {
+                  return;
+               }
+               request = std::move(requests_.front());
+               requests_.pop_front();
+            }
+            std::this_thread::sleep_for(kRoundTrip);
+            request.second(decodePage(request.first));
+         }
+      }
+
+      HistoryStream::PagePtr decodePage(uint32_t id) const
+      {
+         auto page = std::make_shared<HistoryStream::Page>();
+         const size_t first = id * kPageSize;
+         const auto last = std::min(first + kPageSize, nbEntries_);
+         for (size_t i = first; i < last; ++i) {
+            BinaryWriter bwHash;
+            for (int j = 0; j < 4; ++j) {
+               bwHash.put_uint64_t(i);
+            }
+            auto msg = std::make_shared<::Codec_LedgerEntry::LedgerEntry>();
+            msg->set_balance(static_cast<int64_t>(i % 1000) * 1000);
+            msg->set_txheight(static_cast<uint32_t>(nbEntries_ - i));
+            msg->set_txhash(bwHash.getData().toBinStr());
+            msg->set_txtime(static_cast<uint32_t>(1500000000 + i));
+            page->emplace_back(msg);
+         }
+         return page;
+      }
+
+   private:
+      const size_t nbEntries_;
+
+      std::mutex  mutex_;
+      std::condition_variable cv_;
+      std::deque<std::pair<uint32_t, HistoryStream::PageCb>>   requests_;
+      bool stopped_{ false };
+
+      std::thread thread_;
+   };
+
+   void runScrolls(const std::string &name, size_t nbEntries, size_t nbRuns, size_t cachedPages)
+   {
+      PageServer server(nbEntries);
+      const auto fetcher = [&server](uint32_t id, const HistoryStream::PageCb &cb) {
+         return server.fetch(id, cb);
+      };
+
+      LatencyStats firstPageStats(nbRuns);
+      LatencyStats pageStats;
+      HistoryStream::Stats lastStats;
+      size_t maxCachedEntries = 0;
+
+      for (size_t run = 0; run < nbRuns; ++run) {
+         auto stream = std::make_shared<HistoryStream>(fetcher, kPrefetchPages, cachedPages);
+         bool firstPage = true;
+
+         while (true) {
+            auto promPage = std::make_shared<std::promise<HistoryStream::PagePtr>>();
+            auto futPage = promPage->get_future();
+            const auto start = std::chrono::steady_clock::now();
+            if (!stream->next([promPage](const HistoryStream::PagePtr &page) {
+               promPage->set_value(page);
+            })) {
+               throw std::runtime_error("history page request failed");
+            }
+            const auto page = futPage.get();
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start);
+            if (!page) {
+               throw std::runtime_error("history page failed");
+            }
+            if (page->empty()) {
+               break;
+            }
+            pageStats.add(elapsed, page->size());
+            if (firstPage) {
+               firstPageStats.add(stream->stats().firstPageTime, page->size());
+               firstPage = false;
+            }
+            maxCachedEntries = std::max(maxCachedEntries, stream->stats().cachedEntries);
+
+            // the caller is busy with the page while the next ones are prefetched
+            std::this_thread::sleep_for(kConsumeTime);
+         }
+         lastStats = stream->stats();
+         stream->cancel();
+      }
+
+      bs::bench::report(name + ".firstPage", firstPageStats.summary(), "entries");
+      bs::bench::report(name + ".page", pageStats.summary(), "entries");
+      std::cout << name << ".cache: max " << maxCachedEntries << " entries kept, last run "
+         << lastStats.hits << " hits, " << lastStats.misses << " misses, "
+         << lastStats.prefetched << " prefetched" << std::endl;
+   }
+
+   void runHistoryStream(const bs::bench::Params &params)
+   {
+      const auto nbEntries = params.sizeOr(100000);
+      const auto nbRuns = params.iterationsOr(3);
+
+      // bounded LRU against keeping every page, as the former per wallet history cache did
+      runScrolls("history.stream", nbEntries, nbRuns, kCachedPages);
+      runScrolls("history.stream.unbounded", nbEntries, nbRuns, nbEntries / kPageSize + 1);
+   }
+
+   const bs::bench::Registrar historyStreamCase("history.stream"
+      , "Time to first page, per page wait and cached entries when scrolling a large ledger"
+      , runHistoryStream);
+}
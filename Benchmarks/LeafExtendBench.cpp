@@ -0,0 +1,157 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <QTemporaryDir>
+#include "Bench.h"
+#include "CoreHDLeaf.h"
+#include "CoreHDWallet.h"
+
+// Core hd::Leaf address chain extension.
+//
+// leaf.extend - repeated small extensions of a small and of a large leaf
+//    size: addresses in the large leaf (100000), iterations: extensions (100)
+// leaf.generate - one-shot generation of 10k addresses and of a larger batch on fresh leaves
+//    size: addresses in the larger batch (100000), iterations: fresh leaves per batch size (3)
+// leaf.scan - address hashes derived from the chain xpub (as used by gap-limit rescans)
+//    serially and split between threads, and indexing of addresses past the account pool
+//    size: addresses (10000), iterations: derivations per thread count (3),
+//    threads: max derivation threads (hardware concurrency)
+
+namespace {
+   const unsigned kInitialLookup = 100;
+   const unsigned kExtendBatch = 100;
+   const size_t kSmallLeafSize = 1000;
+
+   // Core HD wallet with the default XBT structure, files are removed with the dir
+   struct BenchWallet
+   {
+      QTemporaryDir  dir;
+      std::shared_ptr<bs::core::hd::Wallet>  wallet;
+      std::shared_ptr<bs::core::hd::Leaf>    leaf;
+   };
+
+   std::unique_ptr<BenchWallet> createWallet()
+   {
+      auto result = std::make_unique<BenchWallet>();
+      if (!result->dir.isValid()) {
+         throw std::runtime_error("failed to create wallet dir");
+      }
+      const bs::wallet::PasswordData pd{ SecureBinaryData::fromString("bench")
+         , { bs::wallet::EncryptionType::Password }, {}, {} };
+      result->wallet = std::make_shared<bs::core::hd::Wallet>("bench", ""
+         , bs::core::wallet::Seed(NetworkType::TestNet), pd
+         , result->dir.path().toStdString(), bs::bench::logger());
+      {
+         const bs::core::WalletPasswordScoped lock(result->wallet, pd.password);
+         result->wallet->createStructure(kInitialLookup);
+      }
+      const auto leaves = result->wallet->getLeaves();
+      if (leaves.empty()) {
+         throw std::runtime_error("no leaves created");
+      }
+      result->leaf = leaves.front();
+      return result;
+   }
+
+   LatencyStats::Summary measureExtensions(size_t leafSize, size_t nbRuns)
+   {
+      const auto benchWallet = createWallet();
+      if (leafSize > kInitialLookup) {
+         benchWallet->leaf->extendAddressChain(static_cast<unsigned>(leafSize - kInitialLookup), true);
+      }
+      return bs::bench::measure(nbRuns, [&benchWallet] {
+         return benchWallet->leaf->extendAddressChain(kExtendBatch, true).size();
+      });
+   }
+
+   void runExtend(const bs::bench::Params &params)
+   {
+      const auto leafSize = params.sizeOr(100000);
+      const auto nbRuns = params.iterationsOr(100);
+
+      // cost per extension should not depend on the number of addresses already in the leaf
+      bs::bench::report("leaf.extend.small", measureExtensions(kSmallLeafSize, nbRuns), "addresses");
+      bs::bench::report("leaf.extend.large", measureExtensions(leafSize, nbRuns), "addresses");
+   }
+
+   LatencyStats::Summary measureGeneration(size_t nbAddresses, size_t nbRuns)
+   {
+      LatencyStats stats(nbRuns);
+      for (size_t i = 0; i < nbRuns; ++i) {
+         const auto benchWallet = createWallet();
+         LatencyTimer timer(stats);
+         timer.setItems(benchWallet->leaf->extendAddressChain(
+            static_cast<unsigned>(nbAddresses), true).size());
+      }
+      return stats.summary();
+   }
+
+   void runGenerate(const bs::bench::Params &params)
+   {
+      const auto nbAddresses = params.sizeOr(100000);
+      const auto nbRuns = params.iterationsOr(3);
+
+      bs::bench::report("leaf.generate.10k", measureGeneration(10000, nbRuns), "addresses");
+      bs::bench::report("leaf.generate." + std::to_string(nbAddresses)
+         , measureGeneration(nbAddresses, nbRuns), "addresses");
+   }
+
+   void runScan(const bs::bench::Params &params)
+   {
+      const auto nbAddresses = static_cast<unsigned>(params.sizeOr(10000));
+      const auto nbRuns = params.iterationsOr(3);
+      const auto maxThreads = params.threadsOr(std::max(1u, std::thread::hardware_concurrency()));
+      const auto benchWallet = createWallet();
+      const auto &leaf = benchWallet->leaf;
+
+      // Armory extension of a fresh leaf by the same number of addresses as the reference
+      bs::bench::report("leaf.scan.armory", measureGeneration(nbAddresses, nbRuns), "addresses");
+
+      for (unsigned nbThreads = 1; nbThreads <= maxThreads; nbThreads *= 2) {
+         bs::bench::report("leaf.scan.threads" + std::to_string(nbThreads)
+            , bs::bench::measure(nbRuns, [&leaf, nbAddresses, nbThreads] {
+               return leaf->deriveAddressHashes(true, kInitialLookup, nbAddresses, nbThreads).size();
+            }), "addresses");
+
+         if ((nbThreads < maxThreads) && (nbThreads * 2 > maxThreads)) {
+            nbThreads = maxThreads / 2;   // always finish with maxThreads
+         }
+      }
+
+      // every 10th address of the range past the pool is used, so the chain
+      // is scanned up to the last one plus the gap
+      const auto hashes = leaf->deriveAddressHashes(true, kInitialLookup, nbAddresses);
+      std::set<BinaryData> usedAddrs;
+      for (size_t i = 0; i < hashes.size(); i += 10) {
+         usedAddrs.insert(hashes[i]);
+      }
+      bs::bench::report("leaf.scan.indexPath", bs::bench::measure(nbRuns, [&leaf, &usedAddrs] {
+         return leaf->indexPath(usedAddrs).size();
+      }), "addresses");
+   }
+
+   const bs::bench::Registrar extendCase("leaf.extend"
+      , "Repeated address chain extensions of a small and a large core leaf"
+      , runExtend);
+
+   const bs::bench::Registrar generateCase("leaf.generate"
+      , "Address generation through core leaf chain extension on fresh leaves"
+      , runGenerate);
+
+   const bs::bench::Registrar scanCase("leaf.scan"
+      , "Serial vs threaded address hash derivation from chain xpub"
+      , runScan);
+}
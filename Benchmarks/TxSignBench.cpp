@@ -0,0 +1,245 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <QTemporaryDir>
+#include "Address.h"
+#include "Bench.h"
+#include "BinaryData.h"
+#include "BtcUtils.h"
+#include "CoreHDLeaf.h"
+#include "CoreHDWallet.h"
+#include "XBTAmount.h"
+
+// Signing of TXSignRequest by core wallets.
+//
+// tx.sign - Wallet::signTXRequest() throughput by number of signing threads, each
+//    thread signs single requests with its own wallet (as the signer does for
+//    concurrent requests on different wallets)
+//    size: inputs per request (2), iterations: requests per thread (100),
+//    threads: maximum number of threads, doubled from 1 (hardware concurrency);
+//    each count is repeated as one bs::core::SignTXRequests() batch (tx.sign.batchN);
+//    then one wallet signs with and without a key cache (tx.sign.keycache/nokeycache)
+// tx.state - serializeState() and txId() of a settlement-sized request: fresh
+//    requests, repeated calls, RBF flag toggled between calls, and its signing
+//    size: inputs of the request (500), iterations: calls per mode (100)
+
+namespace {
+   const unsigned kLookup = 100;
+   const uint64_t kInputValue = 100000;
+   const uint64_t kFee = 1000;
+
+   const bs::wallet::PasswordData &passwordData()
+   {
+      static const bs::wallet::PasswordData pd{ SecureBinaryData::fromString("bench")
+         , { bs::wallet::EncryptionType::Password }, {}, {} };
+      return pd;
+   }
+
+   BinaryData outputScript(const bs::Address &addr)
+   {
+      const auto serialized = addr.getRecipient(bs::XBTAmount{ kInputValue })->getSerializedScript();
+      BinaryRefReader brr(serialized.getRef());
+      brr.advance(8);   // value
+      const auto scriptSize = brr.get_var_int();
+      return brr.get_BinaryData(static_cast<uint32_t>(scriptSize));
+   }
+
+   // Core HD wallet with a request spending its own (synthetic) UTXOs
+   struct SigningWallet
+   {
+      QTemporaryDir  dir;
+      std::shared_ptr<bs::core::hd::Wallet>  wallet;
+      std::shared_ptr<bs::core::hd::Leaf>    leaf;
+      bs::core::wallet::TXSignRequest        request;
+   };
+
+   std::unique_ptr<SigningWallet> createWallet(unsigned id, size_t nbInputs)
+   {
+      auto result = std::make_unique<SigningWallet>();
+      if (!result->dir.isValid()) {
+         throw std::runtime_error("failed to create wallet dir");
+      }
+      result->wallet = std::make_shared<bs::core::hd::Wallet>("bench" + std::to_string(id), ""
+         , bs::core::wallet::Seed(NetworkType::TestNet), passwordData()
+         , result->dir.path().toStdString(), bs::bench::logger());
+      {
+         const bs::core::WalletPasswordScoped lock(result->wallet, passwordData().password);
+         result->wallet->createStructure(kLookup);
+      }
+      const auto leaves = result->wallet->getLeaves();
+      if (leaves.empty()) {
+         throw std::runtime_error("no leaves created");
+      }
+      result->leaf = leaves.front();
+
+      auto &request = result->request;
+      request.walletIds = { result->leaf->walletId() };
+      for (size_t i = 0; i < nbInputs; ++i) {
+         const auto addr = result->leaf->getNewExtAddress();
+         BinaryWriter bwHash;
+         bwHash.put_uint32_t(id);
+         bwHash.put_uint32_t(static_cast<uint32_t>(i));
+         request.inputs.push_back(UTXO(kInputValue, 100, 0, 0
+            , BtcUtils::getSha256(bwHash.getData()), outputScript(addr)));
+      }
+      request.recipients.push_back(result->leaf->getNewExtAddress().getRecipient(
+         bs::XBTAmount{ nbInputs * kInputValue - kFee }));
+      request.fee = kFee;
+      return result;
+   }
+
+   void runSign(const bs::bench::Params &params)
+   {
+      const auto nbInputs = params.sizeOr(2);
+      const auto nbRequests = params.iterationsOr(100);
+      const auto maxThreads = params.threadsOr(std::max(1u, std::thread::hardware_concurrency()));
+
+      std::vector<std::unique_ptr<SigningWallet>> wallets;
+      for (unsigned i = 0; i < maxThreads; ++i) {
+         wallets.push_back(createWallet(i, nbInputs));
+      }
+
+      for (unsigned nbThreads = 1; nbThreads <= maxThreads; nbThreads *= 2) {
+         LatencyStats stats(nbThreads * nbRequests);
+         std::vector<std::thread> threads;
+         const auto start = std::chrono::steady_clock::now();
+         for (unsigned i = 0; i < nbThreads; ++i) {
+            threads.emplace_back([&stats, &signingWallet = *wallets[i], nbRequests, nbInputs] {
+               const bs::core::WalletPasswordScoped lock(signingWallet.wallet, passwordData().password);
+               for (size_t j = 0; j < nbRequests; ++j) {
+                  LatencyTimer timer(stats);
+                  timer.setItems(nbInputs);
+                  signingWallet.leaf->signTXRequest(signingWallet.request);
+               }
+            });
+         }
+         for (auto &thread : threads) {
+            thread.join();
+         }
+         const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+
+         // throughput in the line below is per thread, wall clock throughput is printed after it
+         const auto name = "tx.sign.threads" + std::to_string(nbThreads);
+         const auto summary = stats.summary();
+         bs::bench::report(name, summary, "signatures");
+         std::cout << std::fixed << std::setprecision(1) << name << ": "
+            << summary.items * 1000000.0 / std::max<int64_t>(1, elapsed.count())
+            << " signatures/s over " << nbThreads << " wallet(s)" << std::endl;
+
+         // same requests through bs::core::SignTXRequests() in one batch
+         {
+            bs::core::SignBatch batch;
+            std::vector<std::unique_ptr<bs::core::WalletPasswordScoped>> passLocks;
+            for (unsigned i = 0; i < nbThreads; ++i) {
+               passLocks.push_back(std::make_unique<bs::core::WalletPasswordScoped>(
+                  wallets[i]->wallet, passwordData().password));
+               for (size_t j = 0; j < nbRequests; ++j) {
+                  batch.push_back({ wallets[i]->leaf, wallets[i]->request });
+               }
+            }
+            const auto result = bs::core::SignTXRequests(batch, false, nbThreads);
+            if (result.nbSigned != batch.size()) {
+               throw std::runtime_error("batch signed " + std::to_string(result.nbSigned)
+                  + " of " + std::to_string(batch.size()) + " requests");
+            }
+            std::cout << std::fixed << std::setprecision(1) << "tx.sign.batch" << nbThreads << ": "
+               << result.nbSigned * 1000000.0 / std::max<int64_t>(1, result.elapsed.count())
+               << " signatures/s, " << result.nbInputs * 1000000.0 / std::max<int64_t>(1, result.elapsed.count())
+               << " inputs/s" << std::endl;
+         }
+
+         if ((nbThreads < maxThreads) && (nbThreads * 2 > maxThreads)) {
+            nbThreads = maxThreads / 2;   // always finish with maxThreads
+         }
+      }
+
+      // one wallet with private keys kept in a key cache between requests (auto-sign session)
+      auto &signingWallet = *wallets.front();
+      signingWallet.leaf->setKeyCache(std::make_shared<bs::core::wallet::KeyCache>());
+      const auto cachedStats = bs::bench::measure(nbRequests, [&signingWallet] {
+         const bs::core::WalletPasswordScoped lock(signingWallet.wallet, passwordData().password);
+         signingWallet.leaf->signTXRequest(signingWallet.request);
+         return 1;
+      });
+      signingWallet.leaf->setKeyCache(nullptr);
+      const auto uncachedStats = bs::bench::measure(nbRequests, [&signingWallet] {
+         const bs::core::WalletPasswordScoped lock(signingWallet.wallet, passwordData().password);
+         signingWallet.leaf->signTXRequest(signingWallet.request);
+         return 1;
+      });
+      bs::bench::report("tx.sign.keycache", cachedStats, "signatures");
+      bs::bench::report("tx.sign.nokeycache", uncachedStats, "signatures");
+   }
+
+   void runState(const bs::bench::Params &params)
+   {
+      const auto nbInputs = params.sizeOr(500);
+      const auto nbRuns = params.iterationsOr(100);
+      const auto signingWallet = createWallet(0, nbInputs);
+      const auto resolver = signingWallet->leaf->getPublicResolver();
+      const auto &request = signingWallet->request;
+
+      const auto coldStats = bs::bench::measure(nbRuns, [&] {
+         bs::core::wallet::TXSignRequest fresh;
+         fresh.walletIds = request.walletIds;
+         fresh.inputs = request.inputs;
+         fresh.recipients = request.recipients;
+         fresh.fee = request.fee;
+         fresh.serializeState(resolver);
+         fresh.txId(resolver);
+         return 1;
+      });
+
+      auto cached = request;
+      cached.serializeState(resolver);
+      const auto cachedStats = bs::bench::measure(nbRuns, [&] {
+         cached.serializeState(resolver);
+         cached.txId(resolver);
+         return 1;
+      });
+
+      auto edited = request;
+      const auto editStats = bs::bench::measure(nbRuns, [&] {
+         edited.RBF = !edited.RBF;
+         edited.serializeState(resolver);
+         edited.txId(resolver);
+         return 1;
+      });
+
+      const bs::core::WalletPasswordScoped lock(signingWallet->wallet, passwordData().password);
+      const auto signStats = bs::bench::measure(std::max<size_t>(1, nbRuns / 10), [&] {
+         signingWallet->leaf->signTXRequest(request);
+         return nbInputs;
+      });
+
+      bs::bench::report("tx.state.cold", coldStats, "requests");
+      bs::bench::report("tx.state.cached", cachedStats, "requests");
+      bs::bench::report("tx.state.rbfToggle", editStats, "requests");
+      bs::bench::report("tx.state.sign", signStats, "signatures");
+   }
+
+   const bs::bench::Registrar signCase("tx.sign"
+      , "Single request signing throughput by number of threads on separate wallets"
+      , runSign);
+
+   const bs::bench::Registrar stateCase("tx.state"
+      , "Memoized unsigned state and TX id versus fresh requests, large request signing"
+      , runState);
+}
@@ -0,0 +1,173 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include "Address.h"
+#include "Bench.h"
+#include "BtcUtils.h"
+#include "CoinSelection.h"
+#include "CoreWallet.h"
+#include "XBTAmount.h"
+
+// TXSignRequest::estimateTxVirtSize() on a small payment and a consolidation
+// with many inputs: fresh requests, repeated calls on an unchanged request,
+// recipient and input edits through the request mutators between calls, an
+// input edited directly on the vector, and Armory's UtxoSelection size
+// computation (what the estimate used before) for reference.
+//
+// size: inputs of the large request (1000), iterations: estimates per mode (1000)
+
+namespace {
+   const size_t kSmallInputs = 2;
+   const size_t kRecipients = 2;
+
+   BinaryData randomHash(std::mt19937_64 &rng, size_t nbWords)
+   {
+      BinaryWriter bw;
+      for (size_t i = 0; i < nbWords; ++i) {
+         bw.put_uint64_t(rng());
+      }
+      return bw.getData();
+   }
+
+   UTXO createInput(std::mt19937_64 &rng, bool segWit)
+   {
+      const auto hash160 = BtcUtils::getHash160(randomHash(rng, 1));
+      const auto script = segWit ? BtcUtils::getP2WPKHOutputScript(hash160)
+         : BtcUtils::getP2PKHScript(hash160);
+      return UTXO(100000 + rng() % 1000000, 100, 0, 0, randomHash(rng, 4), script);
+   }
+
+   bs::Address randomAddress(std::mt19937_64 &rng)
+   {
+      BinaryWriter bw;
+      bw.put_uint8_t(SCRIPT_PREFIX_P2WPKH);
+      bw.put_BinaryData(BtcUtils::getHash160(randomHash(rng, 1)));
+      return bs::Address::fromHash(bw.getData());
+   }
+
+   std::shared_ptr<ScriptRecipient> createRecipient(std::mt19937_64 &rng, uint64_t value)
+   {
+      return randomAddress(rng).getRecipient(bs::XBTAmount{ value });
+   }
+
+   bs::core::wallet::TXSignRequest createRequest(std::mt19937_64 &rng, size_t nbInputs)
+   {
+      bs::core::wallet::TXSignRequest request;
+      for (size_t i = 0; i < nbInputs; ++i) {
+         // every fourth input is legacy to have a mixed witness
+         request.inputs.push_back(createInput(rng, (i % 4) != 0));
+      }
+      for (size_t i = 0; i < kRecipients; ++i) {
+         request.recipients.push_back(createRecipient(rng, 10000));
+      }
+      request.change.address = randomAddress(rng);
+      request.change.value = 5000;
+      request.fee = 1000;
+      return request;
+   }
+
+   size_t armoryVirtSize(const bs::core::wallet::TXSignRequest &request)
+   {
+      auto utxos = bs::Address::decorateUTXOsCopy(request.inputs);
+      std::map<unsigned int, std::shared_ptr<ScriptRecipient>> recipients;
+      for (unsigned int i = 0; i < request.recipients.size(); ++i) {
+         recipients[i] = request.recipients[i];
+      }
+      const PaymentStruct payment(recipients, request.fee, 0, 0);
+      UtxoSelection selection(utxos);
+      selection.computeSizeAndFee(payment);
+      const size_t nonWitSize = selection.size_ - selection.witnessSize_;
+      return std::ceil(static_cast<float>(3 * nonWitSize + selection.size_) / 4.0f);
+   }
+
+   void runRequest(const std::string &name, size_t nbInputs, size_t nbRuns, std::mt19937_64 &rng)
+   {
+      const auto request = createRequest(rng, nbInputs);
+      const auto &inputs = request.inputs;
+      const auto &recipients = request.recipients;
+      size_t virtSize = 0;
+
+      const auto coldStats = bs::bench::measure(nbRuns, [&] {
+         bs::core::wallet::TXSignRequest fresh;
+         fresh.inputs = inputs;
+         fresh.recipients = recipients;
+         fresh.change.address = request.change.address;
+         fresh.change.value = request.change.value;
+         virtSize = fresh.estimateTxVirtSize();
+         return 1;
+      });
+
+      auto cached = request;
+      cached.estimateTxVirtSize();
+      const auto cachedStats = bs::bench::measure(nbRuns, [&] {
+         virtSize = cached.estimateTxVirtSize();
+         return 1;
+      });
+
+      // amount typed in the dialog: the recipient is replaced before each estimate
+      auto edited = request;
+      edited.estimateTxVirtSize();
+      uint64_t amount = 10000;
+      const auto recipStats = bs::bench::measure(nbRuns, [&] {
+         edited.setRecipient(edited.recipients.size() - 1, createRecipient(rng, ++amount));
+         virtSize = edited.estimateTxVirtSize();
+         return 1;
+      });
+
+      // input toggled in the coin control: totals are updated for the changed input only
+      size_t inputIdx = 0;
+      const auto inputStats = bs::bench::measure(nbRuns, [&] {
+         edited.setInput(inputIdx++ % edited.inputs.size(), createInput(rng, true));
+         virtSize = edited.estimateTxVirtSize();
+         return 1;
+      });
+
+      // same edit made directly on the vector: all inputs are re-checked by script
+      const auto directStats = bs::bench::measure(nbRuns, [&] {
+         edited.inputs[inputIdx++ % edited.inputs.size()] = createInput(rng, true);
+         edited.markChanged();
+         virtSize = edited.estimateTxVirtSize();
+         return 1;
+      });
+
+      size_t armorySize = 0;
+      const auto armoryStats = bs::bench::measure(std::max<size_t>(1, nbRuns / 10), [&] {
+         armorySize = armoryVirtSize(request);
+         return 1;
+      });
+
+      bs::bench::report("tx.size." + name + ".cold", coldStats, "estimates");
+      bs::bench::report("tx.size." + name + ".cached", cachedStats, "estimates");
+      bs::bench::report("tx.size." + name + ".recipientEdit", recipStats, "estimates");
+      bs::bench::report("tx.size." + name + ".inputEdit", inputStats, "estimates");
+      bs::bench::report("tx.size." + name + ".directEdit", directStats, "estimates");
+      bs::bench::report("tx.size." + name + ".armory", armoryStats, "estimates");
+      std::cout << "tx.size." << name << ": " << inputs.size() << " inputs, "
+         << cached.estimateTxVirtSize() << " vbytes estimated, " << armorySize
+         << " vbytes by Armory (no change output)" << std::endl;
+   }
+
+   void runSize(const bs::bench::Params &params)
+   {
+      const auto nbRuns = params.iterationsOr(1000);
+      std::mt19937_64 rng(42);
+      runRequest("small", kSmallInputs, nbRuns, rng);
+      runRequest("large", params.sizeOr(1000), nbRuns, rng);
+   }
+
+   const bs::bench::Registrar sizeCase("tx.size"
+      , "TXSignRequest size estimate on fresh, unchanged and edited requests"
+      , runSize);
+}
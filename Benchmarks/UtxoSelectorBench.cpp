@@ -0,0 +1,144 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include "Address.h"
+#include "Bench.h"
+#include "BtcUtils.h"
+#include "CoinSelection.h"
+#include "UtxoSelector.h"
+#include "XBTAmount.h"
+
+// bs::UtxoSelector over synthetic UTXO pools: selection from scratch, amount
+// edits on the same selector (incremental re-selection) and Armory's
+// CoinSelection on the same pools for reference.
+//
+// size: UTXOs in the pool (5000), iterations: selections per mode (200)
+
+namespace {
+   const float kFeePerByte = 5.0f;
+   const size_t kRecipientOutputSize = 31;   // P2WPKH output
+   const uint64_t kTypingStep = 1000;
+
+   using ValueGen = std::function<uint64_t(std::mt19937_64 &)>;
+
+   std::vector<UTXO> createPool(size_t nbUtxos, const ValueGen &valueGen, std::mt19937_64 &rng)
+   {
+      std::vector<UTXO> result;
+      result.reserve(nbUtxos);
+      for (size_t i = 0; i < nbUtxos; ++i) {
+         BinaryWriter bwHash;
+         for (int j = 0; j < 4; ++j) {
+            bwHash.put_uint64_t(rng());
+         }
+         BinaryWriter bwAddr;
+         bwAddr.put_uint64_t(rng());
+         const auto script = BtcUtils::getP2WPKHOutputScript(BtcUtils::getHash160(bwAddr.getData()));
+         result.emplace_back(valueGen(rng), 100, 0, 0, bwHash.getData(), script);
+      }
+      bs::Address::decorateUTXOs(result);
+      return result;
+   }
+
+   bs::UtxoSelector::Params selectorParams(uint64_t target)
+   {
+      bs::UtxoSelector::Params params;
+      params.target = target;
+      params.feePerByte = kFeePerByte;
+      params.txOutSize = kRecipientOutputSize;
+      return params;
+   }
+
+   void runDistribution(const std::string &name, const std::vector<UTXO> &pool
+      , size_t nbRuns, std::mt19937_64 &rng)
+   {
+      uint64_t poolValue = 0;
+      for (const auto &utxo : pool) {
+         poolValue += utxo.getValue();
+      }
+      // targets between 1% and 50% of the pool value
+      std::vector<uint64_t> targets(nbRuns);
+      for (auto &target : targets) {
+         target = poolValue / 100 + rng() % (poolValue / 2);
+      }
+
+      size_t run = 0;
+      size_t nbValid = 0;
+      const auto coldStats = bs::bench::measure(nbRuns, [&] {
+         bs::UtxoSelector selector;
+         selector.setUtxos(pool);
+         if (selector.select(selectorParams(targets[run++ % targets.size()])).valid) {
+            nbValid++;
+         }
+         return pool.size();
+      });
+
+      bs::UtxoSelector selector;
+      selector.setUtxos(pool);
+      run = 0;
+      const auto editStats = bs::bench::measure(nbRuns, [&] {
+         // user typing the amount: each selection differs from the previous by a small step
+         selector.select(selectorParams(targets.front() + kTypingStep * run++));
+         return 1;
+      });
+      const auto selectorStats = selector.stats();
+
+      run = 0;
+      const auto armoryStats = bs::bench::measure(std::max<size_t>(1, nbRuns / 10), [&] {
+         auto utxos = pool;
+         std::map<unsigned int, std::shared_ptr<ScriptRecipient>> recipients;
+         recipients[0] = bs::Address::fromUTXO(pool.front()).getRecipient(
+            bs::XBTAmount{ targets[run++ % targets.size()] });
+         PaymentStruct payment(recipients, 0, kFeePerByte, ADJUST_FEE);
+         CoinSelection coinSelection(nullptr, {}, poolValue, UINT32_MAX);
+         coinSelection.getUtxoSelectionForRecipients(payment, utxos);
+         return pool.size();
+      });
+
+      bs::bench::report("utxo.select." + name + ".cold", coldStats, "utxos");
+      bs::bench::report("utxo.select." + name + ".edit", editStats, "selections");
+      bs::bench::report("utxo.select." + name + ".armory", armoryStats, "utxos");
+      std::cout << "utxo.select." << name << ": " << nbValid << " of " << nbRuns
+         << " cold selections valid, edits: " << selectorStats.bnbMatches << " exact matches, "
+         << selectorStats.resorts << " resorts, " << selectorStats.cached << " cached" << std::endl;
+   }
+
+   void runSelect(const bs::bench::Params &params)
+   {
+      const auto nbUtxos = params.sizeOr(5000);
+      const auto nbRuns = params.iterationsOr(200);
+      std::mt19937_64 rng(42);
+
+      const ValueGen uniform = [](std::mt19937_64 &gen) {
+         return 10000 + gen() % 10000000;
+      };
+      // mostly small change outputs with a few large deposits
+      const ValueGen dust = [](std::mt19937_64 &gen) {
+         return (gen() % 10) ? (546 + gen() % 20000) : (1000000 + gen() % 100000000);
+      };
+      // exchange withdrawals of round amounts, many exact match candidates
+      const ValueGen roundValues = [](std::mt19937_64 &gen) {
+         static const uint64_t amounts[] = { 100000, 1000000, 10000000, 100000000 };
+         return amounts[gen() % 4] * (1 + gen() % 5);
+      };
+
+      runDistribution("uniform", createPool(nbUtxos, uniform, rng), nbRuns, rng);
+      runDistribution("dust", createPool(nbUtxos, dust, rng), nbRuns, rng);
+      runDistribution("round", createPool(nbUtxos, roundValues, rng), nbRuns, rng);
+   }
+
+   const bs::bench::Registrar selectCase("utxo.select"
+      , "Coin selection over uniform, dust-heavy and round-value UTXO pools"
+      , runSelect);
+}
@@ -0,0 +1,84 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <future>
+#include <stdexcept>
+#include <QTemporaryDir>
+#include "ArmoryConnection.h"
+#include "Bench.h"
+#include "CoreHDWallet.h"
+#include "CoreWalletsManager.h"
+#include "InprocSigner.h"
+#include "Wallets/SyncWalletsManager.h"
+
+// Terminal startup: sync::WalletsManager::syncWallets() against InprocSigner
+// holding many HD wallets, with Armory offline. Reports the whole sync and
+// each SyncPipeline stage.
+//
+// size: HD wallets (20), iterations: startups, each with a fresh sync manager (5)
+
+namespace {
+   const auto kSyncTimeout = std::chrono::minutes(5);
+
+   void runStartup(const bs::bench::Params &params)
+   {
+      const auto nbWallets = params.sizeOr(20);
+      const auto nbRuns = params.iterationsOr(5);
+      const auto logger = bs::bench::logger();
+
+      QTemporaryDir walletsDir;
+      if (!walletsDir.isValid()) {
+         throw std::runtime_error("failed to create wallets dir");
+      }
+      const bs::wallet::PasswordData pd{ SecureBinaryData::fromString("bench")
+         , { bs::wallet::EncryptionType::Password }, {}, {} };
+
+      auto coreMgr = std::make_shared<bs::core::WalletsManager>(logger);
+      for (size_t i = 0; i < nbWallets; ++i) {
+         coreMgr->createWallet("bench" + std::to_string(i), {}
+            , bs::core::wallet::Seed(NetworkType::TestNet)
+            , walletsDir.path().toStdString(), pd, false);
+      }
+      auto signer = std::make_shared<InprocSigner>(coreMgr, logger, std::string{}, NetworkType::TestNet);
+      signer->Start();
+      const auto armory = std::make_shared<ArmoryConnection>(logger);
+
+      LatencyStats startupStats(nbRuns);
+      bs::sync::SyncPipeline::Stats pipelineStats;
+      for (size_t run = 0; run < nbRuns; ++run) {
+         auto syncMgr = std::make_shared<bs::sync::WalletsManager>(logger, nullptr, armory);
+         syncMgr->setSignContainer(signer);
+
+         auto promSynced = std::make_shared<std::promise<void>>();
+         auto futSynced = promSynced->get_future();
+         LatencyTimer timer(startupStats);
+         timer.setItems(nbWallets);
+         syncMgr->syncWallets([promSynced](int cur, int total) {
+            if (cur == total) {
+               promSynced->set_value();
+            }
+         });
+         if (futSynced.wait_for(kSyncTimeout) != std::future_status::ready) {
+            throw std::runtime_error("wallets sync timed out");
+         }
+         pipelineStats = syncMgr->syncStats();
+      }
+
+      bs::bench::report("sync.startup", startupStats.summary(), "wallets");
+      for (size_t i = 0; i < pipelineStats.stages.size(); ++i) {
+         bs::bench::report(std::string("sync.startup.") + bs::sync::SyncPipeline::toString(
+            static_cast<bs::sync::SyncPipeline::Stage>(i)), pipelineStats.stages[i]);
+      }
+   }
+
+   const bs::bench::Registrar startupCase("sync.startup"
+      , "Wallets sync at startup with many HD wallets through InprocSigner"
+      , runStartup);
+}
@@ -0,0 +1,117 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include "Bench.h"
+#include "BinaryData.h"
+#include "Wallets/SyncHDGroup.h"
+#include "Wallets/SyncHDLeaf.h"
+#include "Wallets/SyncHDWallet.h"
+#include "Wallets/SyncWalletsManager.h"
+
+// WalletsManager::mergeEntries over a ZC burst touching many leaves, next to
+// the former pairwise merge for reference.
+//
+// size: entries in the burst (10000), iterations: merges (100)
+
+namespace {
+   const size_t kHDWallets = 40;
+   const size_t kLeavesPerWallet = 5;
+   const size_t kEntriesPerTx = 2;  // average, entries of one tx come from different leaves
+
+   // Merge as it was done before entries were keyed by tx hash
+   std::vector<bs::TXEntry> mergePairwise(const bs::sync::WalletsManager &mgr
+      , const std::vector<bs::TXEntry> &entries)
+   {
+      std::vector<bs::TXEntry> mergedEntries;
+      for (const auto &entry : entries) {
+         bool entryMerged = false;
+         for (auto &mergedEntry : mergedEntries) {
+            if (mgr.mergeableEntries(mergedEntry, entry)) {
+               entryMerged = true;
+               mergedEntry.merge(entry);
+               break;
+            }
+         }
+         if (!entryMerged) {
+            mergedEntries.push_back(entry);
+         }
+      }
+      return mergedEntries;
+   }
+
+   void runMerge(const bs::bench::Params &params)
+   {
+      const auto nbEntries = params.sizeOr(10000);
+      const auto nbRuns = params.iterationsOr(100);
+      const auto logger = bs::bench::logger();
+
+      auto mgr = std::make_shared<bs::sync::WalletsManager>(logger, nullptr, nullptr);
+      std::vector<std::string> leafIds;
+      for (size_t i = 0; i < kHDWallets; ++i) {
+         bs::sync::WalletInfo info;
+         info.format = bs::sync::WalletFormat::HD;
+         info.id = "hd" + std::to_string(i);
+         info.name = info.id;
+         info.netType = NetworkType::TestNet;
+         info.watchOnly = false;
+
+         auto hdWallet = std::make_shared<bs::sync::hd::Wallet>(info, nullptr, logger);
+         hdWallet->setWCT(mgr.get());
+         auto group = hdWallet->createGroup(bs::hd::CoinType::Bitcoin_test, false);
+         for (bs::hd::Path::Elem j = 0; j < kLeavesPerWallet; ++j) {
+            const auto leafId = info.id + "_leaf" + std::to_string(j);
+            group->createLeaf(bs::hd::Path({ bs::hd::Purpose::Native, bs::hd::CoinType::Bitcoin_test, j })
+               , leafId);
+            leafIds.push_back(leafId);
+         }
+         mgr->adoptNewWallet(hdWallet);
+      }
+
+      std::mt19937_64 rng(42);
+      std::vector<BinaryData> txHashes(std::max<size_t>(1, nbEntries / kEntriesPerTx));
+      for (auto &txHash : txHashes) {
+         BinaryWriter bw;
+         for (int i = 0; i < 4; ++i) {
+            bw.put_uint64_t(rng());
+         }
+         txHash = bw.getData();
+      }
+      std::vector<bs::TXEntry> entries(nbEntries);
+      for (auto &entry : entries) {
+         entry.txHash = txHashes[rng() % txHashes.size()];
+         entry.walletIds = { leafIds[rng() % leafIds.size()] };
+         entry.value = static_cast<int64_t>(rng() % 100000000) - 50000000;
+         entry.blockNum = UINT32_MAX;
+      }
+
+      size_t nbMerged = 0;
+      const auto mergeStats = bs::bench::measure(nbRuns, [&mgr, &entries, &nbMerged] {
+         nbMerged = mgr->mergeEntries(entries).size();
+         return entries.size();
+      });
+      const auto pairwiseStats = bs::bench::measure(std::max<size_t>(1, nbRuns / 20)
+         , [&mgr, &entries, &nbMerged] {
+         if (mergePairwise(*mgr, entries).size() != nbMerged) {
+            throw std::runtime_error("pairwise merge result differs");
+         }
+         return entries.size();
+      });
+
+      bs::bench::report("zc.merge", mergeStats, "entries");
+      bs::bench::report("zc.merge.pairwise", pairwiseStats, "entries");
+   }
+
+   const bs::bench::Registrar mergeCase("zc.merge"
+      , "ZC entries merge over a burst across 200 leaves"
+      , runMerge);
+}
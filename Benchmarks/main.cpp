@@ -0,0 +1,79 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include <iostream>
+#include "Bench.h"
+#include "cxxopts.hpp"
+
+int main(int argc, char **argv)
+{
+   cxxopts::Options options("bs_bench", "BlockSettle common library benchmarks");
+   options.positional_help("[case...]");
+   options.add_options()
+      ("h,help", "Print help")
+      ("l,list", "List available cases")
+      ("n,size", "Workload size (case specific)", cxxopts::value<size_t>()->default_value("0"))
+      ("i,iterations", "Number of measured runs", cxxopts::value<size_t>()->default_value("0"))
+      ("t,threads", "Number of worker threads", cxxopts::value<unsigned>()->default_value("0"))
+      ("cases", "Cases to run, all if empty", cxxopts::value<std::vector<std::string>>())
+      ;
+   options.parse_positional({ "cases" });
+
+   bs::bench::Params params;
+   std::vector<std::string> selected;
+   try {
+      const auto result = options.parse(argc, argv);
+      if (result.count("help")) {
+         std::cout << options.help() << std::endl;
+         return 0;
+      }
+      if (result.count("list")) {
+         for (const auto &benchCase : bs::bench::cases()) {
+            std::cout << benchCase.name << " - " << benchCase.description << std::endl;
+         }
+         return 0;
+      }
+      params.size = result["size"].as<size_t>();
+      params.iterations = result["iterations"].as<size_t>();
+      params.threads = result["threads"].as<unsigned>();
+      if (result.count("cases")) {
+         selected = result["cases"].as<std::vector<std::string>>();
+      }
+   }
+   catch (const cxxopts::OptionException &e) {
+      std::cerr << e.what() << std::endl << options.help() << std::endl;
+      return 1;
+   }
+
+   int rc = 0;
+   for (const auto &benchCase : bs::bench::cases()) {
+      if (!selected.empty()) {
+         bool match = false;
+         for (const auto &name : selected) {
+            // exact name or prefix up to a dot ("cc" runs all "cc.*" cases)
+            if ((benchCase.name == name) || (benchCase.name.compare(0, name.size() + 1, name + ".") == 0)) {
+               match = true;
+               break;
+            }
+         }
+         if (!match) {
+            continue;
+         }
+      }
+      try {
+         benchCase.func(params);
+      }
+      catch (const std::exception &e) {
+         std::cerr << benchCase.name << " failed: " << e.what() << std::endl;
+         rc = 1;
+      }
+   }
+   return rc;
+}
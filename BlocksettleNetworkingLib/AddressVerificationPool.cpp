@@ -18,7 +18,7 @@
 
 AddressVerificationPool::AddressVerificationPool(const std::shared_ptr<spdlog::logger>& logger
    , const std::string& poolId
-   , const std::shared_ptr<ArmoryConnection> &armory)
+   , const std::shared_ptr<ArmoryConnection> &armory, const std::string &cacheFileName)
    : logger_(logger)
    , poolId_(poolId)
 {
@@ -26,7 +26,7 @@ AddressVerificationPool::AddressVerificationPool(const std::shared_ptr<spdlog::l
    , [this](const bs::Address &address, AddressVerificationState state)
       {
          completeVerification(address, state);
-      });
+      }, cacheFileName);
 }
 
 bool AddressVerificationPool::submitForVerification(const bs::Address &address
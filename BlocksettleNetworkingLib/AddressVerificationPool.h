@@ -32,8 +32,9 @@ public:
    using verificationCompletedCallback = std::function<void (AddressVerificationState state)>;
 public:
    // pool Id will be used as wallet ID in verificator, as well as identifier in log
+   // verified states are persisted in cacheFileName if set
    AddressVerificationPool(const std::shared_ptr<spdlog::logger>& logger, const std::string& poolId
-      , const std::shared_ptr<ArmoryConnection> &);
+      , const std::shared_ptr<ArmoryConnection> &, const std::string &cacheFileName = {});
 
    ~AddressVerificationPool() noexcept = default;
 
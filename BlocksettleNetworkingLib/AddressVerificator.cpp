@@ -14,24 +14,41 @@
 #include "AuthAddressLogic.h"
 #include "BinaryData.h"
 #include "BlockDataManagerConfig.h"
+#include "CacheFile.h"
 #include "FastLock.h"
 
+#include <algorithm>
 #include <cassert>
 #include <spdlog/spdlog.h>
 
-struct AddressVerificationData
-{
-   bs::Address                   address;
-   AddressVerificationState      currentState{};
-};
+namespace {
+
+   const uint8_t kCachedStateVersion = 1;
+
+   bool isCacheable(AddressVerificationState state)
+   {
+      switch (state) {
+      case AddressVerificationState::NotSubmitted:
+      case AddressVerificationState::PendingVerification:
+      case AddressVerificationState::Verified:
+      case AddressVerificationState::Revoked:
+         return true;
+      default:
+         return false;
+      }
+   }
+
+} // namespace
 
 AddressVerificator::AddressVerificator(const std::shared_ptr<spdlog::logger>& logger
-   , const std::shared_ptr<ArmoryConnection> &armory, VerificationCallback callback)
+   , const std::shared_ptr<ArmoryConnection> &armory, VerificationCallback callback
+   , const std::string &cacheFileName)
    : ArmoryCallbackTarget()
    , logger_(logger)
    , validationMgr_(new ValidationAddressManager(armory))
    , userCallback_(std::move(callback))
    , stopExecution_(false)
+   , cacheFile_(new CacheFile(cacheFileName))
 {
    startCommandQueue();
    init(armory.get());
@@ -39,6 +56,7 @@ AddressVerificator::AddressVerificator(const std::shared_ptr<spdlog::logger>& lo
 
 AddressVerificator::~AddressVerificator() noexcept
 {
+   validityFlag_.reset();
    cleanup();
    stopCommandQueue();
 }
@@ -146,13 +164,28 @@ void AddressVerificator::startAddressVerification()
    });
 }
 
+void AddressVerificator::onNewBlock(unsigned int, unsigned int branchHeight)
+{
+   if (branchHeight != UINT32_MAX) {
+      invalidateCache(branchHeight);
+   }
+   refreshUserAddresses();
+}
+
 void AddressVerificator::refreshUserAddresses()
 {
-   std::lock_guard<std::mutex> lock(userAddressesMutex_);
-   logger_->debug("[{}] updating {} user address[es]", __func__, userAddresses_.size());
-   for (const auto &addr : userAddresses_) {
-      AddCommandToQueue(CreateAddressValidationCommand(addr));
+   std::set<bs::Address> addresses;
+   {
+      std::lock_guard<std::mutex> lock(userAddressesMutex_);
+      addresses = userAddresses_;
+   }
+   logger_->debug("[{}] updating {} user address[es]", __func__, addresses.size());
+   if (addresses.empty()) {
+      return;
    }
+   AddCommandToQueue([this, addresses] {
+      validateAddresses(addresses);
+   });
 }
 
 void AddressVerificator::AddCommandToQueue(ExecutionCommand&& command)
@@ -162,53 +195,301 @@ void AddressVerificator::AddCommandToQueue(ExecutionCommand&& command)
    dataAvailable_.notify_all();
 }
 
-AddressVerificator::ExecutionCommand AddressVerificator::CreateAddressValidationCommand(const bs::Address &address)
+void AddressVerificator::validateAddresses(const std::set<bs::Address> &addresses)
+{   // if we are here, that means that addresses were added, and now it is time to try to validate them
+   if (bsAddressList_.empty()) {
+      for (const auto &addr : addresses) {
+         ReturnValidationResult(addr, AddressVerificationState::VerificationFailed);
+      }
+      return;
+   }
+   if (!validationMgr_->isReady()) {
+      // addresses will be refreshed once validation addresses are loaded
+      logger_->debug("[AddressVerificator::validateAddresses] validation addresses are not ready yet");
+      return;
+   }
+
+   std::set<bs::Address> unknownAddresses;
+   std::map<bs::Address, CachedState> cachedAddresses;
+   for (const auto &addr : addresses) {
+      CachedState cachedState;
+      if (getCachedState(addr, cachedState)) {
+         cachedAddresses.emplace(addr, std::move(cachedState));
+      }
+      else {
+         unknownAddresses.insert(addr);
+      }
+   }
+
+   if (!cachedAddresses.empty()) {
+      checkCachedAddresses(cachedAddresses);
+   }
+   if (!unknownAddresses.empty()) {
+      verifyAddresses(unknownAddresses);
+   }
+}
+
+void AddressVerificator::checkCachedAddresses(const std::map<bs::Address, CachedState> &addresses)
 {
-   auto state = std::make_shared<AddressVerificationData>();
+   unsigned int height = UINT32_MAX;
+   std::set<BinaryData> addrSet;
+   for (const auto &addr : addresses) {
+      height = std::min(height, addr.second.checkHeight);
+      addrSet.insert(addr.first);
+   }
+   // Rescan last blocks to catch shallow reorgs that happened while offline
+   height = (height > VALIDATION_CONF_COUNT) ? height - VALIDATION_CONF_COUNT : 0;
 
-   state->address = address;
-   state->currentState = AddressVerificationState::InProgress;
+   const auto &cbChanges = [this, addresses, handle = validityFlag_.handle()]
+      (const OutpointBatch &batch, std::exception_ptr exPtr) mutable
+   {
+      ValidityGuard lock(handle);
+      if (!handle.isValid()) {
+         return;
+      }
+      // results are reported from the command queue thread, not from Armory's callback
+      AddCommandToQueue([this, addresses, batch, exPtr] {
+         processCachedAddresses(addresses, batch, exPtr);
+      });
+   };
 
-   return CreateAddressValidationCommand(state);
+   if (!armory_ || !armory_->getOutpointsForAddresses(addrSet, cbChanges, height)) {
+      for (const auto &addr : addresses) {
+         ReturnValidationResult(addr.first, AddressVerificationState::VerificationFailed);
+      }
+   }
 }
 
-AddressVerificator::ExecutionCommand AddressVerificator::CreateAddressValidationCommand(const std::shared_ptr<AddressVerificationData>& state)
+void AddressVerificator::processCachedAddresses(const std::map<bs::Address, CachedState> &addresses
+   , const OutpointBatch &batch, const std::exception_ptr &exPtr)
 {
-   return [this, state]() {
-      this->validateAddress(state);
+   // Addresses with new or updated outpoints need full verification
+   std::set<bs::Address> changedAddresses;
+   for (const auto &addr : addresses) {
+      if (exPtr == nullptr) {
+         const auto opIter = batch.outpoints_.find(addr.first);
+         if ((opIter == batch.outpoints_.end()) || opIter->second.empty()) {
+            try {
+               auto cachedState = addr.second;
+               cachedState.state = evaluateCachedState(cachedState);
+               cachedState.checkHeight = std::max(cachedState.checkHeight, batch.heightCutoff_ + 1);
+               putCachedState(addr.first, cachedState);
+               ReturnValidationResult(addr.first, cachedState.state);
+               continue;
+            }
+            catch (const std::exception &e) {
+               logger_->warn("[AddressVerificator::processCachedAddresses] cached state of {}"
+                  " is not usable: {}", addr.first.display(), e.what());
+            }
+         }
+      }
+      changedAddresses.insert(addr.first);
+   }
+
+   logger_->debug("[AddressVerificator::processCachedAddresses] {} of {} cached address[es] changed"
+      , changedAddresses.size(), addresses.size());
+   if (!changedAddresses.empty()) {
+      verifyAddresses(changedAddresses);
+   }
+}
+
+AddressVerificationState AddressVerificator::evaluateCachedState(const CachedState &cachedState) const
+{
+   if (!cachedState.hasPath) {
+      return cachedState.state;
+   }
+
+   // Path is dropped if its validation address was revoked
+   const auto validationAddr = validationMgr_->getValidationAddressForTxHash(cachedState.pathTxHash);
+   if ((validationAddr == nullptr) || !validationMgr_->isValid(*validationAddr)) {
+      return AddressVerificationState::Revoked;
+   }
+
+   // Only confirmation count could change
+   OutpointData path;
+   path.txHash_ = cachedState.pathTxHash;
+   path.txHeight_ = cachedState.pathHeight;
+   return AuthAddressLogic::getAuthAddrState({ path }, 1, armory_->topBlock());
+}
+
+void AddressVerificator::verifyAddresses(const std::set<bs::Address> &addresses)
+{
+   const auto &failAll = [this, addresses] {
+      for (const auto &addr : addresses) {
+         ReturnValidationResult(addr, AddressVerificationState::VerificationFailed);
+      }
+   };
+
+   if (!armory_ || (armory_->state() != ArmoryState::Ready)) {
+      logger_->error("[AddressVerificator::verifyAddresses] invalid Armory state {}"
+         , armory_ ? (int)armory_->state() : -1);
+      failAll();
+      return;
+   }
+
+   const auto &cbOutpoints = [this, addresses, handle = validityFlag_.handle()]
+      (const OutpointBatch &batch, std::exception_ptr exPtr) mutable
+   {
+      ValidityGuard lock(handle);
+      if (!handle.isValid()) {
+         return;
+      }
+      // results are reported from the command queue thread, not from Armory's callback
+      AddCommandToQueue([this, addresses, batch, exPtr] {
+         processVerifiedAddresses(addresses, batch, exPtr);
+      });
    };
+
+   const std::set<BinaryData> addrSet(addresses.begin(), addresses.end());
+   if (!armory_->getOutpointsForAddresses(addrSet, cbOutpoints)) {
+      failAll();
+   }
 }
 
-void AddressVerificator::validateAddress(const std::shared_ptr<AddressVerificationData> &state)
-{   // if we are here, that means that address was added, and now it is time to try to validate it
-   if (bsAddressList_.empty()) {
-      state->currentState = AddressVerificationState::VerificationFailed;
-      ReturnValidationResult(state);
+void AddressVerificator::processVerifiedAddresses(const std::set<bs::Address> &addresses
+   , const OutpointBatch &batch, const std::exception_ptr &exPtr)
+{
+   if (exPtr != nullptr) {
+      for (const auto &addr : addresses) {
+         ReturnValidationResult(addr, AddressVerificationState::VerificationFailed);
+      }
       return;
    }
 
-   if (!armory_ || (armory_->state() != ArmoryState::Ready)) {
-      logger_->error("[AddressVerificator::ValidateAddress] invalid Armory state {}", (int)armory_->state());
-      state->currentState = AddressVerificationState::VerificationFailed;
-      ReturnValidationResult(state);
+   // getAuthAddrStates resolves failures per address, so one bad address
+   // doesn't affect the states of the rest of the batch
+   std::map<bs::Address, OutpointData> validPaths;
+   std::map<bs::Address, AddressVerificationState> states;
+   try {
+      states = AuthAddressLogic::getAuthAddrStates(*validationMgr_, addresses, batch, &validPaths);
+   }
+   catch (const std::exception &e) {
+      logger_->error("[AddressVerificator::processVerifiedAddresses] failed to validate state for {}"
+         " address[es]: {}", addresses.size(), e.what());
+      for (const auto &addr : addresses) {
+         ReturnValidationResult(addr, AddressVerificationState::VerificationFailed);
+      }
       return;
    }
+   for (const auto &state : states) {
+      if (isCacheable(state.second)) {
+         CachedState cachedState;
+         cachedState.state = state.second;
+         cachedState.checkHeight = batch.heightCutoff_ + 1;
+         const auto pathIter = validPaths.find(state.first);
+         if (pathIter != validPaths.end()) {
+            cachedState.hasPath = true;
+            cachedState.pathTxHash = pathIter->second.txHash_;
+            cachedState.pathHeight = pathIter->second.txHeight_;
+         }
+         putCachedState(state.first, cachedState);
+      }
+      ReturnValidationResult(state.first, state.second);
+   }
+}
 
+bool AddressVerificator::readCachedState(const bs::Address &address, const BinaryData &data
+   , CachedState &cachedState) const
+{
+   if (data.empty()) {
+      return false;
+   }
    try {
-      state->currentState = AuthAddressLogic::getAuthAddrState(*validationMgr_, state->address);
+      BinaryRefReader brr(data.getRef());
+      if (brr.get_uint8_t() != kCachedStateVersion) {
+         return false;
+      }
+      cachedState.state = static_cast<AddressVerificationState>(brr.get_uint8_t());
+      cachedState.checkHeight = brr.get_uint32_t();
+      cachedState.hasPath = (brr.get_uint8_t() != 0);
+      if (cachedState.hasPath) {
+         cachedState.pathTxHash = brr.get_BinaryData(32);
+         cachedState.pathHeight = brr.get_uint32_t();
+      }
    }
    catch (const std::exception &e) {
-      logger_->error("[{}] failed to validate state for {}: {}", __func__
-         , state->address.display(), e.what());
-      state->currentState = AddressVerificationState::VerificationFailed;
+      logger_->warn("[AddressVerificator::readCachedState] invalid cached state for {}: {}"
+         , address.display(), e.what());
+      return false;
+   }
+   return true;
+}
+
+bool AddressVerificator::getCachedState(const bs::Address &address, CachedState &cachedState)
+{
+   std::lock_guard<std::mutex> lock(cacheMutex_);
+   const auto it = cache_.find(address);
+   if (it != cache_.end()) {
+      cachedState = it->second;
+      return true;
+   }
+
+   if (!readCachedState(address, cacheFile_->get(address.prefixed()), cachedState)) {
+      return false;
+   }
+   if (!isCacheable(cachedState.state)) {
+      return false;
+   }
+   cache_[address] = cachedState;
+   return true;
+}
+
+void AddressVerificator::putCachedState(const bs::Address &address, const CachedState &cachedState)
+{
+   BinaryWriter bw;
+   bw.put_uint8_t(kCachedStateVersion);
+   bw.put_uint8_t(static_cast<uint8_t>(cachedState.state));
+   bw.put_uint32_t(cachedState.checkHeight);
+   bw.put_uint8_t(cachedState.hasPath ? 1 : 0);
+   if (cachedState.hasPath) {
+      bw.put_BinaryData(cachedState.pathTxHash);
+      bw.put_uint32_t(cachedState.pathHeight);
+   }
+
+   std::lock_guard<std::mutex> lock(cacheMutex_);
+   cache_[address] = cachedState;
+   cacheFile_->put(address.prefixed(), bw.getData());
+}
+
+void AddressVerificator::invalidateCache(unsigned int branchHeight)
+{
+   std::lock_guard<std::mutex> lock(cacheMutex_);
+   for (auto it = cache_.begin(); it != cache_.end(); ) {
+      if (it->second.checkHeight > branchHeight) {
+         cacheFile_->remove(it->first.prefixed());
+         it = cache_.erase(it);
+      }
+      else {
+         ++it;
+      }
+   }
+
+   // Entries that were never looked up since startup live only in the file
+   for (const auto &key : cacheFile_->keys()) {
+      bs::Address address;
+      try {
+         address = bs::Address::fromHash(key);
+      }
+      catch (const std::exception &) {
+         cacheFile_->remove(key);
+         continue;
+      }
+      if (cache_.find(address) != cache_.end()) {
+         continue;
+      }
+      CachedState cachedState;
+      if (!readCachedState(address, cacheFile_->get(key), cachedState)
+         || (cachedState.checkHeight > branchHeight)) {
+         cacheFile_->remove(key);
+      }
    }
-   ReturnValidationResult(state);
 }
 
-void AddressVerificator::ReturnValidationResult(const std::shared_ptr<AddressVerificationData>& state)
+void AddressVerificator::ReturnValidationResult(const bs::Address &address
+   , AddressVerificationState state)
 {
    if (userCallback_) {
-      userCallback_(state->address, state->currentState);
+      userCallback_(address, state);
    }
 }
 
@@ -15,6 +15,7 @@
 #include <condition_variable>
 #include <queue>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -25,6 +26,7 @@
 #include "ArmoryConnection.h"
 #include "AsyncClient.h"
 #include "AuthAddress.h"
+#include "ValidityFlag.h"
 
 namespace spdlog {
    class logger;
@@ -32,7 +34,7 @@ namespace spdlog {
 namespace ClientClasses {
    class LedgerEntry;
 }
-struct AddressVerificationData;
+class CacheFile;
 class ValidationAddressManager;
 
 // once we could connect to a super node we should not wait for refresh signals from armory
@@ -47,8 +49,9 @@ private:
    using ExecutionCommand = std::function<void (void)>;
 
 public:
+   // Verified states are persisted in cacheFileName (kept in memory only if empty)
    AddressVerificator(const std::shared_ptr<spdlog::logger>& logger, const std::shared_ptr<ArmoryConnection> &
-      , VerificationCallback callback);
+      , VerificationCallback callback, const std::string &cacheFileName = {});
    ~AddressVerificator() noexcept override;
 
    AddressVerificator(const AddressVerificator&) = delete;
@@ -66,10 +69,7 @@ public:
    std::pair<bs::Address, UTXO> getRevokeData(const bs::Address &authAddr);
 
 protected:
-   void onNewBlock(unsigned int, unsigned int) override
-   {
-      refreshUserAddresses();
-   }
+   void onNewBlock(unsigned int, unsigned int branchHeight) override;
 
    void onZCReceived(const std::vector<bs::TXEntry> &) override
    {
@@ -85,12 +85,38 @@ private:
 
    void AddCommandToQueue(ExecutionCommand&& command);
 
-   ExecutionCommand CreateAddressValidationCommand(const bs::Address &address);
-   ExecutionCommand CreateAddressValidationCommand(const std::shared_ptr<AddressVerificationData>& state);
-
-   void validateAddress(const std::shared_ptr<AddressVerificationData>& state);
+   // Cached addresses are only checked for changes since last verification,
+   // results are returned asynchronously
+   void validateAddresses(const std::set<bs::Address> &);
+   // Requests outpoints of all addresses at once, results are returned asynchronously
+   void verifyAddresses(const std::set<bs::Address> &);
+   // Invoked on the command queue thread with the results of verifyAddresses request
+   void processVerifiedAddresses(const std::set<bs::Address> &, const OutpointBatch &
+      , const std::exception_ptr &);
 
-   void ReturnValidationResult(const std::shared_ptr<AddressVerificationData>& state);
+   struct CachedState
+   {
+      AddressVerificationState state{};
+      // Addresses are rechecked from this height (DB height cutoff + 1)
+      unsigned int   checkHeight{};
+      // The only valid path of Verified and PendingVerification addresses
+      bool           hasPath{};
+      BinaryData     pathTxHash;
+      unsigned int   pathHeight{};
+   };
+   void checkCachedAddresses(const std::map<bs::Address, CachedState> &);
+   // Invoked on the command queue thread with the results of checkCachedAddresses request
+   void processCachedAddresses(const std::map<bs::Address, CachedState> &, const OutpointBatch &
+      , const std::exception_ptr &);
+   AddressVerificationState evaluateCachedState(const CachedState &) const;
+
+   bool readCachedState(const bs::Address &, const BinaryData &, CachedState &) const;
+   bool getCachedState(const bs::Address &, CachedState &);
+   void putCachedState(const bs::Address &, const CachedState &);
+   // Drops states that could be affected by reorg
+   void invalidateCache(unsigned int branchHeight);
+
+   void ReturnValidationResult(const bs::Address &, AddressVerificationState);
 
 private:
    std::shared_ptr<spdlog::logger>           logger_;
@@ -109,6 +135,12 @@ private:
 
    std::mutex                    userAddressesMutex_;
    std::set<bs::Address>         userAddresses_;
+
+   std::unique_ptr<CacheFile>    cacheFile_;
+   std::mutex                    cacheMutex_;
+   std::map<bs::Address, CachedState>  cache_;
+
+   ValidityFlag                  validityFlag_;
 };
 
 #endif // __AUTH_ADDRESS_VERIFICATOR_H__
@@ -99,6 +99,8 @@ public:
       logDefault,
       logMessages,
       txCacheFileName,
+      walletsSnapshotFileName,
+      authAddrCacheFileName,
       nbBackupFilesKeep,
       aqScripts,
       lastAqScript,
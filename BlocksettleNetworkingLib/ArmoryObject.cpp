@@ -32,8 +32,6 @@ namespace {
 
    const int kDefaultArmoryDBStartTimeoutMsec = 500;
 
-   const uint32_t kRequiredConfCountForCache = 6;
-
 } // namespace
 
 
@@ -149,21 +147,7 @@ bool ArmoryObject::getWalletsLedgerDelegate(const LedgerDelegateCb &cb)
 
 bool ArmoryObject::getTxByHash(const BinaryData &hash, const TxCb &cb, bool allowCachedResult)
 {
-   if (allowCachedResult) {
-      const auto tx = getFromCache(hash);
-      if (tx) {
-         if (needInvokeCb()) {
-            QMetaObject::invokeMethod(this, [cb, tx] {
-               cb(*tx);
-            });
-         } else {
-            cb(*tx);
-         }
-         return true;
-      }
-   }
-   const auto &cbWrap = [this, cb, hash](Tx tx) {
-      putToCacheIfNeeded(hash, std::make_shared<Tx>(tx));
+   const auto &cbWrap = [this, cb](Tx tx) {
       if (!cb) {
          return;
       }
@@ -174,57 +158,29 @@ bool ArmoryObject::getTxByHash(const BinaryData &hash, const TxCb &cb, bool allo
          cb(tx);
       }
    };
-   return ArmoryConnection::getTxByHash(hash, cbWrap);
+   return ArmoryConnection::getTxByHash(hash, cbWrap, allowCachedResult);
 }
 
 bool ArmoryObject::getTXsByHash(const std::set<BinaryData> &hashes, const TXsCb &cb, bool allowCachedResult)
 {
-   auto result = std::make_shared<AsyncClient::TxBatchResult>();
-
-   std::set<BinaryData> missedHashes;
-   if (allowCachedResult) {
-      for (const auto &hash : hashes) {
-         const auto tx = getFromCache(hash);
-         if (tx) {
-            (*result)[hash] = tx;
-         }
-         else {
-            missedHashes.insert(hash);
-         }
-      }
-   } else {
-      missedHashes = hashes;
-   }
-
-   if (missedHashes.empty()) {
-      if (needInvokeCb()) {
-         QMetaObject::invokeMethod(this, [cb, result] {
-            cb(*result, nullptr);
-         });
-      } else {
-         cb(*result, nullptr);
-      }
-      return true;
-   }
-   const auto &cbWrap = [this, cb, result]
+   const auto &cbWrap = [this, cb]
       (const AsyncClient::TxBatchResult &txs, std::exception_ptr exPtr)
    {
+      if (!cb) {
+         return;
+      }
       if (exPtr != nullptr) {
          cb({}, exPtr);
          return;
       }
-      for (const auto &tx : txs) {
-         putToCacheIfNeeded(tx.first, tx.second);
-         (*result)[tx.first] = tx.second;
-      }
       if (needInvokeCb()) {
-         QMetaObject::invokeMethod(this, [cb, result] { cb(*result, nullptr); });
+         QMetaObject::invokeMethod(this, [cb, txs] { cb(txs, nullptr); });
       }
       else {
-         cb(*result, nullptr);
+         cb(txs, nullptr);
       }
    };
-   return ArmoryConnection::getTXsByHash(missedHashes, cbWrap);
+   return ArmoryConnection::getTXsByHash(hashes, cbWrap, allowCachedResult);
 }
 
 bool ArmoryObject::getRawHeaderForTxHash(const BinaryData& inHash, const BinaryDataCb &callback)
@@ -294,30 +250,13 @@ bool ArmoryObject::getFeeSchedule(const FloatMapCb &cb)
    return ArmoryConnection::getFeeSchedule(cbWrap);
 }
 
-std::shared_ptr<const Tx> ArmoryObject::getFromCache(const BinaryData &hash)
+std::shared_ptr<const Tx> ArmoryObject::getFromPersistentCache(const BinaryData &hash)
 {
    return txCache_.get(hash);
 }
 
-void ArmoryObject::putToCacheIfNeeded(const BinaryData &hash, const std::shared_ptr<const Tx> &tx)
+void ArmoryObject::putToPersistentCache(const BinaryData &hash, const std::shared_ptr<const Tx> &tx)
 {
-   if (!tx || !tx->isInitialized() || tx->getTxHeight() == UINT32_MAX) {
-      return;
-   }
-   const auto topBlock = topBlock_.load();
-   if (topBlock == 0 || topBlock == UINT32_MAX) {
-      return;
-   }
-
-   if (tx->getTxHeight() > topBlock) {
-      // should not happen
-      SPDLOG_LOGGER_ERROR(logger_, "invalid tx height: {}, topBlock: {}", tx->getTxHeight(), topBlock);
-      return;
-   }
-   if (topBlock - tx->getTxHeight() < kRequiredConfCountForCache) {
-      return;
-   }
-
    try {
       txCache_.put(hash, tx);
    } catch (const std::exception &e) {
@@ -45,9 +45,9 @@ private:
 
    bool needInvokeCb() const;
 
-   std::shared_ptr<const Tx> getFromCache(const BinaryData &hash);
-   // Will store only transactions with >= 6 confirmations
-   void putToCacheIfNeeded(const BinaryData &hash, const std::shared_ptr<const Tx> &tx);
+protected:
+   std::shared_ptr<const Tx> getFromPersistentCache(const BinaryData &hash) override;
+   void putToPersistentCache(const BinaryData &hash, const std::shared_ptr<const Tx> &tx) override;
 
 private:
    const bool     cbInMainThread_;
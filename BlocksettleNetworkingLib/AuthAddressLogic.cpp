@@ -10,8 +10,14 @@
 */
 #include "AuthAddressLogic.h"
 
+#include <future>
+#include <thread>
+
 constexpr uint64_t kAuthValueThreshold = 1000;
 
+// Smaller address sets are evaluated on the calling thread
+constexpr size_t kMinAddressesPerThread = 64;
+
 ///////////////////////////////////////////////////////////////////////////////
 void ValidationAddressACT::onRefresh(const std::vector<BinaryData>& ids, bool online)
 {
@@ -96,6 +102,7 @@ void ValidationAddressACT::stop()
 ValidationAddressManager::ValidationAddressManager(
    std::shared_ptr<ArmoryConnection> conn) :
    connPtr_(conn)
+   , spenderIndex_(std::make_shared<SpenderIndex>())
 {
    ready_.store(false, std::memory_order_relaxed);
    if (connPtr_) {
@@ -260,6 +267,10 @@ unsigned ValidationAddressManager::update()
    auto opLbd = [this, promPtr](const OutpointBatch &batch)->void
    {
       unsigned opCount = 0;
+
+      //copy of the spender index, swapped in once all addresses are processed
+      auto spenderIndex = std::make_shared<SpenderIndex>(
+         *std::atomic_load_explicit(&spenderIndex_, std::memory_order_acquire));
       for (auto& outpointPair : batch.outpoints_) {
          auto& outpointVec = outpointPair.second;
          if (outpointVec.size() == 0) {
@@ -312,12 +323,19 @@ unsigned ValidationAddressManager::update()
                if (fIter->second->isSpent()) {
                   updateValidationAddrStruct->spenderHashes_.erase(
                      fIter->second->spenderHash().getRef());
+
+                  auto indexIter = spenderIndex->find(fIter->second->spenderHash());
+                  if (indexIter != spenderIndex->end() &&
+                     indexIter->second == &maIter->first) {
+                     spenderIndex->erase(indexIter);
+                  }
                }
                fIter->second = aop;
                if (op.isSpent_) {
                   //set valid spender hash ref
                   updateValidationAddrStruct->spenderHashes_.insert(
                      fIter->second->spenderHash().getRef());
+                  (*spenderIndex)[fIter->second->spenderHash()] = &maIter->first;
                }
                continue;
             }
@@ -327,6 +345,7 @@ unsigned ValidationAddressManager::update()
                //we can just insert the spender hash without worry, as it wont fail to
                //replace an expiring reference
                updateValidationAddrStruct->spenderHashes_.insert(aop->spenderHash().getRef());
+               (*spenderIndex)[aop->spenderHash()] = &maIter->first;
             }
          }
 
@@ -335,6 +354,9 @@ unsigned ValidationAddressManager::update()
             &maIter->second, updateValidationAddrStruct, std::memory_order_release);
       }
 
+      std::atomic_store_explicit(&spenderIndex_
+         , std::shared_ptr<const SpenderIndex>(spenderIndex), std::memory_order_release);
+
       //update cutoffs
       topBlock_ = batch.heightCutoff_ + 1;
       zcIndex_ = batch.zcIndexCutoff_;
@@ -862,21 +884,30 @@ const BinaryData& ValidationAddressManager::findValidationAddressForUTXO(
 const BinaryData& ValidationAddressManager::findValidationAddressForTxHash(
    const BinaryData& txHash) const
 {
-   for (auto& maPair : validationAddresses_) {
-      auto iter = maPair.second->spenderHashes_.find(txHash);
-      if (iter == maPair.second->spenderHashes_.end()) {
-         continue;
-      }
-      return maPair.first;
+   auto validationAddr = getValidationAddressForTxHash(txHash);
+   if (validationAddr == nullptr) {
+      throw std::runtime_error("no validation address spends to that hash");
    }
-   throw std::runtime_error("no validation address spends to that hash");
+   return *validationAddr;
+}
+
+////
+const BinaryData* ValidationAddressManager::getValidationAddressForTxHash(
+   const BinaryData& txHash) const
+{
+   const auto spenderIndex = std::atomic_load_explicit(
+      &spenderIndex_, std::memory_order_acquire);
+   auto iter = spenderIndex->find(txHash);
+   if (iter == spenderIndex->end()) {
+      return nullptr;
+   }
+   return iter->second;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 std::vector<OutpointData> AuthAddressLogic::getValidPaths(
    const ValidationAddressManager& vam, const bs::Address& addr, size_t &nbPaths)
 {
-   std::vector<OutpointData> validPaths;
    nbPaths = 0;
 
    //get txout history for address
@@ -900,40 +931,48 @@ std::vector<OutpointData> AuthAddressLogic::getValidPaths(
 
    auto& opVec = opMap.begin()->second;
    nbPaths = opVec.size();
+   return getValidPaths(vam, opVec);
+}
+
+std::vector<OutpointData> AuthAddressLogic::getValidPaths(
+   const ValidationAddressManager& vam, const std::vector<OutpointData> &opVec)
+{
+   std::vector<OutpointData> validPaths;
 
    //check all spent outputs vs ValidationAddressManager
    for (auto& outpoint : opVec) {
-      try {
-         /*
-         Does this txHash spend from a validation address output? It will
-         throw if not.
-         */
-         auto& validationAddr = 
-            vam.findValidationAddressForTxHash(outpoint.txHash_);
+      /*
+      Does this txHash spend from a validation address output? Most
+      outpoints of a busy address don't, skip them without throwing.
+      */
+      auto validationAddr =
+         vam.getValidationAddressForTxHash(outpoint.txHash_);
+      if (validationAddr == nullptr) {
+         continue;
+      }
+
+      /*
+      Is the validation output spent? Spending it revokes the
+      address.
+      */
+      if (outpoint.isSpent_) {
+         continue;
+      }
 
+      try {
          /*
          If relevant validation address is invalid, this address is invalid,
          regardless of any other path states.
          */
-         if (!vam.isValid(validationAddr)) {
-            throw AuthLogicException(
-               "Address is vetted by invalid validation address");
-         }
-
-         /*
-         Is the validation output spent? Spending it revokes the
-         address.
-         */
-         if (outpoint.isSpent_) {
-            throw AuthLogicException(
-               "Address has been revoked");
+         if (!vam.isValid(*validationAddr)) {
+            continue;
          }
-
-         validPaths.push_back(outpoint);
       }
       catch (const std::exception &) {
          continue;
       }
+
+      validPaths.push_back(outpoint);
    }
 
    return validPaths;
@@ -956,28 +995,102 @@ AddressVerificationState AuthAddressLogic::getAuthAddrState(
    try {
       size_t nbPaths = 0;
       auto&& validPaths = getValidPaths(vam, addr, nbPaths);
+      return getAuthAddrState(validPaths, nbPaths, currentTop);
+   }
+   catch (const AuthLogicException &) { }
 
-      //is there only 1 valid path?
-      if (validPaths.empty()) {
-         return (nbPaths > 0) ? AddressVerificationState::Revoked
-            : AddressVerificationState::NotSubmitted;
-      }
-      else if (validPaths.size() > 1) {
-         return AddressVerificationState::Revoked;
+   return AddressVerificationState::NotSubmitted;
+}
+
+AddressVerificationState AuthAddressLogic::getAuthAddrState(
+   const std::vector<OutpointData> &validPaths, size_t nbPaths, unsigned int currentTop)
+{
+   //is there only 1 valid path?
+   if (validPaths.empty()) {
+      return (nbPaths > 0) ? AddressVerificationState::Revoked
+         : AddressVerificationState::NotSubmitted;
+   }
+   else if (validPaths.size() > 1) {
+      return AddressVerificationState::Revoked;
+   }
+   auto& outpoint = validPaths[0];
+
+   //does this path have enough confirmations?
+   auto opHeight = outpoint.txHeight_;
+   if (currentTop >= opHeight &&
+      (1 + currentTop - opHeight) >= VALIDATION_CONF_COUNT) {
+      return AddressVerificationState::Verified;
+   }
+   return AddressVerificationState::PendingVerification;
+}
+
+////
+std::map<bs::Address, AddressVerificationState> AuthAddressLogic::getAuthAddrStates(
+   const ValidationAddressManager &vam, const std::set<bs::Address> &addrs
+   , const OutpointBatch &batch, std::map<bs::Address, OutpointData> *validPaths)
+{
+   auto currentTop = vam.connPtr()->topBlock();
+   if (currentTop == UINT32_MAX) {
+      throw std::runtime_error("invalid top height");
+   }
+
+   const std::vector<bs::Address> addrVec(addrs.begin(), addrs.end());
+   std::vector<AddressVerificationState> states(addrVec.size()
+      , AddressVerificationState::NotSubmitted);
+   std::vector<std::vector<OutpointData>> paths(addrVec.size());
+
+   //addresses missing from the batch have no history
+   const auto evaluate = [&vam, &batch, &addrVec, &states, &paths, currentTop]
+      (size_t start, size_t end)
+   {
+      for (size_t i = start; i < end; ++i) {
+         const auto opIter = batch.outpoints_.find(addrVec[i]);
+         if (opIter == batch.outpoints_.end()) {
+            continue;
+         }
+         // failures are resolved per address, like in single-address getAuthAddrState
+         try {
+            paths[i] = getValidPaths(vam, opIter->second);
+            states[i] = getAuthAddrState(paths[i], opIter->second.size(), currentTop);
+         }
+         catch (const AuthLogicException &) {
+            paths[i].clear();
+            states[i] = AddressVerificationState::NotSubmitted;
+         }
+         catch (const std::exception &) {
+            paths[i].clear();
+            states[i] = AddressVerificationState::VerificationFailed;
+         }
       }
-      auto& outpoint = validPaths[0];
+   };
 
-      //does this path have enough confirmations?
-      auto opHeight = outpoint.txHeight_;
-      if (currentTop >= opHeight &&
-         (1 + currentTop - opHeight) >= VALIDATION_CONF_COUNT) {
-         return AddressVerificationState::Verified;
+   const size_t nbThreads = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency())
+      , (addrVec.size() + kMinAddressesPerThread - 1) / kMinAddressesPerThread);
+   if (nbThreads <= 1) {
+      evaluate(0, addrVec.size());
+   }
+   else {
+      const size_t chunkSize = (addrVec.size() + nbThreads - 1) / nbThreads;
+      std::vector<std::future<void>> futures;
+      for (size_t start = chunkSize; start < addrVec.size(); start += chunkSize) {
+         futures.push_back(std::async(std::launch::async, evaluate
+            , start, std::min(start + chunkSize, addrVec.size())));
+      }
+      evaluate(0, chunkSize);
+      for (auto &fut : futures) {
+         fut.get();
       }
-      return AddressVerificationState::PendingVerification;
    }
-   catch (const AuthLogicException &) { }
 
-   return AddressVerificationState::NotSubmitted;
+   std::map<bs::Address, AddressVerificationState> result;
+   for (size_t i = 0; i < addrVec.size(); ++i) {
+      result.emplace(addrVec[i], states[i]);
+      if (validPaths && (paths[i].size() == 1)) {
+         validPaths->emplace(addrVec[i], paths[i][0]);
+      }
+   }
+   return result;
 }
 
 ////
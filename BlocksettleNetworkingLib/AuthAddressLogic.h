@@ -12,8 +12,10 @@
 #define _H_AUTHADDRESSLOGIC
 
 #include <atomic>
+#include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
 
 #include "Address.h"
 #include "AuthAddress.h"
@@ -216,6 +218,10 @@ private:
    ArmoryThreading::BlockingQueue<BinaryData> refreshQueue_;
 
    std::map<BinaryData, std::shared_ptr<ValidationAddressStruct>> validationAddresses_;
+
+   //<spender tx hash, validation address (key of validationAddresses_)>
+   using SpenderIndex = std::unordered_map<BinaryData, const BinaryData *, BinaryDataHash>;
+   std::shared_ptr<const SpenderIndex> spenderIndex_;
    unsigned topBlock_ = 0;
    unsigned zcIndex_ = 0;
 
@@ -274,9 +280,13 @@ public:
    bool getSpendableTxOutFor(const bs::Address &, const std::function<void(const UTXO &)> &, size_t nbOutputs = 1) const;
    bool getVettingUTXOsFor(const bs::Address &, const std::function<void(const std::vector<UTXO> &)> &) const;
 
+   //throw if no validation address spends to that hash
    const BinaryData& findValidationAddressForUTXO(const UTXO&) const;
    const BinaryData& findValidationAddressForTxHash(const BinaryData&) const;
 
+   //returns nullptr if no validation address spends to that hash
+   const BinaryData* getValidationAddressForTxHash(const BinaryData&) const;
+
    //tx generating methods
    BinaryData fundUserAddress(const bs::Address&, std::shared_ptr<ResolverFeed>,
       const bs::Address& validationAddr = bs::Address()) const;
@@ -302,6 +312,23 @@ struct AuthAddressLogic
    }
    static std::vector<OutpointData> getValidPaths(
       const ValidationAddressManager&, const bs::Address&, size_t &nbPaths);
+   static std::vector<OutpointData> getValidPaths(
+      const ValidationAddressManager&, const std::vector<OutpointData> &);
+   static AddressVerificationState getAuthAddrState(
+      const std::vector<OutpointData> &validPaths, size_t nbPaths, unsigned int currentTop);
+
+   /*
+   Batched version of getAuthAddrState, doesn't block on the DB: evaluates
+   the states from outpoints of all addresses fetched with a single
+   ArmoryConnection::getOutpointsForAddresses call. Large address sets are
+   split between worker threads. If set, validPaths receives the only valid
+   path of Verified and PendingVerification addresses. Failures are resolved
+   per address: NotSubmitted on AuthLogicException, VerificationFailed on
+   other errors.
+   */
+   static std::map<bs::Address, AddressVerificationState> getAuthAddrStates(
+      const ValidationAddressManager &, const std::set<bs::Address> &
+      , const OutpointBatch &, std::map<bs::Address, OutpointData> *validPaths = nullptr);
    static BinaryData revoke(const ValidationAddressManager&, const bs::Address&,
       std::shared_ptr<ResolverFeed>);
    static std::pair<bs::Address, UTXO> getRevokeData(const ValidationAddressManager &
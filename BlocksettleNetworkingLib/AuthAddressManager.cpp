@@ -83,6 +83,8 @@ bool AuthAddressManager::setup()
       return false;
    }
 
+   const auto cacheFileName = settings_
+      ? settings_->get<std::string>(ApplicationSettings::authAddrCacheFileName) : std::string{};
    addressVerificator_ = std::make_shared<AddressVerificator>(logger_, armory_
       , [this](const bs::Address &address, AddressVerificationState state)
    {
@@ -98,7 +100,7 @@ bool AuthAddressManager::setup()
             emit VerifiedAddressListUpdated();
          }
       }
-   });
+   }, cacheFileName);
 
    SetBSAddressList(bsAddressList_);
    return true;
@@ -0,0 +1,71 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "BloomFilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Address.h"
+
+namespace {
+
+   const size_t kMinBitCount = 64;
+   const unsigned kMaxHashCount = 16;
+
+   // splitmix64 finalizer, derives second hash for double hashing
+   uint64_t mix(uint64_t x)
+   {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      return x;
+   }
+
+} // namespace
+
+BloomFilter::BloomFilter(size_t expectedCount, double falsePositiveRate)
+{
+   const double ln2 = std::log(2.0);
+   const double n = static_cast<double>(std::max<size_t>(expectedCount, 1));
+   const double p = std::min(std::max(falsePositiveRate, 1e-9), 0.5);
+
+   const auto bitCount = static_cast<size_t>(std::ceil(-n * std::log(p) / (ln2 * ln2)));
+   bitCount_ = std::max(bitCount, kMinBitCount);
+   bits_.resize((bitCount_ + 63) / 64);
+
+   const auto hashCount = static_cast<unsigned>(std::round(bitCount_ / n * ln2));
+   hashCount_ = std::min(std::max(hashCount, 1u), kMaxHashCount);
+}
+
+void BloomFilter::insert(const BinaryData &key)
+{
+   const uint64_t h1 = BinaryDataHash()(key);
+   const uint64_t h2 = mix(h1) | 1;
+   for (unsigned i = 0; i < hashCount_; ++i) {
+      const auto bit = (h1 + i * h2) % bitCount_;
+      bits_[bit / 64] |= (uint64_t(1) << (bit % 64));
+   }
+}
+
+bool BloomFilter::mayContain(const BinaryData &key) const
+{
+   const uint64_t h1 = BinaryDataHash()(key);
+   const uint64_t h2 = mix(h1) | 1;
+   for (unsigned i = 0; i < hashCount_; ++i) {
+      const auto bit = (h1 + i * h2) % bitCount_;
+      if ((bits_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0) {
+         return false;
+      }
+   }
+   return true;
+}
@@ -0,0 +1,39 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "BinaryData.h"
+
+// Fixed size probabilistic set of BinaryData keys.
+// mayContain() never returns false for inserted keys, but could return true for others
+// (at about falsePositiveRate when expectedCount keys are inserted).
+class BloomFilter
+{
+public:
+   BloomFilter(size_t expectedCount, double falsePositiveRate = 0.01);
+
+   void insert(const BinaryData &);
+   bool mayContain(const BinaryData &) const;
+
+   size_t bitCount() const { return bitCount_; }
+   unsigned hashCount() const { return hashCount_; }
+
+private:
+   std::vector<uint64_t> bits_;
+   size_t bitCount_{};
+   unsigned hashCount_{};
+};
+
+#endif
@@ -133,6 +133,16 @@ void CacheFile::write()
       map_[entry.first] = entry.second;
    }
    mapModified_.clear();
+
+   for (const auto &key : keysRemoved_) {
+      BinaryWriter bwKey;
+      bwKey.put_uint8_t(DB_PREFIX);
+      bwKey.put_BinaryData(key);
+
+      CharacterArrayRef keyRef(bwKey.getData().getSize(), bwKey.getData().getPtr());
+      db_->erase(keyRef);
+   }
+   keysRemoved_.clear();
 }
 
 void CacheFile::saver()
@@ -148,13 +158,14 @@ void CacheFile::saver()
          QMutexLocker lock(&mtxModified_);
          wcModified_.wait(&mtxModified_);
 
-         if (stopped_ || mapModified_.empty()) {
+         if (stopped_ || (mapModified_.empty() && keysRemoved_.empty())) {
             continue;
          }
 
          auto curTime = std::chrono::system_clock::now();
          std::chrono::duration<double> diff = curTime - start;
-         if ((diff < minSaveDuration) && (mapModified_.size() < nbElemsThreshold)) {
+         if ((diff < minSaveDuration)
+            && (mapModified_.size() + keysRemoved_.size() < nbElemsThreshold)) {
             continue;
          }
 
@@ -217,10 +228,39 @@ void CacheFile::put(const BinaryData &key, const BinaryData &val)
    else {
       QMutexLocker lock(&mtxModified_);
       mapModified_[key] = val;
+      keysRemoved_.erase(key);
+      wcModified_.wakeOne();
+   }
+}
+
+void CacheFile::remove(const BinaryData &key)
+{
+   QWriteLocker lock(&rwLock_);
+   map_.erase(key);
+   if (!inMem_) {
+      QMutexLocker lockMapModif(&mtxModified_);
+      mapModified_.erase(key);
+      keysRemoved_.insert(key);
       wcModified_.wakeOne();
    }
 }
 
+std::set<BinaryData> CacheFile::keys() const
+{
+   std::set<BinaryData> result;
+   QReadLocker lockMap(&rwLock_);
+   for (const auto &entry : map_) {
+      result.insert(entry.first);
+   }
+   if (!inMem_) {
+      QMutexLocker lockMapModif(&mtxModified_);
+      for (const auto &entry : mapModified_) {
+         result.insert(entry.first);
+      }
+   }
+   return result;
+}
+
 void TxCacheFile::put(const BinaryData &key, const std::shared_ptr<const Tx> &tx)
 {
    std::lock_guard<std::mutex> lock(txMapMutex_);
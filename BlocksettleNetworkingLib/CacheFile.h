@@ -13,6 +13,7 @@
 
 #include <unordered_map>
 #include <atomic>
+#include <set>
 #include <QObject>
 #include <QReadWriteLock>
 #include <QWaitCondition>
@@ -35,6 +36,9 @@ public:
 
    void put(const BinaryData &key, const BinaryData &val);
    BinaryData get(const BinaryData &key) const;
+   void remove(const BinaryData &key);
+   // Keys of all stored entries, including ones not flushed to the DB yet
+   std::set<BinaryData> keys() const;
    void stop();
 
 protected:
@@ -49,6 +53,7 @@ private:
    LMDB     *  db_ = nullptr;
    std::shared_ptr<LMDBEnv>  dbEnv_;
    std::map<BinaryData, BinaryData> map_, mapModified_;
+   std::set<BinaryData>    keysRemoved_;
    mutable QReadWriteLock  rwLock_;
    mutable QWaitCondition  wcModified_;
    mutable QMutex          mtxModified_;
@@ -0,0 +1,336 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+
+#include "ColoredCoinBatcher.h"
+
+#include <cassert>
+#include <spdlog/spdlog.h>
+
+#include "ColoredCoinLogic.h"
+
+ColoredCoinQueryBatcher::ColoredCoinQueryBatcher(const std::shared_ptr<spdlog::logger> &logger
+   , const std::shared_ptr<ArmoryConnection> &armory
+   , std::chrono::milliseconds flushWindow)
+   : logger_(logger)
+   , armory_(armory)
+   , flushWindow_(flushWindow)
+{
+   processThread_ = std::thread(&ColoredCoinQueryBatcher::processThreadFunc, this);
+}
+
+ColoredCoinQueryBatcher::~ColoredCoinQueryBatcher()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+   }
+   cv_.notify_one();
+   processThread_.join();
+}
+
+void ColoredCoinQueryBatcher::beginUpdate()
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   activeUpdates_ += 1;
+}
+
+void ColoredCoinQueryBatcher::endUpdate()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      activeUpdates_ -= 1;
+      assert(activeUpdates_ >= 0);
+   }
+   // Remaining active trackers may be all waiting now
+   cv_.notify_one();
+}
+
+OutpointBatch ColoredCoinQueryBatcher::getOutpointsForAddresses(const std::set<BinaryData> &addresses
+   , unsigned int height, unsigned int zcIndex)
+{
+   auto query = std::make_shared<Query>();
+   query->type = QueryType::Outpoints;
+   query->keys = addresses;
+   query->height = height;
+   query->zcIndex = zcIndex;
+   enqueue(query).get();
+   return std::move(query->outpointsResult);
+}
+
+AsyncClient::TxBatchResult ColoredCoinQueryBatcher::getTXsByHash(const std::set<BinaryData> &hashes)
+{
+   if (hashes.empty()) {
+      return {};
+   }
+   auto query = std::make_shared<Query>();
+   query->type = QueryType::Txs;
+   query->keys = hashes;
+   enqueue(query).get();
+   return std::move(query->txsResult);
+}
+
+ColoredCoinQueryBatcher::SpentnessMap ColoredCoinQueryBatcher::getSpentnessForOutputs(const OutputsMap &outputs)
+{
+   if (outputs.empty()) {
+      return {};
+   }
+   auto query = std::make_shared<Query>();
+   query->type = QueryType::Spentness;
+   query->outputs = outputs;
+   enqueue(query).get();
+   return std::move(query->spentnessResult);
+}
+
+ColoredCoinQueryBatcher::SpentnessMap ColoredCoinQueryBatcher::getSpentnessForZcOutputs(const OutputsMap &outputs)
+{
+   if (outputs.empty()) {
+      return {};
+   }
+   auto query = std::make_shared<Query>();
+   query->type = QueryType::ZcSpentness;
+   query->outputs = outputs;
+   enqueue(query).get();
+   return std::move(query->spentnessResult);
+}
+
+ColoredCoinQueryBatcher::Stats ColoredCoinQueryBatcher::stats() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return stats_;
+}
+
+std::future<void> ColoredCoinQueryBatcher::enqueue(const QueryPtr &query)
+{
+   auto result = query->done.get_future();
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.push_back(query);
+      stats_.queries += 1;
+      stats_.itemsRequested += query->keys.size();
+      for (const auto &output : query->outputs) {
+         stats_.itemsRequested += output.second.size();
+      }
+   }
+   cv_.notify_one();
+   return result;
+}
+
+void ColoredCoinQueryBatcher::processThreadFunc()
+{
+   while (true) {
+      std::vector<QueryPtr> queries;
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         cv_.wait(lock, [this] {
+            return quit_ || !pending_.empty();
+         });
+         if (quit_) {
+            break;
+         }
+
+         const auto deadline = std::chrono::steady_clock::now() + flushWindow_;
+         cv_.wait_until(lock, deadline, [this] {
+            // Trackers outside of update routines (including goOnline) are not counted
+            return quit_ || (static_cast<int>(pending_.size()) >= activeUpdates_);
+         });
+         if (quit_) {
+            break;
+         }
+
+         queries = std::move(pending_);
+         pending_.clear();
+      }
+
+      flush(std::move(queries));
+   }
+
+   std::vector<QueryPtr> queries;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queries = std::move(pending_);
+      pending_.clear();
+   }
+   setError(queries, std::make_exception_ptr(ColoredCoinException("query batcher stopped")));
+}
+
+void ColoredCoinQueryBatcher::flush(std::vector<QueryPtr> queries)
+{
+   // Outpoint queries could be merged only if cutoffs are the same
+   std::map<std::pair<unsigned int, unsigned int>, std::vector<QueryPtr>> outpointQueries;
+   std::vector<QueryPtr> txQueries;
+   std::vector<QueryPtr> spentnessQueries;
+   std::vector<QueryPtr> zcSpentnessQueries;
+
+   for (auto &query : queries) {
+      switch (query->type) {
+         case QueryType::Outpoints:
+            outpointQueries[{query->height, query->zcIndex}].push_back(std::move(query));
+            break;
+         case QueryType::Txs:
+            txQueries.push_back(std::move(query));
+            break;
+         case QueryType::Spentness:
+            spentnessQueries.push_back(std::move(query));
+            break;
+         case QueryType::ZcSpentness:
+            zcSpentnessQueries.push_back(std::move(query));
+            break;
+      }
+   }
+
+   for (const auto &item : outpointQueries) {
+      sendOutpoints(item.first.first, item.first.second, item.second);
+   }
+   if (!txQueries.empty()) {
+      sendTxs(txQueries);
+   }
+   if (!spentnessQueries.empty()) {
+      sendSpentness(false, spentnessQueries);
+   }
+   if (!zcSpentnessQueries.empty()) {
+      sendSpentness(true, zcSpentnessQueries);
+   }
+
+   SPDLOG_LOGGER_TRACE(logger_, "flushed {} CC queries, {} outpoint groups, {} tx, {} spentness, {} zc spentness"
+      , queries.size(), outpointQueries.size(), txQueries.size(), spentnessQueries.size(), zcSpentnessQueries.size());
+}
+
+void ColoredCoinQueryBatcher::sendOutpoints(unsigned int height, unsigned int zcIndex
+   , const std::vector<QueryPtr> &queries)
+{
+   std::set<BinaryData> addresses;
+   for (const auto &query : queries) {
+      addresses.insert(query->keys.begin(), query->keys.end());
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.armoryRequests += 1;
+      stats_.itemsSent += addresses.size();
+   }
+
+   const auto cb = [queries](const OutpointBatch &batch, std::exception_ptr exPtr)
+   {
+      if (exPtr != nullptr) {
+         setError(queries, exPtr);
+         return;
+      }
+      for (const auto &query : queries) {
+         auto &result = query->outpointsResult;
+         result.heightCutoff_ = batch.heightCutoff_;
+         result.zcIndexCutoff_ = batch.zcIndexCutoff_;
+         for (const auto &addr : query->keys) {
+            auto it = batch.outpoints_.find(addr);
+            if (it != batch.outpoints_.end()) {
+               result.outpoints_.emplace(it->first, it->second);
+            }
+         }
+         query->done.set_value();
+      }
+   };
+
+   if (!armory_->getOutpointsForAddresses(addresses, cb, height, zcIndex)) {
+      setError(queries, std::make_exception_ptr(ColoredCoinException("invalid DB state/connection")));
+   }
+}
+
+void ColoredCoinQueryBatcher::sendTxs(const std::vector<QueryPtr> &queries)
+{
+   std::set<BinaryData> hashes;
+   for (const auto &query : queries) {
+      hashes.insert(query->keys.begin(), query->keys.end());
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.armoryRequests += 1;
+      stats_.itemsSent += hashes.size();
+   }
+
+   const auto cb = [queries](const AsyncClient::TxBatchResult &batch, std::exception_ptr exPtr)
+   {
+      if (exPtr != nullptr) {
+         setError(queries, exPtr);
+         return;
+      }
+      // Tx objects are shared between trackers and must not be modified by them
+      for (const auto &query : queries) {
+         for (const auto &hash : query->keys) {
+            auto it = batch.find(hash);
+            if (it != batch.end()) {
+               query->txsResult.emplace(it->first, it->second);
+            }
+         }
+         query->done.set_value();
+      }
+   };
+
+   if (!armory_->getTXsByHash(hashes, cb, false)) {
+      setError(queries, std::make_exception_ptr(ColoredCoinException("invalid DB state/connection")));
+   }
+}
+
+void ColoredCoinQueryBatcher::sendSpentness(bool zc, const std::vector<QueryPtr> &queries)
+{
+   OutputsMap outputs;
+   size_t outputsCount = 0;
+   for (const auto &query : queries) {
+      for (const auto &output : query->outputs) {
+         auto &indices = outputs[output.first];
+         const auto prevSize = indices.size();
+         indices.insert(output.second.begin(), output.second.end());
+         outputsCount += indices.size() - prevSize;
+      }
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.armoryRequests += 1;
+      stats_.itemsSent += outputsCount;
+   }
+
+   const auto cb = [queries](const SpentnessMap &batch, std::exception_ptr exPtr)
+   {
+      if (exPtr != nullptr) {
+         setError(queries, exPtr);
+         return;
+      }
+      for (const auto &query : queries) {
+         for (const auto &output : query->outputs) {
+            auto hashIt = batch.find(output.first);
+            if (hashIt == batch.end()) {
+               continue;
+            }
+            auto &result = query->spentnessResult[output.first];
+            for (auto index : output.second) {
+               auto indexIt = hashIt->second.find(index);
+               if (indexIt != hashIt->second.end()) {
+                  result.emplace(index, indexIt->second);
+               }
+            }
+         }
+         query->done.set_value();
+      }
+   };
+
+   bool result = zc ? armory_->getSpentnessForZcOutputs(outputs, cb)
+      : armory_->getSpentnessForOutputs(outputs, cb);
+   if (!result) {
+      setError(queries, std::make_exception_ptr(ColoredCoinException("invalid DB state/connection")));
+   }
+}
+
+void ColoredCoinQueryBatcher::setError(const std::vector<QueryPtr> &queries, std::exception_ptr exPtr)
+{
+   for (const auto &query : queries) {
+      query->done.set_exception(exPtr);
+   }
+}
@@ -0,0 +1,123 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+
+#ifndef COLORED_COIN_BATCHER_H
+#define COLORED_COIN_BATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "ArmoryConnection.h"
+
+namespace spdlog {
+   class logger;
+}
+
+// Merges blocking Armory queries issued concurrently by several ColoredCoinTracker
+// instances (one batched request per query type), de-duplicates tx hashes and
+// outpoints and fans the results back out to the callers.
+// Pending queries are flushed as soon as every tracker that is inside update()/zcUpdate()
+// is waiting on the batcher, or when flush window expires (whichever comes first).
+class ColoredCoinQueryBatcher
+{
+public:
+   using SpentnessMap = std::map<BinaryData, std::map<unsigned int, SpentnessResult>>;
+   using OutputsMap = std::map<BinaryData, std::set<unsigned>>;
+
+   struct Stats
+   {
+      // Queries received from trackers
+      uint64_t queries{};
+      // Requests sent to Armory
+      uint64_t armoryRequests{};
+      // Tx hashes/outputs/addresses requested by trackers (sum over all queries)
+      uint64_t itemsRequested{};
+      // Unique tx hashes/outputs/addresses sent to Armory
+      uint64_t itemsSent{};
+   };
+
+   ColoredCoinQueryBatcher(const std::shared_ptr<spdlog::logger> &
+      , const std::shared_ptr<ArmoryConnection> &
+      , std::chrono::milliseconds flushWindow = std::chrono::milliseconds(10));
+   ~ColoredCoinQueryBatcher();
+
+   // Trackers must wrap update routines with these calls, used to detect when all active trackers are waiting
+   void beginUpdate();
+   void endUpdate();
+
+   // Blocking calls, thread-safe.
+   // Throw ColoredCoinException on invalid DB state/connection or rethrow Armory errors.
+   OutpointBatch getOutpointsForAddresses(const std::set<BinaryData> &, unsigned int height, unsigned int zcIndex);
+   AsyncClient::TxBatchResult getTXsByHash(const std::set<BinaryData> &);
+   SpentnessMap getSpentnessForOutputs(const OutputsMap &);
+   SpentnessMap getSpentnessForZcOutputs(const OutputsMap &);
+
+   Stats stats() const;
+
+private:
+   enum class QueryType
+   {
+      Outpoints,
+      Txs,
+      Spentness,
+      ZcSpentness,
+   };
+
+   struct Query
+   {
+      QueryType type;
+
+      // addresses or tx hashes
+      std::set<BinaryData> keys;
+      unsigned int height{};
+      unsigned int zcIndex{};
+      OutputsMap outputs;
+
+      OutpointBatch outpointsResult;
+      AsyncClient::TxBatchResult txsResult;
+      SpentnessMap spentnessResult;
+      std::promise<void> done;
+   };
+   using QueryPtr = std::shared_ptr<Query>;
+
+   // Returned future rethrows error if set
+   std::future<void> enqueue(const QueryPtr &);
+   void processThreadFunc();
+   void flush(std::vector<QueryPtr> queries);
+
+   void sendOutpoints(unsigned int height, unsigned int zcIndex, const std::vector<QueryPtr> &);
+   void sendTxs(const std::vector<QueryPtr> &);
+   void sendSpentness(bool zc, const std::vector<QueryPtr> &);
+
+   static void setError(const std::vector<QueryPtr> &, std::exception_ptr);
+
+   std::shared_ptr<spdlog::logger> logger_;
+   std::shared_ptr<ArmoryConnection> armory_;
+   const std::chrono::milliseconds flushWindow_;
+
+   mutable std::mutex mutex_;
+   std::condition_variable cv_;
+   std::vector<QueryPtr> pending_;
+   int activeUpdates_{};
+   bool quit_{false};
+   Stats stats_;
+
+   std::thread processThread_;
+};
+
+#endif
@@ -11,11 +11,31 @@
 
 #include "ColoredCoinCache.h"
 
+#include <algorithm>
+#include <iterator>
+
 #include "ColoredCoinLogic.h"
 #include "cc_snapshots.pb.h"
 
 namespace {
 
+   void addOutpoint(const CcOutpoint &point, bs::cc_snapshots::Outpoint *d)
+   {
+      d->set_value(point.value());
+      d->set_index(point.index());
+      d->set_tx_hash(point.getTxHash()->toBinStr());
+      d->set_scr_addr(point.getScrAddr()->toBinStr());
+   }
+
+   void addIndices(const BinaryData &txHash, const std::set<unsigned> &indices
+      , bs::cc_snapshots::SpentOutputs *d)
+   {
+      d->set_tx_hash(txHash.toBinStr());
+      for (auto index : indices) {
+         d->add_index(index);
+      }
+   }
+
    std::shared_ptr<BinaryData> getOrInsert(const BinaryData &hash, std::map<BinaryData, std::shared_ptr<BinaryData>> &txHashes)
    {
       auto &elem = txHashes[hash];
@@ -29,17 +49,13 @@ namespace {
    {
       for (const auto &utxo : utxoSet) {
          for (const auto &item : utxo.second) {
-            const auto &point = *item.second;
-            auto d = msg.add_outpoints();
-            d->set_value(point.value());
-            d->set_index(point.index());
-            d->set_tx_hash(point.getTxHash()->toBinStr());
-            d->set_scr_addr(point.getScrAddr()->toBinStr());
+            addOutpoint(*item.second, msg.add_outpoints());
          }
       }
    }
 
-   bool deserializeUtxoSet(const bs::cc_snapshots::ColoredCoinSnapshot &msg, CcUtxoSet &utxoSet, ScrAddrCcSet &scrAddrCcSet)
+   bool deserializeUtxoSet(const bs::cc_snapshots::ColoredCoinSnapshot &msg, CcUtxoSet &utxoSet
+      , ScrAddrCcSet &scrAddrCcSet, ScrAddrBalanceMap &balances, const OutPointsSet *spentOutputs)
    {
       std::map<BinaryData, std::shared_ptr<BinaryData>> txHashes;
       std::map<BinaryData, std::shared_ptr<BinaryData>> scrAddresses;
@@ -63,6 +79,14 @@ namespace {
          if (!scrAddrItem.second) {
             return false;
          }
+
+         if (spentOutputs) {
+            auto spentIt = spentOutputs->find(txHash);
+            if (spentIt != spentOutputs->end() && spentIt->second.count(point->index()) != 0) {
+               continue;
+            }
+         }
+         addCcAddressBalance(balances, scrAddr, point->value());
       }
 
       return true;
@@ -91,6 +115,103 @@ namespace {
       }
    }
 
+   void diffUtxoSet(const CcUtxoSet &prev, const CcUtxoSet &next
+      , bs::cc_snapshots::ColoredCoinSnapshotDelta &msg)
+   {
+      // Both maps are sorted by tx hash, walk them side by side
+      auto prevIt = prev.begin();
+      auto nextIt = next.begin();
+      while (prevIt != prev.end() || nextIt != next.end()) {
+         if (nextIt == next.end() || (prevIt != prev.end() && prevIt->first < nextIt->first)) {
+            std::set<unsigned> removed;
+            for (const auto &item : prevIt->second) {
+               removed.insert(item.first);
+            }
+            addIndices(prevIt->first, removed, msg.add_removed_outpoints());
+            ++prevIt;
+            continue;
+         }
+         if (prevIt == prev.end() || nextIt->first < prevIt->first) {
+            for (const auto &item : nextIt->second) {
+               addOutpoint(*item.second, msg.add_added_outpoints());
+            }
+            ++nextIt;
+            continue;
+         }
+
+         std::set<unsigned> removed;
+         for (const auto &item : prevIt->second) {
+            if (nextIt->second.find(item.first) == nextIt->second.end()) {
+               removed.insert(item.first);
+            }
+         }
+         if (!removed.empty()) {
+            addIndices(prevIt->first, removed, msg.add_removed_outpoints());
+         }
+         for (const auto &item : nextIt->second) {
+            // Outpoint data never changes for the same tx hash and index
+            if (prevIt->second.find(item.first) == prevIt->second.end()) {
+               addOutpoint(*item.second, msg.add_added_outpoints());
+            }
+         }
+         ++prevIt;
+         ++nextIt;
+      }
+   }
+
+   bool diffTxHistory(const OutPointsSet &prev, const OutPointsSet &next
+      , bs::cc_snapshots::ColoredCoinSnapshotDelta &msg)
+   {
+      if (next.size() < prev.size()) {
+         return false;
+      }
+      for (const auto &item : next) {
+         auto it = prev.find(item.first);
+         if (it == prev.end()) {
+            addIndices(item.first, item.second, msg.add_tx_history());
+            continue;
+         }
+         if (it->second.size() > item.second.size()
+            || !std::includes(item.second.begin(), item.second.end(), it->second.begin(), it->second.end())) {
+            return false;
+         }
+         if (it->second.size() == item.second.size()) {
+            continue;
+         }
+         std::set<unsigned> added;
+         std::set_difference(item.second.begin(), item.second.end(), it->second.begin(), it->second.end()
+            , std::inserter(added, added.end()));
+         addIndices(item.first, added, msg.add_tx_history());
+      }
+      // Every previous entry must still be present
+      for (const auto &item : prev) {
+         if (next.find(item.first) == next.end()) {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   bool diffRevokedAddresses(const std::map<BinaryData, unsigned> &prev
+      , const std::map<BinaryData, unsigned> &next, bs::cc_snapshots::ColoredCoinSnapshotDelta &msg)
+   {
+      for (const auto &item : prev) {
+         if (next.find(item.first) == next.end()) {
+            return false;
+         }
+      }
+      for (const auto &item : next) {
+         auto it = prev.find(item.first);
+         if (it != prev.end() && it->second == item.second) {
+            continue;
+         }
+         auto d = msg.add_revoked_addresses();
+         d->set_scr_addr(item.first.toBinStr());
+         d->set_height(item.second);
+      }
+      return true;
+   }
+
 } // namespace
 
 std::string serializeColoredCoinSnapshot(const std::shared_ptr<ColoredCoinSnapshot> &snapshot)
@@ -139,7 +260,8 @@ std::shared_ptr<ColoredCoinSnapshot> deserializeColoredCoinSnapshot(const std::s
 
    auto snapshot = std::make_shared<ColoredCoinSnapshot>();
 
-   result = deserializeUtxoSet(msg, snapshot->utxoSet_, snapshot->scrAddrCcSet_);
+   result = deserializeUtxoSet(msg, snapshot->utxoSet_, snapshot->scrAddrCcSet_
+      , snapshot->balances_, nullptr);
    if (!result) {
       return {};
    }
@@ -163,12 +285,121 @@ std::shared_ptr<ColoredCoinZCSnapshot> deserializeColoredCoinZcSnapshot(const st
 
    auto snapshot = std::make_shared<ColoredCoinZCSnapshot>();
 
-   result = deserializeUtxoSet(msg, snapshot->utxoSet_, snapshot->scrAddrCcSet_);
+   // Spent outputs are needed first to skip them in balances_
+   deserializeOutPointsSet(msg, snapshot->spentOutputs_);
+
+   result = deserializeUtxoSet(msg, snapshot->utxoSet_, snapshot->scrAddrCcSet_
+      , snapshot->balances_, &snapshot->spentOutputs_);
    if (!result) {
       return {};
    }
 
-   deserializeOutPointsSet(msg, snapshot->spentOutputs_);
+   return snapshot;
+}
+
+bool serializeColoredCoinSnapshotDelta(const std::shared_ptr<ColoredCoinSnapshot> &prev
+   , const std::shared_ptr<ColoredCoinSnapshot> &next, std::string &result)
+{
+   if (!prev || !next) {
+      return false;
+   }
+
+   bs::cc_snapshots::ColoredCoinSnapshotDelta msg;
+
+   if (!diffTxHistory(prev->txHistory_, next->txHistory_, msg)) {
+      return false;
+   }
+
+   if (!diffRevokedAddresses(prev->revokedAddresses_, next->revokedAddresses_, msg)) {
+      return false;
+   }
+
+   diffUtxoSet(prev->utxoSet_, next->utxoSet_, msg);
+
+   result = msg.SerializeAsString();
+   return true;
+}
+
+std::shared_ptr<ColoredCoinSnapshot> applyColoredCoinSnapshotDelta(
+   const std::shared_ptr<ColoredCoinSnapshot> &base, const std::string &data)
+{
+   if (!base) {
+      return {};
+   }
+
+   bs::cc_snapshots::ColoredCoinSnapshotDelta msg;
+   bool result = msg.ParseFromString(data);
+   if (!result) {
+      return {};
+   }
+
+   auto snapshot = std::make_shared<ColoredCoinSnapshot>(*base);
+
+   for (const auto &d : msg.removed_outpoints()) {
+      const auto txHash = BinaryData::fromString(d.tx_hash());
+      auto hashIt = snapshot->utxoSet_.find(txHash);
+      if (hashIt == snapshot->utxoSet_.end()) {
+         return {};
+      }
+      for (auto index : d.index()) {
+         auto idIt = hashIt->second.find(index);
+         if (idIt == hashIt->second.end()) {
+            return {};
+         }
+         auto scrAddrIt = snapshot->scrAddrCcSet_.find(*idIt->second->getScrAddr());
+         if (scrAddrIt != snapshot->scrAddrCcSet_.end()) {
+            if (scrAddrIt->second.erase(idIt->second) != 0) {
+               removeCcAddressBalance(snapshot->balances_, scrAddrIt->first, idIt->second->value());
+            }
+            if (scrAddrIt->second.empty()) {
+               snapshot->scrAddrCcSet_.erase(scrAddrIt);
+            }
+         }
+         hashIt->second.erase(idIt);
+      }
+      if (hashIt->second.empty()) {
+         snapshot->utxoSet_.erase(hashIt);
+      }
+   }
+
+   for (const auto &d : msg.added_outpoints()) {
+      auto point = std::make_shared<CcOutpoint>(d.value(), d.index());
+      const auto txHash = BinaryData::fromString(d.tx_hash());
+      const auto scrAddr = BinaryData::fromString(d.scr_addr());
+
+      auto &utxo = snapshot->utxoSet_[txHash];
+      if (utxo.find(point->index()) != utxo.end()) {
+         return {};
+      }
+
+      // Reuse hash and address pointers where possible, as full deserialization does
+      if (!utxo.empty()) {
+         point->setTxHash(utxo.begin()->second->getTxHash());
+      } else {
+         point->setTxHash(txHash);
+      }
+      auto &scrAddrSet = snapshot->scrAddrCcSet_[scrAddr];
+      if (!scrAddrSet.empty()) {
+         point->setScrAddr((*scrAddrSet.begin())->getScrAddr());
+      } else {
+         point->setScrAddr(std::make_shared<BinaryData>(scrAddr));
+      }
+
+      utxo.emplace(point->index(), point);
+      scrAddrSet.insert(point);
+      addCcAddressBalance(snapshot->balances_, scrAddr, point->value());
+   }
+
+   for (const auto &d : msg.tx_history()) {
+      auto &indices = snapshot->txHistory_[BinaryData::fromString(d.tx_hash())];
+      for (auto index : d.index()) {
+         indices.insert(index);
+      }
+   }
+
+   for (const auto &d : msg.revoked_addresses()) {
+      snapshot->revokedAddresses_[BinaryData::fromString(d.scr_addr())] = d.height();
+   }
 
    return snapshot;
 }
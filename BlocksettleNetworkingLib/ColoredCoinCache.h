@@ -25,4 +25,15 @@ std::string serializeColoredCoinZcSnapshot(const std::shared_ptr<ColoredCoinZCSn
 std::shared_ptr<ColoredCoinSnapshot> deserializeColoredCoinSnapshot(const std::string &data);
 std::shared_ptr<ColoredCoinZCSnapshot> deserializeColoredCoinZcSnapshot(const std::string &data);
 
+// Serializes changes needed to get next from prev.
+// Returns false if delta could not be built and full snapshot must be sent instead
+// (one of the snapshots is empty or something was removed from history/revocations, e.g. after reorg).
+bool serializeColoredCoinSnapshotDelta(const std::shared_ptr<ColoredCoinSnapshot> &prev
+   , const std::shared_ptr<ColoredCoinSnapshot> &next, std::string &result);
+
+// Returns new snapshot (base is not modified).
+// Will return empty result in case of errors (full resync is required then).
+std::shared_ptr<ColoredCoinSnapshot> applyColoredCoinSnapshotDelta(
+   const std::shared_ptr<ColoredCoinSnapshot> &base, const std::string &data);
+
 #endif
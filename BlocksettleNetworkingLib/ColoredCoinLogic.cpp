@@ -9,6 +9,10 @@
 
 */
 #include "ColoredCoinLogic.h"
+#include "BloomFilter.h"
+#include "ColoredCoinBatcher.h"
+
+#include <algorithm>
 
 /***
 
@@ -104,6 +108,29 @@ namespace  {
       }
       return true;
    };
+
+   // Marks tracker as busy for the query batcher while update routine is running
+   class BatcherUpdateGuard
+   {
+   public:
+      BatcherUpdateGuard(const std::shared_ptr<ColoredCoinQueryBatcher> &batcher)
+         : batcher_(batcher)
+      {
+         if (batcher_) {
+            batcher_->beginUpdate();
+         }
+      }
+
+      ~BatcherUpdateGuard()
+      {
+         if (batcher_) {
+            batcher_->endUpdate();
+         }
+      }
+
+   private:
+      std::shared_ptr<ColoredCoinQueryBatcher> batcher_;
+   };
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -133,6 +160,56 @@ void CcOutpoint::setScrAddr(const std::shared_ptr<BinaryData>& scrAddr)
    scrAddr_ = scrAddr;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void addCcAddressBalance(ScrAddrBalanceMap& balances
+   , const BinaryData& scrAddr, uint64_t value)
+{
+   auto& balance = balances[scrAddr];
+   balance.value_ += value;
+   balance.count_ += 1;
+}
+
+////
+void removeCcAddressBalance(ScrAddrBalanceMap& balances
+   , const BinaryData& scrAddr, uint64_t value)
+{
+   auto iter = balances.find(scrAddr);
+   if (iter == balances.end()) {
+      throw ColoredCoinException("missing address balance");
+   }
+   iter->second.value_ -= value;
+   iter->second.count_ -= 1;
+   if (iter->second.count_ == 0) {
+      balances.erase(iter);
+   }
+}
+
+////
+void rebaseCcZcSnapshot(const std::shared_ptr<ColoredCoinSnapshot>& ssPtr
+   , ColoredCoinZCSnapshot& zcSnapshot)
+{
+   zcSnapshot.confirmedSpent_.clear();
+   zcSnapshot.confirmedSnapshot_ = ssPtr;
+   if (ssPtr == nullptr) {
+      return;
+   }
+
+   for (const auto& spentPair : zcSnapshot.spentOutputs_) {
+      auto hashIter = ssPtr->utxoSet_.find(spentPair.first);
+      if (hashIter == ssPtr->utxoSet_.end()) {
+         continue;
+      }
+      for (const auto& index : spentPair.second) {
+         auto idIter = hashIter->second.find(index);
+         if (idIter == hashIter->second.end()) {
+            continue;
+         }
+         addCcAddressBalance(zcSnapshot.confirmedSpent_
+            , *idIter->second->getScrAddr(), idIter->second->value());
+      }
+   }
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 void ColoredCoinTracker::addOriginAddress(const bs::Address& addr)
@@ -146,6 +223,16 @@ void ColoredCoinTracker::addRevocationAddress(const bs::Address& addr)
    revocationAddresses_.insert(addr.prefixed());
 }
 
+////
+void ColoredCoinTracker::setQueryBatcher(
+   const std::shared_ptr<ColoredCoinQueryBatcher>& batcher)
+{
+   if (ready_.load(std::memory_order_relaxed)) {
+      throw ColoredCoinException("query batcher must be set before goOnline");
+   }
+   queryBatcher_ = batcher;
+}
+
 ////
 std::shared_ptr<ColoredCoinSnapshot> ColoredCoinTracker::snapshot() const
 {
@@ -369,25 +456,39 @@ std::vector<Tx> ColoredCoinTracker::grabTxBatch(
    if (hashes.empty()) {
       return {};
    }
-   auto txProm = std::make_shared<std::promise<std::vector<Tx>>>();
+   const auto &batch = grabTxs(hashes);
+
+   std::vector<Tx> sortedBatch;
+   sortedBatch.reserve(batch.size());
+   for (const auto &tx : batch) {
+      if (!tx.second) {
+         continue;
+      }
+      //tx objects could be shared with other trackers, copy them
+      sortedBatch.emplace_back(*tx.second);
+   }
+   std::sort(sortedBatch.begin(), sortedBatch.end(), TxComparator());
+   return sortedBatch;
+}
+
+////
+AsyncClient::TxBatchResult ColoredCoinTracker::grabTxs(
+   const std::set<BinaryData>& hashes)
+{
+   if (queryBatcher_) {
+      return queryBatcher_->getTXsByHash(hashes);
+   }
+
+   auto txProm = std::make_shared<std::promise<AsyncClient::TxBatchResult>>();
    auto txFut = txProm->get_future();
-   auto txLbd = [txProm, hashes]
+   auto txLbd = [txProm]
       (const AsyncClient::TxBatchResult &batch, std::exception_ptr exPtr)
    {
       if (exPtr != nullptr) {
          txProm->set_exception(exPtr);
       }
       else {
-         std::vector<Tx> sortedBatch;
-         sortedBatch.reserve(batch.size());
-         for (const auto &tx : batch) {
-            if (!tx.second) {
-               continue;
-            }
-            sortedBatch.emplace_back(std::move(*tx.second));
-         }
-         std::sort(sortedBatch.begin(), sortedBatch.end(), TxComparator());
-         txProm->set_value(sortedBatch);
+         txProm->set_value(batch);
       }
    };
    if (!connPtr_->getTXsByHash(hashes, txLbd, false)) {
@@ -396,6 +497,61 @@ std::vector<Tx> ColoredCoinTracker::grabTxBatch(
    return txFut.get();
 }
 
+////
+OutpointBatch ColoredCoinTracker::grabOutpoints(
+   const std::set<BinaryData>& addrSet, unsigned heightCutoff, unsigned zcCutoff)
+{
+   if (queryBatcher_) {
+      return queryBatcher_->getOutpointsForAddresses(addrSet, heightCutoff, zcCutoff);
+   }
+
+   auto promPtr = std::make_shared<std::promise<OutpointBatch>>();
+   auto fut = promPtr->get_future();
+   auto lbd = [promPtr](const OutpointBatch &batch, std::exception_ptr exPtr)
+   {
+      if (exPtr != nullptr) {
+         promPtr->set_exception(exPtr);
+      }
+      else {
+         promPtr->set_value(batch);
+      }
+   };
+
+   if (!connPtr_->getOutpointsForAddresses(addrSet, lbd, heightCutoff, zcCutoff)) {
+      throw ColoredCoinException("invalid DB state/connection");
+   }
+   return fut.get();
+}
+
+////
+ColoredCoinTracker::SpentnessMap ColoredCoinTracker::grabSpentness(
+   const std::map<BinaryData, std::set<unsigned>>& outputs, bool zc)
+{
+   if (queryBatcher_) {
+      return zc ? queryBatcher_->getSpentnessForZcOutputs(outputs)
+         : queryBatcher_->getSpentnessForOutputs(outputs);
+   }
+
+   auto spentnessProm = std::make_shared<std::promise<SpentnessMap>>();
+   auto spentnessFut = spentnessProm->get_future();
+   auto spentnessLbd = [spentnessProm]
+      (const SpentnessMap &batch, std::exception_ptr exPtr)
+   {
+      if (exPtr != nullptr) {
+         spentnessProm->set_exception(exPtr);
+      }
+      else {
+         spentnessProm->set_value(batch);
+      }
+   };
+   bool result = zc ? connPtr_->getSpentnessForZcOutputs(outputs, spentnessLbd)
+      : connPtr_->getSpentnessForOutputs(outputs, spentnessLbd);
+   if (!result) {
+      throw ColoredCoinException("invalid DB state/connection");
+   }
+   return spentnessFut.get();
+}
+
 ////
 std::set<BinaryData> ColoredCoinTracker::processTxBatch(
    std::shared_ptr<ColoredCoinSnapshot>& ssPtr,
@@ -490,24 +646,7 @@ std::set<BinaryData> ColoredCoinTracker::processTxBatch(
    }
 
    //check new utxo list
-   auto spentnessProm = std::make_shared<
-      std::promise<std::map<BinaryData, std::map<unsigned int, SpentnessResult>>>>();
-   auto spentnessFut = spentnessProm->get_future();
-   auto spentnessLbd = [spentnessProm]
-      (const std::map<BinaryData, std::map<unsigned int, SpentnessResult>> &batch
-         , std::exception_ptr exPtr)
-   {
-      if (exPtr != nullptr) {
-         spentnessProm->set_exception(exPtr);
-      }
-      else {
-         spentnessProm->set_value(batch);
-      }
-   };
-   if (!connPtr_->getSpentnessForOutputs(spentnessToTrack, spentnessLbd)) {
-      throw ColoredCoinException("invalid DB state/connection");
-   }
-   auto&& spentnessBatch = spentnessFut.get();
+   auto&& spentnessBatch = grabSpentness(spentnessToTrack, false);
 
    //aggregate spender hashes
    for (auto& spentness : spentnessBatch) {
@@ -584,7 +723,14 @@ std::set<BinaryData> ColoredCoinTracker::processZcBatch(
                      std::make_pair(input.first, std::set<unsigned>())).first;
                }
 
-               spentIter->second.insert(input.second);
+               if (spentIter->second.insert(input.second).second) {
+                  const auto& opPtr = idIter->second;
+                  if (zcPtr->isBasedOn(ssPtr)) {
+                     addCcAddressBalance(zcPtr->confirmedSpent_
+                        , *opPtr->getScrAddr(), opPtr->value());
+                  }
+                  zcPtr->spentScrAddrs_.insert(*opPtr->getScrAddr());
+               }
                continue;
             }
          }
@@ -595,10 +741,6 @@ std::set<BinaryData> ColoredCoinTracker::processZcBatch(
             continue;
          }
 
-         zcHashIter->second.erase(input.second);
-         if (zcHashIter->second.size() == 0)
-            zcPtr->utxoSet_.erase(zcHashIter);
-
          //add to spent outputs as well
          auto zcSpentIter = zcPtr->spentOutputs_.find(input.first);
          if (zcSpentIter == zcPtr->spentOutputs_.end()) {
@@ -606,7 +748,20 @@ std::set<BinaryData> ColoredCoinTracker::processZcBatch(
                std::make_pair(input.first, std::set<unsigned>())).first;
          }
 
-         zcSpentIter->second.insert(input.second);
+         bool newSpend = zcSpentIter->second.insert(input.second).second;
+
+         auto zcIdIter = zcHashIter->second.find(input.second);
+         if (zcIdIter != zcHashIter->second.end()) {
+            //spent outputs are not accounted for in zc balances
+            if (newSpend) {
+               removeCcAddressBalance(zcPtr->balances_
+                  , *zcIdIter->second->getScrAddr(), zcIdIter->second->value());
+            }
+            zcPtr->spentScrAddrs_.insert(*zcIdIter->second->getScrAddr());
+            zcHashIter->second.erase(zcIdIter);
+         }
+         if (zcHashIter->second.size() == 0)
+            zcPtr->utxoSet_.erase(zcHashIter);
       }
 
       if (parsedTx.isInitialized()) {
@@ -635,24 +790,7 @@ std::set<BinaryData> ColoredCoinTracker::processZcBatch(
    }
 
    //check new utxo list
-   auto spentnessProm = std::make_shared<
-      std::promise<std::map<BinaryData, std::map<unsigned int, SpentnessResult>>>>();
-   auto spentnessFut = spentnessProm->get_future();
-   auto spentnessLbd = [spentnessProm]
-      (const std::map<BinaryData, std::map<unsigned int, SpentnessResult>> &batch
-         , std::exception_ptr exPtr)
-   {
-      if (exPtr != nullptr) {
-         spentnessProm->set_exception(exPtr);
-      }
-      else {
-         spentnessProm->set_value(batch);
-      }
-   };
-   if (!connPtr_->getSpentnessForZcOutputs(spentnessToTrack, spentnessLbd)) {
-      throw ColoredCoinException("invalid DB state/connection");
-   }
-   auto&& spentnessBatch = spentnessFut.get();
+   auto&& spentnessBatch = grabSpentness(spentnessToTrack, true);
 
    //aggregate spender hashes
    for (auto& spentness : spentnessBatch) {
@@ -675,22 +813,7 @@ void ColoredCoinTracker::processRevocationBatch(
       return;
    }
    //grab listed tx
-   auto txProm = std::make_shared<std::promise<AsyncClient::TxBatchResult>>();
-   auto txFut = txProm->get_future();
-   auto txLbd = [txProm]
-      (const AsyncClient::TxBatchResult &batch, std::exception_ptr exPtr)
-   {
-      if (exPtr != nullptr) {
-         txProm->set_exception(exPtr);
-      }
-      else {
-         txProm->set_value(batch);
-      }
-   };
-   if (!connPtr_->getTXsByHash(hashes, txLbd, false)) {
-      throw ColoredCoinException("invalid DB state/connection");
-   }
-   const auto &txBatch = txFut.get();
+   const auto &txBatch = grabTxs(hashes);
 
    //mark all output scrAddr as revoked
    for (const auto &tx : txBatch) {
@@ -725,9 +848,126 @@ std::set<BinaryData> ColoredCoinTracker::collectRevokeAddresses() const
    return addrSet;
 }
 
+////
+ColoredCoinTracker::Timings ColoredCoinTracker::timings() const
+{
+   Timings result;
+   result.sync = syncStats_.summary();
+   result.update = updateStats_.summary();
+   result.zcUpdate = zcUpdateStats_.summary();
+   return result;
+}
+
+////
+uint64_t ColoredCoinTracker::zcNotificationsFiltered() const
+{
+   if (actPtr_ == nullptr) {
+      return 0;
+   }
+   return actPtr_->zcNotificationsFiltered();
+}
+
+////
+uint64_t ColoredCoinTracker::zcNotificationsProcessed() const
+{
+   if (actPtr_ == nullptr) {
+      return 0;
+   }
+   return actPtr_->zcNotificationsProcessed();
+}
+
+////
+void ColoredCoinTracker::updateZcFilter(
+   const std::shared_ptr<ColoredCoinSnapshot>& ssPtr
+   , const std::shared_ptr<ColoredCoinZCSnapshot>& zcPtr)
+{
+   size_t count = originAddresses_.size() + revocationAddresses_.size();
+   if (ssPtr != nullptr) {
+      count += ssPtr->scrAddrCcSet_.size();
+   }
+   if (zcPtr != nullptr) {
+      count += zcPtr->scrAddrCcSet_.size();
+   }
+
+   auto filter = std::make_shared<BloomFilter>(count);
+   for (auto& addr : originAddresses_) {
+      filter->insert(addr);
+   }
+   for (auto& addr : revocationAddresses_) {
+      filter->insert(addr);
+   }
+   if (ssPtr != nullptr) {
+      for (auto& addrPair : ssPtr->scrAddrCcSet_) {
+         filter->insert(addrPair.first);
+      }
+   }
+   if (zcPtr != nullptr) {
+      for (auto& addrPair : zcPtr->scrAddrCcSet_) {
+         filter->insert(addrPair.first);
+      }
+   }
+
+   std::atomic_store_explicit(&zcFilter_, filter, std::memory_order_release);
+}
+
+////
+bool ColoredCoinTracker::isCcAddress(
+   const std::shared_ptr<ColoredCoinSnapshot>& ssPtr
+   , const std::shared_ptr<ColoredCoinZCSnapshot>& zcPtr
+   , const BinaryData& scrAddr) const
+{
+   if (originAddresses_.find(scrAddr) != originAddresses_.end() ||
+      revocationAddresses_.find(scrAddr) != revocationAddresses_.end()) {
+      return true;
+   }
+   if (ssPtr != nullptr &&
+      ssPtr->scrAddrCcSet_.find(scrAddr) != ssPtr->scrAddrCcSet_.end()) {
+      return true;
+   }
+   if (zcPtr != nullptr &&
+      zcPtr->scrAddrCcSet_.find(scrAddr) != zcPtr->scrAddrCcSet_.end()) {
+      return true;
+   }
+   return false;
+}
+
+////
+bool ColoredCoinTracker::isZcRelevant(const bs::TXEntry& entry) const
+{
+   auto filter = std::atomic_load_explicit(&zcFilter_, std::memory_order_acquire);
+   if (filter == nullptr || entry.addresses.empty()) {
+      //can't tell
+      return true;
+   }
+
+   std::shared_ptr<ColoredCoinSnapshot> ssPtr;
+   std::shared_ptr<ColoredCoinZCSnapshot> zcPtr;
+   bool snapshotsLoaded = false;
+   for (auto& addr : entry.addresses) {
+      if (!filter->mayContain(addr)) {
+         continue;
+      }
+
+      //verify filter hits against the snapshots
+      if (!snapshotsLoaded) {
+         ssPtr = snapshot();
+         zcPtr = zcSnapshot();
+         snapshotsLoaded = true;
+      }
+      if (isCcAddress(ssPtr, zcPtr, addr)) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 ////
 std::set<BinaryData> ColoredCoinTracker::update()
 {
+   BatcherUpdateGuard batcherGuard(queryBatcher_);
+   LatencyTimer timer(updateStats_);
+
    //create new snapshot
    auto ssPtr = std::make_shared<ColoredCoinSnapshot>();
 
@@ -754,27 +994,12 @@ std::set<BinaryData> ColoredCoinTracker::update()
       addrSet.insert(addrRef.first);
    }
 
-   auto promPtr = std::make_shared<std::promise<OutpointBatch>>();
-   auto fut = promPtr->get_future();
-   auto lbd = [promPtr](const OutpointBatch &batch, std::exception_ptr exPtr)
-   {
-      if (exPtr != nullptr) {
-         promPtr->set_exception(exPtr);
-      }
-      else {
-         promPtr->set_value(batch);
-      }
-   };
 
    /*
    We don't want any zc data for this call so pass UINT32_MAX
    as the zc cutoff.
    */
-   if (!connPtr_->getOutpointsForAddresses(addrSet, lbd, startHeight_, UINT32_MAX)) {
-      throw ColoredCoinException("invalid DB state/connection");
-   }
-
-   auto&& outpointData = fut.get();
+   auto&& outpointData = grabOutpoints(addrSet, startHeight_, UINT32_MAX);
    std::set<BinaryData> hashesToCheck;
    std::set<BinaryData> revokesToCheck;
 
@@ -848,6 +1073,7 @@ std::set<BinaryData> ColoredCoinTracker::update()
 
    //process revokes
    processRevocationBatch(ssPtr, revokesToCheck);
+   uint64_t txCount = revokesToCheck.size();
 
    //process settlements
    bool parseLowest = false;
@@ -855,6 +1081,7 @@ std::set<BinaryData> ColoredCoinTracker::update()
       if (hashesToCheck.empty()) {
          break;
       }
+      txCount += hashesToCheck.size();
 
       //run through the batch of transactions
       auto&& newHashSet = processTxBatch(ssPtr, hashesToCheck, parseLowest);
@@ -885,6 +1112,7 @@ std::set<BinaryData> ColoredCoinTracker::update()
 
    //update cutoff
    startHeight_ = outpointData.heightCutoff_ + 1;
+   timer.setItems(txCount);
 
    //track new addresses
    std::set<BinaryData> toReg;
@@ -896,6 +1124,7 @@ std::set<BinaryData> ColoredCoinTracker::update()
 
    //swap new snapshot in
    std::atomic_store_explicit(&snapshot_, ssPtr, std::memory_order_release);
+   updateZcFilter(ssPtr, zcSnapshot());
    snapshotUpdated();
 
    //purge zc container
@@ -908,6 +1137,9 @@ std::set<BinaryData> ColoredCoinTracker::update()
 ////
 std::set<BinaryData> ColoredCoinTracker::zcUpdate()
 {
+   BatcherUpdateGuard batcherGuard(queryBatcher_);
+   LatencyTimer timer(zcUpdateStats_);
+
    //create new snapshot
    auto ssPtr = std::make_shared<ColoredCoinZCSnapshot>();
    auto currentSs = snapshot();
@@ -917,6 +1149,14 @@ std::set<BinaryData> ColoredCoinTracker::zcUpdate()
       if (currentZcSs != nullptr) {
          *ssPtr = *currentZcSs;
       }
+      else {
+         ssPtr->spentScrAddrsKnown_ = true;
+      }
+   }
+
+   //a new block may have confirmed or dropped outputs spent by zc
+   if (!ssPtr->isBasedOn(currentSs)) {
+      rebaseCcZcSnapshot(currentSs, *ssPtr);
    }
 
    //track changeset for relevant addresses
@@ -932,27 +1172,12 @@ std::set<BinaryData> ColoredCoinTracker::zcUpdate()
       addrSet.insert(addrRef.first);
    }
    //note: we dont deal with unconfirmed revocations
-   auto promPtr = std::make_shared<std::promise<OutpointBatch>>();
-   auto fut = promPtr->get_future();
-   auto lbd = [promPtr](const OutpointBatch &batch, std::exception_ptr exPtr)
-   {
-      if (exPtr != nullptr) {
-         promPtr->set_exception(exPtr);
-      }
-      else {
-         promPtr->set_value(batch);
-      }
-   };
 
    /*
    We don't want any confirmed data for this call so pass UINT32_MAX
    as the height cutoff.
    */
-   if (!connPtr_->getOutpointsForAddresses(addrSet, lbd, UINT32_MAX, zcCutOff_)) {
-      throw ColoredCoinException("invalid DB state/connection");
-   }
-
-   auto&& outpointData = fut.get();
+   auto&& outpointData = grabOutpoints(addrSet, UINT32_MAX, zcCutOff_);
    std::set<BinaryData> hashesToCheck;
 
    //parse new outputs for origin addresses
@@ -994,8 +1219,10 @@ std::set<BinaryData> ColoredCoinTracker::zcUpdate()
    //process unconfirmed settlements
    
    bool processFirst = false;
+   uint64_t txCount = 0;
    while (hashesToCheck.size())
    {
+      txCount += hashesToCheck.size();
       auto&& returnedHashes = 
          processZcBatch(currentSs, ssPtr, hashesToCheck, processFirst);
       processFirst = false;
@@ -1017,6 +1244,7 @@ std::set<BinaryData> ColoredCoinTracker::zcUpdate()
 
    //update zc cutoff
    zcCutOff_ = outpointData.zcIndexCutoff_;
+   timer.setItems(txCount);
 
    //track new addresses
    std::set<BinaryData> toReg;
@@ -1028,6 +1256,7 @@ std::set<BinaryData> ColoredCoinTracker::zcUpdate()
 
    //swap the new snapshot in
    std::atomic_store_explicit(&zcSnapshot_, ssPtr, std::memory_order_release);
+   updateZcFilter(currentSs, ssPtr);
    zcSnapshotUpdated();
 
    //register new addresses
@@ -1052,28 +1281,14 @@ void ColoredCoinTracker::purgeZc()
          txHashes.insert(hashPair.first);
    }
 
-   auto promPtr = std::make_shared<std::promise<AsyncClient::TxBatchResult>>();
-   auto fut = promPtr->get_future();
-   const auto &getTxBatchLbd = [promPtr]
-      (const AsyncClient::TxBatchResult &batch, std::exception_ptr exPtr)
-   {
-      if (exPtr != nullptr) {
-         promPtr->set_exception(exPtr);
-      }
-      else {
-         promPtr->set_value(batch);
-      }
-   };
-
    if (txHashes.size() == 0)
       return;
 
-   if (!connPtr_->getTXsByHash(txHashes, getTxBatchLbd, false)) {
-      throw ColoredCoinException("invalid DB state/connection");
-   }
-   const auto &txBatch = fut.get();
+   const auto &txBatch = grabTxs(txHashes);
 
    auto zcPtr = std::make_shared<ColoredCoinZCSnapshot>();
+   zcPtr->confirmedSnapshot_ = currentSs;
+   zcPtr->spentScrAddrsKnown_ = true;
    std::set<BinaryData> txsToCheck;
    for (const auto &tx : txBatch) {
       if (!tx.second || (tx.second->getTxHeight() != UINT32_MAX)) {
@@ -1102,6 +1317,7 @@ void ColoredCoinTracker::purgeZc()
 
    //swap the new snapshot in
    std::atomic_store_explicit(&zcSnapshot_, zcPtr, std::memory_order_release);
+   updateZcFilter(currentSs, zcPtr);
    zcSnapshotUpdated();
 }
 
@@ -1109,13 +1325,10 @@ void ColoredCoinTracker::purgeZc()
 uint64_t ColoredCoinTrackerClient::getCcValueForAddress(const BinaryData& scrAddr) const
 {
    /*takes prefixed scrAddr*/
+   auto ssPtr = ccSnapshots_->snapshot();
+   auto zcPtr = ccSnapshots_->zcSnapshot();
 
-   uint64_t tally = 0;
-   auto&& addrOp = getSpendableOutpointsForAddress(scrAddr);
-   for (auto& op : addrOp) {
-      tally += op->value();
-   }
-   return tally;
+   return ColoredCoinTracker::getCcValueForAddress(ssPtr, zcPtr, scrAddr, false);
 }
 
 ////
@@ -1183,6 +1396,65 @@ ColoredCoinTracker::getSpendableOutpointsForAddress(
    return result;
 }
 
+////
+uint64_t ColoredCoinTracker::getCcValueForAddress(
+   const std::shared_ptr<ColoredCoinSnapshot>& ssPtr,
+   const std::shared_ptr<ColoredCoinZCSnapshot>& zcPtr,
+   const BinaryData& scrAddr, bool confirmedOnly)
+{
+   /*takes prefixed scrAddr*/
+   if (scrAddr.getSize() != 21 && scrAddr.getSize() != 33)
+      throw ColoredCoinException("only takes prefixed addresses");
+
+   uint64_t tally = 0;
+   if (ssPtr != nullptr) {
+      auto iter = ssPtr->balances_.find(scrAddr);
+      if (iter != ssPtr->balances_.end()) {
+         auto revokeIter = ssPtr->revokedAddresses_.find(scrAddr);
+         if (revokeIter != ssPtr->revokedAddresses_.end()) {
+            return 0;
+         }
+
+         if (zcPtr == nullptr || zcPtr->spentOutputs_.empty()) {
+            tally = iter->second.value_;
+         }
+         else if (zcPtr->isBasedOn(ssPtr)) {
+            tally = iter->second.value_;
+            auto spentIter = zcPtr->confirmedSpent_.find(scrAddr);
+            if (spentIter != zcPtr->confirmedSpent_.end()) {
+               tally -= spentIter->second.value_;
+            }
+         }
+         else if (zcPtr->spentScrAddrsKnown_ &&
+            zcPtr->spentScrAddrs_.find(scrAddr) == zcPtr->spentScrAddrs_.end()) {
+            //zc snapshot lags behind the confirmed one but spends nothing here
+            tally = iter->second.value_;
+         }
+         else {
+            //lagging zc snapshot spends from this address: its running total
+            //may count outputs gone from the confirmed snapshot, check the
+            //spentness of each confirmed outpoint instead
+            auto&& addrOp = getSpendableOutpointsForAddress(
+               ssPtr, zcPtr, scrAddr, true);
+            for (auto& op : addrOp) {
+               tally += op->value();
+            }
+         }
+      }
+   }
+
+   if (zcPtr == nullptr || confirmedOnly) {
+      return tally;
+   }
+
+   auto zcIter = zcPtr->balances_.find(scrAddr);
+   if (zcIter != zcPtr->balances_.end()) {
+      tally += zcIter->second.value_;
+   }
+
+   return tally;
+}
+
 ////
 std::vector<std::shared_ptr<CcOutpoint>> ColoredCoinTrackerClient::getSpendableOutpointsForAddress(
    const BinaryData& scrAddr) const
@@ -1251,7 +1523,9 @@ void ColoredCoinTracker::eraseScrAddrOp(
    if (scrAddrIter == ssPtr->scrAddrCcSet_.end()) {
       return;
    }
-   scrAddrIter->second.erase(opPtr);
+   if (scrAddrIter->second.erase(opPtr) != 0) {
+      removeCcAddressBalance(ssPtr->balances_, scrAddrIter->first, opPtr->value());
+   }
    if (scrAddrIter->second.size() == 0) {
       ssPtr->scrAddrCcSet_.erase(scrAddrIter);
    }
@@ -1309,8 +1583,10 @@ void ColoredCoinTracker::addUtxo(
    }
    opPtr->setScrAddr(scrAddrPtr);
 
-   //add to utxo set
-   hashIter->second.insert(std::make_pair(txOutIndex, opPtr));
+   //add to utxo set, origin address outputs are added again on every update
+   if (hashIter->second.insert(std::make_pair(txOutIndex, opPtr)).second) {
+      addCcAddressBalance(ssPtr->balances_, scrAddr, value);
+   }
 
    //add to scrAddr to utxo map
    addScrAddrOp(ssPtr->scrAddrCcSet_, opPtr);
@@ -1371,7 +1647,16 @@ void ColoredCoinTracker::addZcUtxo(
    opPtr->setScrAddr(scrAddrPtr);
 
    //add to utxo set
-   hashIter->second.insert(std::make_pair(txOutIndex, opPtr));
+   if (hashIter->second.insert(std::make_pair(txOutIndex, opPtr)).second) {
+      bool spent = false;
+      auto spentIter = zcPtr->spentOutputs_.find(txHash);
+      if (spentIter != zcPtr->spentOutputs_.end()) {
+         spent = spentIter->second.find(txOutIndex) != spentIter->second.end();
+      }
+      if (!spent) {
+         addCcAddressBalance(zcPtr->balances_, scrAddr, value);
+      }
+   }
 
    //add to scrAddr to utxo map
    addScrAddrOp(zcPtr->scrAddrCcSet_, opPtr);
@@ -1391,6 +1676,10 @@ void ColoredCoinTracker::reorg(bool hard)
    std::atomic_store_explicit(
       &zcSnapshot_, zcSnapshot, std::memory_order_release);
 
+   //let all ZC notifications through until the next update
+   std::shared_ptr<BloomFilter> filter = nullptr;
+   std::atomic_store_explicit(&zcFilter_, filter, std::memory_order_release);
+
    startHeight_ = 0;
    zcCutOff_ = 0;
 
@@ -1418,10 +1707,14 @@ bool ColoredCoinTracker::goOnline()
    if (ready_.load(std::memory_order_relaxed) || !walletObj_) {
       return false;
    }
+   const auto syncStart = std::chrono::steady_clock::now();
 
    //use default ACT if none is set
    if (actPtr_ == nullptr) {
       actPtr_ = std::make_shared<ColoredCoinACT>(connPtr_.get());
+
+      //only ZCs and refreshes of our own wallet are of interest
+      connPtr_->addTargetRoutes(actPtr_.get(), { walletId_ });
    }
 
    //register CC addresses
@@ -1434,6 +1727,7 @@ bool ColoredCoinTracker::goOnline()
       addrVec.push_back(addr);
    }
    auto &&regID = walletObj_->registerAddresses(addrVec, false);
+   connPtr_->addRegistrationRoute(actPtr_.get(), regID);
    while (true) {
       /*
       Wait on regID. We have to do this because we can't start
@@ -1443,6 +1737,10 @@ bool ColoredCoinTracker::goOnline()
       if ((notif->type_ == DBNS_Offline) && !notif->online_) {
          return false;
       }
+      if (notif->type_ == DBNS_ZC || notif->type_ == DBNS_NewBlock) {
+         //covered by the update routines below
+         actPtr_->updateProcessed();
+      }
       if (notif->type_ == DBNS_Refresh) {
          if (notif->ids_.size() == 1 &&
             notif->ids_[0] == BinaryData::fromString(regID)) {
@@ -1462,12 +1760,17 @@ bool ColoredCoinTracker::goOnline()
       addrVec.emplace_back(addr);
    }
    regID = walletObj_->registerAddresses(addrVec, true);
+   connPtr_->addRegistrationRoute(actPtr_.get(), regID);
 
    while (true) {
       auto&& notif = actPtr_->popNotification();
       if ((notif->type_ == DBNS_Offline) && !notif->online_) {
          return false;
       }
+      if (notif->type_ == DBNS_ZC || notif->type_ == DBNS_NewBlock) {
+         //covered by the update routines below
+         actPtr_->updateProcessed();
+      }
       if (notif->type_ == DBNS_Refresh) {
          if (notif->ids_.size() == 1 &&
             notif->ids_[0] == BinaryData::fromString(regID)) {
@@ -1485,6 +1788,11 @@ bool ColoredCoinTracker::goOnline()
    //flag ready
    ready_.store(true, std::memory_order_relaxed);
 
+   const auto syncDuration = std::chrono::steady_clock::now() - syncStart;
+   const auto syncTimings = timings();
+   syncStats_.add(std::chrono::duration_cast<std::chrono::microseconds>(syncDuration)
+      , syncTimings.update.items + syncTimings.zcUpdate.items);
+
    return true;
 }
 
@@ -1527,15 +1835,7 @@ uint64_t ColoredCoinTrackerClient::getUnconfirmedCcValueForAddresses(
    auto zcPtr = ccSnapshots_->zcSnapshot();
 
    for (auto& scrAddr : scrAddrSet)
-   {
-      auto opVec = ColoredCoinTracker::getSpendableOutpointsForAddress(nullptr, zcPtr, scrAddr, false);
-
-      uint64_t scrAddrTotal = 0;
-      for (auto op : opVec)
-         scrAddrTotal += op->value();
-
-      total += scrAddrTotal;
-   }
+      total += ColoredCoinTracker::getCcValueForAddress(nullptr, zcPtr, scrAddr, false);
 
    return total;
 }
@@ -1554,15 +1854,7 @@ uint64_t ColoredCoinTrackerClient::getConfirmedCcValueForAddresses(
    auto zcPtr = ccSnapshots_->zcSnapshot();
 
    for (auto& scrAddr : scrAddrSet)
-   {
-      auto opVec = ColoredCoinTracker::getSpendableOutpointsForAddress(ssPtr, zcPtr, scrAddr, true);
-
-      uint64_t scrAddrTotal = 0;
-      for (auto op : opVec)
-         scrAddrTotal += op->value();
-      
-      total += scrAddrTotal;
-   }
+      total += ColoredCoinTracker::getCcValueForAddress(ssPtr, zcPtr, scrAddr, true);
 
    return total;
 }
@@ -1598,10 +1890,33 @@ ColoredCoinTracker::OutpointMap ColoredCoinTrackerClient::getCCUtxoForAddresses(
 ////////////////////////////////////////////////////////////////////////////////
 void ColoredCoinACT::onZCReceived(const std::vector<bs::TXEntry> &zcs)
 {
+   /*
+   Skip ZCs that do not touch any of the tracker's CC addresses, as
+   zcUpdate would query Armory for nothing. The filter is bypassed while
+   updates are pending, since these may add CC addresses it doesn't
+   know about yet.
+   */
+   auto ccPtr = ccPtr_;
+   if (ccPtr != nullptr && pendingUpdates_.load(std::memory_order_acquire) == 0) {
+      bool relevant = false;
+      for (const auto &zc : zcs) {
+         if (ccPtr->isZcRelevant(zc)) {
+            relevant = true;
+            break;
+         }
+      }
+
+      if (!relevant) {
+         zcFiltered_.fetch_add(1, std::memory_order_relaxed);
+         return;
+      }
+   }
+   zcProcessed_.fetch_add(1, std::memory_order_relaxed);
+
    auto dbns = std::make_shared<DBNotificationStruct>(DBNS_ZC);
    dbns->zc_ = zcs;
 
-   notifQueue_.push_back(std::move(dbns));
+   pushUpdate(std::move(dbns));
 }
 
 ////
@@ -1611,7 +1926,7 @@ void ColoredCoinACT::onNewBlock(unsigned int height, unsigned int branchHeight)
    dbns->block_ = height;
    dbns->branchHeight_ = branchHeight;
 
-   notifQueue_.push_back(std::move(dbns));
+   pushUpdate(std::move(dbns));
 }
 
 ////
@@ -1634,6 +1949,19 @@ void ColoredCoinACT::onStateChanged(ArmoryState state)
    }
 }
 
+////
+void ColoredCoinACT::pushUpdate(std::shared_ptr<DBNotificationStruct> dbns)
+{
+   pendingUpdates_.fetch_add(1, std::memory_order_release);
+   notifQueue_.push_back(std::move(dbns));
+}
+
+////
+void ColoredCoinACT::updateProcessed()
+{
+   pendingUpdates_.fetch_sub(1, std::memory_order_release);
+}
+
 ////
 void ColoredCoinACT::start()
 {
@@ -1707,12 +2035,18 @@ void ColoredCoinACT::processNotification()
                addrSet.insert(zcAddrSet.begin(), zcAddrSet.end());
             }
 
+            //snapshots and ZC filter are up to date at this point
+            updateProcessed();
+
             //now register the update() address set
             if (addrSet.size() > 0) {
                std::vector<BinaryData> addrVec;
                for (auto& addr : addrSet)
                   addrVec.emplace_back(addr);
                auto&& regID = ccPtr_->walletObj_->registerAddresses(addrVec, true);
+               if (armory_ != nullptr) {
+                  armory_->addRegistrationRoute(this, regID);
+               }
 
                /*
                We have to wait on the refresh event for the registration
@@ -1729,6 +2063,7 @@ void ColoredCoinACT::processNotification()
          case DBNS_ZC:
          {
             auto&& addrSet = ccPtr_->zcUpdate();
+            updateProcessed();
 
             //same as with DBNS_NewBlock address registration
             if (addrSet.size() > 0) {
@@ -1737,6 +2072,9 @@ void ColoredCoinACT::processNotification()
                   addrVec.emplace_back(addr);
                }
                auto&& regID = ccPtr_->walletObj_->registerAddresses(addrVec, true);
+               if (armory_ != nullptr) {
+                  armory_->addRegistrationRoute(this, regID);
+               }
 
                regStruct.set(notifPtr, regID);
             }
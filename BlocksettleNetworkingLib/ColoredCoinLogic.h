@@ -15,9 +15,12 @@
 #include <set>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "Address.h"
 #include "ArmoryConnection.h"
+#include "LatencyStats.h"
 
 ////
 class ColoredCoinException : public std::runtime_error
@@ -107,6 +110,19 @@ using CcUtxoSet = std::map<BinaryData, std::map<unsigned, std::shared_ptr<CcOutp
 using ScrAddrCcSet = std::map<BinaryData, OpPtrSet>;
 using OutPointsSet = std::map<BinaryData, std::set<unsigned>>;
 
+////
+struct CcAddressBalance
+{
+   uint64_t value_ = 0;
+   unsigned count_ = 0;
+};
+
+//<prefixed scrAddr, balance>, entries are dropped once count_ reaches 0
+using ScrAddrBalanceMap = std::unordered_map<BinaryData, CcAddressBalance, BinaryDataHash>;
+
+void addCcAddressBalance(ScrAddrBalanceMap&, const BinaryData&, uint64_t);
+void removeCcAddressBalance(ScrAddrBalanceMap&, const BinaryData&, uint64_t);
+
 ////
 struct ColoredCoinSnapshot
 {
@@ -122,6 +138,9 @@ public:
 
    //<txHash, txOutId>
    OutPointsSet txHistory_;
+
+   //running totals of scrAddrCcSet_
+   ScrAddrBalanceMap balances_;
 };
 
 ////
@@ -136,10 +155,37 @@ public:
 
    //<hash, <txOutIds>>
    OutPointsSet spentOutputs_;
+
+   //running totals of scrAddrCcSet_ outpoints not in spentOutputs_
+   ScrAddrBalanceMap balances_;
+
+   //running totals of spentOutputs_ found in confirmedSnapshot_, the
+   //confirmed snapshot this one was built against
+   ScrAddrBalanceMap confirmedSpent_;
+   std::weak_ptr<ColoredCoinSnapshot> confirmedSnapshot_;
+
+   //owners of all spentOutputs_ entries, only filled by the tracker
+   //(not restored with deserialized snapshots)
+   std::unordered_set<BinaryData, BinaryDataHash> spentScrAddrs_;
+   bool spentScrAddrsKnown_ = false;
+
+   //true if confirmedSpent_ matches ssPtr; compares control blocks, which
+   //can't be reused by another snapshot while confirmedSnapshot_ refers to it
+   bool isBasedOn(const std::shared_ptr<ColoredCoinSnapshot>& ssPtr) const
+   {
+      return !confirmedSnapshot_.owner_before(ssPtr)
+         && !ssPtr.owner_before(confirmedSnapshot_);
+   }
 };
 
+//rebuilds confirmedSpent_ of the zc snapshot against ssPtr
+void rebaseCcZcSnapshot(const std::shared_ptr<ColoredCoinSnapshot>& ssPtr
+   , ColoredCoinZCSnapshot& zcSnapshot);
+
 ////
+class BloomFilter;
 class ColoredCoinTracker;
+class ColoredCoinQueryBatcher;
 
 ////
 class ColoredCoinACT : public ArmoryCallbackTarget
@@ -179,12 +225,23 @@ private:
 
    ColoredCoinTracker* ccPtr_ = nullptr;
 
+   //ZC notifications skipped by the tracker filter and queued for processing
+   std::atomic<uint64_t> zcFiltered_{0};
+   std::atomic<uint64_t> zcProcessed_{0};
+
+   //new block and ZC notifications queued but not processed yet,
+   //the filter is bypassed until the tracker catches up with them
+   std::atomic<int> pendingUpdates_{0};
+
 private:
    std::shared_ptr<DBNotificationStruct> popNotification(void)
    {
       return notifQueue_.pop_front();
    }
 
+   void pushUpdate(std::shared_ptr<DBNotificationStruct>);
+   void updateProcessed(void);
+
 protected:
    virtual void onUpdate(std::shared_ptr<DBNotificationStruct>) {}
 
@@ -212,6 +269,9 @@ public:
    virtual void stop();
    virtual void setCCManager(ColoredCoinTracker* ccPtr) { ccPtr_ = ccPtr; }
 
+   uint64_t zcNotificationsFiltered(void) const { return zcFiltered_.load(std::memory_order_relaxed); }
+   uint64_t zcNotificationsProcessed(void) const { return zcProcessed_.load(std::memory_order_relaxed); }
+
 private:
    virtual void processNotification(void);
 };
@@ -267,14 +327,33 @@ private:
    SnapshotUpdatedCb snapshotUpdatedCb_;
    SnapshotUpdatedCb zcSnapshotUpdatedCb_;
 
+   std::shared_ptr<ColoredCoinQueryBatcher> queryBatcher_;
+
+   //live CC addresses, used to skip ZC notifications that do not touch them
+   std::shared_ptr<BloomFilter> zcFilter_;
+
+   //durations of goOnline/update/zcUpdate, items are tx hashes processed
+   LatencyStats syncStats_;
+   LatencyStats updateStats_;
+   LatencyStats zcUpdateStats_;
+
 protected:
+   std::string walletId_;
    std::shared_ptr<AsyncClient::BtcWallet> walletObj_;
    std::shared_ptr<ColoredCoinACT>  actPtr_;
 
 private:
+   using SpentnessMap = std::map<BinaryData, std::map<unsigned int, SpentnessResult>>;
+
    ////
    std::vector<Tx> grabTxBatch(const std::set<BinaryData>&);
 
+   //blocking Armory queries, routed through the query batcher if set
+   AsyncClient::TxBatchResult grabTxs(const std::set<BinaryData>&);
+   OutpointBatch grabOutpoints(const std::set<BinaryData>&, unsigned, unsigned);
+   SpentnessMap grabSpentness(
+      const std::map<BinaryData, std::set<unsigned>>&, bool zc);
+
    ParsedCcTx processTx(
       const std::shared_ptr<ColoredCoinSnapshot> &,
       const std::shared_ptr<ColoredCoinZCSnapshot>&,
@@ -326,6 +405,18 @@ private:
    std::set<BinaryData> collectOriginAddresses() const;
    std::set<BinaryData> collectRevokeAddresses() const;
 
+   ////
+   void updateZcFilter(
+      const std::shared_ptr<ColoredCoinSnapshot>&,
+      const std::shared_ptr<ColoredCoinZCSnapshot>&);
+   bool isCcAddress(
+      const std::shared_ptr<ColoredCoinSnapshot>&,
+      const std::shared_ptr<ColoredCoinZCSnapshot>&,
+      const BinaryData&) const;
+
+   //false if the ZC does not touch any live CC address
+   bool isZcRelevant(const bs::TXEntry&) const;
+
    ////
    void waitOnRefresh(const std::string&);
    void pushRefreshID(std::vector<BinaryData>&);
@@ -352,7 +443,8 @@ public:
       ready_.store(false, std::memory_order_relaxed);
 
       auto&& wltIdSbd = CryptoPRNG::generateRandom(12);
-      walletObj_ = connPtr_->instantiateWallet(wltIdSbd.toHexStr());
+      walletId_ = wltIdSbd.toHexStr();
+      walletObj_ = connPtr_->instantiateWallet(walletId_);
    }
 
    ~ColoredCoinTracker(void) override
@@ -379,10 +471,32 @@ public:
       const std::shared_ptr<ColoredCoinZCSnapshot>&,
       const BinaryData&, bool);
 
+   //same as summing up getSpendableOutpointsForAddress values,
+   //uses snapshot running balances
+   static uint64_t getCcValueForAddress(
+      const std::shared_ptr<ColoredCoinSnapshot>&,
+      const std::shared_ptr<ColoredCoinZCSnapshot>&,
+      const BinaryData&, bool);
+
    ////
    void addOriginAddress(const bs::Address&) override;
    void addRevocationAddress(const bs::Address&) override;
 
+   //share Armory queries with other trackers, call before goOnline
+   void setQueryBatcher(const std::shared_ptr<ColoredCoinQueryBatcher>&);
+
+   //ZC notifications skipped/queued by the CC address filter
+   uint64_t zcNotificationsFiltered(void) const;
+   uint64_t zcNotificationsProcessed(void) const;
+
+   struct Timings
+   {
+      LatencyStats::Summary sync;
+      LatencyStats::Summary update;
+      LatencyStats::Summary zcUpdate;
+   };
+   Timings timings(void) const;
+
    ////
    bool goOnline(void) override;
 };
@@ -11,6 +11,9 @@
 
 #include "ColoredCoinServer.h"
 
+#include <algorithm>
+
+#include "ColoredCoinBatcher.h"
 #include "ColoredCoinCache.h"
 #include "ColoredCoinLogic.h"
 #include "DispatchQueue.h"
@@ -22,6 +25,9 @@
 
 namespace {
 
+   // Full snapshot is sent instead of delta if client is too far behind with acks
+   const uint64_t kMaxUnackedSnapshotVersions = 16;
+
    bool isValidTrackerAddr(const std::string &str)
    {
       try {
@@ -134,6 +140,11 @@ public:
    bool registered_{false};
    int id_{};
 
+   // 0 if no versioned snapshot was received yet
+   uint64_t snapshotVersion_{};
+   // Full snapshot was requested, deltas are dropped until it arrives
+   bool resyncPending_{false};
+
    std::shared_ptr<ColoredCoinSnapshot> snapshot_;
    std::shared_ptr<ColoredCoinZCSnapshot> zcSnapshot_;
 
@@ -145,24 +156,14 @@ public:
 class CcTrackerSrvImpl : public ColoredCoinTracker
 {
 public:
-   struct Client
-   {
-      std::string clientId;
-      int id{};
-
-      bool operator<(const Client &other) const {
-         if (clientId != other.clientId) {
-            return clientId < other.clientId;
-         }
-         return id < other.id;
-      }
-   };
-
    CcTrackerSrvImpl(CcTrackerServer *parent
       , uint64_t coinsPerShare
       , std::shared_ptr<ArmoryConnection> connPtr
       , uint64_t index)
       : ColoredCoinTracker(coinsPerShare, connPtr)
+      , publisher_([parent](const std::string &clientId, const std::string &data) {
+         parent->sendData(clientId, data);
+      })
       , parent_(parent)
       , index_(index)
    {
@@ -176,52 +177,171 @@ public:
 
    void snapshotUpdated() override
    {
-      SPDLOG_LOGGER_DEBUG(parent_->logger_, "snapshots updated, {}", index_);
+      const auto batcherStats = parent_->queryBatcher_->stats();
+      SPDLOG_LOGGER_DEBUG(parent_->logger_, "snapshots updated, {}, total Armory queries: {} requested, {} sent ({} of {} items sent)"
+         , index_, batcherStats.queries, batcherStats.armoryRequests, batcherStats.itemsSent, batcherStats.itemsRequested);
+      const auto updateTimings = timings().update;
+      SPDLOG_LOGGER_DEBUG(parent_->logger_, "tracker {} updates: {}, {} tx ({:.1f} tx/s), p50: {} us, p90: {} us, p99: {} us, max: {} us"
+         , index_, updateTimings.count, updateTimings.items, updateTimings.throughput(), updateTimings.p50.count()
+         , updateTimings.p90.count(), updateTimings.p99.count(), updateTimings.max.count());
 
       parent_->dispatchQueue_.dispatch([this] {
-         auto s = snapshot();
-         ccSnapshot_ = serializeColoredCoinSnapshot(s);
-         for (const auto &client : clients_) {
-            sendSnapshot(client);
+         const auto prevStats = publisher_.stats();
+         if (!publisher_.publish(snapshot())) {
+            return;
          }
+         const auto &stats = publisher_.stats();
+         SPDLOG_LOGGER_DEBUG(parent_->logger_, "snapshot {} version {} sent: {} full ({} bytes), {} delta ({} bytes)"
+            ", tracker total: {} bytes, server total: {} bytes", index_, publisher_.version()
+            , stats.fullSent - prevStats.fullSent, stats.fullBytes - prevStats.fullBytes
+            , stats.deltaSent - prevStats.deltaSent, stats.deltaBytes - prevStats.deltaBytes
+            , stats.bytes(), parent_->bytesSent_);
       });
    }
 
    virtual void zcSnapshotUpdated() override
    {
-      SPDLOG_LOGGER_DEBUG(parent_->logger_, "zc snapshots updated, {}", index_);
+      SPDLOG_LOGGER_DEBUG(parent_->logger_, "zc snapshots updated, {}, ZC notifications: {} processed, {} filtered"
+         , index_, zcNotificationsProcessed(), zcNotificationsFiltered());
 
       parent_->dispatchQueue_.dispatch([this] {
-         auto s = zcSnapshot();
-         ccZcSnapshot_ = serializeColoredCoinZcSnapshot(s);
-         for (const auto &client : clients_) {
-            sendZcSnapshot(client);
-         }
+         publisher_.publishZc(zcSnapshot());
       });
    }
 
-   void sendSnapshot(const Client &client) {
-      bs::tracker_server::Response response;
-      auto d = response.mutable_update_cc_snapshot();
-      d->set_id(client.id);
-      d->set_data(ccSnapshot_);
-      parent_->server_->SendDataToClient(client.clientId, response.SerializeAsString());
+   CcSnapshotPublisher publisher_;
+   CcTrackerServer *parent_{};
+   const uint64_t index_;
+};
+
+CcSnapshotPublisher::CcSnapshotPublisher(const SendCb &sendCb)
+   : sendCb_(sendCb)
+{
+}
+
+void CcSnapshotPublisher::addClient(const Client &client, bool deltaUpdates)
+{
+   auto &state = clients_[client];
+   state.deltaUpdates = deltaUpdates;
+   state.ackedVersion = version_;
+   stats_.fullBytes += sendSnapshot(client, state);
+   stats_.fullSent += 1;
+   stats_.zcBytes += sendZcSnapshot(client);
+   stats_.zcSent += 1;
+}
+
+bool CcSnapshotPublisher::removeClient(const Client &client)
+{
+   return (clients_.erase(client) == 1);
+}
+
+bool CcSnapshotPublisher::ack(const Client &client, uint64_t version)
+{
+   auto it = clients_.find(client);
+   if (it == clients_.end()) {
+      return false;
    }
+   it->second.ackedVersion = std::max(it->second.ackedVersion, version);
+   return true;
+}
 
-   void sendZcSnapshot(const Client &client) {
-      bs::tracker_server::Response response;
-      auto d = response.mutable_update_cc_zc_snapshot();
-      d->set_id(client.id);
-      d->set_data(ccZcSnapshot_);
-      parent_->server_->SendDataToClient(client.clientId, response.SerializeAsString());
+bool CcSnapshotPublisher::resync(const Client &client)
+{
+   auto it = clients_.find(client);
+   if (it == clients_.end()) {
+      return false;
    }
+   stats_.fullBytes += sendSnapshot(client, it->second);
+   stats_.fullSent += 1;
+   return true;
+}
 
-   std::string ccSnapshot_;
-   std::string ccZcSnapshot_;
-   std::set<Client> clients_;
-   CcTrackerServer *parent_{};
-   const uint64_t index_;
-};
+bool CcSnapshotPublisher::publish(const std::shared_ptr<ColoredCoinSnapshot> &snapshot)
+{
+   if (snapshot == lastSnapshot_) {
+      return false;
+   }
+
+   const uint64_t baseVersion = version_;
+   std::string delta;
+   bool hasDelta = serializeColoredCoinSnapshotDelta(lastSnapshot_, snapshot, delta);
+
+   lastSnapshot_ = snapshot;
+   version_ += 1;
+   fullSnapshot_.clear();
+   fullSnapshotValid_ = false;
+   stats_.updates += 1;
+
+   for (auto &client : clients_) {
+      auto &state = client.second;
+      if (hasDelta && state.deltaUpdates && state.sentVersion == baseVersion
+         && version_ - state.ackedVersion <= kMaxUnackedSnapshotVersions) {
+         stats_.deltaBytes += sendSnapshotDelta(client.first, state, baseVersion, delta);
+         stats_.deltaSent += 1;
+      } else {
+         stats_.fullBytes += sendSnapshot(client.first, state);
+         stats_.fullSent += 1;
+      }
+   }
+   return true;
+}
+
+void CcSnapshotPublisher::publishZc(const std::shared_ptr<ColoredCoinZCSnapshot> &snapshot)
+{
+   zcSnapshot_ = serializeColoredCoinZcSnapshot(snapshot);
+   for (const auto &client : clients_) {
+      stats_.zcBytes += sendZcSnapshot(client.first);
+      stats_.zcSent += 1;
+   }
+}
+
+const std::string &CcSnapshotPublisher::fullSnapshot()
+{
+   if (!fullSnapshotValid_) {
+      fullSnapshot_ = serializeColoredCoinSnapshot(lastSnapshot_);
+      fullSnapshotValid_ = true;
+   }
+   return fullSnapshot_;
+}
+
+size_t CcSnapshotPublisher::sendSnapshot(const Client &client, ClientState &state)
+{
+   bs::tracker_server::Response response;
+   auto d = response.mutable_update_cc_snapshot();
+   d->set_id(client.id);
+   d->set_data(fullSnapshot());
+   d->set_version(version_);
+   state.sentVersion = version_;
+   const auto data = response.SerializeAsString();
+   sendCb_(client.clientId, data);
+   return data.size();
+}
+
+size_t CcSnapshotPublisher::sendSnapshotDelta(const Client &client, ClientState &state
+   , uint64_t baseVersion, const std::string &delta)
+{
+   bs::tracker_server::Response response;
+   auto d = response.mutable_update_cc_snapshot_delta();
+   d->set_id(client.id);
+   d->set_base_version(baseVersion);
+   d->set_version(version_);
+   d->set_data(delta);
+   state.sentVersion = version_;
+   const auto data = response.SerializeAsString();
+   sendCb_(client.clientId, data);
+   return data.size();
+}
+
+size_t CcSnapshotPublisher::sendZcSnapshot(const Client &client)
+{
+   bs::tracker_server::Response response;
+   auto d = response.mutable_update_cc_zc_snapshot();
+   d->set_id(client.id);
+   d->set_data(zcSnapshot_);
+   const auto data = response.SerializeAsString();
+   sendCb_(client.clientId, data);
+   return data.size();
+}
 
 CcTrackerClient::CcTrackerClient(const std::shared_ptr<spdlog::logger> &logger)
    : logger_(logger)
@@ -285,6 +405,9 @@ void CcTrackerClient::OnDataReceived(const std::string &data)
          case bs::tracker_server::Response::kUpdateCcZcSnapshot:
             processUpdateCcZcSnapshot(response.update_cc_zc_snapshot());
             return;
+         case bs::tracker_server::Response::kUpdateCcSnapshotDelta:
+            processUpdateCcSnapshotDelta(response.update_cc_snapshot_delta());
+            return;
          case bs::tracker_server::Response::DATA_NOT_SET:
             SPDLOG_LOGGER_ERROR(logger_, "got invalid empty response from server");
             return;
@@ -362,6 +485,7 @@ void CcTrackerClient::registerClient(CcTrackerImpl *client)
    auto d = request.mutable_register_cc();
 
    d->set_id(client->id_);
+   d->set_delta_updates(true);
    d->mutable_tracker_key()->set_coins_per_share(client->coinsPerShare_);
    std::set<std::string> originAddresses;
    for (const auto &addr : client->originAddresses_) {
@@ -402,6 +526,8 @@ void CcTrackerClient::scheduleRestart()
          setState(State::Restarting);
          for (const auto &item : clients_) {
             item->registered_ = false;
+            item->snapshotVersion_ = 0;
+            item->resyncPending_ = false;
          }
       }
    });
@@ -428,9 +554,69 @@ void CcTrackerClient::processUpdateCcSnapshot(const bs::tracker_server::Response
    CcTrackerImpl *tracker = it->second;
    auto snapshot = deserializeColoredCoinSnapshot(response.data());
    std::atomic_store_explicit(&tracker->snapshot_, snapshot, std::memory_order_release);
+   tracker->snapshotVersion_ = response.version();
+   tracker->resyncPending_ = false;
    if (tracker->snapshotUpdatedCb_) {
       tracker->snapshotUpdatedCb_();
    }
+   if (response.version() != 0) {
+      sendAck(tracker);
+   }
+}
+
+void CcTrackerClient::processUpdateCcSnapshotDelta(const bs::tracker_server::Response_UpdateCcSnapshotDelta &response)
+{
+   auto it = clientsById_.find(response.id());
+   if (it == clientsById_.end()) {
+      SPDLOG_LOGGER_ERROR(logger_, "unknown id");
+      return;
+   }
+   CcTrackerImpl *tracker = it->second;
+   if (tracker->resyncPending_) {
+      return;
+   }
+   if (tracker->snapshotVersion_ == 0 || tracker->snapshotVersion_ != response.base_version()) {
+      SPDLOG_LOGGER_WARN(logger_, "snapshot version gap detected (local: {}, base: {}), request full resync"
+         , tracker->snapshotVersion_, response.base_version());
+      requestResync(tracker);
+      return;
+   }
+
+   auto snapshot = applyColoredCoinSnapshotDelta(tracker->snapshot(), response.data());
+   if (!snapshot) {
+      SPDLOG_LOGGER_ERROR(logger_, "applying snapshot delta failed, request full resync");
+      requestResync(tracker);
+      return;
+   }
+
+   std::atomic_store_explicit(&tracker->snapshot_, snapshot, std::memory_order_release);
+   tracker->snapshotVersion_ = response.version();
+   if (tracker->snapshotUpdatedCb_) {
+      tracker->snapshotUpdatedCb_();
+   }
+   sendAck(tracker);
+}
+
+void CcTrackerClient::sendAck(CcTrackerImpl *client)
+{
+   bs::tracker_server::Request request;
+   auto d = request.mutable_ack_cc_snapshot();
+   d->set_id(client->id_);
+   d->set_version(client->snapshotVersion_);
+   connection_->send(request.SerializeAsString());
+}
+
+void CcTrackerClient::requestResync(CcTrackerImpl *client)
+{
+   bs::tracker_server::Request request;
+   auto d = request.mutable_resync_cc();
+   d->set_id(client->id_);
+   d->set_version(client->snapshotVersion_);
+   connection_->send(request.SerializeAsString());
+
+   // Ignore any following deltas until full snapshot is received
+   client->snapshotVersion_ = 0;
+   client->resyncPending_ = true;
 }
 
 void CcTrackerClient::processUpdateCcZcSnapshot(const bs::tracker_server::Response_UpdateCcZcSnapshot &response)
@@ -442,6 +628,10 @@ void CcTrackerClient::processUpdateCcZcSnapshot(const bs::tracker_server::Respon
    }
    CcTrackerImpl *tracker = it->second;
    auto snapshot = deserializeColoredCoinZcSnapshot(response.data());
+   if (snapshot) {
+      // Confirmed outputs spent by ZC are not sent, restore them from the local snapshot
+      rebaseCcZcSnapshot(tracker->snapshot(), *snapshot);
+   }
    std::atomic_store_explicit(&tracker->zcSnapshot_, snapshot, std::memory_order_release);
    if (tracker->zcSnapshotUpdatedCb_) {
       tracker->zcSnapshotUpdatedCb_();
@@ -452,6 +642,7 @@ CcTrackerServer::CcTrackerServer(const std::shared_ptr<spdlog::logger> &logger
    , const std::shared_ptr<ArmoryConnection> &armory)
    : logger_(logger)
    , armory_(armory)
+   , queryBatcher_(std::make_shared<ColoredCoinQueryBatcher>(logger, armory))
 {
    dispatchThread_ = std::thread([this]{
       while (!dispatchQueue_.done()) {
@@ -494,6 +685,12 @@ void CcTrackerServer::OnDataFromClient(const std::string &clientId, const std::s
          case bs::tracker_server::Request::kRegisterCc:
             processRegisterCc(client, request.register_cc());
             return;
+         case bs::tracker_server::Request::kAckCcSnapshot:
+            processAckCcSnapshot(client, request.ack_cc_snapshot());
+            return;
+         case bs::tracker_server::Request::kResyncCc:
+            processResyncCc(client, request.resync_cc());
+            return;
          case bs::tracker_server::Request::DATA_NOT_SET:
             SPDLOG_LOGGER_ERROR(logger_, "invalid request from client {}", bs::toHex(clientId));
             return;
@@ -522,9 +719,9 @@ void CcTrackerServer::OnClientDisconnected(const std::string &clientId)
 
       auto &client = it->second;
       for (const auto &item : client.trackers) {
-         auto c = CcTrackerSrvImpl::Client{client.clientId, item.first};
-         size_t count = item.second->clients_.erase(c);
-         assert(count == 1);
+         auto c = CcSnapshotPublisher::Client{client.clientId, item.first};
+         bool removed = item.second->publisher_.removeClient(c);
+         assert(removed);
       }
 
       connectedClients_.erase(it);
@@ -548,13 +745,14 @@ void CcTrackerServer::processRegisterCc(CcTrackerServer::ClientData &client, con
    auto &trackerWeakPtr = trackers_[trackerKey];
    auto trackerPtr = trackerWeakPtr.lock();
 
-   auto c = CcTrackerSrvImpl::Client{client.clientId, request.id()};
+   auto c = CcSnapshotPublisher::Client{client.clientId, request.id()};
 
    if (!trackerPtr) {
       startedTrackerCount_ += 1;
       auto startedTrackerIndex = startedTrackerCount_;
 
       trackerPtr = std::make_shared<CcTrackerSrvImpl>(this, request.tracker_key().coins_per_share(), armory_, startedTrackerIndex);
+      trackerPtr->setQueryBatcher(queryBatcher_);
       SPDLOG_LOGGER_INFO(logger_, "create new tracker {}...", trackerPtr->index_);
       for (const auto &addr : request.tracker_key().origin_addresses()) {
          SPDLOG_LOGGER_INFO(logger_, "add origin address {}", addr);
@@ -576,7 +774,9 @@ void CcTrackerServer::processRegisterCc(CcTrackerServer::ClientData &client, con
             std::exit(EXIT_FAILURE);
          }
 
-         SPDLOG_LOGGER_INFO(logger_, "new tracker ({}) started successfully", trackerPtr->index_);
+         const auto syncTimings = trackerPtr->timings().sync;
+         SPDLOG_LOGGER_INFO(logger_, "new tracker ({}) started successfully in {} ms, {} tx processed"
+            , trackerPtr->index_, syncTimings.total.count() / 1000, syncTimings.items);
       });
       regThread.detach();
 
@@ -587,7 +787,37 @@ void CcTrackerServer::processRegisterCc(CcTrackerServer::ClientData &client, con
 
    client.trackers[request.id()] = trackerPtr;
 
-   trackerPtr->clients_.insert(c);
-   trackerPtr->sendSnapshot(c);
-   trackerPtr->sendZcSnapshot(c);
+   trackerPtr->publisher_.addClient(c, request.delta_updates());
+}
+
+void CcTrackerServer::processAckCcSnapshot(CcTrackerServer::ClientData &client, const bs::tracker_server::Request_AckCcSnapshot &request)
+{
+   auto it = client.trackers.find(request.id());
+   if (it == client.trackers.end()) {
+      SPDLOG_LOGGER_ERROR(logger_, "ack for unknown tracker id is ignored");
+      return;
+   }
+
+   auto c = CcSnapshotPublisher::Client{client.clientId, request.id()};
+   it->second->publisher_.ack(c, request.version());
+}
+
+void CcTrackerServer::processResyncCc(CcTrackerServer::ClientData &client, const bs::tracker_server::Request_ResyncCc &request)
+{
+   auto it = client.trackers.find(request.id());
+   if (it == client.trackers.end()) {
+      SPDLOG_LOGGER_ERROR(logger_, "resync for unknown tracker id is ignored");
+      return;
+   }
+
+   SPDLOG_LOGGER_DEBUG(logger_, "resync requested for tracker {} (client version: {})"
+      , it->second->index_, request.version());
+   auto c = CcSnapshotPublisher::Client{client.clientId, request.id()};
+   it->second->publisher_.resync(c);
+}
+
+void CcTrackerServer::sendData(const std::string &clientId, const std::string &data)
+{
+   bytesSent_ += data.size();
+   server_->SendDataToClient(clientId, data);
 }
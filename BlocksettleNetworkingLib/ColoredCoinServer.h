@@ -13,6 +13,7 @@
 #define COLORED_COIN_SERVER_H
 
 #include <functional>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -28,6 +29,9 @@ namespace spdlog {
 
 class ArmoryConnection;
 class CcTrackerImpl;
+struct ColoredCoinSnapshot;
+struct ColoredCoinZCSnapshot;
+class ColoredCoinQueryBatcher;
 class CcTrackerSrvImpl;
 class ColoredCoinTrackerInterface;
 class ZmqBIP15XDataConnection;
@@ -36,8 +40,11 @@ class ZmqContext;
 
 namespace bs {
    namespace tracker_server {
+      class Request_AckCcSnapshot;
       class Request_RegisterCc;
+      class Request_ResyncCc;
       class Response_UpdateCcSnapshot;
+      class Response_UpdateCcSnapshotDelta;
       class Response_UpdateCcZcSnapshot;
    }
 }
@@ -82,8 +89,12 @@ private:
    void reconnect();
 
    void processUpdateCcSnapshot(const bs::tracker_server::Response_UpdateCcSnapshot &response);
+   void processUpdateCcSnapshotDelta(const bs::tracker_server::Response_UpdateCcSnapshotDelta &response);
    void processUpdateCcZcSnapshot(const bs::tracker_server::Response_UpdateCcZcSnapshot &response);
 
+   void sendAck(CcTrackerImpl *client);
+   void requestResync(CcTrackerImpl *client);
+
    std::shared_ptr<spdlog::logger> logger_;
    std::unique_ptr<ZmqBIP15XDataConnection> connection_;
 
@@ -102,6 +113,84 @@ private:
 
 };
 
+// Sends snapshot updates of one tracker to its clients: a delta from the
+// previous version to clients that are up to date, the full snapshot otherwise.
+// Not thread-safe, CcTrackerServer uses it from its dispatch thread only.
+class CcSnapshotPublisher
+{
+public:
+   struct Client
+   {
+      std::string clientId;
+      int id{};
+
+      bool operator<(const Client &other) const {
+         if (clientId != other.clientId) {
+            return clientId < other.clientId;
+         }
+         return id < other.id;
+      }
+   };
+
+   struct Stats
+   {
+      uint64_t updates{};
+      uint64_t fullSent{};
+      uint64_t fullBytes{};
+      uint64_t deltaSent{};
+      uint64_t deltaBytes{};
+      uint64_t zcSent{};
+      uint64_t zcBytes{};
+
+      uint64_t bytes() const { return fullBytes + deltaBytes + zcBytes; }
+   };
+
+   using SendCb = std::function<void(const std::string &clientId, const std::string &data)>;
+
+   explicit CcSnapshotPublisher(const SendCb &sendCb);
+
+   // Sends the current full and ZC snapshots to the new client
+   void addClient(const Client &client, bool deltaUpdates);
+   bool removeClient(const Client &client);
+   bool ack(const Client &client, uint64_t version);
+   bool resync(const Client &client);
+
+   // Returns false if the snapshot is the same as the last published one
+   bool publish(const std::shared_ptr<ColoredCoinSnapshot> &snapshot);
+   void publishZc(const std::shared_ptr<ColoredCoinZCSnapshot> &snapshot);
+
+   uint64_t version() const { return version_; }
+   size_t clientCount() const { return clients_.size(); }
+   const Stats &stats() const { return stats_; }
+
+private:
+   struct ClientState
+   {
+      bool deltaUpdates{false};
+      uint64_t sentVersion{};
+      uint64_t ackedVersion{};
+   };
+
+   const std::string &fullSnapshot();
+   size_t sendSnapshot(const Client &client, ClientState &state);
+   size_t sendSnapshotDelta(const Client &client, ClientState &state, uint64_t baseVersion, const std::string &delta);
+   size_t sendZcSnapshot(const Client &client);
+
+   SendCb sendCb_;
+
+   std::shared_ptr<ColoredCoinSnapshot> lastSnapshot_;
+   // Versions start from 1 (0 is reserved for servers without delta updates)
+   uint64_t version_{1};
+   // Full snapshot is serialized lazily as most clients expected to use deltas
+   std::string fullSnapshot_;
+   bool fullSnapshotValid_{true};
+   std::string zcSnapshot_;
+
+   std::map<Client, ClientState> clients_;
+   Stats stats_;
+
+};
+
 class CcTrackerServer : public ServerConnectionListener
 {
 public:
@@ -130,10 +219,17 @@ private:
    };
 
    void processRegisterCc(ClientData &client, const bs::tracker_server::Request_RegisterCc &request);
+   void processAckCcSnapshot(ClientData &client, const bs::tracker_server::Request_AckCcSnapshot &request);
+   void processResyncCc(ClientData &client, const bs::tracker_server::Request_ResyncCc &request);
+
+   void sendData(const std::string &clientId, const std::string &data);
 
    std::shared_ptr<spdlog::logger> logger_;
    std::shared_ptr<ArmoryConnection> armory_;
 
+   // Shared by all trackers to merge their per-block Armory queries
+   std::shared_ptr<ColoredCoinQueryBatcher> queryBatcher_;
+
    std::unique_ptr<ZmqBIP15XServerConnection> server_;
 
    std::map<std::string, ClientData> connectedClients_;
@@ -146,6 +242,9 @@ private:
 
    uint64_t startedTrackerCount_{};
 
+   // Snapshot updates sent to all clients by all trackers, dispatch thread only
+   uint64_t bytesSent_{};
+
 };
 
 #endif
@@ -23,6 +23,8 @@
 #include "ZmqHelperFunctions.h"
 
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <unordered_set>
 
 using namespace Blocksettle::Communication;
 using namespace bs::error;
@@ -393,7 +395,7 @@ bool HeadlessContainerListener::onSignTxRequest(const std::string &clientId, con
    }
 
    auto autoSignCategory = static_cast<bs::signer::AutoSignCategory>(dialogData.value<int>(PasswordDialogData::AutoSignCategory));
-   const bool autoSign = (autoSignCategory == bs::signer::AutoSignCategory::SettlementDealer) && isAutoSignActive(rootWalletId);
+   const bool autoSign = (autoSignCategory == bs::signer::AutoSignCategory::SettlementDealer) && checkAutoSignSession(rootWalletId);
 
    if (amount && !checkSpendLimit(amount, rootWalletId, autoSign)) {
       SignTXResponse(clientId, packet.id(), reqType, ErrorCode::TxSpendLimitExceed);
@@ -447,8 +449,22 @@ bool HeadlessContainerListener::onSignTxRequest(const std::string &clientId, con
             SignTXResponse(clientId, id, reqType, ErrorCode::MissingPassword);
             return;
          }
+         if (autoSign) {
+            takeAutoSign(rootWalletId);
+         }
+         const auto signStarted = std::chrono::steady_clock::now();
          if (wallets.size() == 1) {
             const auto wallet = wallets.front();
+            if (autoSign && !keepDuplicatedRecipients) {
+               // spend is reserved now and given back if signing fails
+               onXbtSpent(amount, autoSign);
+               if (pendingAutoSigns_.empty()) {
+                  queue_->dispatch([this] { signPendingAutoSigns(); });
+               }
+               pendingAutoSigns_.push_back({ clientId, id, reqType, rootWalletId, wallet
+                  , txSignReq, partial, amount, pass });
+               return;
+            }
             const bs::core::WalletPasswordScoped passLock(rootWallet, pass);
             const auto tx = partial ? wallet->signPartialTXRequest(txSignReq)
                : wallet->signTXRequest(txSignReq, keepDuplicatedRecipients);
@@ -488,6 +504,11 @@ bool HeadlessContainerListener::onSignTxRequest(const std::string &clientId, con
             SignTXResponse(clientId, id, reqType, ErrorCode::NoError, tx);
          }
 
+         if (autoSign) {
+            onAutoSigned(rootWalletId, std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - signStarted));
+         }
+
          onXbtSpent(amount, autoSign);
          if (callbacks_) {
             callbacks_->xbtSpent(amount, autoSign);
@@ -496,7 +517,7 @@ bool HeadlessContainerListener::onSignTxRequest(const std::string &clientId, con
       catch (const std::exception &e) {
          logger_->error("[HeadlessContainerListener] failed to sign {} TX request: {}", partial ? "partial" : "full", e.what());
          SignTXResponse(clientId, id, reqType, ErrorCode::InternalError);
-         passwords_.erase(rootWalletId);
+         autoSignSessions_.erase(rootWalletId);
       }
    };
 
@@ -586,11 +607,46 @@ bool HeadlessContainerListener::onSignMultiTXRequest(const std::string &clientId
    const auto cbOnAllPasswords = [this, txMultiReq, walletMap, clientId, reqType, id=packet.id()]
                                  (const std::unordered_map<std::string, SecureBinaryData> &walletPasswords) {
       try {
-         const auto wallet = walletsMgr_->getWalletById(walletPasswords.begin()->first);
-         const auto rootWallet = walletsMgr_->getHDRootForLeaf(wallet->walletId());
-         const bs::core::WalletPasswordScoped passLock(rootWallet, walletPasswords.begin()->second);
-         const auto tx = bs::core::SignMultiInputTX(txMultiReq, walletMap);
-         SignTXResponse(clientId, id, reqType, ErrorCode::NoError, tx);
+         if (txMultiReq.prevState.empty()) {
+            const auto wallet = walletsMgr_->getWalletById(walletPasswords.begin()->first);
+            const auto rootWallet = walletsMgr_->getHDRootForLeaf(wallet->walletId());
+            const bs::core::WalletPasswordScoped passLock(rootWallet, walletPasswords.begin()->second);
+            const auto tx = bs::core::SignMultiInputTX(txMultiReq, walletMap);
+            SignTXResponse(clientId, id, reqType, ErrorCode::NoError, tx);
+            return;
+         }
+
+         // each wallet signs its inputs of the signer state in parallel,
+         // partially signed states are then merged
+         bs::core::SignBatch batch;
+         std::vector<std::unique_ptr<bs::core::WalletPasswordScoped>> passLocks;
+         std::unordered_set<std::string> lockedRoots;
+         for (const auto &wallet : walletMap) {
+            const auto rootWallet = walletsMgr_->getHDRootForLeaf(wallet.first);
+            const auto itPass = walletPasswords.find(wallet.first);
+            if (rootWallet && (itPass != walletPasswords.end())
+               && lockedRoots.insert(rootWallet->walletId()).second) {
+               passLocks.push_back(std::make_unique<bs::core::WalletPasswordScoped>(rootWallet, itPass->second));
+            }
+            bs::core::wallet::TXSignRequest txReq;
+            txReq.walletIds = { wallet.first };
+            txReq.prevStates = { txMultiReq.prevState };
+            batch.push_back({ wallet.second, txReq });
+         }
+         const auto result = bs::core::SignTXRequests(batch, true);
+         passLocks.clear();
+
+         bs::CheckRecipSigner signer;
+         for (size_t i = 0; i < batch.size(); ++i) {
+            if (result.signedTXs[i].empty()) {
+               throw std::runtime_error("wallet " + batch[i].first->walletId() + ": " + result.errors[i]);
+            }
+            signer.deserializeState(result.signedTXs[i]);
+         }
+         if (!signer.verify()) {
+            throw std::logic_error("signer failed to verify");
+         }
+         SignTXResponse(clientId, id, reqType, ErrorCode::NoError, signer.serialize());
       }
       catch (const std::exception &e) {
          logger_->error("[HeadlessContainerListener] failed to sign multi TX request: {}", e.what());
@@ -816,12 +872,9 @@ bool HeadlessContainerListener::RequestPasswordIfNeeded(const std::string &clien
    bool autoSignAllowed = (autoSignCategory == bs::signer::AutoSignCategory::SettlementDealer);
 
    SecureBinaryData password;
-   if (autoSignAllowed && needPassword) {
-      const auto passwordIt = passwords_.find(rootId);
-      if (passwordIt != passwords_.end()) {
-         needPassword = false;
-         password = passwordIt->second;
-      }
+   if (autoSignAllowed && needPassword && checkAutoSignSession(rootId)) {
+      needPassword = false;
+      password = autoSignSessions_[rootId].password;
    }
 
    if (!needPassword) {
@@ -1748,7 +1801,17 @@ bs::error::ErrorCode HeadlessContainerListener::activateAutoSign(const std::stri
       return ErrorCode::InvalidPassword;
    }
 
-   passwords_[hdWallet->walletId()] = password;
+   AutoSignSession session;
+   session.password = password;
+   session.keys = std::make_shared<bs::core::wallet::KeyCache>();
+   session.wallet = hdWallet;
+   if (limits_.autoSignTimeS > 0) {
+      session.expiry = std::chrono::steady_clock::now() + std::chrono::seconds(limits_.autoSignTimeS);
+   }
+   if (limits_.autoSignMaxCount) {
+      session.signsLeft = limits_.autoSignMaxCount;
+   }
+   autoSignSessions_[hdWallet->walletId()] = std::move(session);
 
    // multicast event
    AutoSignActivatedEvent(ErrorCode::NoError, walletId);
@@ -1762,10 +1825,16 @@ bs::error::ErrorCode HeadlessContainerListener::deactivateAutoSign(const std::st
    logger_->info("Deactivate AutoSign for {} (error code: {})", walletId, static_cast<int>(reason));
 
    if (walletId.empty()) {
-      passwords_.clear();
+      autoSignSessions_.clear();
    }
    else {
-      passwords_.erase(walletId);
+      autoSignSessions_.erase(walletId);
+   }
+
+   if (autoSignStats_.signs) {
+      logger_->debug("[HeadlessContainerListener] auto-signed {} times, avg sign time {} us, max {} us"
+         , autoSignStats_.signs, autoSignStats_.totalSignTime.count() / autoSignStats_.signs
+         , autoSignStats_.maxSignTime.count());
    }
 
    // multicast event
@@ -1777,22 +1846,130 @@ bs::error::ErrorCode HeadlessContainerListener::deactivateAutoSign(const std::st
 bool HeadlessContainerListener::isAutoSignActive(const std::string &walletId) const
 {
    if (walletId.empty()) {
-      return !passwords_.empty();
+      return !autoSignSessions_.empty();
    }
-   if (passwords_.find(walletId) != passwords_.end()) {
+   if (autoSignSessions_.find(walletId) != autoSignSessions_.end()) {
       return true;
    }
    const auto &rootWallet = walletsMgr_->getHDRootForLeaf(walletId);
    if (!rootWallet) {
       return false;
    }
-   return (passwords_.find(rootWallet->walletId()) != passwords_.end());
+   return (autoSignSessions_.find(rootWallet->walletId()) != autoSignSessions_.end());
+}
+
+bool HeadlessContainerListener::checkAutoSignSession(const std::string &rootId)
+{
+   const auto itSession = autoSignSessions_.find(rootId);
+   if (itSession == autoSignSessions_.end()) {
+      return false;
+   }
+   const auto &session = itSession->second;
+   const auto wallet = session.wallet.lock();
+   if (!wallet || (wallet != walletsMgr_->getHDWalletById(rootId))) {
+      logger_->info("[HeadlessContainerListener::checkAutoSignSession] wallet {} was changed", rootId);
+      autoSignStats_.invalidated++;
+      deactivateAutoSign(rootId, ErrorCode::WalletNotFound);
+      return false;
+   }
+   if (!session.signsLeft || (std::chrono::steady_clock::now() >= session.expiry)) {
+      logger_->info("[HeadlessContainerListener::checkAutoSignSession] auto-sign for {} expired", rootId);
+      autoSignStats_.expired++;
+      deactivateAutoSign(rootId, ErrorCode::AutoSignDisabled);
+      return false;
+   }
+   return true;
+}
+
+void HeadlessContainerListener::takeAutoSign(const std::string &rootId)
+{
+   const auto itSession = autoSignSessions_.find(rootId);
+   if ((itSession != autoSignSessions_.end()) && (itSession->second.signsLeft != UINT64_MAX)) {
+      itSession->second.signsLeft--;
+   }
+}
+
+void HeadlessContainerListener::onAutoSigned(const std::string &rootId
+   , std::chrono::microseconds signTime)
+{
+   autoSignStats_.signs++;
+   autoSignStats_.totalSignTime += signTime;
+   autoSignStats_.maxSignTime = std::max(autoSignStats_.maxSignTime, signTime);
+}
+
+void HeadlessContainerListener::signPendingAutoSigns()
+{
+   const auto pending = std::move(pendingAutoSigns_);
+   pendingAutoSigns_.clear();
+
+   for (const bool partial : { false, true }) {
+      bs::core::SignBatch batch;
+      std::vector<const PendingAutoSign *> requests;
+      std::vector<std::unique_ptr<bs::core::WalletPasswordScoped>> passLocks;
+      std::unordered_set<std::string> lockedRoots;
+
+      for (const auto &req : pending) {
+         if (req.partial != partial) {
+            continue;
+         }
+         const auto rootWallet = walletsMgr_->getHDWalletById(req.rootWalletId);
+         const auto itSession = autoSignSessions_.find(req.rootWalletId);
+         if (!rootWallet || (itSession == autoSignSessions_.end())) {
+            logger_->error("[HeadlessContainerListener] auto-sign for {} was deactivated before signing"
+               , req.rootWalletId);
+            onXbtSpent(-static_cast<int64_t>(req.amount), true);
+            SignTXResponse(req.clientId, req.id, req.reqType, ErrorCode::AutoSignDisabled);
+            continue;
+         }
+         if (lockedRoots.insert(req.rootWalletId).second) {
+            passLocks.push_back(std::make_unique<bs::core::WalletPasswordScoped>(rootWallet, req.password));
+         }
+         req.wallet->setKeyCache(itSession->second.keys);
+         batch.push_back({ req.wallet, req.txSignReq });
+         requests.push_back(&req);
+      }
+      if (batch.empty()) {
+         continue;
+      }
+
+      const auto result = bs::core::SignTXRequests(batch, partial);
+      passLocks.clear();
+      for (const auto &req : requests) {
+         req->wallet->setKeyCache(nullptr);
+      }
+
+      const auto signTime = result.elapsed / static_cast<int64_t>(batch.size());
+      for (size_t i = 0; i < requests.size(); ++i) {
+         const auto &req = *requests[i];
+         if (result.signedTXs[i].empty()) {
+            logger_->error("[HeadlessContainerListener] failed to sign {} TX request: {}"
+               , partial ? "partial" : "full", result.errors[i]);
+            onXbtSpent(-static_cast<int64_t>(req.amount), true);
+            SignTXResponse(req.clientId, req.id, req.reqType, ErrorCode::InternalError);
+            autoSignSessions_.erase(req.rootWalletId);
+            continue;
+         }
+         SignTXResponse(req.clientId, req.id, req.reqType, ErrorCode::NoError, result.signedTXs[i]);
+         onAutoSigned(req.rootWalletId, signTime);
+         if (callbacks_) {
+            callbacks_->xbtSpent(req.amount, true);
+         }
+      }
+   }
 }
 
 void HeadlessContainerListener::walletsListUpdated()
 {
    logger_->debug("send WalletsListUpdatedType message");
 
+   std::vector<std::string> autoSignWalletIds;
+   for (const auto &session : autoSignSessions_) {
+      autoSignWalletIds.push_back(session.first);
+   }
+   for (const auto &walletId : autoSignWalletIds) {
+      checkAutoSignSession(walletId);
+   }
+
    headless::RequestPacket packet;
    packet.set_type(headless::WalletsListUpdatedType);
    sendData(packet.SerializeAsString());
@@ -2048,10 +2225,9 @@ bool HeadlessContainerListener::onExtAddrChain(const std::string &clientId, head
          }
 
          for (const auto &addr : newAddrVec) {
-            auto &&index = wallet->getAddressIndex(addr);
             auto addrData = response.add_addresses();
-            addrData->set_address(addr.display());
-            addrData->set_index(index);
+            addrData->set_address(addr.first.display());
+            addrData->set_index(addr.second);
          }
       }
       catch (const std::exception &e) {
@@ -122,6 +122,16 @@ public:
    // once they are ready
    void syncWallet();
 
+   struct AutoSignStats
+   {
+      uint64_t signs{};
+      std::chrono::microseconds  totalSignTime{};
+      std::chrono::microseconds  maxSignTime{};
+      uint64_t expired{};        // by time or count limit
+      uint64_t invalidated{};    // wallet was changed or removed
+   };
+   AutoSignStats autoSignStats() const { return autoSignStats_; }
+
 protected:
    bool isAutoSignActive(const std::string &walletId) const;
 
@@ -204,6 +214,13 @@ private:
 
    bool checkSpendLimit(uint64_t value, const std::string &walletId, bool autoSign);
 
+   // Returns false and deactivates auto-sign if session timed out, used up
+   // its sign count or its wallet has changed
+   bool checkAutoSignSession(const std::string &rootId);
+   void takeAutoSign(const std::string &rootId);
+   void onAutoSigned(const std::string &rootId, std::chrono::microseconds signTime);
+   void signPendingAutoSigns();
+
    void sendUpdateStatuses(std::string clientId = {});
 
    void sendSyncWallets(std::string clientId = {});
@@ -218,9 +235,37 @@ private:
    bs::signer::Limits                  limits_;
    std::unordered_set<std::string>     connectedClients_;
 
-   std::unordered_map<std::string, SecureBinaryData>                 passwords_;
+   // Opt-in bounds are set by limits_ autoSignTimeS and autoSignMaxCount.
+   // Private keys decrypted by auto-signing are kept in keys until the session
+   // ends, so only keys not used before in the session are decrypted again.
+   struct AutoSignSession
+   {
+      SecureBinaryData  password;
+      std::shared_ptr<bs::core::wallet::KeyCache>  keys;
+      std::weak_ptr<bs::core::hd::Wallet>    wallet;
+      std::chrono::steady_clock::time_point  expiry{ std::chrono::steady_clock::time_point::max() };
+      uint64_t          signsLeft{ UINT64_MAX };
+   };
+   std::unordered_map<std::string, AutoSignSession>   autoSignSessions_;  // key is root wallet id
+   AutoSignStats                                      autoSignStats_;
    //std::unordered_set<std::string>  autoSignPwdReqs_;
 
+   // Auto-sign requests that arrive before signPendingAutoSigns() runs on
+   // the queue are signed together with bs::core::SignTXRequests()
+   struct PendingAutoSign
+   {
+      std::string    clientId;
+      unsigned int   id{};
+      Blocksettle::Communication::headless::RequestType reqType{};
+      std::string    rootWalletId;
+      std::shared_ptr<bs::core::hd::Leaf> wallet;
+      bs::core::wallet::TXSignRequest     txSignReq;
+      bool           partial{};
+      uint64_t       amount{};
+      SecureBinaryData  password;
+   };
+   std::vector<PendingAutoSign>  pendingAutoSigns_;
+
    std::vector<PasswordRequest> deferredPasswordRequests_;
    bool deferredDialogRunning_ = false;
 
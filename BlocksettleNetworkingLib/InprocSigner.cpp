@@ -514,13 +514,7 @@ void InprocSigner::extendAddressChain(
       return;
    }
 
-   auto&& newAddrVec = wallet->extendAddressChain(count, extInt);
-   for (auto& addr : newAddrVec) {
-      auto&& index = wallet->getAddressIndex(addr);
-      auto addrPair = std::make_pair(addr, index);
-      result.emplace_back(addrPair);
-   }
-
+   result = wallet->extendAddressChain(count, extInt);
    cb(result);
 }
 
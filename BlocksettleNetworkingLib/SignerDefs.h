@@ -37,8 +37,9 @@ namespace signer {
    struct Limits {
       uint64_t    autoSignSpendXBT = UINT64_MAX;
       uint64_t    manualSpendXBT = UINT64_MAX;
-      int         autoSignTimeS = 0;
+      int         autoSignTimeS = 0;           // 0 - until deactivated
       int         manualPassKeepInMemS = 0;
+      uint64_t    autoSignMaxCount = 0;        // 0 - unlimited
 
       Limits() {}
       Limits(uint64_t asXbt, uint64_t manXbt, int asTime, int manPwTime)
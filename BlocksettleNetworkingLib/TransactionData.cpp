@@ -16,6 +16,7 @@
 #include "SelectedTransactionInputs.h"
 #include "ScriptRecipient.h"
 #include "RecipientContainer.h"
+#include "UtxoSelector.h"
 #include "Wallets/SyncHDGroup.h"
 #include "Wallets/SyncWallet.h"
 #include "Wallets/SyncWalletsManager.h"
@@ -68,6 +69,7 @@ bool TransactionData::setWallet(const std::shared_ptr<bs::sync::Wallet> &wallet
          , std::vector<AddressBookEntry>{}
       , static_cast<uint64_t>(wallet->getSpendableBalance() * BTCNumericTypes::BalanceDivider)
          , topBlock);
+      utxoSelector_ = std::make_shared<bs::UtxoSelector>();
       InvalidateTransactionData();
    }
    else if (resetInputs) {
@@ -116,6 +118,7 @@ bool TransactionData::setGroup(const std::shared_ptr<bs::sync::hd::Group> &group
          , std::vector<AddressBookEntry>{}
          , static_cast<uint64_t>(spendableBalance * BTCNumericTypes::BalanceDivider)
          , topBlock);
+      utxoSelector_ = std::make_shared<bs::UtxoSelector>();
       InvalidateTransactionData();
    } else if (resetInputs) {
       if (selectedInputs_) {
@@ -162,6 +165,7 @@ bool TransactionData::setWalletAndInputs(const std::shared_ptr<bs::sync::Wallet>
       , std::vector<AddressBookEntry>{}
    , static_cast<uint64_t>(wallet->getSpendableBalance() * BTCNumericTypes::BalanceDivider)
       , topBlock);
+   utxoSelector_ = std::make_shared<bs::UtxoSelector>();
    InvalidateTransactionData();
    return true;
 }
@@ -241,23 +245,25 @@ bool TransactionData::UpdateTransactionData()
          summary_.selectedBalance = availableBalance / BTCNumericTypes::BalanceDivider;
       } else if (selectedInputs_->UseAutoSel()) {
          UtxoSelection selection;
-         try {
-            selection = coinSelection_->getUtxoSelectionForRecipients(payment
-               , transactions);
-         } catch (const std::runtime_error &err) {
-            if (logger_) {
-               logger_->error("UpdateTransactionData (auto-selection) - coinSelection exception: {}"
-                  , err.what());
-            }
-            return false;
-         } catch (...) {
-            if (logger_) {
-               logger_->error("UpdateTransactionData (auto-selection) - coinSelection exception");
+         if (!selectUtxos(transactions, payment, totalFee, selection)) {
+            try {
+               selection = coinSelection_->getUtxoSelectionForRecipients(payment
+                  , transactions);
+            } catch (const std::runtime_error &err) {
+               if (logger_) {
+                  logger_->error("UpdateTransactionData (auto-selection) - coinSelection exception: {}"
+                     , err.what());
+               }
+               return false;
+            } catch (...) {
+               if (logger_) {
+                  logger_->error("UpdateTransactionData (auto-selection) - coinSelection exception");
+               }
+               return false;
             }
-            return false;
+            usedUTXO_ = selection.utxoVec_;
          }
 
-         usedUTXO_ = selection.utxoVec_;
          summary_.txVirtSize = getVirtSize(selection);
          summary_.totalFee = selection.fee_;
          summary_.feePerByte = selection.fee_byte_;
@@ -476,6 +482,32 @@ UtxoSelection TransactionData::computeSizeAndFee(const std::vector<UTXO>& inUTXO
    return selection;
 }
 
+// Native auto-selection of inputs (see bs::UtxoSelector), size and fee of the
+// selected inputs are then computed by Armory as for manual selection.
+// RET: false if no input set was found - Armory's coin selection should be
+//      used then.
+bool TransactionData::selectUtxos(const std::vector<UTXO> &utxos
+   , const PaymentStruct &payment, uint64_t totalFee, UtxoSelection &selection) const
+{
+   if (!utxoSelector_) {
+      return false;
+   }
+   utxoSelector_->setUtxos(utxos);
+
+   bs::UtxoSelector::Params params;
+   params.target = payment.spendVal_;
+   params.feePerByte = totalFee ? 0 : feePerByte_;
+   params.totalFee = totalFee;
+   params.txOutSize = payment.size_;
+   const auto result = utxoSelector_->select(params);
+   if (!result.valid) {
+      return false;
+   }
+   selection = computeSizeAndFee(result.utxos, payment);
+   // Size estimates differ from Armory's - let it select then
+   return (selection.value_ >= payment.spendVal_ + selection.fee_);
+}
+
 // A temporary private function that calculates the virtual size of an incoming
 // UtxoSelection object. This needs to be removed when a particular PR
 // (https://github.com/goatpig/BitcoinArmory/pull/538) is accepted upstream.
@@ -25,6 +25,7 @@ namespace spdlog {
    class logger;
 }
 namespace bs {
+   class UtxoSelector;
    namespace sync {
       namespace hd {
          class Group;
@@ -145,6 +146,8 @@ private:
    std::vector<UTXO> decorateUTXOs() const;
    UtxoSelection computeSizeAndFee(const std::vector<UTXO>& inUTXOs
       , const PaymentStruct& inPS) const;
+   bool selectUtxos(const std::vector<UTXO> &, const PaymentStruct &
+      , uint64_t totalFee, UtxoSelection &) const;
 
    // Temporary function until some Armory changes are accepted upstream.
    size_t getVirtSize(const UtxoSelection& inUTXOSel) const;
@@ -167,6 +170,7 @@ private:
    unsigned int nextId_;
    std::unordered_map<unsigned int, std::shared_ptr<RecipientContainer>> recipients_;
    std::shared_ptr<CoinSelection>   coinSelection_;
+   std::shared_ptr<bs::UtxoSelector>   utxoSelector_;
 
    mutable std::vector<UTXO>  usedUTXO_;
    TransactionSummary   summary_;
@@ -0,0 +1,253 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "SyncBalanceScheduler.h"
+
+#include <algorithm>
+#include <set>
+#include <spdlog/spdlog.h>
+
+using namespace bs::sync;
+
+BalanceScheduler::BalanceScheduler(const std::shared_ptr<spdlog::logger> &logger
+   , const std::shared_ptr<ArmoryConnection> &armory
+   , std::chrono::milliseconds flushWindow, std::chrono::milliseconds maxDelay)
+   : logger_(logger)
+   , armory_(armory)
+   , flushWindow_(flushWindow)
+   , maxDelay_(std::max(flushWindow, maxDelay))
+{
+   processThread_ = std::thread(&BalanceScheduler::processThreadFunc, this);
+}
+
+BalanceScheduler::~BalanceScheduler()
+{
+   validityFlag_.reset();
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+   }
+   cv_.notify_one();
+   processThread_.join();
+}
+
+bool BalanceScheduler::isReady() const
+{
+   return (armory_ && (armory_->state() == ArmoryState::Ready));
+}
+
+bool BalanceScheduler::getCombinedBalances(const std::vector<std::string> &walletIds
+   , const BalancesCb &cb)
+{
+   if (!isReady()) {
+      return false;
+   }
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pendingBalances_.push_back({ walletIds, cb, std::chrono::steady_clock::now() });
+      requests_++;
+   }
+   cv_.notify_one();
+   return true;
+}
+
+bool BalanceScheduler::getCombinedTxNs(const std::vector<std::string> &walletIds
+   , const CountsCb &cb)
+{
+   if (!isReady()) {
+      return false;
+   }
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pendingCounts_.push_back({ walletIds, cb, std::chrono::steady_clock::now() });
+      requests_++;
+   }
+   cv_.notify_one();
+   return true;
+}
+
+BalanceScheduler::Stats BalanceScheduler::stats() const
+{
+   Stats result;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      result.requests = requests_;
+      result.armoryRequests = armoryRequests_;
+   }
+   result.latency = latency_.summary();
+   return result;
+}
+
+void BalanceScheduler::processThreadFunc()
+{
+   while (true) {
+      std::vector<BalancesRequest> balances;
+      std::vector<CountsRequest> counts;
+      {
+         std::unique_lock<std::mutex> lock(mutex_);
+         cv_.wait(lock, [this] {
+            return quit_ || (pendingCount() > 0);
+         });
+         if (quit_) {
+            break;
+         }
+
+         // Keep collecting while wallets are still reporting in, a burst of
+         // Armory notifications usually hits all registered wallets at once
+         const auto hardDeadline = std::chrono::steady_clock::now() + maxDelay_;
+         while (!quit_) {
+            const auto count = pendingCount();
+            const auto deadline = std::min(std::chrono::steady_clock::now() + flushWindow_, hardDeadline);
+            const bool updated = cv_.wait_until(lock, deadline, [this, count] {
+               return quit_ || (pendingCount() != count);
+            });
+            if (!updated || (std::chrono::steady_clock::now() >= hardDeadline)) {
+               break;
+            }
+         }
+         if (quit_) {
+            break;
+         }
+
+         balances.swap(pendingBalances_);
+         counts.swap(pendingCounts_);
+      }
+
+      SPDLOG_LOGGER_TRACE(logger_, "[BalanceScheduler] flushing {} balance and {} txn count requests"
+         , balances.size(), counts.size());
+      if (!balances.empty()) {
+         sendBalances(std::move(balances));
+      }
+      if (!counts.empty()) {
+         sendCounts(std::move(counts));
+      }
+   }
+}
+
+template <typename ResultT, typename CbT>
+void BalanceScheduler::deliver(const std::map<std::string, ResultT> &result
+   , const std::vector<Request<CbT>> &requests)
+{
+   const auto now = std::chrono::steady_clock::now();
+   for (const auto &request : requests) {
+      std::map<std::string, ResultT> walletResult;
+      for (const auto &walletId : request.walletIds) {
+         const auto itResult = result.find(walletId);
+         if (itResult != result.end()) {
+            walletResult.emplace(itResult->first, itResult->second);
+         }
+      }
+      if (request.cb) {
+         request.cb(walletResult);
+      }
+   }
+
+   for (const auto &request : requests) {
+      latency_.add(std::chrono::duration_cast<std::chrono::microseconds>(now - request.queued)
+         , request.walletIds.size());
+   }
+}
+
+namespace {
+   template <typename RequestT>
+   std::vector<std::string> mergeWalletIds(const std::vector<RequestT> &requests)
+   {
+      std::set<std::string> walletIds;
+      for (const auto &request : requests) {
+         walletIds.insert(request.walletIds.cbegin(), request.walletIds.cend());
+      }
+      return { walletIds.cbegin(), walletIds.cend() };
+   }
+}  // namespace
+
+void BalanceScheduler::sendBalances(std::vector<BalancesRequest> requests)
+{
+   const auto walletIds = mergeWalletIds(requests);
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      armoryRequests_++;
+   }
+   const auto requestsPtr = std::make_shared<std::vector<BalancesRequest>>(std::move(requests));
+   const auto &cb = [this, requestsPtr, handle = validityFlag_.handle()]
+      (const std::map<std::string, CombinedBalances> &balances) mutable
+   {
+      ValidityGuard lock(handle);
+      if (!handle.isValid()) {
+         return;
+      }
+      if (balances.empty() && (requestsPtr->size() > 1)) {
+         sendSeparately(*requestsPtr, &ArmoryConnection::getCombinedBalances);
+         return;
+      }
+      deliver(balances, *requestsPtr);
+   };
+   if (!armory_->getCombinedBalances(walletIds, cb)) {
+      SPDLOG_LOGGER_ERROR(logger_, "[BalanceScheduler::sendBalances] failed to request balances for {} wallets"
+         " ({} requests)", walletIds.size(), requestsPtr->size());
+      deliver(std::map<std::string, CombinedBalances>{}, *requestsPtr);
+   }
+}
+
+void BalanceScheduler::sendCounts(std::vector<CountsRequest> requests)
+{
+   const auto walletIds = mergeWalletIds(requests);
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      armoryRequests_++;
+   }
+   const auto requestsPtr = std::make_shared<std::vector<CountsRequest>>(std::move(requests));
+   const auto &cb = [this, requestsPtr, handle = validityFlag_.handle()]
+      (const std::map<std::string, CombinedCounts> &counts) mutable
+   {
+      ValidityGuard lock(handle);
+      if (!handle.isValid()) {
+         return;
+      }
+      if (counts.empty() && (requestsPtr->size() > 1)) {
+         sendSeparately(*requestsPtr, &ArmoryConnection::getCombinedTxNs);
+         return;
+      }
+      deliver(counts, *requestsPtr);
+   };
+   if (!armory_->getCombinedTxNs(walletIds, cb)) {
+      SPDLOG_LOGGER_ERROR(logger_, "[BalanceScheduler::sendCounts] failed to request txn counts for {} wallets"
+         " ({} requests)", walletIds.size(), requestsPtr->size());
+      deliver(std::map<std::string, CombinedCounts>{}, *requestsPtr);
+   }
+}
+
+template <typename ResultT>
+void BalanceScheduler::sendSeparately(const std::vector<Request<std::function<void(const std::map<std::string, ResultT> &)>>> &requests
+   , bool (ArmoryConnection::*send)(const std::vector<std::string> &
+      , const std::function<void(const std::map<std::string, ResultT> &)> &))
+{
+   using RequestT = Request<std::function<void(const std::map<std::string, ResultT> &)>>;
+   SPDLOG_LOGGER_WARN(logger_, "[BalanceScheduler::sendSeparately] merged request failed, resending {} requests"
+      , requests.size());
+   for (const auto &request : requests) {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         armoryRequests_++;
+      }
+      const std::vector<RequestT> single{ request };
+      const auto &cb = [this, single, handle = validityFlag_.handle()]
+         (const std::map<std::string, ResultT> &result) mutable
+      {
+         ValidityGuard lock(handle);
+         if (!handle.isValid()) {
+            return;
+         }
+         deliver(result, single);
+      };
+      if (!(armory_.get()->*send)(request.walletIds, cb)) {
+         deliver(std::map<std::string, ResultT>{}, single);
+      }
+   }
+}
@@ -0,0 +1,124 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+
+#ifndef BS_SYNC_BALANCE_SCHEDULER_H
+#define BS_SYNC_BALANCE_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ArmoryConnection.h"
+#include "LatencyStats.h"
+#include "ValidityFlag.h"
+
+namespace spdlog {
+   class logger;
+}
+
+namespace bs {
+   namespace sync {
+
+      // Debounces balance and txn count refreshes requested by separate wallets:
+      // requests arriving within the flush window are merged into a single
+      // getCombinedBalances/getCombinedTxNs call and the results are split back
+      // per requester. Window is extended while new requests keep arriving, but
+      // not longer than maxDelay after the first one. If a merged request fails,
+      // its requests are resent separately, so that one failing wallet doesn't
+      // stall refreshes of the others. Failed requests receive an empty result.
+      class BalanceScheduler
+      {
+      public:
+         using BalancesCb = std::function<void(const std::map<std::string, CombinedBalances> &)>;
+         using CountsCb = std::function<void(const std::map<std::string, CombinedCounts> &)>;
+
+         struct Stats
+         {
+            // Refresh requests received from wallets
+            uint64_t requests{};
+            // Combined requests sent to Armory
+            uint64_t armoryRequests{};
+            // Time from the request to delivery of its result
+            LatencyStats::Summary   latency;
+
+            uint64_t requestsSaved() const
+            {
+               return (requests > armoryRequests) ? requests - armoryRequests : 0;
+            }
+         };
+
+         BalanceScheduler(const std::shared_ptr<spdlog::logger> &
+            , const std::shared_ptr<ArmoryConnection> &
+            , std::chrono::milliseconds flushWindow = std::chrono::milliseconds(30)
+            , std::chrono::milliseconds maxDelay = std::chrono::milliseconds(200));
+         ~BalanceScheduler();
+
+         BalanceScheduler(const BalanceScheduler&) = delete;
+         BalanceScheduler& operator = (const BalanceScheduler&) = delete;
+
+         // Thread-safe. Return false if Armory is not ready, callbacks are invoked
+         // from Armory thread with results for requested wallet IDs only.
+         bool getCombinedBalances(const std::vector<std::string> &walletIds, const BalancesCb &);
+         bool getCombinedTxNs(const std::vector<std::string> &walletIds, const CountsCb &);
+
+         Stats stats() const;
+
+      private:
+         template <typename CbT> struct Request
+         {
+            std::vector<std::string>   walletIds;
+            CbT   cb;
+            std::chrono::steady_clock::time_point  queued;
+         };
+         using BalancesRequest = Request<BalancesCb>;
+         using CountsRequest = Request<CountsCb>;
+
+         bool isReady() const;
+         size_t pendingCount() const { return pendingBalances_.size() + pendingCounts_.size(); }
+         void processThreadFunc();
+         void sendBalances(std::vector<BalancesRequest>);
+         void sendCounts(std::vector<CountsRequest>);
+         template <typename ResultT>
+         void sendSeparately(const std::vector<Request<std::function<void(const std::map<std::string, ResultT> &)>>> &
+            , bool (ArmoryConnection::*send)(const std::vector<std::string> &
+               , const std::function<void(const std::map<std::string, ResultT> &)> &));
+
+         template <typename ResultT, typename CbT>
+         void deliver(const std::map<std::string, ResultT> &, const std::vector<Request<CbT>> &);
+
+         std::shared_ptr<spdlog::logger>     logger_;
+         std::shared_ptr<ArmoryConnection>   armory_;
+         const std::chrono::milliseconds     flushWindow_;
+         const std::chrono::milliseconds     maxDelay_;
+
+         mutable std::mutex         mutex_;
+         std::condition_variable    cv_;
+         std::vector<BalancesRequest>  pendingBalances_;
+         std::vector<CountsRequest>    pendingCounts_;
+         bool     quit_{ false };
+         uint64_t requests_{};
+         uint64_t armoryRequests_{};
+         LatencyStats   latency_;
+
+         std::thread    processThread_;
+         ValidityFlag   validityFlag_;
+      };
+
+   }  //namespace sync
+}  //namespace bs
+
+#endif // BS_SYNC_BALANCE_SCHEDULER_H
@@ -45,53 +45,31 @@ hd::Leaf::~Leaf()
 
 void hd::Leaf::synchronize(const std::function<void()> &cbDone)
 {
-   const auto &cbProcess = [this, cbDone, handle = validityFlag_.handle()]
+   synchronize(cbDone, nullptr);
+}
+
+void hd::Leaf::synchronize(const std::function<void()> &cbDone, const std::function<void()> &cbFailed)
+{
+   const auto &cbProcess = [this, cbDone, cbFailed, handle = validityFlag_.handle()]
       (bs::sync::WalletData data) mutable
    {
       // Do not lock handle here as this could cause deadlocks!
       // hd::Leaf is destroyed and this callback is called on same thread (main thread) and so it's OK.
       if (!handle.isValid()) {
+         if (cbFailed) {
+            cbFailed();
+         }
          return;
       }
-      reset();
-
-      if (wct_) {
-         wct_->metadataChanged(walletId());
+      try {
+         applySyncData(data);
+         storeSyncData(data);
       }
-
-      if (data.highestExtIndex == UINT32_MAX ||
-         data.highestIntIndex == UINT32_MAX)
-         throw WalletException("unintialized addr chain use index");
-
-      lastExtIdx_ = data.highestExtIndex;
-      lastIntIdx_ = data.highestIntIndex;
-
-      logger_->debug("[sync::hd::Leaf::synchronize] {}: last indices {}+{}={} address[es]"
-         , walletId(), lastExtIdx_, lastIntIdx_, data.addresses.size());
-      for (const auto &addr : data.addresses) {
-         addAddress(addr.address, addr.index, false);
-         setAddressComment(addr.address, addr.comment, false);
-      }
-
-      {
-         FastLock locker{addressPoolLock_};
-         for (const auto &addr : data.addrPool) {
-            //addPool normally won't contain comments
-            const auto path = bs::hd::Path::fromString(addr.index);
-            auto type = path.get(-2);
-            auto index = path.get(-1);
-            addressPool_[{ path }] = addr.address;
-            poolByAddr_[addr.address] = { path };
-            if (type == addrTypeExternal) {
-               lastPoolExtIdx_ = std::max(lastPoolExtIdx_, index);
-            } else {
-               lastPoolIntIdx_ = std::max(lastPoolIntIdx_, index);
-            }
+      catch (...) {
+         if (cbFailed) {
+            cbFailed();
          }
-      }
-
-      for (const auto &txComment : data.txComments) {
-         setTransactionComment(txComment.txHash, txComment.comment, false);
+         throw;
       }
 
       if (cbDone)
@@ -101,6 +79,118 @@ void hd::Leaf::synchronize(const std::function<void()> &cbDone)
    signContainer_->syncWallet(walletId(), cbProcess);
 }
 
+void hd::Leaf::applySyncData(const bs::sync::WalletData &data)
+{
+   // Leaf restored from snapshot gets only the changes since the snapshot
+   if (syncDataFromSnapshot_.exchange(false) && applySyncDataDiff(data)) {
+      return;
+   }
+   reset();
+
+   if (wct_) {
+      wct_->metadataChanged(walletId());
+   }
+
+   if (data.highestExtIndex == UINT32_MAX ||
+      data.highestIntIndex == UINT32_MAX)
+      throw WalletException("unintialized addr chain use index");
+
+   lastExtIdx_ = data.highestExtIndex;
+   lastIntIdx_ = data.highestIntIndex;
+
+   logger_->debug("[sync::hd::Leaf::synchronize] {}: last indices {}+{}={} address[es]"
+      , walletId(), lastExtIdx_, lastIntIdx_, data.addresses.size());
+   for (const auto &addr : data.addresses) {
+      addAddress(addr.address, addr.index, false);
+      setAddressComment(addr.address, addr.comment, false);
+   }
+
+   applyAddressPool(data.addrPool);
+
+   for (const auto &txComment : data.txComments) {
+      setTransactionComment(txComment.txHash, txComment.comment, false);
+   }
+}
+
+bool hd::Leaf::applySyncDataDiff(const bs::sync::WalletData &data)
+{
+   if (data.highestExtIndex == UINT32_MAX ||
+      data.highestIntIndex == UINT32_MAX) {
+      return false;
+   }
+
+   // All restored addresses must be known to signer at the same paths,
+   // otherwise the leaf is rebuilt from scratch
+   std::vector<const AddressData *> newAddresses;
+   size_t nbKnown = 0;
+   for (const auto &addr : data.addresses) {
+      const auto itIndex = addrToIndex_.find(addr.address.unprefixed());
+      if (itIndex == addrToIndex_.end()) {
+         newAddresses.push_back(&addr);
+      }
+      else if (itIndex->second.path == bs::hd::Path::fromString(addr.index)) {
+         nbKnown++;
+      }
+      else {
+         return false;
+      }
+   }
+   if (nbKnown != (extAddresses_.size() + intAddresses_.size())) {
+      return false;
+   }
+
+   if (wct_) {
+      wct_->metadataChanged(walletId());
+   }
+   lastExtIdx_ = std::max(lastExtIdx_, data.highestExtIndex);
+   lastIntIdx_ = std::max(lastIntIdx_, data.highestIntIndex);
+
+   logger_->debug("[sync::hd::Leaf::synchronize] {}: {} new address[es] since snapshot"
+      , walletId(), newAddresses.size());
+   for (const auto &addr : newAddresses) {
+      addAddress(addr->address, addr->index, false);
+   }
+   for (const auto &addr : data.addresses) {
+      setAddressComment(addr.address, addr.comment, false);
+   }
+
+   applyAddressPool(data.addrPool);
+
+   for (const auto &txComment : data.txComments) {
+      setTransactionComment(txComment.txHash, txComment.comment, false);
+   }
+   return true;
+}
+
+void hd::Leaf::applyAddressPool(const std::vector<AddressData> &addrPool)
+{
+   std::vector<bs::Address> poolAddresses;
+   poolAddresses.reserve(addrPool.size());
+   {
+      FastLock locker{addressPoolLock_};
+      for (const auto &addr : addrPool) {
+         //addPool normally won't contain comments
+         const auto path = bs::hd::Path::fromString(addr.index);
+         auto type = path.get(-2);
+         auto index = path.get(-1);
+         const bool isNew = (poolByAddr_.find(addr.address) == poolByAddr_.end());
+         addressPool_[{ path }] = addr.address;
+         poolByAddr_[addr.address] = { path };
+         if (isNew) {
+            poolAddresses.push_back(addr.address);
+         }
+         if (type == addrTypeExternal) {
+            lastPoolExtIdx_ = std::max(lastPoolExtIdx_, index);
+         } else {
+            lastPoolIntIdx_ = std::max(lastPoolIntIdx_, index);
+         }
+      }
+   }
+   if (wct_ && !poolAddresses.empty()) {
+      wct_->addressesAdded(walletId(), poolAddresses);
+   }
+}
+
 void hd::Leaf::setPath(const bs::hd::Path &path)
 {
    if (path != path_) {
@@ -322,6 +412,7 @@ void hd::Leaf::reset()
       wct_->walletReset(walletId());
    }
    unconfTgtRegIds_.clear();
+   dropHistoryStream();
 }
 
 const std::string& hd::Leaf::walletId() const
@@ -482,6 +573,12 @@ std::vector<std::string> hd::Leaf::registerWallet(
       logger_->debug("[sync::hd::Leaf::registerWallet] registered {}+{} addresses in {}, {} regIds {} {}"
          , addrsExt.size(), addrsInt.size(), walletId(), regIds.size()
          , regIdExt_, regIdInt_);
+      if (isExtOnly_) {
+         addArmoryRoutes({ walletId() }, regIds);
+      }
+      else {
+         addArmoryRoutes({ walletId(), walletIdInt() }, regIds);
+      }
       return regIds;
    }
    return {};
@@ -498,6 +595,7 @@ void hd::Leaf::unregisterWallet()
          btcWalletInt_->unregister();
       }
    }
+   dropHistoryStream();
    bs::sync::Wallet::unregisterWallet();
 }
 
@@ -590,12 +688,18 @@ void hd::Leaf::topUpAddressPool(bool extInt, const std::function<void()> &cb)
       with the DB, which is why they are only saved in the pool.
       ***/
 
+      std::vector<bs::Address> poolAddresses;
+      poolAddresses.reserve(addrVec.size());
       for (const auto &addrPair : addrVec) {
          const auto path = bs::hd::Path::fromString(addrPair.second);
 
          FastLock locker{addressPoolLock_};
          addressPool_[{ path }] = addrPair.first;
          poolByAddr_[addrPair.first] = { path };
+         poolAddresses.push_back(addrPair.first);
+      }
+      if (wct_ && !poolAddresses.empty()) {
+         wct_->addressesAdded(walletId(), poolAddresses);
       }
 
       //register new addresses with db
@@ -609,11 +713,13 @@ void hd::Leaf::topUpAddressPool(bool extInt, const std::function<void()> &cb)
             std::unique_lock<std::mutex> lock(regMutex_);
             const auto regId = btcWallet_->registerAddresses(addrHashes, true);
             refreshCallbacks_[regId] = cb;
+            addArmoryRoutes({}, { regId });
          }
          else {
             std::unique_lock<std::mutex> lock(regMutex_);
             const auto regId = btcWalletInt_->registerAddresses(addrHashes, true);
             refreshCallbacks_[regId] = cb;
+            addArmoryRoutes({}, { regId });
          }
          registeredAddresses_.insert(addrHashes.begin(), addrHashes.end());
          return;
@@ -868,13 +974,70 @@ BTCNumericTypes::balance_type hd::Leaf::getSpendableBalance() const
 bool hd::Leaf::getHistoryPage(uint32_t id, std::function<void(const Wallet *wallet
    , std::vector<ClientClasses::LedgerEntry>)> cb, bool onlyNew) const
 {
-   auto cbCnt = std::make_shared<std::atomic_uint>(0);
-   auto result = std::make_shared<std::vector<ClientClasses::LedgerEntry>>();
-   const auto &cbWrap = [this, cb, cbCnt, result](const Wallet *wallet
+   if (!isBalanceAvailable()) {
+      return false;
+   }
+   if (onlyNew) {
+      return fetchHistoryPage(id, cb, onlyNew);
+   }
+
+   std::shared_ptr<HistoryStream> stream;
+   {
+      std::lock_guard<std::mutex> lock(historyStreamMutex_);
+      if (!historyStream_) {
+         historyStream_ = historyStream();
+      }
+      stream = historyStream_;
+   }
+   return stream->getPage(id, [this, cb, handle = validityFlag_.handle()]
+      (const HistoryStream::PagePtr &page) mutable
+   {
+      ValidityGuard lock(handle);
+      if (!handle.isValid()) {
+         return;
+      }
+      if (page) {
+         cb(this, *page);
+      }
+      else {
+         cb(nullptr, {});
+      }
+   });
+}
+
+bool hd::Leaf::fetchHistoryPage(uint32_t id, std::function<void(const Wallet *wallet
+   , std::vector<ClientClasses::LedgerEntry>)> cb, bool onlyNew) const
+{
+   struct MergedPage
+   {
+      std::mutex  mutex;
+      unsigned int nbPending;
+      bool        failed{ false };
+      std::vector<ClientClasses::LedgerEntry>   entries;
+   };
+   auto merged = std::make_shared<MergedPage>();
+   merged->nbPending = isExtOnly_ ? 1 : 2;
+
+   const auto &cbWrap = [cb, merged](const Wallet *wallet
       , std::vector<ClientClasses::LedgerEntry> entries) {
-      result->insert(result->end(), entries.begin(), entries.end());
-      if (isExtOnly_ || (cbCnt->fetch_add(1) > 0)) {
-         cb(wallet, *result);
+      {
+         std::lock_guard<std::mutex> lock(merged->mutex);
+         if (wallet) {
+            merged->entries.insert(merged->entries.end(), entries.begin(), entries.end());
+         }
+         else {
+            merged->failed = true;
+         }
+         if (--merged->nbPending > 0) {
+            return;
+         }
+      }
+      // Failure of either part fails the whole page
+      if (merged->failed) {
+         cb(nullptr, {});
+      }
+      else {
+         cb(wallet, std::move(merged->entries));
       }
    };
    bool rc = Wallet::getHistoryPage(btcWallet_, id, cbWrap, onlyNew);
@@ -884,6 +1047,50 @@ bool hd::Leaf::getHistoryPage(uint32_t id, std::function<void(const Wallet *wall
    return rc;
 }
 
+std::shared_ptr<HistoryStream> hd::Leaf::historyStream(size_t prefetchPages, size_t maxCachedPages) const
+{
+   const auto &fetcher = [this, handle = validityFlag_.handle()]
+      (uint32_t id, const HistoryStream::PageCb &cb) mutable -> bool
+   {
+      ValidityGuard lock(handle);
+      if (!handle.isValid()) {
+         return false;
+      }
+      return fetchHistoryPage(id, [cb](const Wallet *wallet, std::vector<ClientClasses::LedgerEntry> entries) {
+         if (!wallet) {
+            cb(nullptr);
+            return;
+         }
+         cb(std::make_shared<const HistoryStream::Page>(std::move(entries)));
+      }, false);
+   };
+   return std::make_shared<HistoryStream>(fetcher, prefetchPages, maxCachedPages);
+}
+
+void hd::Leaf::dropHistoryStream()
+{  // requests in flight are still delivered by the released stream
+   std::lock_guard<std::mutex> lock(historyStreamMutex_);
+   historyStream_.reset();
+}
+
+void hd::Leaf::onZeroConfReceived(const std::vector<bs::TXEntry> &entries)
+{
+   dropHistoryStream();
+   Wallet::onZeroConfReceived(entries);
+}
+
+void hd::Leaf::onNewBlock(unsigned int block, unsigned int branchHeight)
+{
+   dropHistoryStream();
+   Wallet::onNewBlock(block, branchHeight);
+}
+
+void hd::Leaf::onZCInvalidated(const std::set<BinaryData> &ids)
+{
+   dropHistoryStream();
+   Wallet::onZCInvalidated(ids);
+}
+
 std::string hd::Leaf::getAddressIndex(const bs::Address &addr)
 {
    const auto path = getPathForAddress(addr);
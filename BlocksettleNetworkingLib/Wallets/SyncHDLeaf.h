@@ -20,6 +20,7 @@
 
 #include "ArmoryConnection.h"
 #include "HDPath.h"
+#include "SyncHistoryStream.h"
 #include "SyncWallet.h"
 
 namespace spdlog {
@@ -46,6 +47,8 @@ namespace bs {
 
             virtual void setPath(const bs::hd::Path &);
             void synchronize(const std::function<void()> &cbDone) override;
+            // cbFailed is invoked instead of cbDone if signer data couldn't be applied
+            void synchronize(const std::function<void()> &cbDone, const std::function<void()> &cbFailed);
 
             void init(bool force = false) override;
 
@@ -64,8 +67,15 @@ namespace bs {
 
             bool getSpendableTxOutList(const ArmoryConnection::UTXOsCb &, uint64_t val, bool excludeReservation) override;
             BTCNumericTypes::balance_type getSpendableBalance() const override;
+            // Pages of merged external and internal history. Regular requests are
+            // served by the leaf's history stream (next pages are prefetched),
+            // onlyNew requests always go to Armory. Callback receives nullptr
+            // wallet if the page could not be fetched.
             bool getHistoryPage(uint32_t id, std::function<void(const bs::sync::Wallet *wallet
                , std::vector<ClientClasses::LedgerEntry>)>, bool onlyNew = false) const;
+            // Standalone stream of merged history pages
+            std::shared_ptr<HistoryStream> historyStream(size_t prefetchPages = 2
+               , size_t maxCachedPages = 8) const;
 
             bool containsAddress(const bs::Address &addr) override;
             bool containsHiddenAddress(const bs::Address &addr) const override;
@@ -120,6 +130,10 @@ namespace bs {
 
          protected:
             void onRefresh(const std::vector<BinaryData> &ids, bool online) override;
+            void onZeroConfReceived(const std::vector<bs::TXEntry> &) override;
+            void onNewBlock(unsigned int, unsigned int) override;
+            void onZCInvalidated(const std::set<BinaryData> &ids) override;
+            void applySyncData(const bs::sync::WalletData &) override;
             virtual void createAddress(const CbAddress &cb, const AddrPoolKey &);
             void reset();
             bs::hd::Path getPathForAddress(const bs::Address &) const;
@@ -189,8 +203,18 @@ namespace bs {
             bool  scanExt_ = true;
             std::set<BinaryData> activeScannedAddresses_;
 
+            // Serves getHistoryPage, dropped when history could change
+            mutable std::mutex   historyStreamMutex_;
+            mutable std::shared_ptr<HistoryStream> historyStream_;
+
          private:
             void createAddress(const CbAddress &, bool isInternal = false);
+            bool fetchHistoryPage(uint32_t id, std::function<void(const bs::sync::Wallet *wallet
+               , std::vector<ClientClasses::LedgerEntry>)>, bool onlyNew) const;
+            void dropHistoryStream();
+            // Applies signer data on top of the snapshot, returns false if it doesn't match
+            bool applySyncDataDiff(const bs::sync::WalletData &);
+            void applyAddressPool(const std::vector<AddressData> &);
             AddrPoolKey getAddressIndexForAddr(const BinaryData &addr) const;
             AddrPoolKey addressIndex(const bs::Address &) const;
             void resumeScan(const std::string &refreshId);
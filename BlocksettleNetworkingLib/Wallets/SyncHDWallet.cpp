@@ -12,6 +12,7 @@
 
 #include "CheckRecipSigner.h"
 #include "SyncWallet.h"
+#include "SyncWalletSnapshot.h"
 #include "WalletSignerContainer.h"
 
 #include <QtConcurrent/QtConcurrentRun>
@@ -59,13 +60,27 @@ hd::Wallet::~Wallet()
    }
 }
 
-void hd::Wallet::synchronize(const std::function<void()> &cbDone)
+void hd::Wallet::synchronize(const std::function<void()> &cbDone
+   , const std::shared_ptr<SyncPipeline> &pipeline
+   , const std::shared_ptr<WalletSnapshotStore> &snapshots
+   , const std::function<void()> &cbRestored)
 {
    if (!signContainer_) {
       return;
    }
-   const auto &cbProcess = [this, cbDone](HDWalletData data)
+   // Restored leaves are shown right away, signer data is applied to them as a diff
+   std::set<std::string> restoredIds;
+   if (snapshots) {
+      restoredIds = restoreFromSnapshots(*snapshots);
+      if (!restoredIds.empty() && cbRestored) {
+         cbRestored();
+      }
+   }
+
+   const auto &cbProcess = [this, cbDone, pipeline, snapshots, restoredIds
+      , started = std::chrono::steady_clock::now()] (HDWalletData data)
    {
+      std::set<std::string> signerLeafIds;
       for (const auto &grpData : data.groups) {
          auto group = getGroup(grpData.type);
          if (!group) {
@@ -86,6 +101,7 @@ void hd::Wallet::synchronize(const std::function<void()> &cbDone)
          }
 
          for (const auto &leafData : grpData.leaves) {
+            signerLeafIds.insert(leafData.id);
             auto leaf = group->getLeaf(leafData.path);
             if (!leaf) {
                leaf = group->createLeaf(leafData.path, leafData.id);
@@ -108,25 +124,98 @@ void hd::Wallet::synchronize(const std::function<void()> &cbDone)
          }
       }
 
+      // Leaves restored from snapshots that signer doesn't have anymore
+      for (const auto &leafId : restoredIds) {
+         if (signerLeafIds.find(leafId) != signerLeafIds.end()) {
+            continue;
+         }
+         LOG(logger_, info, "[hd::Wallet::synchronize] restored leaf {} is not in signer", leafId);
+         const auto leaf = getLeaf(leafId);
+         for (const auto &group : groups_) {
+            if (leaf && group.second->deleteLeaf(leaf)) {
+               leaves_.clear();
+               break;
+            }
+         }
+      }
+
       const auto leaves = getLeaves();
-      auto leafIds = std::make_shared<std::set<std::string>>();
-      for (const auto &leaf : leaves)
-         leafIds->insert(leaf->walletId());
+      if (pipeline) {
+         pipeline->addTiming(SyncPipeline::Stage::HDWallet
+            , std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started)
+            , leaves.size());
+      }
 
+      // Leaves could complete concurrently when synchronized in parallel
+      auto leavesLeft = std::make_shared<std::atomic<size_t>>(leaves.size());
       for (const auto &leaf : leaves) {
-         const auto &cbLeafDone = [leafIds, cbDone, id=leaf->walletId()] 
+         const std::function<void()> cbLeafDone = [leavesLeft, cbDone]
          {
-            leafIds->erase(id);
-            if (leafIds->empty() && cbDone)
+            if ((leavesLeft->fetch_sub(1) == 1) && cbDone)
                cbDone();
          };
-         leaf->synchronize(cbLeafDone);
+
+         // Snapshot provides last known balances until Armory is ready. Leaf is
+         // still reported done only after signer data is applied on top of it,
+         // so it is not registered before that.
+         WalletSnapshot snapshot;
+         if (snapshots && (restoredIds.find(leaf->walletId()) == restoredIds.end())
+            && snapshots->get(leaf->walletId(), walletId(), snapshot)
+            && leaf->applySnapshot(snapshot)) {
+            LOG(logger_, debug, "[hd::Wallet::synchronize] {} restored from snapshot at block {}"
+               , leaf->walletId(), snapshot.topBlock);
+         }
+
+         if (pipeline) {
+            pipeline->add(SyncPipeline::Stage::Leaf, [leaf, cbLeafDone](const std::function<void()> &done)
+            {
+               // job is completed on failure too, the failure itself propagates as before
+               leaf->synchronize([cbLeafDone, done] {
+                  done();
+                  if (cbLeafDone) {
+                     cbLeafDone();
+                  }
+               }, done);
+            });
+         }
+         else {
+            leaf->synchronize(cbLeafDone);
+         }
       }
    };
 
    signContainer_->syncHDWallet(walletId(), cbProcess);
 }
 
+std::set<std::string> hd::Wallet::restoreFromSnapshots(const WalletSnapshotStore &snapshots)
+{
+   std::set<std::string> result;
+   for (const auto &entry : snapshots.getAll(walletId())) {
+      const auto &snapshot = entry.second;
+      const auto groupType = static_cast<bs::hd::CoinType>(snapshot.groupType | bs::hd::hardFlag);
+      // Auth and settlement groups are set up with signer data (user id and settlement maps)
+      if ((groupType == bs::hd::CoinType::BlockSettle_Auth)
+         || (groupType == bs::hd::CoinType::BlockSettle_Settlement)
+         || (snapshot.path.length() == 0)) {
+         continue;
+      }
+      const auto group = createGroup(groupType, snapshot.extOnly);
+      const auto leaf = group ? group->createLeaf(snapshot.path, entry.first) : nullptr;
+      if (!leaf || (leaf->walletId() != entry.first)) {
+         continue;
+      }
+      if (leaf->applySnapshot(snapshot)) {
+         LOG(logger_, debug, "[hd::Wallet::restoreFromSnapshots] {} restored from snapshot at block {}"
+            , leaf->walletId(), snapshot.topBlock);
+         result.insert(leaf->walletId());
+      }
+      else {
+         group->deleteLeaf(leaf);
+      }
+   }
+   return result;
+}
+
 std::string hd::Wallet::walletId() const
 {
    return walletId_;
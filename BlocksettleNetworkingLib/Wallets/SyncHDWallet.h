@@ -12,9 +12,11 @@
 #define BS_SYNC_HD_WALLET_H
 
 #include <functional>
+#include <set>
 #include "SignerDefs.h"
 #include "SyncHDGroup.h"
 #include "SyncHDLeaf.h"
+#include "SyncPipeline.h"
 #include "WalletEncryption.h"
 
 namespace spdlog {
@@ -25,6 +27,7 @@ class WalletSignerContainer;
 namespace bs {
    namespace sync {
       class Wallet;
+      class WalletSnapshotStore;
 
       namespace hd {
 
@@ -48,7 +51,14 @@ namespace bs {
             Wallet(Wallet&&) = delete;
             Wallet& operator = (Wallet&&) = delete;
 
-            void synchronize(const std::function<void()> &cbDone);
+            // Leaves are synchronized through pipeline if it's set,
+            // leaves with valid snapshot start with its balances and get signer data as a diff.
+            // cbRestored is invoked before signer replies if any leaves were created from
+            // snapshots - they are removed later if signer doesn't know them anymore.
+            void synchronize(const std::function<void()> &cbDone
+               , const std::shared_ptr<SyncPipeline> &pipeline = nullptr
+               , const std::shared_ptr<WalletSnapshotStore> &snapshots = nullptr
+               , const std::function<void()> &cbRestored = nullptr);
 
             std::vector<bs::wallet::EncryptionType> encryptionTypes() const;
             std::vector<BinaryData> encryptionKeys() const;
@@ -112,8 +122,13 @@ namespace bs {
 
          protected:
             void addressAdded(const std::string &walletId) override { wct_->addressAdded(walletId); }
+            void addressesAdded(const std::string &walletId, const std::vector<bs::Address> &addrs) override
+            {
+               wct_->addressesAdded(walletId, addrs);
+            }
             void walletReady(const std::string &walletId) override { wct_->walletReady(walletId); }
             void balanceUpdated(const std::string &walletId) override { wct_->balanceUpdated(walletId); }
+            void walletReset(const std::string &walletId) override { wct_->walletReset(walletId); }
             void metadataChanged(const std::string &) override { wct_->metadataChanged(walletId()); }
             void walletCreated(const std::string &walletId) override;
             void walletDestroyed(const std::string &walletId) override;
@@ -134,6 +149,11 @@ namespace bs {
             bs::wallet::KeyRank  encryptionRank_{ 1, 1 };
             const bool isOffline_;
 
+         private:
+            // Creates leaves of groups that need no signer data from snapshots,
+            // returns ids of restored leaves
+            std::set<std::string> restoreFromSnapshots(const WalletSnapshotStore &);
+
          private:
             std::unordered_set<std::string>  scannedLeaves_;
          };
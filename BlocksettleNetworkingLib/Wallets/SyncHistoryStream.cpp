@@ -0,0 +1,198 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "SyncHistoryStream.h"
+
+#include <algorithm>
+
+using namespace bs::sync;
+
+HistoryStream::HistoryStream(const PageFetcher &fetcher, size_t prefetchPages, size_t maxCachedPages)
+   : fetcher_(fetcher)
+   , prefetchPages_(prefetchPages)
+   , maxCachedPages_(std::max<size_t>(1, maxCachedPages))
+   , created_(std::chrono::steady_clock::now())
+{}
+
+bool HistoryStream::next(const PageCb &cb)
+{
+   uint32_t id = 0;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      id = nextId_;
+   }
+   return getPage(id, cb);
+}
+
+bool HistoryStream::getPage(uint32_t id, const PageCb &cb)
+{
+   if (cancelled_) {
+      return false;
+   }
+
+   PagePtr page;
+   bool inFlight = false;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      nextId_ = id + 1;
+
+      if (id >= endId_) {
+         page = std::make_shared<Page>();
+      }
+      else {
+         const auto it = pages_.find(id);
+         if (it != pages_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            page = it->second->second;
+            stats_.hits++;
+         }
+         else {
+            stats_.misses++;
+            auto pendingIt = pending_.find(id);
+            inFlight = (pendingIt != pending_.end());
+            if (!inFlight) {
+               pendingIt = pending_.emplace(id, std::vector<PageCb>{}).first;
+            }
+            pendingIt->second.push_back(cb);
+         }
+      }
+   }
+
+   if (page) {
+      if (cb) {
+         cb(page);
+      }
+   }
+   else if (!inFlight && !fetch(id)) {
+      std::vector<PageCb> waiters;
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         const auto it = pending_.find(id);
+         if (it != pending_.end()) {
+            waiters = std::move(it->second);
+            pending_.erase(it);
+         }
+      }
+      for (const auto &waiter : waiters) {
+         if (waiter) {
+            waiter(nullptr);
+         }
+      }
+      return false;
+   }
+
+   prefetch(id + 1);
+   return true;
+}
+
+void HistoryStream::cancel()
+{
+   cancelled_ = true;
+   std::lock_guard<std::mutex> lock(mutex_);
+   pending_.clear();
+}
+
+HistoryStream::Stats HistoryStream::stats() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   auto result = stats_;
+   result.cachedPages = lru_.size();
+   for (const auto &page : lru_) {
+      result.cachedEntries += page.second->size();
+   }
+   return result;
+}
+
+bool HistoryStream::fetch(uint32_t id)
+{
+   // Stream is kept alive until the requested page arrives, so that waiters
+   // are served even if the owner has released the stream meanwhile
+   const auto self = shared_from_this();
+   return fetcher_(id, [self, id](const PagePtr &page) {
+      self->onPage(id, page);
+   });
+}
+
+void HistoryStream::prefetch(uint32_t fromId)
+{
+   std::vector<uint32_t> ids;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (uint32_t id = fromId; (id - fromId < prefetchPages_) && (id < endId_); ++id) {
+         if ((pages_.find(id) != pages_.end()) || (pending_.find(id) != pending_.end())) {
+            continue;
+         }
+         pending_.emplace(id, std::vector<PageCb>{});
+         ids.push_back(id);
+      }
+      stats_.prefetched += ids.size();
+   }
+
+   for (const auto id : ids) {
+      if (cancelled_) {
+         break;
+      }
+      if (!fetch(id)) {
+         std::lock_guard<std::mutex> lock(mutex_);
+         pending_.erase(id);
+      }
+   }
+}
+
+void HistoryStream::onPage(uint32_t id, const PagePtr &page)
+{
+   std::vector<PageCb> waiters;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = pending_.find(id);
+      if (it != pending_.end()) {
+         waiters = std::move(it->second);
+         pending_.erase(it);
+      }
+      if (page) {
+         if (stats_.firstPageTime.count() == 0) {
+            stats_.firstPageTime = std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - created_);
+         }
+         if (page->empty()) {
+            endId_ = std::min(endId_, id);
+         }
+         else {
+            cachePage(id, page);
+         }
+      }
+   }
+
+   if (cancelled_) {
+      return;
+   }
+   for (const auto &waiter : waiters) {
+      if (waiter) {
+         waiter(page);
+      }
+   }
+}
+
+void HistoryStream::cachePage(uint32_t id, const PagePtr &page)
+{
+   const auto it = pages_.find(id);
+   if (it != pages_.end()) {
+      it->second->second = page;
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return;
+   }
+   lru_.emplace_front(id, page);
+   pages_[id] = lru_.begin();
+
+   while (lru_.size() > maxCachedPages_) {
+      pages_.erase(lru_.back().first);
+      lru_.pop_back();
+   }
+}
@@ -0,0 +1,101 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#ifndef BS_SYNC_HISTORY_STREAM_H
+#define BS_SYNC_HISTORY_STREAM_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ClientClasses.h"
+
+namespace bs {
+   namespace sync {
+
+      // Sequential reader of wallet history pages. Pages following the last
+      // requested one are fetched in background and kept in a bounded LRU, so
+      // that scrolling through large ledgers doesn't stall on each page.
+      // Must be created with std::make_shared.
+      class HistoryStream : public std::enable_shared_from_this<HistoryStream>
+      {
+      public:
+         using Page = std::vector<ClientClasses::LedgerEntry>;
+         using PagePtr = std::shared_ptr<const Page>;
+         // Page is nullptr on failure
+         using PageCb = std::function<void(const PagePtr &)>;
+         // Returns false if request could not be sent
+         using PageFetcher = std::function<bool(uint32_t id, const PageCb &)>;
+
+         struct Stats
+         {
+            uint64_t hits{};
+            uint64_t misses{};
+            uint64_t prefetched{};
+            size_t   cachedPages{};
+            size_t   cachedEntries{};
+            // Time from stream creation to the first received page
+            std::chrono::microseconds  firstPageTime{};
+         };
+
+         HistoryStream(const PageFetcher &, size_t prefetchPages = 2, size_t maxCachedPages = 8);
+
+         HistoryStream(const HistoryStream&) = delete;
+         HistoryStream& operator = (const HistoryStream&) = delete;
+
+         // Returns pages in order starting from the first one, empty page marks the end of history.
+         // Callbacks could be invoked from Armory thread and are not invoked after cancel().
+         bool next(const PageCb &);
+         // Random access to the page, next() continues after it
+         bool getPage(uint32_t id, const PageCb &);
+
+         // Stops prefetching and drops pending callbacks
+         void cancel();
+         bool isCancelled() const { return cancelled_; }
+
+         Stats stats() const;
+
+      private:
+         bool fetch(uint32_t id);
+         void prefetch(uint32_t fromId);
+         void onPage(uint32_t id, const PagePtr &);
+         void cachePage(uint32_t id, const PagePtr &);   // mutex_ must be locked
+
+      private:
+         const PageFetcher fetcher_;
+         const size_t      prefetchPages_;
+         const size_t      maxCachedPages_;
+         const std::chrono::steady_clock::time_point  created_;
+
+         std::atomic_bool  cancelled_{ false };
+
+         mutable std::mutex   mutex_;
+         uint32_t nextId_{};
+         // Id of the first empty page, if known
+         uint32_t endId_{ UINT32_MAX };
+
+         // Most recently used pages first
+         using LruList = std::list<std::pair<uint32_t, PagePtr>>;
+         LruList  lru_;
+         std::map<uint32_t, LruList::iterator>  pages_;
+         // In-flight requests with their waiting callbacks (none for prefetched pages)
+         std::map<uint32_t, std::vector<PageCb>>   pending_;
+         Stats    stats_;
+      };
+
+   }  //namespace sync
+}  //namespace bs
+
+#endif // BS_SYNC_HISTORY_STREAM_H
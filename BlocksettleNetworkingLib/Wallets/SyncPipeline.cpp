@@ -0,0 +1,69 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "SyncPipeline.h"
+
+using namespace bs::sync;
+
+void SyncPipeline::add(Stage stage, const Job &job)
+{
+   if (!job) {
+      return;
+   }
+   running_++;
+   const auto started = std::chrono::steady_clock::now();
+   auto isDone = std::make_shared<std::atomic_bool>(false);
+   const auto done = [self = shared_from_this(), isDone, stage, started] {
+      if (isDone->exchange(true)) {
+         return;
+      }
+      self->onJobDone(stage, started);
+   };
+   try {
+      job(done);
+   }
+   catch (...) {
+      done();     // error is handled by job's owner
+      throw;
+   }
+}
+
+void SyncPipeline::addTiming(Stage stage, std::chrono::microseconds duration, uint64_t items)
+{
+   stageStats_[static_cast<size_t>(stage)].add(duration, items);
+}
+
+SyncPipeline::Stats SyncPipeline::stats() const
+{
+   Stats result;
+   result.running = running_;
+   for (size_t i = 0; i < stageStats_.size(); ++i) {
+      result.stages[i] = stageStats_[i].summary();
+   }
+   return result;
+}
+
+const char *SyncPipeline::toString(Stage stage)
+{
+   switch (stage) {
+   case Stage::HDWallet:            return "HD wallet";
+   case Stage::Leaf:                return "leaf";
+   case Stage::Register:            return "register";
+   case Stage::TrackAddressChain:   return "track address chain";
+   default:                         return "unknown";
+   }
+}
+
+void SyncPipeline::onJobDone(Stage stage, std::chrono::steady_clock::time_point started)
+{
+   stageStats_[static_cast<size_t>(stage)].add(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started));
+   running_--;
+}
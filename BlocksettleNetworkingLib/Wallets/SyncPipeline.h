@@ -0,0 +1,78 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+
+#ifndef BS_SYNC_PIPELINE_H
+#define BS_SYNC_PIPELINE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "LatencyStats.h"
+
+namespace bs {
+   namespace sync {
+
+      // Runs asynchronous wallet sync jobs (signer and Armory round-trips) and
+      // collects per-stage timings. Jobs are started right away on the caller's
+      // thread, as leaf requests were sent before - no queue or threads.
+      // Thread-safe, jobs may complete synchronously (as with InprocSigner).
+      // Must be created with std::make_shared.
+      class SyncPipeline : public std::enable_shared_from_this<SyncPipeline>
+      {
+      public:
+         enum class Stage {
+            HDWallet,      // HD wallet structure fetched from signer
+            Leaf,          // leaf synchronize
+            Register,      // Armory registration sent
+            TrackAddressChain,   // txn counts fetched and chain use synced to signer
+            Count
+         };
+
+         // Job must call done from any thread, on failure paths too - extra calls are ignored
+         using Job = std::function<void(const std::function<void()> &done)>;
+
+         struct Stats
+         {
+            size_t   running{};
+            // Time from job start to its completion, per stage
+            std::array<LatencyStats::Summary, static_cast<size_t>(Stage::Count)> stages;
+         };
+
+         SyncPipeline() = default;
+
+         SyncPipeline(const SyncPipeline&) = delete;
+         SyncPipeline& operator = (const SyncPipeline&) = delete;
+
+         void add(Stage, const Job &);
+
+         // Records duration of synchronous stage work not run as a job
+         void addTiming(Stage, std::chrono::microseconds, uint64_t items = 1);
+
+         Stats stats() const;
+
+         static const char *toString(Stage);
+
+      private:
+         void onJobDone(Stage, std::chrono::steady_clock::time_point started);
+
+         std::atomic<size_t>  running_{};
+
+         std::array<LatencyStats, static_cast<size_t>(Stage::Count)> stageStats_;
+      };
+
+   }  //namespace sync
+}  //namespace bs
+
+#endif // BS_SYNC_PIPELINE_H
@@ -14,11 +14,124 @@
 
 #include "CheckRecipSigner.h"
 #include "CoinSelection.h"
+#include "SyncBalanceScheduler.h"
+#include "SyncWalletSnapshot.h"
 #include "WalletSignerContainer.h"
 #include "WalletUtils.h"
 
 using namespace bs::sync;
 
+namespace {
+
+   // Must be called with writer lock held
+   template <typename MapT, typename SrcT>
+   size_t applyChanges(std::shared_ptr<const MapT> &snapshot, const SrcT &src)
+   {
+      const auto current = std::atomic_load_explicit(&snapshot, std::memory_order_acquire);
+      std::vector<typename SrcT::const_iterator> changes;
+      for (auto it = src.cbegin(); it != src.cend(); ++it) {
+         const auto itCur = current->find(it->first);
+         if ((itCur == current->end()) || (itCur->second != it->second)) {
+            changes.push_back(it);
+         }
+      }
+      if (changes.empty()) {
+         return 0;
+      }
+      auto updated = std::make_shared<MapT>(*current);
+      for (const auto &it : changes) {
+         (*updated)[it->first] = it->second;
+      }
+      std::atomic_store_explicit(&snapshot, std::shared_ptr<const MapT>(std::move(updated))
+         , std::memory_order_release);
+      return changes.size();
+   }
+
+   // Must be called with writer lock held. Changes of all keys are published
+   // in a single snapshot, nothing is applied if callback returns false
+   template <typename MapT>
+   bool modifyEntries(std::shared_ptr<const MapT> &snapshot, const std::set<BinaryData> &keys
+      , const std::function<bool(const BinaryData &, typename MapT::mapped_type *)> &cb)
+   {
+      const auto current = std::atomic_load_explicit(&snapshot, std::memory_order_acquire);
+      std::vector<std::pair<BinaryData, typename MapT::mapped_type>> changes;
+      for (const auto &key : keys) {
+         const auto itCur = current->find(key);
+         if (itCur == current->end()) {
+            if (!cb(key, nullptr)) {
+               return false;
+            }
+            continue;
+         }
+         auto value = itCur->second;
+         if (!cb(key, &value)) {
+            return false;
+         }
+         if (value != itCur->second) {
+            changes.emplace_back(key, std::move(value));
+         }
+      }
+      if (changes.empty()) {
+         return true;
+      }
+      auto updated = std::make_shared<MapT>(*current);
+      for (auto &change : changes) {
+         (*updated)[change.first] = std::move(change.second);
+      }
+      std::atomic_store_explicit(&snapshot, std::shared_ptr<const MapT>(std::move(updated))
+         , std::memory_order_release);
+      return true;
+   }
+
+   // History page digests kept for onlyNew requests
+   const size_t kMaxHistoryDigests = 256;
+
+   // First 8 bytes of tx hash - enough to tell entries of one page apart
+   uint64_t compactTxHash(const BinaryData &txHash)
+   {
+      uint64_t result = 0;
+      memcpy(&result, txHash.getPtr(), std::min(sizeof(result), txHash.getSize()));
+      return result;
+   }
+
+} // namespace
+
+std::shared_ptr<const Wallet::BalanceData::AddressBalanceMap> Wallet::BalanceData::addressBalances() const
+{
+   return std::atomic_load_explicit(&addressBalanceMap_, std::memory_order_acquire);
+}
+
+std::shared_ptr<const Wallet::BalanceData::AddressTxNMap> Wallet::BalanceData::addressTxNs() const
+{
+   return std::atomic_load_explicit(&addressTxNMap_, std::memory_order_acquire);
+}
+
+size_t Wallet::BalanceData::updateAddressBalances(const std::map<BinaryData, std::vector<uint64_t>> &balances)
+{
+   std::lock_guard<std::mutex> lock(addrMapsMtx);
+   return applyChanges(addressBalanceMap_, balances);
+}
+
+size_t Wallet::BalanceData::updateAddressTxNs(const std::map<BinaryData, uint64_t> &txns)
+{
+   std::lock_guard<std::mutex> lock(addrMapsMtx);
+   return applyChanges(addressTxNMap_, txns);
+}
+
+bool Wallet::BalanceData::modifyAddressBalances(const std::set<BinaryData> &addrs
+   , const std::function<bool(const BinaryData &, std::vector<uint64_t> *)> &cb)
+{
+   std::lock_guard<std::mutex> lock(addrMapsMtx);
+   return modifyEntries(addressBalanceMap_, addrs, cb);
+}
+
+bool Wallet::BalanceData::modifyAddressTxNs(const std::set<BinaryData> &addrs
+   , const std::function<bool(const BinaryData &, uint64_t *)> &cb)
+{
+   std::lock_guard<std::mutex> lock(addrMapsMtx);
+   return modifyEntries(addressTxNMap_, addrs, cb);
+}
+
 Wallet::Wallet(WalletSignerContainer *container, const std::shared_ptr<spdlog::logger> &logger)
    : signContainer_(container), logger_(logger)
 {
@@ -65,14 +178,8 @@ void Wallet::synchronize(const std::function<void()> &cbDone)
          return;
       }
 
-      usedAddresses_.clear();
-      for (const auto &addr : data.addresses) {
-         addAddress(addr.address, addr.index, false);
-         setAddressComment(addr.address, addr.comment, false);
-      }
-
-      for (const auto &txComment : data.txComments)
-         setTransactionComment(txComment.txHash, txComment.comment, false);
+      applySyncData(data);
+      storeSyncData(data);
 
       if (cbDone) {
          cbDone();
@@ -82,6 +189,76 @@ void Wallet::synchronize(const std::function<void()> &cbDone)
    signContainer_->syncWallet(walletId(), cbProcess);
 }
 
+void Wallet::applySyncData(const WalletData &data)
+{
+   usedAddresses_.clear();
+   for (const auto &addr : data.addresses) {
+      addAddress(addr.address, addr.index, false);
+      setAddressComment(addr.address, addr.comment, false);
+   }
+
+   for (const auto &txComment : data.txComments)
+      setTransactionComment(txComment.txHash, txComment.comment, false);
+}
+
+void Wallet::storeSyncData(const WalletData &data)
+{
+   auto syncData = std::make_shared<const WalletData>(data);
+   std::lock_guard<std::mutex> lock(syncDataMutex_);
+   syncData_ = std::move(syncData);
+}
+
+bool Wallet::applySnapshot(const WalletSnapshot &snapshot)
+{
+   try {
+      applySyncData(snapshot.data);
+   }
+   catch (const std::exception &e) {
+      SPDLOG_LOGGER_WARN(logger_, "failed to apply snapshot for {}: {}", walletId(), e.what());
+      return false;
+   }
+   storeSyncData(snapshot.data);
+   syncDataFromSnapshot_ = true;
+
+   balanceData_->updateAddressBalances(snapshot.addressBalances);
+   balanceData_->updateAddressTxNs(snapshot.addressTxNs);
+   balanceData_->totalBalance = snapshot.totalBalance;
+   balanceData_->spendableBalance = snapshot.spendableBalance;
+   balanceData_->unconfirmedBalance = snapshot.unconfirmedBalance;
+   balanceData_->addrCount = snapshot.addrCount;
+   balanceData_->fromSnapshot = true;
+
+   if (wct_) {
+      wct_->balanceUpdated(walletId());
+   }
+   return true;
+}
+
+bool Wallet::getSnapshot(WalletSnapshot &snapshot) const
+{
+   if (!isBalanceAvailable() || balanceData_->fromSnapshot) {
+      return false;
+   }
+   {
+      std::lock_guard<std::mutex> lock(syncDataMutex_);
+      if (!syncData_) {
+         return false;
+      }
+      snapshot.data = *syncData_;
+   }
+   snapshot.topBlock = armory_->topBlock();
+   snapshot.totalBalance = balanceData_->totalBalance;
+   snapshot.spendableBalance = balanceData_->spendableBalance;
+   snapshot.unconfirmedBalance = balanceData_->unconfirmedBalance;
+   snapshot.addrCount = balanceData_->addrCount;
+
+   const auto addrBalances = balanceData_->addressBalances();
+   snapshot.addressBalances.insert(addrBalances->cbegin(), addrBalances->cend());
+   const auto addrTxNs = balanceData_->addressTxNs();
+   snapshot.addressTxNs.insert(addrTxNs->cbegin(), addrTxNs->cend());
+   return true;
+}
+
 std::string Wallet::getAddressComment(const bs::Address &address) const
 {
    const auto &itComment = addrComments_.find(address);
@@ -144,9 +321,14 @@ bool Wallet::isBalanceAvailable() const
       && (isRegistered() == Registered::Registered || isRegistered() == Registered::Updating);
 }
 
+bool Wallet::hasBalances() const
+{
+   return isBalanceAvailable() || balanceData_->fromSnapshot;
+}
+
 BTCNumericTypes::balance_type Wallet::getSpendableBalance() const
 {
-   if (!isBalanceAvailable()) {
+   if (!hasBalances()) {
       return std::numeric_limits<double>::infinity();
    }
    return balanceData_->spendableBalance;
@@ -154,7 +336,7 @@ BTCNumericTypes::balance_type Wallet::getSpendableBalance() const
 
 BTCNumericTypes::balance_type Wallet::getUnconfirmedBalance() const
 {
-   if (!isBalanceAvailable()) {
+   if (!hasBalances()) {
       return 0;
    }
    return balanceData_->unconfirmedBalance;
@@ -162,7 +344,7 @@ BTCNumericTypes::balance_type Wallet::getUnconfirmedBalance() const
 
 BTCNumericTypes::balance_type Wallet::getTotalBalance() const
 {
-   if (!isBalanceAvailable()) {
+   if (!hasBalances()) {
       return std::numeric_limits<double>::infinity();
    }
    return balanceData_->totalBalance;
@@ -170,14 +352,13 @@ BTCNumericTypes::balance_type Wallet::getTotalBalance() const
 
 std::vector<uint64_t> Wallet::getAddrBalance(const bs::Address &addr) const
 {
-   if (!isBalanceAvailable()) {
+   if (!hasBalances()) {
       SPDLOG_LOGGER_ERROR(logger_, "balance is not available for wallet {}", walletId());
       return {};
    }
-   std::unique_lock<std::mutex> lock(balanceData_->addrMapsMtx);
-
-   auto iter = balanceData_->addressBalanceMap.find(addr.prefixed());
-   if (iter == balanceData_->addressBalanceMap.end()) {
+   const auto balances = balanceData_->addressBalances();
+   const auto iter = balances->find(addr.prefixed());
+   if (iter == balances->end()) {
       return {};
    }
 
@@ -186,14 +367,13 @@ std::vector<uint64_t> Wallet::getAddrBalance(const bs::Address &addr) const
 
 uint64_t Wallet::getAddrTxN(const bs::Address &addr) const
 {
-   if (!isBalanceAvailable()) {
+   if (!hasBalances()) {
       SPDLOG_LOGGER_ERROR(logger_, "balance is not available for wallet {}", walletId());
       return {};
    }
-   std::unique_lock<std::mutex> lock(balanceData_->addrMapsMtx);
-
-   auto iter = balanceData_->addressTxNMap.find(addr.prefixed());
-   if (iter == balanceData_->addressTxNMap.end()) {
+   const auto txns = balanceData_->addressTxNs();
+   const auto iter = txns->find(addr.prefixed());
+   if (iter == txns->end()) {
       return 0;
    }
 
@@ -231,45 +411,55 @@ bool Wallet::updateBalances(const std::function<void(void)> &cb)
       const auto onCombinedBalances = [balanceData = balanceData_, walletId=walletId()]
          (const std::map<std::string, CombinedBalances> &balanceMap)
       {
+         const auto &flushCallbacks = [balanceData] {
+            std::vector<std::function<void(void)>> cbCopy;
+            {
+               std::unique_lock<std::mutex> lock(balanceData->cbMutex);
+               cbCopy.swap(balanceData->cbBalances);
+            }
+            for (const auto &cb : cbCopy) {
+               if (cb) {
+                  cb();
+               }
+            }
+         };
+         if (balanceMap.empty()) {  // request failed - keep current balances
+            flushCallbacks();
+            return;
+         }
+
          BTCNumericTypes::balance_type total = 0, spendable = 0, unconfirmed = 0;
          uint64_t addrCount = 0;
-         {
-            std::unique_lock<std::mutex> lock(balanceData->addrMapsMtx);
-            for (const auto &wltBal : balanceMap) {
-               total += static_cast<BTCNumericTypes::balance_type>(
-                  wltBal.second.walletBalanceAndCount_[0]) / BTCNumericTypes::BalanceDivider;
-               /*      spendable += static_cast<BTCNumericTypes::balance_type>(
-                        wltBal.second.walletBalanceAndCount_[1]) / BTCNumericTypes::BalanceDivider;*/
-               unconfirmed += static_cast<BTCNumericTypes::balance_type>(
-                  wltBal.second.walletBalanceAndCount_[2]) / BTCNumericTypes::BalanceDivider;
-
-               //wallet txn count
-               addrCount += wltBal.second.walletBalanceAndCount_[3];
-
-               //address balances
-               updateMap<std::map<BinaryData, std::vector<uint64_t>>>(
-                  wltBal.second.addressBalances_, balanceData->addressBalanceMap);
-            }
-            spendable = total - unconfirmed;
+         for (const auto &wltBal : balanceMap) {
+            total += static_cast<BTCNumericTypes::balance_type>(
+               wltBal.second.walletBalanceAndCount_[0]) / BTCNumericTypes::BalanceDivider;
+            /*      spendable += static_cast<BTCNumericTypes::balance_type>(
+                     wltBal.second.walletBalanceAndCount_[1]) / BTCNumericTypes::BalanceDivider;*/
+            unconfirmed += static_cast<BTCNumericTypes::balance_type>(
+               wltBal.second.walletBalanceAndCount_[2]) / BTCNumericTypes::BalanceDivider;
+
+            //wallet txn count
+            addrCount += wltBal.second.walletBalanceAndCount_[3];
+
+            //address balances (only changed ones are applied)
+            balanceData->updateAddressBalances(wltBal.second.addressBalances_);
          }
+         spendable = total - unconfirmed;
 
          balanceData->totalBalance = total;
          balanceData->spendableBalance = spendable;
          balanceData->unconfirmedBalance = unconfirmed;
          balanceData->addrCount = addrCount;
-
-         std::vector<std::function<void(void)>> cbCopy;
-         {
-            std::unique_lock<std::mutex> lock(balanceData->cbMutex);
-            cbCopy.swap(balanceData->cbBalances);
-         }
-         for (const auto &cb : cbCopy) {
-            if (cb) {
-               cb();
-            }
-         }
+         balanceData->fromSnapshot = false;
+         flushCallbacks();
       };
-      return armory_->getCombinedBalances(walletIDs, onCombinedBalances);
+      const auto scheduler = balanceScheduler_.lock();
+      const bool rc = scheduler ? scheduler->getCombinedBalances(walletIDs, onCombinedBalances)
+         : armory_->getCombinedBalances(walletIDs, onCombinedBalances);
+      if (!rc) {
+         dropPendingCallbacks(balanceData_->cbBalances);
+      }
+      return rc;
    } else {          // if the callbacks queue is not empty, don't call
       return true;   // armory's RPC - just add the callback and return
    }
@@ -348,6 +538,26 @@ void Wallet::setWCT(WalletCallbackTarget *wct)
    wct_ = wct;
 }
 
+void Wallet::dropPendingCallbacks(std::vector<std::function<void(void)>> &callbacks)
+{  // The first callback belongs to the failed request (its caller gets false),
+   // the ones queued meanwhile are completed so that next requests are sent
+   std::vector<std::function<void(void)>> cbCopy;
+   {
+      std::unique_lock<std::mutex> lock(balanceData_->cbMutex);
+      cbCopy.swap(callbacks);
+   }
+   for (size_t i = 1; i < cbCopy.size(); ++i) {
+      if (cbCopy[i]) {
+         cbCopy[i]();
+      }
+   }
+}
+
+void Wallet::setBalanceScheduler(const std::shared_ptr<BalanceScheduler> &scheduler)
+{
+   balanceScheduler_ = scheduler;
+}
+
 bool Wallet::getAddressTxnCounts(const std::function<void(void)> &cb)
 {  /***
    Same as updateBalances, this methods grabs the addr txn count
@@ -377,9 +587,7 @@ bool Wallet::getAddressTxnCounts(const std::function<void(void)> &cb)
          (const std::map<std::string, CombinedCounts> &countMap)
       {
          for (const auto &count : countMap) {
-            std::unique_lock<std::mutex> lock(balanceData->addrMapsMtx);
-            updateMap<std::map<BinaryData, uint64_t>>(
-               count.second.addressTxnCounts_, balanceData->addressTxNMap);
+            balanceData->updateAddressTxNs(count.second.addressTxnCounts_);
          }
 
          auto cbTxNsCopy = std::make_shared<std::vector<std::function<void(void)>>>();
@@ -393,7 +601,13 @@ bool Wallet::getAddressTxnCounts(const std::function<void(void)> &cb)
             }
          }
       };
-      return armory_->getCombinedTxNs(walletIDs, cbTxNs);
+      const auto scheduler = balanceScheduler_.lock();
+      const bool rc = scheduler ? scheduler->getCombinedTxNs(walletIDs, cbTxNs)
+         : armory_->getCombinedTxNs(walletIDs, cbTxNs);
+      if (!rc) {
+         dropPendingCallbacks(balanceData_->cbTxNs);
+      }
+      return rc;
    }
    else {
       return true;
@@ -409,58 +623,84 @@ bool Wallet::getHistoryPage(const std::shared_ptr<AsyncClient::BtcWallet> &btcWa
    if (!isBalanceAvailable()) {
       return false;
    }
-   const auto &cb = [this, id, onlyNew, clientCb, handle = validityFlag_.handle(), logger=logger_]
+   const HistoryPageKey key{ btcWallet.get(), id };
+   const auto &cb = [this, key, onlyNew, clientCb, handle = validityFlag_.handle(), logger=logger_]
                     (ReturnMessage<std::vector<ClientClasses::LedgerEntry>> entries) mutable -> void
    {
+      std::vector<ClientClasses::LedgerEntry> le;
       try {
-         auto le = entries.get();
-
-         ValidityGuard lock(handle);
-         if (!handle.isValid()) {
-            return;
-         }
-         if (!onlyNew) {
-            clientCb(this, le);
-         }
-         else {
-            const auto &histPage = historyCache_.find(id);
-            if (histPage == historyCache_.end()) {
-               clientCb(this, le);
-            }
-            else if (histPage->second.size() == le.size()) {
-               clientCb(this, {});
-            }
-            else {
-               std::vector<ClientClasses::LedgerEntry> diff;
-               struct comparator {
-                  bool operator() (const ClientClasses::LedgerEntry &a, const ClientClasses::LedgerEntry &b) const {
-                     return (a.getTxHash() < b.getTxHash());
-                  }
-               };
-               std::set<ClientClasses::LedgerEntry, comparator> diffSet;
-               diffSet.insert(le.begin(), le.end());
-               for (const auto &entry : histPage->second) {
-                  diffSet.erase(entry);
-               }
-               for (const auto &diffEntry : diffSet) {
-                  diff.emplace_back(diffEntry);
-               }
-               clientCb(this, diff);
-            }
-         }
-         historyCache_[id] = le;
+         le = entries.get();
       }
       catch (const std::exception& e) {
          if (logger != nullptr) {
             logger->error("[bs::sync::Wallet::getHistoryPage] Return data " \
-               "error - {} - ID {}", e.what(), id);
+               "error - {} - ID {}", e.what(), key.second);
          }
+         ValidityGuard lock(handle);
+         if (handle.isValid()) {
+            clientCb(nullptr, {});
+         }
+         return;
+      }
+
+      ValidityGuard lock(handle);
+      if (!handle.isValid()) {
+         return;
+      }
+      std::vector<ClientClasses::LedgerEntry> newEntries;
+      const bool isKnownPage = updateHistoryDigest(key, le, newEntries);
+      if (onlyNew && isKnownPage) {
+         clientCb(this, std::move(newEntries));
+      }
+      else {
+         clientCb(this, std::move(le));
       }
    };
    btcWallet->getHistoryPage(id, cb);
    return true;
 }
 
+bool Wallet::updateHistoryDigest(const HistoryPageKey &key
+   , const std::vector<ClientClasses::LedgerEntry> &page
+   , std::vector<ClientClasses::LedgerEntry> &newEntries) const
+{
+   HistoryPageDigest digest;
+   digest.nbEntries = page.size();
+   for (const auto &entry : page) {
+      digest.txHashes.insert(compactTxHash(entry.getTxHash()));
+   }
+
+   std::lock_guard<std::mutex> lock(historyCacheMutex_);
+   auto it = historyCache_.find(key);
+   if (it == historyCache_.end()) {
+      const bool wasEvicted = (evictedHistoryPages_.erase(key) > 0);
+      historyLru_.push_front(key);
+      digest.lruIt = historyLru_.begin();
+      historyCache_.emplace(key, std::move(digest));
+      while (historyCache_.size() > kMaxHistoryDigests) {
+         const auto &oldest = historyLru_.back();
+         evictedHistoryPages_.insert(oldest);
+         historyCache_.erase(oldest);
+         historyLru_.pop_back();
+      }
+      return wasEvicted;
+   }
+   if (it->second.nbEntries != page.size()) {
+      std::set<uint64_t> reported;
+      for (const auto &entry : page) {
+         const auto txHash = compactTxHash(entry.getTxHash());
+         if ((it->second.txHashes.find(txHash) == it->second.txHashes.end())
+            && reported.insert(txHash).second) {
+            newEntries.push_back(entry);
+         }
+      }
+   }
+   historyLru_.splice(historyLru_.begin(), historyLru_, it->second.lruIt);
+   digest.lruIt = historyLru_.begin();
+   it->second = std::move(digest);
+   return true;
+}
+
 QString Wallet::displayTxValue(int64_t val) const
 {
    return QLocale().toString(val / BTCNumericTypes::BalanceDivider, 'f', BTCNumericTypes::default_precision);
@@ -485,7 +725,9 @@ void Wallet::setArmory(const std::shared_ptr<ArmoryConnection> &armory)
 
 void Wallet::onZCInvalidated(const std::set<BinaryData> &ids)
 {
-   unsigned int processedEntries = 0;
+   // Changes of all invalidated entries are applied to address balances at once
+   std::vector<std::pair<BinaryData, BTCNumericTypes::balance_type>> invalidated;
+   std::map<BinaryData, uint64_t> addrDeltas;
    for (const auto &id : ids) {
       const auto &itTx = zcEntries_.find(id);
       if (itTx == zcEntries_.end()) {
@@ -502,30 +744,48 @@ void Wallet::onZCInvalidated(const std::set<BinaryData> &ids)
          if (containsAddress(addr)) {
             const auto addrBal = txOut.getValue();
             invalidatedBalance += addrBal / BTCNumericTypes::BalanceDivider;
-
-            std::unique_lock<std::mutex> lock(balanceData_->addrMapsMtx);
-            auto it = balanceData_->addressBalanceMap.find(addr.prefixed());
-            if (it == balanceData_->addressBalanceMap.end()) {
-               return;
-            }
-
-            auto &addrBalances = it->second;
-            if (addrBalances.size() < 3) {
-               SPDLOG_LOGGER_ERROR(logger_, "invalid addr balances vector");
-               return;
-            }
-
-            addrBalances[0] -= addrBal;
-            addrBalances[1] -= addrBal;
+            addrDeltas[addr.prefixed()] += addrBal;
          }
       }
-      balanceData_->unconfirmedBalance = balanceData_->unconfirmedBalance - invalidatedBalance;
+      invalidated.emplace_back(itTx->first, invalidatedBalance);
+   }
+   if (invalidated.empty()) {
+      return;
+   }
+
+   std::set<BinaryData> addrs;
+   for (const auto &addrDelta : addrDeltas) {
+      addrs.insert(addrDelta.first);
+   }
+   // Addresses missing from the balance map (or with malformed balances) are
+   // skipped, the rest of the entry bookkeeping is done regardless
+   bool isValid = true;
+   balanceData_->modifyAddressBalances(addrs
+      , [&addrDeltas, &isValid](const BinaryData &addr, std::vector<uint64_t> *addrBalances)
+   {
+      if (addrBalances == nullptr) {
+         return true;
+      }
+      if (addrBalances->size() < 3) {
+         isValid = false;
+         return true;
+      }
+      const auto addrBal = addrDeltas.at(addr);
+      (*addrBalances)[0] -= addrBal;
+      (*addrBalances)[1] -= addrBal;
+      return true;
+   });
+   if (!isValid) {
+      SPDLOG_LOGGER_ERROR(logger_, "invalid addr balances vector");
+   }
+
+   for (const auto &entry : invalidated) {
+      balanceData_->unconfirmedBalance = balanceData_->unconfirmedBalance - entry.second;
       logger_->debug("[{}] {} processed invalidated ZC entry {}, balance: {}"
-         , __func__, walletId(), itTx->first.toHexStr(true), invalidatedBalance);
-      zcEntries_.erase(itTx);
-      processedEntries++;
+         , __func__, walletId(), entry.first.toHexStr(true), entry.second);
+      zcEntries_.erase(entry.first);
    }
-   if (processedEntries && wct_) {
+   if (wct_) {
       wct_->balanceUpdated(walletId());
    }
 }
@@ -536,64 +796,100 @@ void Wallet::onZeroConfReceived(const std::vector<bs::TXEntry> &entries)
       return;
    }
 
-   const auto &cbTX = [this, balanceData = balanceData_, handle = validityFlag_.handle(), armory=armory_]
-      (const Tx &tx) mutable
+   // All ZCs and then all their spent outputs are fetched in one batch, so
+   // that txn counts of all affected addresses are published at once
+   const auto &cbTXs = [this, balanceData = balanceData_, handle = validityFlag_.handle(), armory=armory_]
+      (const AsyncClient::TxBatchResult &txs, std::exception_ptr exPtr) mutable
    {
+      if (exPtr != nullptr) {
+         return;
+      }
       ValidityGuard lock(handle);
       if (!handle.isValid()) {
          return;
       }
 
-      for (size_t i = 0; i < tx.getNumTxOut(); ++i) {
-         const auto txOut = tx.getTxOutCopy(i);
-         const auto txType = txOut.getScriptType();
-         if (txType == TXOUT_SCRIPT_OPRETURN || txType == TXOUT_SCRIPT_NONSTANDARD) {
+      std::vector<std::pair<BinaryData, uint32_t>> prevOuts;
+      std::set<BinaryData> prevHashes;
+      for (const auto &txEntry : txs) {
+         if (!txEntry.second || !txEntry.second->isInitialized()) {
             continue;
          }
-         const auto addr = bs::Address::fromTxOut(txOut);
-         if (containsAddress(addr)) {
-            zcEntries_[tx.getThisHash()] = tx;
-            break;
+         const auto &tx = *txEntry.second;
+         for (size_t i = 0; i < tx.getNumTxOut(); ++i) {
+            const auto txOut = tx.getTxOutCopy(i);
+            const auto txType = txOut.getScriptType();
+            if (txType == TXOUT_SCRIPT_OPRETURN || txType == TXOUT_SCRIPT_NONSTANDARD) {
+               continue;
+            }
+            const auto addr = bs::Address::fromTxOut(txOut);
+            if (containsAddress(addr)) {
+               zcEntries_[tx.getThisHash()] = tx;
+               break;
+            }
          }
-      }
 
-      for (size_t i = 0; i < tx.getNumTxIn(); ++i) {
-         const TxIn in = tx.getTxInCopy(i);
-         const OutPoint op = in.getOutPoint();
+         for (size_t i = 0; i < tx.getNumTxIn(); ++i) {
+            const TxIn in = tx.getTxInCopy(i);
+            const OutPoint op = in.getOutPoint();
+            prevOuts.emplace_back(op.getTxHash(), op.getTxOutIndex());
+            prevHashes.insert(op.getTxHash());
+         }
+      }
+      if (prevHashes.empty()) {
+         return;
+      }
 
-         const auto &cbPrevTX = [this, balanceData, idx=op.getTxOutIndex(), handle](const Tx &prevTx) mutable
-         {
-            if (!prevTx.isInitialized()) {
-               return;
-            }
-            const TxOut prevOut = prevTx.getTxOutCopy(idx);
-            const auto addr = bs::Address::fromTxOut(prevOut);
-            if (!containsAddress(addr)) {
-               return;
+      const auto &cbPrevTXs = [this, balanceData, prevOuts, handle]
+         (const AsyncClient::TxBatchResult &prevTxs, std::exception_ptr exPtr) mutable
+      {
+         if (exPtr != nullptr) {
+            return;
+         }
+         ValidityGuard lock(handle);
+         if (!handle.isValid()) {
+            return;
+         }
+         std::map<BinaryData, uint64_t> txnIncrements;
+         for (const auto &prevOut : prevOuts) {
+            const auto itTx = prevTxs.find(prevOut.first);
+            if ((itTx == prevTxs.end()) || !itTx->second || !itTx->second->isInitialized()) {
+               continue;
             }
-            bool updated = false;
-            ValidityGuard lock(handle);
-            if (!handle.isValid()) {
-               return;
+            const auto addr = bs::Address::fromTxOut(itTx->second->getTxOutCopy(prevOut.second));
+            if (containsAddress(addr)) {
+               txnIncrements[addr.id()]++;
             }
-            {
-               std::unique_lock<std::mutex> lock(balanceData->addrMapsMtx);
-               const auto &itTxn = balanceData->addressTxNMap.find(addr.id());
-               if (itTxn != balanceData->addressTxNMap.end()) {
-                  itTxn->second++;
-                  updated = true;
-               }
-            }
-            if (updated && wct_) {
-               wct_->balanceUpdated(walletId());
+         }
+         if (txnIncrements.empty()) {
+            return;
+         }
+
+         std::set<BinaryData> addrs;
+         for (const auto &increment : txnIncrements) {
+            addrs.insert(increment.first);
+         }
+         bool updated = false;
+         balanceData->modifyAddressTxNs(addrs, [&txnIncrements, &updated]
+            (const BinaryData &addr, uint64_t *txn)
+         {
+            if (txn != nullptr) {   // unknown addresses are skipped
+               *txn += txnIncrements.at(addr);
+               updated = true;
             }
-         };
-         armory->getTxByHash(op.getTxHash(), cbPrevTX);
-      }
+            return true;
+         });
+         if (updated && wct_) {
+            wct_->balanceUpdated(walletId());
+         }
+      };
+      armory->getTXsByHash(prevHashes, cbPrevTXs);
    };
+   std::set<BinaryData> txHashes;
    for (const auto &entry : entries) {
-      armory_->getTxByHash(entry.txHash, cbTX);
+      txHashes.insert(entry.txHash);
    }
+   armory_->getTXsByHash(txHashes, cbTXs);
    updateBalances([this, handle = validityFlag_.handle(), logger=logger_]() mutable {    // TxNs are not updated for ZCs
       ValidityGuard lock(handle);
       if (!trackLiveAddresses_ || !handle.isValid()) {
@@ -705,6 +1001,19 @@ void Wallet::onRefresh(const std::vector<BinaryData> &ids, bool online)
    }
 }
 
+void Wallet::addArmoryRoutes(const std::vector<std::string> &walletIds
+   , const std::vector<std::string> &regIds)
+{
+   // Custom ACTs may expect all notifications
+   if (!armory_ || !act_ || skipPostOnline_) {
+      return;
+   }
+   armory_->addTargetRoutes(act_.get(), walletIds);
+   for (const auto &regId : regIds) {
+      armory_->addRegistrationRoute(act_.get(), regId);
+   }
+}
+
 std::vector<std::string> Wallet::registerWallet(const std::shared_ptr<ArmoryConnection> &armory, bool asNew)
 {
    setArmory(armory);
@@ -714,6 +1023,7 @@ std::vector<std::string> Wallet::registerWallet(const std::shared_ptr<ArmoryConn
       const auto &addrHashes = getAddrHashes();
       regId_ = wallet->registerAddresses(addrHashes, asNew);
       registeredAddresses_.insert(addrHashes.begin(), addrHashes.end());
+      addArmoryRoutes({ walletId() }, { regId_ });
       logger_->debug("[bs::sync::Wallet::registerWallet] register wallet {}, {} addresses = {}"
          , walletId(), getAddrHashes().size(), regId_);
       return { regId_ };
@@ -726,7 +1036,10 @@ std::vector<std::string> Wallet::registerWallet(const std::shared_ptr<ArmoryConn
 
 void Wallet::unregisterWallet()
 {
+   std::lock_guard<std::mutex> lock(historyCacheMutex_);
    historyCache_.clear();
+   historyLru_.clear();
+   evictedHistoryPages_.clear();
 }
 
 void Wallet::init(bool force)
@@ -997,6 +1310,9 @@ int Wallet::addAddress(const bs::Address &addr, const std::string &index
 {
    if (!addr.empty()) {
       usedAddresses_.push_back(addr);
+      if (wct_) {
+         wct_->addressesAdded(walletId(), { addr });
+      }
    }
 
    if (sync && signContainer_) {
@@ -1048,30 +1364,27 @@ void Wallet::trackChainAddressUse(const std::function<void(bs::sync::SyncState)>
    }
    //1) round up all addresses that have a tx count
    std::set<BinaryData> usedAddrSet;
-   for (auto& addrPair : balanceData_->addressTxNMap) {
+   for (const auto &addrPair : *balanceData_->addressTxNs()) {
       if (addrPair.second != 0) {
          usedAddrSet.insert(addrPair.first);
       }
    }
 
-   {
-      std::unique_lock<std::mutex> lock(balanceData_->addrMapsMtx);
-      for (auto& addrPair : balanceData_->addressBalanceMap) {
-         if (usedAddrSet.find(addrPair.first) != usedAddrSet.end()) {
-            continue;   // skip already added addresses
-         }
-         if (!addrPair.second.empty()) {
-            bool hasBalance = false;
-            for (int i = 0; i < 3; ++i) {
-               if (addrPair.second[i] > 0) {
-                  hasBalance = true;
-                  break;
-               }
-            }
-            if (hasBalance) {
-               usedAddrSet.insert(addrPair.first);
+   for (const auto &addrPair : *balanceData_->addressBalances()) {
+      if (usedAddrSet.find(addrPair.first) != usedAddrSet.end()) {
+         continue;   // skip already added addresses
+      }
+      if (!addrPair.second.empty()) {
+         bool hasBalance = false;
+         for (int i = 0; i < 3; ++i) {
+            if (addrPair.second[i] > 0) {
+               hasBalance = true;
+               break;
             }
          }
+         if (hasBalance) {
+            usedAddrSet.insert(addrPair.first);
+         }
       }
    }
 
@@ -1089,10 +1402,8 @@ void Wallet::trackChainAddressUse(const std::function<void(bs::sync::SyncState)>
 
 size_t Wallet::getActiveAddressCount()
 {
-   std::unique_lock<std::mutex> lock(balanceData_->addrMapsMtx);
-
    size_t count = 0;
-   for (auto& addrBal : balanceData_->addressBalanceMap) {
+   for (const auto &addrBal : *balanceData_->addressBalances()) {
       if (addrBal.second[0] != 0) {
          ++count;
       }
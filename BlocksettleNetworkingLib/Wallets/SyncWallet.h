@@ -13,6 +13,8 @@
 
 #include <atomic>
 #include <functional>
+#include <list>
+#include <set>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -77,6 +79,9 @@ namespace bs {
 
       }  // namepsace wallet
 
+      class BalanceScheduler;
+      struct WalletData;
+      struct WalletSnapshot;
       class WalletACT;
       class WalletCallbackTarget;
 
@@ -118,6 +123,8 @@ namespace bs {
          virtual void unregisterWallet();
 
          virtual bool isBalanceAvailable() const;
+         // Balances are either available or restored from snapshot
+         bool hasBalances() const;
          void onBalanceAvailable(const std::function<void()> &) const;
          virtual BTCNumericTypes::balance_type getSpendableBalance() const;
          virtual BTCNumericTypes::balance_type getUnconfirmedBalance() const;
@@ -212,6 +219,16 @@ namespace bs {
          }
 
          void setWCT(WalletCallbackTarget *wct);
+
+         // Warm start: last known data is shown until signer and Armory sync is complete
+         virtual bool applySnapshot(const WalletSnapshot &);
+         // Returns false unless wallet is synchronized and has actual balances
+         bool getSnapshot(WalletSnapshot &) const;
+         // Addresses come from snapshot, signer data is not applied yet
+         bool isSyncPending() const { return syncDataFromSnapshot_; }
+
+         // Balance and txn count refreshes are sent through scheduler if set
+         void setBalanceScheduler(const std::shared_ptr<BalanceScheduler> &);
          WalletACT* peekACT(void) const { return act_.get(); }
 
       protected:
@@ -222,15 +239,17 @@ namespace bs {
 
          virtual std::vector<BinaryData> getAddrHashes() const = 0;
 
+         // Applies wallet data received from signer
+         virtual void applySyncData(const WalletData &);
+         void storeSyncData(const WalletData &);
+
          virtual bool isOwnId(const std::string &wId) const { return (wId == walletId()); }
 
-         template <typename MapT> static void updateMap(const MapT &src, MapT &dst)
-         {
-            for (const auto &elem : src) {     // std::map::insert doesn't replace elements
-               dst[elem.first] = std::move(elem.second);
-            }
-         }
+         // Route only this wallet's ZCs and refreshes to the default ACT
+         void addArmoryRoutes(const std::vector<std::string> &walletIds
+            , const std::vector<std::string> &regIds);
 
+         // Callback receives nullptr wallet if the page could not be fetched
          bool getHistoryPage(const std::shared_ptr<AsyncClient::BtcWallet> &
             , uint32_t id, std::function<void(const Wallet *wallet
                , std::vector<ClientClasses::LedgerEntry>)>, bool onlyNew = false) const;
@@ -261,14 +280,41 @@ namespace bs {
 
          std::unique_ptr<WalletACT>   act_;
          WalletCallbackTarget       * wct_ = nullptr;
+         std::weak_ptr<BalanceScheduler>  balanceScheduler_;
 
          ValidityFlag validityFlag_;
 
          std::map<BinaryData, Tx>   zcEntries_;
+         // Set while addresses come from snapshot and signer data is not applied yet
+         std::atomic_bool  syncDataFromSnapshot_{ false };
 
       private:
          std::string regId_;
-         mutable std::map<uint32_t, std::vector<ClientClasses::LedgerEntry>>  historyCache_;
+
+         // Last applied signer data, kept for snapshots
+         mutable std::mutex   syncDataMutex_;
+         std::shared_ptr<const WalletData>   syncData_;
+
+         // Compact tx hashes of the last seen history pages (per Armory wallet)
+         // used to report onlyNew entries. Digests are kept in LRU order and
+         // evicted over the limit; an evicted page has no digest to compare with,
+         // so its next fetch reseeds the digest and reports no entries as new.
+         using HistoryPageKey = std::pair<const AsyncClient::BtcWallet *, uint32_t>;
+         struct HistoryPageDigest
+         {
+            size_t               nbEntries{};
+            std::set<uint64_t>   txHashes;
+            std::list<HistoryPageKey>::iterator lruIt;
+         };
+         // Stores the page digest and returns false if the page wasn't seen before,
+         // otherwise newEntries receives the entries missing from the previous digest
+         bool updateHistoryDigest(const HistoryPageKey &, const std::vector<ClientClasses::LedgerEntry> &
+            , std::vector<ClientClasses::LedgerEntry> &newEntries) const;
+
+         mutable std::mutex   historyCacheMutex_;
+         mutable std::map<HistoryPageKey, HistoryPageDigest>   historyCache_;
+         mutable std::list<HistoryPageKey>   historyLru_;
+         mutable std::set<HistoryPageKey>    evictedHistoryPages_;
          mutable std::atomic_bool         balThreadRunning_{ false };
          mutable std::condition_variable  balThrCV_;
          mutable std::mutex               balThrMutex_;
@@ -280,21 +326,47 @@ namespace bs {
          bool trackLiveAddresses_ = true;
          std::atomic<Registered> isRegistered_{Registered::Offline};
 
+         // Per-address maps are read-mostly: readers take immutable snapshots
+         // without locking, writers (serialized with addrMapsMtx) apply only
+         // changed addresses and publish a new snapshot if there were any.
          struct BalanceData {
+            using AddressBalanceMap = std::unordered_map<BinaryData, std::vector<uint64_t>, BinaryDataHash>;
+            using AddressTxNMap = std::unordered_map<BinaryData, uint64_t, BinaryDataHash>;
+
             std::atomic<BTCNumericTypes::balance_type>   spendableBalance{0};
             std::atomic<BTCNumericTypes::balance_type>   unconfirmedBalance{0};
             std::atomic<BTCNumericTypes::balance_type>   totalBalance{0};
 
-            size_t   addrCount = 0;
-            std::mutex  addrMapsMtx;
-            std::map<BinaryData, std::vector<uint64_t>>  addressBalanceMap;
-            std::map<BinaryData, uint64_t>               addressTxNMap;
+            std::atomic<size_t>  addrCount{0};
+            // Set until first balances update is received from Armory
+            std::atomic_bool     fromSnapshot{ false };
+
+            std::shared_ptr<const AddressBalanceMap> addressBalances() const;
+            std::shared_ptr<const AddressTxNMap> addressTxNs() const;
+
+            // Return number of changed addresses
+            size_t updateAddressBalances(const std::map<BinaryData, std::vector<uint64_t>> &);
+            size_t updateAddressTxNs(const std::map<BinaryData, uint64_t> &);
+
+            // Modify values of several addresses and publish them in one snapshot. Callback
+            // receives nullptr for unknown address, nothing is applied if it returns false.
+            bool modifyAddressBalances(const std::set<BinaryData> &addrs
+               , const std::function<bool(const BinaryData &, std::vector<uint64_t> *)> &);
+            bool modifyAddressTxNs(const std::set<BinaryData> &addrs
+               , const std::function<bool(const BinaryData &, uint64_t *)> &);
 
             std::mutex  cbMutex;
             std::vector<std::function<void(void)>> cbTxNs;
             std::vector<std::function<void(void)>> cbBalances;
+
+         private:
+            std::mutex  addrMapsMtx;
+            std::shared_ptr<const AddressBalanceMap>  addressBalanceMap_{ std::make_shared<AddressBalanceMap>() };
+            std::shared_ptr<const AddressTxNMap>      addressTxNMap_{ std::make_shared<AddressTxNMap>() };
          };
          mutable std::shared_ptr<BalanceData>   balanceData_;
+         // Clears callback queue of the request that couldn't be sent
+         void dropPendingCallbacks(std::vector<std::function<void(void)>> &);
          std::map<bs::Address, std::function<void(const std::shared_ptr<AsyncClient::LedgerDelegate> &)>>   cbLedgerByAddr_;
 
          // List of addresses that was actually registered in armory
@@ -332,6 +404,8 @@ namespace bs {
          virtual ~WalletCallbackTarget() = default;
 
          virtual void addressAdded(const std::string &walletId) {}
+         // Called synchronously for each used or pooled address the wallet learns about
+         virtual void addressesAdded(const std::string &walletId, const std::vector<bs::Address> &) {}
          virtual void walletReady(const std::string &walletId) {}
          virtual void balanceUpdated(const std::string &walletId) {}
          virtual void metadataChanged(const std::string &walletId) {}
@@ -0,0 +1,250 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "SyncWalletSnapshot.h"
+
+#include <cmath>
+#include <spdlog/spdlog.h>
+
+#include "ArmoryConnection.h"
+#include "CacheFile.h"
+
+using namespace bs::sync;
+
+namespace {
+
+   const uint8_t kSnapshotVersion = 2;
+
+   // Up to 1000 leaves
+   const size_t kMaxSnapshots = 1000;
+
+   void putString(BinaryWriter &bw, const std::string &str)
+   {
+      bw.put_var_int(str.size());
+      bw.put_BinaryData(BinaryData::fromString(str));
+   }
+
+   std::string getString(BinaryRefReader &brr)
+   {
+      const auto len = brr.get_var_int();
+      return brr.get_BinaryData(static_cast<uint32_t>(len)).toBinStr();
+   }
+
+   void putBinary(BinaryWriter &bw, const BinaryData &data)
+   {
+      bw.put_var_int(data.getSize());
+      bw.put_BinaryData(data);
+   }
+
+   BinaryData getBinary(BinaryRefReader &brr)
+   {
+      const auto len = brr.get_var_int();
+      return brr.get_BinaryData(static_cast<uint32_t>(len));
+   }
+
+   void putBalance(BinaryWriter &bw, BTCNumericTypes::balance_type balance)
+   {
+      bw.put_uint64_t(static_cast<uint64_t>(std::llround(balance * BTCNumericTypes::BalanceDivider)));
+   }
+
+   BTCNumericTypes::balance_type getBalance(BinaryRefReader &brr)
+   {
+      return static_cast<BTCNumericTypes::balance_type>(static_cast<int64_t>(brr.get_uint64_t()))
+         / BTCNumericTypes::BalanceDivider;
+   }
+
+   void putAddresses(BinaryWriter &bw, const std::vector<AddressData> &addresses)
+   {
+      bw.put_var_int(addresses.size());
+      for (const auto &addr : addresses) {
+         putString(bw, addr.index);
+         putString(bw, addr.address.display());
+         putString(bw, addr.comment);
+      }
+   }
+
+   std::vector<AddressData> getAddresses(BinaryRefReader &brr)
+   {
+      std::vector<AddressData> result;
+      const auto count = brr.get_var_int();
+      result.reserve(count);
+      for (uint64_t i = 0; i < count; ++i) {
+         AddressData addr;
+         addr.index = getString(brr);
+         addr.address = bs::Address::fromAddressString(getString(brr));
+         addr.comment = getString(brr);
+         result.emplace_back(std::move(addr));
+      }
+      return result;
+   }
+
+   BinaryData serialize(const WalletSnapshot &snapshot)
+   {
+      BinaryWriter bw;
+      bw.put_uint8_t(kSnapshotVersion);
+      putString(bw, snapshot.rootId);
+      bw.put_uint32_t(snapshot.topBlock);
+      bw.put_uint32_t(static_cast<uint32_t>(snapshot.groupType));
+      putString(bw, snapshot.path.toString());
+      bw.put_uint8_t(snapshot.extOnly ? 1 : 0);
+
+      bw.put_uint32_t(snapshot.data.highestExtIndex);
+      bw.put_uint32_t(snapshot.data.highestIntIndex);
+      putAddresses(bw, snapshot.data.addresses);
+      putAddresses(bw, snapshot.data.addrPool);
+      bw.put_var_int(snapshot.data.txComments.size());
+      for (const auto &txComment : snapshot.data.txComments) {
+         putBinary(bw, txComment.txHash);
+         putString(bw, txComment.comment);
+      }
+
+      putBalance(bw, snapshot.spendableBalance);
+      putBalance(bw, snapshot.unconfirmedBalance);
+      putBalance(bw, snapshot.totalBalance);
+      bw.put_uint64_t(snapshot.addrCount);
+
+      bw.put_var_int(snapshot.addressBalances.size());
+      for (const auto &addrBal : snapshot.addressBalances) {
+         putBinary(bw, addrBal.first);
+         bw.put_var_int(addrBal.second.size());
+         for (const auto &value : addrBal.second) {
+            bw.put_uint64_t(value);
+         }
+      }
+      bw.put_var_int(snapshot.addressTxNs.size());
+      for (const auto &addrTxN : snapshot.addressTxNs) {
+         putBinary(bw, addrTxN.first);
+         bw.put_uint64_t(addrTxN.second);
+      }
+      return bw.getData();
+   }
+
+   WalletSnapshot deserialize(const BinaryData &data)
+   {
+      WalletSnapshot snapshot;
+      BinaryRefReader brr(data.getRef());
+      if (brr.get_uint8_t() != kSnapshotVersion) {
+         throw std::runtime_error("unsupported version");
+      }
+      snapshot.rootId = getString(brr);
+      snapshot.topBlock = brr.get_uint32_t();
+      snapshot.groupType = static_cast<bs::hd::CoinType>(brr.get_uint32_t());
+      snapshot.path = bs::hd::Path::fromString(getString(brr));
+      snapshot.extOnly = (brr.get_uint8_t() != 0);
+
+      snapshot.data.highestExtIndex = brr.get_uint32_t();
+      snapshot.data.highestIntIndex = brr.get_uint32_t();
+      snapshot.data.addresses = getAddresses(brr);
+      snapshot.data.addrPool = getAddresses(brr);
+      const auto nbTxComments = brr.get_var_int();
+      for (uint64_t i = 0; i < nbTxComments; ++i) {
+         TxCommentData txComment;
+         txComment.txHash = getBinary(brr);
+         txComment.comment = getString(brr);
+         snapshot.data.txComments.emplace_back(std::move(txComment));
+      }
+
+      snapshot.spendableBalance = getBalance(brr);
+      snapshot.unconfirmedBalance = getBalance(brr);
+      snapshot.totalBalance = getBalance(brr);
+      snapshot.addrCount = brr.get_uint64_t();
+
+      const auto nbAddrBalances = brr.get_var_int();
+      for (uint64_t i = 0; i < nbAddrBalances; ++i) {
+         auto addr = getBinary(brr);
+         const auto nbValues = brr.get_var_int();
+         std::vector<uint64_t> values;
+         values.reserve(nbValues);
+         for (uint64_t j = 0; j < nbValues; ++j) {
+            values.push_back(brr.get_uint64_t());
+         }
+         snapshot.addressBalances.emplace(std::move(addr), std::move(values));
+      }
+      const auto nbAddrTxNs = brr.get_var_int();
+      for (uint64_t i = 0; i < nbAddrTxNs; ++i) {
+         auto addr = getBinary(brr);
+         snapshot.addressTxNs.emplace(std::move(addr), brr.get_uint64_t());
+      }
+      return snapshot;
+   }
+
+} // namespace
+
+WalletSnapshotStore::WalletSnapshotStore(const std::shared_ptr<spdlog::logger> &logger
+   , const std::shared_ptr<ArmoryConnection> &armory, const std::string &fileName)
+   : logger_(logger)
+   , armory_(armory)
+   , cacheFile_(std::make_unique<CacheFile>(fileName, kMaxSnapshots))
+{}
+
+WalletSnapshotStore::~WalletSnapshotStore() = default;
+
+bool WalletSnapshotStore::get(const std::string &walletId, const std::string &rootId
+   , WalletSnapshot &snapshot) const
+{
+   const auto data = cacheFile_->get(BinaryData::fromString(walletId));
+   if (data.empty()) {
+      return false;
+   }
+   try {
+      snapshot = deserialize(data);
+   }
+   catch (const std::exception &e) {
+      logger_->warn("[WalletSnapshotStore::get] invalid snapshot for {}: {}", walletId, e.what());
+      return false;
+   }
+   if (snapshot.rootId != rootId) {
+      logger_->debug("[WalletSnapshotStore::get] snapshot for {} belongs to other wallet {}"
+         , walletId, snapshot.rootId);
+      return false;
+   }
+   return !isAheadOfTip(walletId, snapshot);
+}
+
+std::map<std::string, WalletSnapshot> WalletSnapshotStore::getAll(const std::string &rootId) const
+{
+   std::map<std::string, WalletSnapshot> result;
+   for (const auto &key : cacheFile_->keys()) {
+      const auto walletId = key.toBinStr();
+      WalletSnapshot snapshot;
+      try {
+         snapshot = deserialize(cacheFile_->get(key));
+      }
+      catch (const std::exception &e) {
+         logger_->warn("[WalletSnapshotStore::getAll] invalid snapshot for {}: {}", walletId, e.what());
+         continue;
+      }
+      if ((snapshot.rootId == rootId) && !isAheadOfTip(walletId, snapshot)) {
+         result.emplace(walletId, std::move(snapshot));
+      }
+   }
+   return result;
+}
+
+bool WalletSnapshotStore::isAheadOfTip(const std::string &walletId, const WalletSnapshot &snapshot) const
+{
+   // Chain tip is unknown until Armory is connected, snapshot will be refreshed then anyway
+   if (armory_ && armory_->topBlock() && (snapshot.topBlock > armory_->topBlock())) {
+      logger_->debug("[WalletSnapshotStore] snapshot for {} is ahead of chain tip ({} > {})"
+         , walletId, snapshot.topBlock, armory_->topBlock());
+      return true;
+   }
+   return false;
+}
+
+void WalletSnapshotStore::put(const std::string &walletId, const WalletSnapshot &snapshot)
+{
+   cacheFile_->put(BinaryData::fromString(walletId), serialize(snapshot));
+}
+
+void WalletSnapshotStore::erase(const std::string &walletId)
+{
+   cacheFile_->remove(BinaryData::fromString(walletId));
+}
@@ -0,0 +1,88 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+
+#ifndef BS_SYNC_WALLET_SNAPSHOT_H
+#define BS_SYNC_WALLET_SNAPSHOT_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BinaryData.h"
+#include "BTCNumericTypes.h"
+#include "SignerDefs.h"
+
+namespace spdlog {
+   class logger;
+}
+class ArmoryConnection;
+class CacheFile;
+
+namespace bs {
+   namespace sync {
+
+      // Last known state of synchronized wallet, used to show wallet data
+      // on startup before signer and Armory sync is complete
+      struct WalletSnapshot
+      {
+         // HD wallet the leaf belonged to
+         std::string    rootId;
+         unsigned int   topBlock{};
+
+         // Leaf location in HD wallet, to show it before signer sends wallet structure
+         bs::hd::CoinType  groupType{};
+         bs::hd::Path      path;
+         bool              extOnly{};
+
+         WalletData     data;
+
+         BTCNumericTypes::balance_type spendableBalance{};
+         BTCNumericTypes::balance_type unconfirmedBalance{};
+         BTCNumericTypes::balance_type totalBalance{};
+         uint64_t addrCount{};
+         std::map<BinaryData, std::vector<uint64_t>>  addressBalances;
+         std::map<BinaryData, uint64_t>               addressTxNs;
+      };
+
+      // Persistent storage of wallet snapshots (kept in memory only if file name is empty)
+      class WalletSnapshotStore
+      {
+      public:
+         WalletSnapshotStore(const std::shared_ptr<spdlog::logger> &
+            , const std::shared_ptr<ArmoryConnection> &
+            , const std::string &fileName);
+         ~WalletSnapshotStore();
+
+         WalletSnapshotStore(const WalletSnapshotStore&) = delete;
+         WalletSnapshotStore& operator = (const WalletSnapshotStore&) = delete;
+
+         // Returns false if there is no snapshot, it was made for other HD wallet
+         // or it is ahead of current Armory chain tip (reorg or other network)
+         bool get(const std::string &walletId, const std::string &rootId, WalletSnapshot &) const;
+         // All valid snapshots of HD wallet leaves, keyed by leaf id
+         std::map<std::string, WalletSnapshot> getAll(const std::string &rootId) const;
+         void put(const std::string &walletId, const WalletSnapshot &);
+         void erase(const std::string &walletId);
+
+      private:
+         bool isAheadOfTip(const std::string &walletId, const WalletSnapshot &) const;
+
+      private:
+         std::shared_ptr<spdlog::logger>     logger_;
+         std::shared_ptr<ArmoryConnection>   armory_;
+         std::unique_ptr<CacheFile>          cacheFile_;
+      };
+
+   }  //namespace sync
+}  //namespace bs
+
+#endif // BS_SYNC_WALLET_SNAPSHOT_H
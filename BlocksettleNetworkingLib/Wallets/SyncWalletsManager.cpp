@@ -49,6 +49,14 @@ WalletsManager::WalletsManager(const std::shared_ptr<spdlog::logger>& logger
 {
    init(armory.get());
 
+   syncPipeline_ = std::make_shared<SyncPipeline>();
+   if (appSettings_) {
+      snapshots_ = std::make_shared<WalletSnapshotStore>(logger, armory
+         , appSettings_->get<std::string>(ApplicationSettings::walletsSnapshotFileName));
+   }
+   if (armory) {
+      balanceScheduler_ = std::make_shared<BalanceScheduler>(logger, armory);
+   }
    ccResolver_ = std::make_shared<CCResolver>();
    maintThreadRunning_ = true;
    maintThread_ = std::thread(&WalletsManager::maintenanceThreadFunc, this);
@@ -56,6 +64,7 @@ WalletsManager::WalletsManager(const std::shared_ptr<spdlog::logger>& logger
 
 WalletsManager::~WalletsManager() noexcept
 {
+   saveSnapshots();
    validityFlag_.reset();
 
    for (const auto &hdWallet : hdWallets_) {
@@ -84,6 +93,11 @@ void WalletsManager::setSignContainer(const std::shared_ptr<WalletSignerContaine
 
 void WalletsManager::reset()
 {
+   saveSnapshots();
+   {
+      std::lock_guard<std::mutex> lock(mtxAddressIndex_);
+      addressIndex_.clear();
+   }
    QMutexLocker lock(&mtxWallets_);
    wallets_.clear();
    hdWallets_.clear();
@@ -114,7 +128,12 @@ void WalletsManager::syncWallet(const bs::sync::WalletInfo &info, const std::fun
                saveWallet(hdWallet);
                cbDone();
             };
-            hdWallet->synchronize(cbHDWalletDone);
+            // Leaves restored from snapshots are shown before signer sends the data
+            const auto &cbRestored = [this, hdWallet] {
+               saveWallet(hdWallet);
+               emit walletChanged(hdWallet->walletId());
+            };
+            hdWallet->synchronize(cbHDWalletDone, syncPipeline_, snapshots_, cbRestored);
          }
       } catch (const std::exception &e) {
          logger_->error("[WalletsManager::syncWallets] failed to create HD wallet "
@@ -143,19 +162,20 @@ void WalletsManager::syncWallets(const CbProgress &cb)
    }
 
    const auto &cbWalletInfo = [this, cb](const std::vector<bs::sync::WalletInfo> &wi) {
-      auto walletIds = std::make_shared<std::unordered_set<std::string>>();
-      for (const auto &info : wi)
-         walletIds->insert(info.id);
+      // HD wallets are synchronized concurrently (leaves are limited by syncPipeline_)
+      // and could complete on different threads
+      auto walletsLeft = std::make_shared<std::atomic<size_t>>(wi.size());
 
       for (const auto &info : wi) {
-         const auto &cbDone = [this, walletIds, id = info.id, total = wi.size(), cb]
+         const auto &cbDone = [this, walletsLeft, total = wi.size(), cb]
          {
-            walletIds->erase(id);
+            const auto left = walletsLeft->fetch_sub(1) - 1;
             if (cb)
-               cb(total - walletIds->size(), total);
+               cb(total - left, total);
 
-            if (walletIds->empty()) {
+            if (left == 0) {
                logger_->debug("[WalletsManager::syncWallets] all wallets synchronized");
+               logSyncStats();
                emit walletsSynchronized();
                emit walletChanged("");
                syncState_ = WalletsSyncState::Synced;
@@ -225,11 +245,13 @@ void WalletsManager::addWallet(const WalletPtr &wallet, bool isHDLeaf)
       updateTracker(ccLeaf);
    }
    wallet->setUserId(userId_);
+   wallet->setBalanceScheduler(balanceScheduler_);
 
    {
       QMutexLocker lock(&mtxWallets_);
       wallets_[wallet->walletId()] = wallet;
    }
+   indexAddresses(wallet->walletId(), wallet->getAddrHashes());
 
    if (isHDLeaf && (wallet->type() == bs::core::wallet::Type::Authentication)) {
       authAddressWallet_ = wallet;
@@ -238,18 +260,73 @@ void WalletsManager::addWallet(const WalletPtr &wallet, bool isHDLeaf)
       emit authWalletChanged();
    }
 
-   if (walletsRegistered_) {
+   // Leaf restored from snapshot is registered when it's added again with signer data
+   if (walletsRegistered_ && !wallet->isSyncPending()) {
       wallet->registerWallet(armoryPtr_);
    }
 }
 
 void WalletsManager::balanceUpdated(const std::string &walletId)
 {
+   if (snapshots_) {    // saved on new block or shutdown
+      std::lock_guard<std::mutex> lock(mtxDirtySnapshots_);
+      dirtySnapshots_.insert(walletId);
+   }
    addToMaintQueue([this, walletId] {
       QMetaObject::invokeMethod(this, [this, walletId] { emit walletBalanceUpdated(walletId); });
    });
 }
 
+void WalletsManager::addressesAdded(const std::string &walletId
+   , const std::vector<bs::Address> &addrs)
+{
+   {
+      QMutexLocker lock(&mtxWallets_);
+      if (wallets_.find(walletId) == wallets_.end()) {   // not added yet - will be indexed in addWallet
+         return;
+      }
+   }
+   std::vector<BinaryData> addrIds;
+   addrIds.reserve(addrs.size());
+   for (const auto &addr : addrs) {
+      addrIds.push_back(addr.id());
+   }
+   indexAddresses(walletId, addrIds);
+}
+
+void WalletsManager::indexAddresses(const std::string &walletId, const std::vector<BinaryData> &addrIds)
+{
+   std::lock_guard<std::mutex> lock(mtxAddressIndex_);
+   for (const auto &addrId : addrIds) {
+      if (addrId.getSize() < 2) {
+         continue;
+      }
+      // leaves look up used addresses by hash without the prefix - index the same way
+      const auto key = addrId.getSliceCopy(1, addrId.getSize() - 1);
+      const auto range = addressIndex_.equal_range(key);
+      const auto itWallet = std::find_if(range.first, range.second
+         , [&walletId](const std::pair<const BinaryData, std::string> &entry) {
+         return (entry.second == walletId);
+      });
+      if (itWallet == range.second) {
+         addressIndex_.emplace(key, walletId);
+      }
+   }
+}
+
+void WalletsManager::unindexAddresses(const std::string &walletId)
+{
+   std::lock_guard<std::mutex> lock(mtxAddressIndex_);
+   for (auto it = addressIndex_.begin(); it != addressIndex_.end(); ) {
+      if (it->second == walletId) {
+         it = addressIndex_.erase(it);
+      }
+      else {
+         ++it;
+      }
+   }
+}
+
 void WalletsManager::addressAdded(const std::string &walletId)
 {
    addToMaintQueue([this, walletId] {
@@ -266,6 +343,8 @@ void WalletsManager::metadataChanged(const std::string &walletId)
 
 void WalletsManager::walletReset(const std::string &walletId)
 {
+   // called synchronously before the leaf is repopulated, which re-indexes its addresses
+   unindexAddresses(walletId);
    addToMaintQueue([this, walletId] {
       QMetaObject::invokeMethod(this, [this, walletId] { emit walletChanged(walletId); });
    });
@@ -279,7 +358,9 @@ void WalletsManager::saveWallet(const HDWalletPtr &wallet)
    const auto existingHdWallet = getHDWalletById(wallet->walletId());
 
    if (existingHdWallet) {    // merge if HD wallet already exists
-      existingHdWallet->merge(*wallet);
+      if (existingHdWallet != wallet) {   // added before with leaves restored from snapshots
+         existingHdWallet->merge(*wallet);
+      }
    }
    else {
       hdWallets_.push_back(wallet);
@@ -444,13 +525,53 @@ WalletsManager::WalletPtr WalletsManager::getWalletById(const std::string& walle
 
 WalletsManager::WalletPtr WalletsManager::getWalletByAddress(const bs::Address &address) const
 {
-   for (const auto &wallet : wallets_) {
-      if (wallet.second && (wallet.second->containsAddress(address)
-         || wallet.second->containsHiddenAddress(address))) {
-         return wallet.second;
+   return getWalletsByAddresses({ address }).front();
+}
+
+std::vector<WalletsManager::WalletPtr> WalletsManager::getWalletsByAddresses(
+   const std::vector<bs::Address> &addrs) const
+{
+   std::vector<std::vector<std::string>> candidateIds(addrs.size());
+   {
+      std::lock_guard<std::mutex> lock(mtxAddressIndex_);
+      for (size_t i = 0; i < addrs.size(); ++i) {
+         if (addrs[i].empty()) {
+            continue;
+         }
+         const auto range = addressIndex_.equal_range(addrs[i].unprefixed());
+         for (auto it = range.first; it != range.second; ++it) {
+            candidateIds[i].push_back(it->second);
+         }
       }
    }
-   return nullptr;
+
+   std::vector<std::vector<WalletPtr>> candidates(addrs.size());
+   {
+      QMutexLocker lock(&mtxWallets_);
+      for (size_t i = 0; i < addrs.size(); ++i) {
+         for (const auto &walletId : candidateIds[i]) {
+            const auto itWallet = wallets_.find(walletId);
+            if (itWallet != wallets_.end()) {
+               candidates[i].push_back(itWallet->second);
+            }
+         }
+      }
+   }
+
+   // leaf checks take leaf locks, so they're done outside of the manager locks
+   std::vector<WalletPtr> result;
+   result.reserve(addrs.size());
+   for (size_t i = 0; i < addrs.size(); ++i) {
+      WalletPtr wallet;
+      for (const auto &candidate : candidates[i]) {
+         if (candidate->containsAddress(addrs[i]) || candidate->containsHiddenAddress(addrs[i])) {
+            wallet = candidate;
+            break;
+         }
+      }
+      result.push_back(wallet);
+   }
+   return result;
 }
 
 WalletsManager::GroupPtr WalletsManager::getGroupByWalletId(const std::string& walletId) const
@@ -530,9 +651,45 @@ BTCNumericTypes::balance_type WalletsManager::getBalanceSum(
 
 void WalletsManager::onNewBlock(unsigned int, unsigned int)
 {
+   addToMaintQueue([this] {
+      saveSnapshots();
+   });
+   if (balanceScheduler_) {
+      const auto stats = balanceScheduler_->stats();
+      SPDLOG_LOGGER_DEBUG(logger_, "[WalletsManager::onNewBlock] balance refreshes: {} requests, {} sent"
+         ", {} saved, latency p50 {} us, p99 {} us", stats.requests, stats.armoryRequests
+         , stats.requestsSaved(), stats.latency.p50.count(), stats.latency.p99.count());
+   }
    QMetaObject::invokeMethod(this, [this] {emit blockchainEvent(); });
 }
 
+SyncPipeline::Stats WalletsManager::syncStats() const
+{
+   return syncPipeline_->stats();
+}
+
+void WalletsManager::logSyncStats() const
+{
+   const auto stats = syncPipeline_->stats();
+   for (size_t i = 0; i < stats.stages.size(); ++i) {
+      const auto &stage = stats.stages[i];
+      if (!stage.count) {
+         continue;
+      }
+      SPDLOG_LOGGER_DEBUG(logger_, "[WalletsManager] sync stage {}: {} job[s], total {} ms, p50 {} ms, max {} ms"
+         , SyncPipeline::toString(static_cast<SyncPipeline::Stage>(i)), stage.count
+         , stage.total.count() / 1000, stage.p50.count() / 1000, stage.max.count() / 1000);
+   }
+}
+
+BalanceScheduler::Stats WalletsManager::balanceRefreshStats() const
+{
+   if (!balanceScheduler_) {
+      return {};
+   }
+   return balanceScheduler_->stats();
+}
+
 void WalletsManager::onStateChanged(ArmoryState state)
 {
    if (state == ArmoryState::Ready) {
@@ -602,10 +759,59 @@ void WalletsManager::eraseWallet(const WalletPtr &wallet)
    if (!wallet) {
       return;
    }
+   if (snapshots_) {
+      {
+         std::lock_guard<std::mutex> lock(mtxDirtySnapshots_);
+         dirtySnapshots_.erase(wallet->walletId());
+      }
+      snapshots_->erase(wallet->walletId());
+   }
+   unindexAddresses(wallet->walletId());
    QMutexLocker lock(&mtxWallets_);
    wallets_.erase(wallet->walletId());
 }
 
+void WalletsManager::saveSnapshots()
+{
+   std::set<std::string> walletIds;
+   {
+      std::lock_guard<std::mutex> lock(mtxDirtySnapshots_);
+      walletIds.swap(dirtySnapshots_);
+   }
+   for (const auto &walletId : walletIds) {
+      saveSnapshot(walletId);
+   }
+}
+
+void WalletsManager::saveSnapshot(const std::string &walletId)
+{
+   if (!snapshots_) {
+      return;
+   }
+   const auto wallet = getWalletById(walletId);
+   const auto rootWallet = getHDRootForLeaf(walletId);
+   if (!wallet || !rootWallet) {
+      return;
+   }
+   WalletSnapshot snapshot;
+   if (!wallet->getSnapshot(snapshot)) {
+      return;
+   }
+   snapshot.rootId = rootWallet->walletId();
+   const auto leaf = std::dynamic_pointer_cast<hd::Leaf>(wallet);
+   if (leaf) {
+      snapshot.path = leaf->path();
+      snapshot.extOnly = leaf->hasExtOnlyAddresses();
+      for (const auto &group : rootWallet->getGroups()) {
+         if (group->getLeaf(leaf->path()) == leaf) {
+            snapshot.groupType = static_cast<bs::hd::CoinType>(group->index());
+            break;
+         }
+      }
+   }
+   snapshots_->put(walletId, snapshot);
+}
+
 bool WalletsManager::deleteWallet(WalletPtr wallet, bool deleteRemotely)
 {
    bool isHDLeaf = false;
@@ -694,13 +900,21 @@ std::vector<std::string> WalletsManager::registerWallets()
       logger_->debug("[WalletsManager::{}] no wallets to register", __func__);
       return result;
    }
+   // Registration requests are asynchronous, results are delivered to wallets' onRefresh
+   const auto started = std::chrono::steady_clock::now();
    for (auto &it : wallets_) {
+      if (it.second->isSyncPending()) {
+         continue;
+      }
       const auto &ids = it.second->registerWallet(armoryPtr_);
       result.insert(result.end(), ids.begin(), ids.end());
       if (ids.empty() && it.second->type() != bs::core::wallet::Type::Settlement) {
          logger_->error("[{}] failed to register wallet {}", __func__, it.second->walletId());
       }
    }
+   syncPipeline_->addTiming(SyncPipeline::Stage::Register
+      , std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started)
+      , wallets_.size());
 
    return result;
 }
@@ -1446,14 +1660,22 @@ void WalletsManager::trackAddressChainUse(
       };
 
       auto leafPtr = it.second;
-      auto countLbd = [leafPtr, trackLbd](void)->void
+      syncPipeline_->add(SyncPipeline::Stage::TrackAddressChain
+         , [leafPtr, trackLbd, cb](const std::function<void()> &done)
       {
-         leafPtr->trackChainAddressUse(trackLbd);
-      };
+         auto countLbd = [leafPtr, trackLbd, done](void)->void
+         {
+            leafPtr->trackChainAddressUse([trackLbd, done](bs::sync::SyncState st) {
+               done();
+               trackLbd(st);
+            });
+         };
 
-      if (!leafPtr->getAddressTxnCounts(countLbd)) {
-         cb(false);
-      }
+         if (!leafPtr->getAddressTxnCounts(countLbd)) {
+            done();
+            cb(false);
+         }
+      });
    }
 }
 
@@ -1816,11 +2038,16 @@ bool WalletsManager::createAuthLeaf(const std::function<void()> &cb)
 std::map<std::string, std::vector<bs::Address>> WalletsManager::getAddressToWalletsMapping(
    const std::vector<UTXO> &utxos) const
 {
-   std::map<std::string, std::vector<bs::Address>> result;
+   std::vector<bs::Address> addrs;
+   addrs.reserve(utxos.size());
    for (const auto &utxo : utxos) {
-      const auto addr = bs::Address::fromUTXO(utxo);
-      const auto wallet = getWalletByAddress(addr);
-      result[wallet ? wallet->walletId() : ""].push_back(addr);
+      addrs.push_back(bs::Address::fromUTXO(utxo));
+   }
+   const auto wallets = getWalletsByAddresses(addrs);
+
+   std::map<std::string, std::vector<bs::Address>> result;
+   for (size_t i = 0; i < addrs.size(); ++i) {
+      result[wallets[i] ? wallets[i]->walletId() : ""].push_back(addrs[i]);
    }
    return result;
 }
@@ -1896,13 +2123,14 @@ std::vector<bs::TXEntry> WalletsManager::mergeEntries(const std::vector<bs::TXEn
 {
    std::vector<bs::TXEntry> mergedEntries;
    mergedEntries.reserve(entries.size());
+   // Only entries of the same TX can be merged - compare with them only
+   std::unordered_map<BinaryData, std::vector<size_t>, BinaryDataHash> entriesByTxHash;
+   entriesByTxHash.reserve(entries.size());
    for (const auto &entry : entries) {
-      if (mergedEntries.empty()) {
-         mergedEntries.push_back(entry);
-         continue;
-      }
+      auto &sameTxEntries = entriesByTxHash[entry.txHash];
       bool entryMerged = false;
-      for (auto &mergedEntry : mergedEntries) {
+      for (const auto idx : sameTxEntries) {
+         auto &mergedEntry = mergedEntries[idx];
          if (mergeableEntries(mergedEntry, entry)) {
             entryMerged = true;
             mergedEntry.merge(entry);
@@ -1910,6 +2138,7 @@ std::vector<bs::TXEntry> WalletsManager::mergeEntries(const std::vector<bs::TXEn
          }
       }
       if (!entryMerged) {
+         sameTxEntries.push_back(mergedEntries.size());
          mergedEntries.push_back(entry);
       }
    }
@@ -12,6 +12,7 @@
 #define BS_SYNC_WALLETS_MANAGER_H
 
 #include <memory>
+#include <mutex>
 #include <set>
 #include <unordered_map>
 #include <vector>
@@ -26,7 +27,10 @@
 #include "BSErrorCode.h"
 #include "BTCNumericTypes.h"
 #include "CoreWallet.h"
+#include "SyncBalanceScheduler.h"
+#include "SyncPipeline.h"
 #include "SyncWallet.h"
+#include "SyncWalletSnapshot.h"
 #include "ValidityFlag.h"
 #include "WalletSignerContainer.h"
 
@@ -87,6 +91,8 @@ namespace bs {
          std::unordered_map<std::string, std::string> getHwDeviceIdToWallet() const;
          WalletPtr getWalletById(const std::string& walletId) const;
          WalletPtr getWalletByAddress(const bs::Address &addr) const;
+         // Batch lookup, result is in the same order as addresses (nullptr for foreign ones)
+         std::vector<WalletPtr> getWalletsByAddresses(const std::vector<bs::Address> &) const;
          WalletPtr getDefaultWallet() const;
          GroupPtr getGroupByWalletId(const std::string &walletId) const;
 
@@ -163,6 +169,11 @@ namespace bs {
 
          std::shared_ptr<ColoredCoinTrackerClient> tracker(const std::string &cc) const;
 
+         // Metrics of coalesced balance/txn count refreshes
+         BalanceScheduler::Stats balanceRefreshStats() const;
+         // Per-stage timings of wallets synchronization
+         SyncPipeline::Stats syncStats() const;
+
       signals:
          void CCLeafCreated(const std::string& ccName);
          void CCLeafCreateFailed(const std::string& ccName, bs::error::ErrorCode result);
@@ -210,6 +221,7 @@ namespace bs {
 
       private:
          void addressAdded(const std::string &) override;
+         void addressesAdded(const std::string &, const std::vector<bs::Address> &) override;
          void balanceUpdated(const std::string &) override;
          void walletReady(const std::string &) override;
          void walletCreated(const std::string &) override;
@@ -226,6 +238,8 @@ namespace bs {
          void saveWallet(const WalletPtr &);
          void saveWallet(const HDWalletPtr &);
          void eraseWallet(const WalletPtr &);
+         void indexAddresses(const std::string &walletId, const std::vector<BinaryData> &addrIds);
+         void unindexAddresses(const std::string &walletId);
 
          void updateTxDirCache(const std::string &txKey, Transaction::Direction
             , const std::vector<bs::Address> &inAddrs
@@ -243,6 +257,10 @@ namespace bs {
          using MaintQueueCb = std::function<void()>;
          void addToMaintQueue(const MaintQueueCb &);
          void maintenanceThreadFunc();
+         void logSyncStats() const;
+         // Snapshots of wallets with updated balances are saved in one go
+         void saveSnapshots();
+         void saveSnapshot(const std::string &walletId);
 
          void processCreatedCCLeaf(const std::string &cc, bs::error::ErrorCode result
             , const std::string &walletId);
@@ -257,6 +275,11 @@ namespace bs {
          std::shared_ptr<spdlog::logger>        logger_;
          std::shared_ptr<ApplicationSettings>   appSettings_;
          std::shared_ptr<ArmoryConnection>      armoryPtr_;
+         std::shared_ptr<BalanceScheduler>      balanceScheduler_;
+         std::shared_ptr<SyncPipeline>          syncPipeline_;
+         std::shared_ptr<WalletSnapshotStore>   snapshots_;
+         std::mutex                             mtxDirtySnapshots_;
+         std::set<std::string>                  dirtySnapshots_;
 
          using wallet_container_type = std::unordered_map<std::string, WalletPtr>;
          using hd_wallet_container_type = std::vector<HDWalletPtr>;
@@ -266,6 +289,11 @@ namespace bs {
          std::unordered_set<std::string>     walletNames_;
          wallet_container_type               wallets_;
          mutable QMutex                      mtxWallets_;
+         // Unprefixed address hash to IDs of leaves that may contain it (used or pooled).
+         // Candidates are confirmed with containsAddress()/containsHiddenAddress(),
+         // so lookups match exactly what a scan over all wallets would.
+         std::unordered_multimap<BinaryData, std::string, BinaryDataHash>   addressIndex_;
+         mutable std::mutex                  mtxAddressIndex_;
          std::set<std::string>               readyWallets_;
          bool     isReady_ = false;
          WalletPtr                           authAddressWallet_;
@@ -0,0 +1,68 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "LatencyStats.h"
+
+#include <algorithm>
+
+double LatencyStats::Summary::throughput() const
+{
+   if (total.count() == 0) {
+      return 0;
+   }
+   return double(items) * 1000000.0 / double(total.count());
+}
+
+LatencyStats::LatencyStats(size_t window)
+   : window_(std::max<size_t>(window, 1))
+{
+   samples_.reserve(window_);
+}
+
+void LatencyStats::add(std::chrono::microseconds duration, uint64_t items)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+
+   totals_.count += 1;
+   totals_.items += items;
+   totals_.total += duration;
+   totals_.max = std::max(totals_.max, duration);
+
+   if (samples_.size() < window_) {
+      samples_.push_back(duration);
+   } else {
+      samples_[next_] = duration;
+   }
+   next_ = (next_ + 1) % window_;
+}
+
+LatencyStats::Summary LatencyStats::summary() const
+{
+   std::vector<std::chrono::microseconds> samples;
+   Summary result;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      samples = samples_;
+      result = totals_;
+   }
+
+   if (samples.empty()) {
+      return result;
+   }
+
+   std::sort(samples.begin(), samples.end());
+   const auto percentile = [&samples](size_t p) {
+      return samples[std::min(samples.size() - 1, samples.size() * p / 100)];
+   };
+   result.p50 = percentile(50);
+   result.p90 = percentile(90);
+   result.p99 = percentile(99);
+   return result;
+}
@@ -0,0 +1,83 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#ifndef __LATENCY_STATS_H__
+#define __LATENCY_STATS_H__
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Thread-safe duration recorder.
+// Totals cover all samples, percentiles are computed over the most recent ones only.
+class LatencyStats
+{
+public:
+   struct Summary
+   {
+      uint64_t count{};
+      // Items processed (tx, addresses...), used for throughput
+      uint64_t items{};
+      std::chrono::microseconds total{};
+      std::chrono::microseconds max{};
+      std::chrono::microseconds p50{};
+      std::chrono::microseconds p90{};
+      std::chrono::microseconds p99{};
+
+      // Items per second over recorded durations
+      double throughput() const;
+   };
+
+   explicit LatencyStats(size_t window = 1024);
+
+   LatencyStats(const LatencyStats&) = delete;
+   LatencyStats& operator = (const LatencyStats&) = delete;
+
+   void add(std::chrono::microseconds duration, uint64_t items = 1);
+
+   Summary summary() const;
+
+private:
+   const size_t window_;
+
+   mutable std::mutex mutex_;
+   std::vector<std::chrono::microseconds> samples_;
+   size_t next_{};
+   Summary totals_;
+};
+
+// Records the time between construction and destruction
+class LatencyTimer
+{
+public:
+   explicit LatencyTimer(LatencyStats &stats)
+      : stats_(stats)
+      , start_(std::chrono::steady_clock::now())
+   {}
+
+   ~LatencyTimer()
+   {
+      stats_.add(std::chrono::duration_cast<std::chrono::microseconds>(
+         std::chrono::steady_clock::now() - start_), items_);
+   }
+
+   LatencyTimer(const LatencyTimer&) = delete;
+   LatencyTimer& operator = (const LatencyTimer&) = delete;
+
+   void setItems(uint64_t items) { items_ = items; }
+
+private:
+   LatencyStats &stats_;
+   const std::chrono::steady_clock::time_point start_;
+   uint64_t items_{1};
+};
+
+#endif // __LATENCY_STATS_H__
@@ -19,6 +19,21 @@
 #include "TxClasses.h"
 #include "XBTAmount.h"
 
+// Hasher for unordered containers keyed by BinaryData (or bs::Address), FNV-1a
+struct BinaryDataHash
+{
+   std::size_t operator()(const BinaryData &data) const
+   {
+      uint64_t hash = 14695981039346656037ULL;
+      const auto ptr = data.getPtr();
+      for (size_t i = 0; i < data.getSize(); ++i) {
+         hash ^= ptr[i];
+         hash *= 1099511628211ULL;
+      }
+      return static_cast<std::size_t>(hash);
+   }
+};
+
 namespace bs {
    class Address : public BinaryData
    {
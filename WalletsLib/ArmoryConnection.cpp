@@ -22,6 +22,15 @@
 #include "ManualResetEvent.h"
 #include "SocketIncludes.h"
 
+namespace {
+
+   const uint32_t kRequiredConfCountForCache = 6;
+
+   const size_t kMaxUnroutedRefreshIds = 1024;
+   const auto kRegistrationRouteTimeout = std::chrono::minutes(10);
+
+} // namespace
+
 
 ArmoryCallbackTarget::ArmoryCallbackTarget()
 {}
@@ -77,6 +86,7 @@ bool ArmoryConnection::addTarget(ArmoryCallbackTarget *act)
       return false;
    }
    activeTargets_.insert(act);
+   updateTargetsList();
    return true;
 }
 
@@ -94,6 +104,8 @@ bool ArmoryConnection::removeTarget(ArmoryCallbackTarget *act)
          return;
       }
       activeTargets_.erase(it);
+      removeTargetRoutes(act);
+      updateTargetsList();
       done.set_value(true);
    });
 
@@ -101,24 +113,226 @@ bool ArmoryConnection::removeTarget(ArmoryCallbackTarget *act)
    return result;
 }
 
-void ArmoryConnection::maintenanceThreadFunc()
+void ArmoryConnection::addTargetRoutes(ArmoryCallbackTarget *act
+   , const std::vector<std::string> &walletIds, const std::vector<BinaryData> &addresses)
 {
-   const auto &forEachTarget = [this](const std::function<void(ArmoryCallbackTarget *tgt)> &cb) {
-      decltype(activeTargets_) notifiedACTs;
+   std::unique_lock<std::mutex> lock(cbMutex_);
+   auto &routes = targetRoutes_[act];
+   for (const auto &walletId : walletIds) {
+      routes.ids.insert(walletId);
+      idRoutes_[walletId].insert(act);
+   }
+   for (const auto &addr : addresses) {
+      routes.addresses.insert(addr);
+      addressRoutes_[addr].insert(act);
+   }
+}
 
-      {
-         std::unique_lock<std::mutex> lock(cbMutex_);
-         notifiedACTs = activeTargets_;
+void ArmoryConnection::addRegistrationRoute(ArmoryCallbackTarget *act, const std::string &regId)
+{
+   std::unique_lock<std::mutex> lock(cbMutex_);
+   expireRegistrationRoutes();
+   if (unroutedRefreshIds_.erase(regId) != 0) {
+      // refresh arrived before the route and was delivered to all targets
+      return;
+   }
+   const auto itRoutes = targetRoutes_.find(act);
+   if (itRoutes == targetRoutes_.end()) {
+      return;
+   }
+   itRoutes->second.ids.insert(regId);
+   idRoutes_[regId].insert(act);
+   registrationIds_[regId] = std::chrono::steady_clock::now();
+}
+
+void ArmoryConnection::removeTargetRoutes(ArmoryCallbackTarget *act)
+{
+   const auto itRoutes = targetRoutes_.find(act);
+   if (itRoutes == targetRoutes_.end()) {
+      return;
+   }
+   for (const auto &id : itRoutes->second.ids) {
+      auto it = idRoutes_.find(id);
+      if (it == idRoutes_.end()) {
+         continue;
+      }
+      it->second.erase(act);
+      if (it->second.empty()) {
+         idRoutes_.erase(it);
+         registrationIds_.erase(id);
       }
+   }
+   for (const auto &addr : itRoutes->second.addresses) {
+      auto it = addressRoutes_.find(addr);
+      if (it == addressRoutes_.end()) {
+         continue;
+      }
+      it->second.erase(act);
+      if (it->second.empty()) {
+         addressRoutes_.erase(it);
+      }
+   }
+   targetRoutes_.erase(itRoutes);
+}
 
-      for (const auto &tgt : notifiedACTs) {
-         if (!maintThreadRunning_) {
-            break;
+void ArmoryConnection::expireRegistrationRoutes()
+{
+   const auto now = std::chrono::steady_clock::now();
+   for (auto it = registrationIds_.begin(); it != registrationIds_.end(); ) {
+      if (now - it->second < kRegistrationRouteTimeout) {
+         ++it;
+         continue;
+      }
+      const auto itRoutes = idRoutes_.find(it->first);
+      if (itRoutes != idRoutes_.end()) {
+         for (const auto &tgt : itRoutes->second) {
+            const auto itTarget = targetRoutes_.find(tgt);
+            if (itTarget != targetRoutes_.end()) {
+               itTarget->second.ids.erase(it->first);
+            }
          }
-         cb(tgt);
+         idRoutes_.erase(itRoutes);
       }
-   };
+      it = registrationIds_.erase(it);
+   }
+}
+
+void ArmoryConnection::updateTargetsList()
+{
+   targetsList_ = std::make_shared<const TargetsList>(activeTargets_.begin(), activeTargets_.end());
+}
+
+void ArmoryConnection::forEachTarget(const CallbackQueueCb &cb)
+{
+   std::shared_ptr<const TargetsList> targets;
+   {
+      std::unique_lock<std::mutex> lock(cbMutex_);
+      targets = targetsList_;
+   }
+   if (!targets) {
+      return;
+   }
+
+   // Targets are removed on maintenance thread only, so they stay valid here
+   for (const auto &tgt : *targets) {
+      if (!maintThreadRunning_) {
+         break;
+      }
+      cb(tgt);
+   }
+}
+
+void ArmoryConnection::routeRefresh(const std::vector<BinaryData> &ids, bool online)
+{
+   std::shared_ptr<const TargetsList> targets;
+   std::unordered_map<ArmoryCallbackTarget *, std::vector<BinaryData>> routedIds;
+   {
+      std::unique_lock<std::mutex> lock(cbMutex_);
+      targets = targetsList_;
+      expireRegistrationRoutes();
+
+      for (const auto &item : targetRoutes_) {
+         routedIds[item.first];
+      }
+      for (const auto &id : ids) {
+         const auto idStr = id.toBinStr();
+         const auto it = idRoutes_.find(idStr);
+         if (it == idRoutes_.end()) {
+            // Not claimed by any target
+            for (auto &item : routedIds) {
+               item.second.push_back(id);
+            }
+            if (unroutedRefreshIds_.insert(idStr).second) {
+               unroutedRefreshOrder_.push_back(idStr);
+               if (unroutedRefreshOrder_.size() > kMaxUnroutedRefreshIds) {
+                  unroutedRefreshIds_.erase(unroutedRefreshOrder_.front());
+                  unroutedRefreshOrder_.pop_front();
+               }
+            }
+            continue;
+         }
+         for (const auto &tgt : it->second) {
+            routedIds[tgt].push_back(id);
+         }
+         if (registrationIds_.erase(idStr) != 0) {
+            for (const auto &tgt : it->second) {
+               targetRoutes_[tgt].ids.erase(idStr);
+            }
+            idRoutes_.erase(it);
+         }
+      }
+   }
+   if (!targets) {
+      return;
+   }
+
+   for (const auto &tgt : *targets) {
+      if (!maintThreadRunning_) {
+         break;
+      }
+      const auto it = routedIds.find(tgt);
+      if (it == routedIds.end()) {
+         tgt->onRefresh(ids, online);
+      }
+      else if (ids.empty() || !it->second.empty()) {
+         tgt->onRefresh(it->second, online);
+      }
+   }
+}
+
+void ArmoryConnection::routeZCs(const std::vector<bs::TXEntry> &entries)
+{
+   std::shared_ptr<const TargetsList> targets;
+   std::unordered_map<ArmoryCallbackTarget *, std::vector<bs::TXEntry>> routedEntries;
+   {
+      std::unique_lock<std::mutex> lock(cbMutex_);
+      targets = targetsList_;
+
+      for (const auto &item : targetRoutes_) {
+         routedEntries[item.first];
+      }
+      if (!targetRoutes_.empty()) {
+         std::unordered_set<ArmoryCallbackTarget *> matched;
+         for (const auto &entry : entries) {
+            matched.clear();
+            for (const auto &walletId : entry.walletIds) {
+               const auto it = idRoutes_.find(walletId);
+               if (it != idRoutes_.end()) {
+                  matched.insert(it->second.begin(), it->second.end());
+               }
+            }
+            for (const auto &addr : entry.addresses) {
+               const auto it = addressRoutes_.find(addr);
+               if (it != addressRoutes_.end()) {
+                  matched.insert(it->second.begin(), it->second.end());
+               }
+            }
+            for (const auto &tgt : matched) {
+               routedEntries[tgt].push_back(entry);
+            }
+         }
+      }
+   }
+   if (!targets) {
+      return;
+   }
 
+   for (const auto &tgt : *targets) {
+      if (!maintThreadRunning_) {
+         break;
+      }
+      const auto it = routedEntries.find(tgt);
+      if (it == routedEntries.end()) {
+         tgt->onZCReceived(entries);
+      }
+      else if (!it->second.empty()) {
+         tgt->onZCReceived(it->second);
+      }
+   }
+}
+
+void ArmoryConnection::maintenanceThreadFunc()
+{
    while (maintThreadRunning_) {
       {
          std::unique_lock<std::mutex> lock(actMutex_);
@@ -143,7 +357,7 @@ void ArmoryConnection::maintenanceThreadFunc()
       }
 
       for (const auto &cb : tempQueue) {
-         forEachTarget(cb);
+         cb();
          if (!maintThreadRunning_) {
             break;
          }
@@ -151,10 +365,24 @@ void ArmoryConnection::maintenanceThreadFunc()
    }
 }
 
+void ArmoryConnection::postToMaintThread(ArmoryConnection::EmptyCb cb)
+{
+   if (!maintThreadRunning_) {
+      cb();
+      return;
+   }
+
+   std::unique_lock<std::mutex> lock(actMutex_);
+   runQueue_.push_back(std::move(cb));
+   actCV_.notify_one();
+}
+
 void ArmoryConnection::addToMaintQueue(const CallbackQueueCb &cb)
 {
    std::unique_lock<std::mutex> lock(actMutex_);
-   actQueue_.push_back(cb);
+   actQueue_.push_back([this, cb] {
+      forEachTarget(cb);
+   });
    actCV_.notify_one();
 }
 
@@ -728,6 +956,9 @@ bool ArmoryConnection::getCombinedBalances(const std::vector<std::string> &walle
       }
       catch (const std::exception &e) {
          logger->error("[ArmoryConnection::getCombinedBalances] failed to get result: {}", e.what());
+         if (cb) {
+            cb({});
+         }
       }
    };
    bdv_->getCombinedBalances(walletIDs, cbWrap);
@@ -764,13 +995,14 @@ bool ArmoryConnection::getCombinedTxNs(const std::vector<std::string> &walletIDs
    return true;
 }
 
-bool ArmoryConnection::addGetTxCallback(const BinaryData &hash, const TxCb &cb)
+bool ArmoryConnection::addGetTxCallback(const BinaryData &hash, const TxResultCb &cb)
 {
    std::unique_lock<std::mutex> lock(cbMutex_);
 
    const auto &it = txCallbacks_.find(hash);
    if (it != txCallbacks_.end()) {
       it->second.push_back(cb);
+      txCoalesced_++;
       return true;
    }
 
@@ -778,9 +1010,10 @@ bool ArmoryConnection::addGetTxCallback(const BinaryData &hash, const TxCb &cb)
    return false;
 }
 
-void ArmoryConnection::callGetTxCallbacks(const BinaryData &hash, const AsyncClient::TxResult &tx)
+void ArmoryConnection::callGetTxCallbacks(const BinaryData &hash, const AsyncClient::TxResult &tx
+   , std::exception_ptr exPtr)
 {
-   std::vector<TxCb> callbacks;
+   std::vector<TxResultCb> callbacks;
    {
       std::unique_lock<std::mutex> lock(cbMutex_);
       const auto &it = txCallbacks_.find(hash);
@@ -789,37 +1022,102 @@ void ArmoryConnection::callGetTxCallbacks(const BinaryData &hash, const AsyncCli
                         , hash.toHexStr(true));
          return;
       }
-      callbacks = it->second;
+      callbacks = std::move(it->second);
       txCallbacks_.erase(it);
    }
    for (const auto &callback : callbacks) {
-      if (callback) {
-         callback(tx ? *tx : Tx{});
-      }
+      callback(tx, exPtr);
+   }
+}
+
+std::shared_ptr<const Tx> ArmoryConnection::getCachedTx(const BinaryData &hash, bool allowPersistent)
+{
+   auto tx = txCache_.get(hash);
+   if (tx || !allowPersistent) {
+      return tx;
+   }
+   // Not promoted to in-memory cache as persistent entries are not complete
+   tx = getFromPersistentCache(hash);
+   if (tx) {
+      txPersistentHits_++;
    }
+   return tx;
+}
+
+void ArmoryConnection::putToCacheIfNeeded(const BinaryData &hash, const std::shared_ptr<const Tx> &tx)
+{
+   if (!tx || !tx->isInitialized() || tx->getTxHeight() == UINT32_MAX) {
+      return;
+   }
+   const auto topBlock = topBlock_.load();
+   if (topBlock == 0 || topBlock == UINT32_MAX) {
+      return;
+   }
+
+   if (tx->getTxHeight() > topBlock) {
+      // should not happen
+      SPDLOG_LOGGER_ERROR(logger_, "invalid tx height: {}, topBlock: {}", tx->getTxHeight(), topBlock);
+      return;
+   }
+   if (topBlock - tx->getTxHeight() < kRequiredConfCountForCache) {
+      return;
+   }
+
+   txCache_.put(hash, tx);
+   putToPersistentCache(hash, tx);
+}
+
+ArmoryConnection::TxCacheStats ArmoryConnection::txCacheStats() const
+{
+   TxCacheStats result;
+   result.memory = txCache_.stats();
+   result.persistentHits = txPersistentHits_;
+   result.coalesced = txCoalesced_;
+   result.fetched = txFetched_;
+   result.fetchLatency = txFetchStats_.summary();
+   return result;
 }
 
-// allowCachedResult is ignored here
-bool ArmoryConnection::getTxByHash(const BinaryData &hash, const TxCb &cb, bool /*allowCachedResult*/)
+bool ArmoryConnection::getTxByHash(const BinaryData &hash, const TxCb &cb, bool allowCachedResult)
 {
    if (!bdv_ || (state_ != ArmoryState::Ready)) {
       logger_->error("[ArmoryConnection::getTxByHash] invalid state: {}", (int)state_.load());
       return false;
    }
-   if (addGetTxCallback(hash, cb)) {
+   // In-memory entries are complete Armory results for deeply confirmed txs,
+   // so allowCachedResult only gates the persistent tier
+   const auto cachedTx = getCachedTx(hash, allowCachedResult);
+   if (cachedTx) {
+      if (cb) {
+         postToMaintThread([cb, cachedTx] { cb(*cachedTx); });
+      }
+      return true;
+   }
+
+   const auto &cbResult = [cb](const AsyncClient::TxResult &tx, std::exception_ptr)
+   {
+      if (cb) {
+         cb(tx ? *tx : Tx{});
+      }
+   };
+   if (addGetTxCallback(hash, cbResult)) {
       return true;
    }
-   const auto &cbWrap = [this, hash]
+   txFetched_++;
+   const auto &cbWrap = [this, hash, start = std::chrono::steady_clock::now()]
       (ReturnMessage<AsyncClient::TxResult> tx)->void
    {
       try {
          auto retTx = tx.get();
+         txFetchStats_.add(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start));
+         putToCacheIfNeeded(hash, retTx);
          callGetTxCallbacks(hash, retTx);
       }
       catch (const std::exception &e) {
          logger_->error("[getTxByHash (cbUpdateCache)] Return data error - {} "
             "- hash {}", e.what(), hash.toHexStr());
-         callGetTxCallbacks(hash, {});
+         callGetTxCallbacks(hash, {}, std::current_exception());
       }
    };
    bdv_->getTxByHash(hash, cbWrap);
@@ -827,7 +1125,7 @@ bool ArmoryConnection::getTxByHash(const BinaryData &hash, const TxCb &cb, bool
 }
 
 bool ArmoryConnection::getTXsByHash(const std::set<BinaryData> &hashes
-   , const TXsCb &cb, bool /*allowCachedResult - ignored here*/)
+   , const TXsCb &cb, bool allowCachedResult)
 {
    if (!bdv_ || (state_ != ArmoryState::Ready)) {
       logger_->error("[ArmoryConnection::getTXsByHash] invalid state: {}", (int)state_.load());
@@ -838,22 +1136,93 @@ bool ArmoryConnection::getTXsByHash(const std::set<BinaryData> &hashes
       return false;
    }
 
-   const auto cbWrap = [logger=logger_, cb]
+   struct BatchResult
+   {
+      std::mutex  mutex;
+      AsyncClient::TxBatchResult txs;
+      size_t      pending{};
+      std::exception_ptr   exPtr;
+   };
+   auto result = std::make_shared<BatchResult>();
+
+   std::set<BinaryData> missedHashes;
+   for (const auto &hash : hashes) {
+      auto tx = getCachedTx(hash, allowCachedResult);
+      if (tx) {
+         result->txs.emplace(hash, std::move(tx));
+      }
+      else {
+         missedHashes.insert(hash);
+      }
+   }
+   if (missedHashes.empty()) {
+      if (cb) {
+         postToMaintThread([cb, result] { cb(result->txs, nullptr); });
+      }
+      return true;
+   }
+
+   // Hashes already requested by other calls are not sent again
+   result->pending = missedHashes.size();
+   std::set<BinaryData> fetchHashes;
+   for (const auto &hash : missedHashes) {
+      const auto &cbResult = [result, cb, hash]
+         (const AsyncClient::TxResult &tx, std::exception_ptr exPtr)
+      {
+         {
+            std::lock_guard<std::mutex> lock(result->mutex);
+            if (exPtr != nullptr) {
+               result->exPtr = exPtr;
+            }
+            else if (tx) {
+               result->txs[hash] = tx;
+            }
+            if (--result->pending > 0) {
+               return;
+            }
+         }
+         if (!cb) {
+            return;
+         }
+         if (result->exPtr != nullptr) {
+            cb({}, result->exPtr);
+         }
+         else {
+            cb(result->txs, nullptr);
+         }
+      };
+      if (!addGetTxCallback(hash, cbResult)) {
+         fetchHashes.insert(hash);
+      }
+   }
+   if (fetchHashes.empty()) {
+      return true;
+   }
+
+   txFetched_ += fetchHashes.size();
+   const auto cbWrap = [this, fetchHashes, start = std::chrono::steady_clock::now()]
       (ReturnMessage<AsyncClient::TxBatchResult> msg)->void
    {
       try {
-         if (cb) {
-            cb(std::move(msg.get()), nullptr);
+         const auto txs = msg.get();
+         txFetchStats_.add(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start), fetchHashes.size());
+         for (const auto &hash : fetchHashes) {
+            const auto it = txs.find(hash);
+            const auto tx = (it == txs.end()) ? AsyncClient::TxResult{} : it->second;
+            putToCacheIfNeeded(hash, tx);
+            callGetTxCallbacks(hash, tx);
          }
       }
       catch (const std::exception &e) {
-         logger->error("[ArmoryConnection::getTXsByHash] failed to get: {}", e.what());
-         if (cb) {
-            cb({}, std::make_exception_ptr(e));
+         logger_->error("[ArmoryConnection::getTXsByHash] failed to get: {}", e.what());
+         const auto exPtr = std::current_exception();
+         for (const auto &hash : fetchHashes) {
+            callGetTxCallbacks(hash, {}, exPtr);
          }
       }
    };
-   bdv_->getTxBatchByHash(hashes, cbWrap);
+   bdv_->getTxBatchByHash(fetchHashes, cbWrap);
    return true;
 }
 
@@ -1055,18 +1424,22 @@ void ArmoryConnection::onRefresh(const std::vector<BinaryData>& ids)
          , online, idString, ids.size());
    }
 #endif   //NDEBUG
-   addToMaintQueue([ids, online](ArmoryCallbackTarget *tgt) {
-      tgt->onRefresh(ids, online);
+   std::unique_lock<std::mutex> lock(actMutex_);
+   actQueue_.push_back([this, ids, online] {
+      routeRefresh(ids, online);
    });
+   actCV_.notify_one();
 }
 
 void ArmoryConnection::onZCsReceived(const std::vector<std::shared_ptr<ClientClasses::LedgerEntry>> &entries)
 {
    const auto newEntries = bs::TXEntry::fromLedgerEntries(entries);
 
-   addToMaintQueue([newEntries](ArmoryCallbackTarget *tgt) {
-      tgt->onZCReceived(newEntries);
+   std::unique_lock<std::mutex> lock(actMutex_);
+   actQueue_.push_back([this, newEntries] {
+      routeZCs(newEntries);
    });
+   actCV_.notify_one();
 }
 
 void ArmoryConnection::onZCsInvalidated(const std::set<BinaryData> &ids)
@@ -1143,6 +1516,10 @@ void ArmoryCallback::run(BdmNotification bdmNotif)
    case BDMAction_NewBlock:
       logger_->debug("[ArmoryCallback::run] BDMAction_NewBlock {}", bdmNotif.height_);
       connection_->setTopBlock(bdmNotif.height_);
+      if (bdmNotif.branchHeight_ != UINT32_MAX) {
+         // Cached transactions could be reorged out
+         connection_->txCache_.clear();
+      }
       connection_->setState(ArmoryState::Ready);
       connection_->addToMaintQueue([height=bdmNotif.height_, branchHgt=bdmNotif.branchHeight_]
          (ArmoryCallbackTarget *tgt)
@@ -28,6 +28,8 @@
 #include "AsyncClient.h"
 #include "BtcDefinitions.h"
 #include "BlockObj.h"
+#include "LatencyStats.h"
+#include "TxCache.h"
 
 class ArmoryConnection;
 
@@ -174,6 +176,7 @@ public:
 
    // For ZC notifications walletId would be replaced with mergedWalletId (and notifications are merged)
    virtual bool getWalletsHistory(const std::vector<std::string> &walletIDs, const WalletsHistoryCb&);
+   // Callback receives empty map if the request failed
    virtual bool getCombinedBalances(const std::vector<std::string> &walletIDs
       , const std::function<void(const std::map<std::string, CombinedBalances> &)> &);
    virtual bool getCombinedTxNs(const std::vector<std::string> &walletIDs
@@ -187,17 +190,17 @@ public:
    bool getSpendableZCoutputs(const std::vector<std::string> &walletIds, const UTXOsCb &);
    bool getRBFoutputs(const std::vector<std::string> &walletIds, const UTXOsCb &);
    bool getUTXOsForAddress(const BinaryData&, const UTXOsCb &, bool withZC = false);
-   bool getOutpointsFor(const std::vector<BinaryData> &, const std::function<void(const OutpointBatch &)> &
+   virtual bool getOutpointsFor(const std::vector<BinaryData> &, const std::function<void(const OutpointBatch &)> &
       , unsigned int height = 0, unsigned int zcIndex = 0);
-   bool getOutpointsForAddresses(const std::set<BinaryData> &
+   virtual bool getOutpointsForAddresses(const std::set<BinaryData> &
       , const std::function<void(const OutpointBatch &, std::exception_ptr)> &
       , unsigned int height = 0, unsigned int zcIndex = 0);
 
    using SpentnessCb = std::function<void(const std::map<BinaryData
       , std::map<unsigned int, SpentnessResult>> &, std::exception_ptr)>;
-   bool getSpentnessForOutputs(const std::map<BinaryData, std::set<unsigned>> &
+   virtual bool getSpentnessForOutputs(const std::map<BinaryData, std::set<unsigned>> &
       , const SpentnessCb &);
-   bool getSpentnessForZcOutputs(const std::map<BinaryData, std::set<unsigned>> &
+   virtual bool getSpentnessForZcOutputs(const std::map<BinaryData, std::set<unsigned>> &
       , const SpentnessCb &);
 
    bool getOutputsForOutpoints(const std::map<BinaryData, std::set<unsigned>> &
@@ -208,11 +211,27 @@ public:
    using TXsCb = std::function<void(const AsyncClient::TxBatchResult &, std::exception_ptr)>;
    using BinaryDataCb = std::function<void(const BinaryData&)>;
 
-   // Is allowCachedResult is set then result could be retrieved from cache.
-   // Please note that Tx::outpointIdVec_ would NOT be initialized if loaded from cache.
+   // Confirmed transactions are always looked up in the in-memory cache first
+   // (it holds complete Armory results). Concurrent requests for the same hash
+   // share one Armory request, including hashes from different batches.
+   // Is allowCachedResult is set then result could be retrieved from persistent cache too.
+   // Please note that Tx::outpointIdVec_ would NOT be initialized if loaded from persistent cache.
    virtual bool getTxByHash(const BinaryData &hash, const TxCb&, bool allowCachedResult = true);
    virtual bool getTXsByHash(const std::set<BinaryData> &hashes, const TXsCb &, bool allowCachedResult = true);
 
+   struct TxCacheStats
+   {
+      TxCache::Stats memory;
+      // Found in persistent cache after in-memory miss
+      uint64_t persistentHits{};
+      // Requested hashes joined to already pending Armory requests
+      uint64_t coalesced{};
+      // Hashes requested from Armory
+      uint64_t fetched{};
+      LatencyStats::Summary fetchLatency;
+   };
+   TxCacheStats txCacheStats() const;
+
    virtual bool getRawHeaderForTxHash(const BinaryData& inHash, const BinaryDataCb &);
    virtual bool getHeaderByHeight(const unsigned int inHeight, const BinaryDataCb &);
 
@@ -238,6 +257,15 @@ public:
    bool addTarget(ArmoryCallbackTarget *);
    bool removeTarget(ArmoryCallbackTarget *);
 
+   // Targets with routes receive only ZC entries for their wallet IDs or addresses
+   // and only refreshes carrying their IDs (plus refresh IDs not routed to any target).
+   // Targets without routes receive all notifications.
+   void addTargetRoutes(ArmoryCallbackTarget *, const std::vector<std::string> &walletIds
+      , const std::vector<BinaryData> &addresses = {});
+   // One-shot route for the refresh notification of an address registration,
+   // ignored for targets without other routes
+   void addRegistrationRoute(ArmoryCallbackTarget *, const std::string &regId);
+
    using BIP151Cb = std::function<bool(const BinaryData&, const std::string&)>;
    void setupConnection(NetworkType, const std::string &host, const std::string &port
       , const std::string &dataDir, const BinaryData &serverKey
@@ -257,6 +285,13 @@ protected:
 
    using EmptyCb = std::function<void()>;
    void runOnMaintThread(EmptyCb cb);
+   // Queues cb even if called from maintenance thread - for results that are
+   // ready immediately but must be delivered asynchronously
+   void postToMaintThread(EmptyCb cb);
+
+   // Optional persistent tier of tx cache, receives only transactions with enough confirmations
+   virtual std::shared_ptr<const Tx> getFromPersistentCache(const BinaryData &) { return nullptr; }
+   virtual void putToPersistentCache(const BinaryData &, const std::shared_ptr<const Tx> &) {}
 
 private:
    void registerBDV(NetworkType);
@@ -267,11 +302,26 @@ private:
 
    void stopServiceThreads();
 
-   bool addGetTxCallback(const BinaryData &hash, const TxCb &);  // returns true if hash exists
-   void callGetTxCallbacks(const BinaryData &hash, const AsyncClient::TxResult &);
+   using TxResultCb = std::function<void(const AsyncClient::TxResult &, std::exception_ptr)>;
+   bool addGetTxCallback(const BinaryData &hash, const TxResultCb &);  // returns true if hash exists
+   void callGetTxCallbacks(const BinaryData &hash, const AsyncClient::TxResult &
+      , std::exception_ptr exPtr = nullptr);
+
+   // Persistent tier is checked only if allowed, in-memory one always
+   std::shared_ptr<const Tx> getCachedTx(const BinaryData &hash, bool allowPersistent);
+   // Will store only transactions with >= 6 confirmations
+   void putToCacheIfNeeded(const BinaryData &hash, const std::shared_ptr<const Tx> &);
 
    void maintenanceThreadFunc();
 
+   using TargetsList = std::vector<ArmoryCallbackTarget *>;
+   void updateTargetsList();  // cbMutex_ must be locked
+   void forEachTarget(const CallbackQueueCb &);
+   void routeRefresh(const std::vector<BinaryData> &ids, bool online);
+   void routeZCs(const std::vector<bs::TXEntry> &);
+   void removeTargetRoutes(ArmoryCallbackTarget *);  // cbMutex_ must be locked
+   void expireRegistrationRoutes();  // cbMutex_ must be locked
+
 protected:
    std::shared_ptr<spdlog::logger>  logger_;
    std::shared_ptr<AsyncClient::BlockDataViewer>   bdv_;
@@ -289,15 +339,40 @@ protected:
    std::atomic_bool              isOnline_;
 
    std::mutex  cbMutex_;
-   std::map<BinaryData, std::vector<TxCb>>   txCallbacks_;
+   std::map<BinaryData, std::vector<TxResultCb>>   txCallbacks_;
+
+   TxCache                 txCache_;
+   std::atomic<uint64_t>   txPersistentHits_{};
+   std::atomic<uint64_t>   txCoalesced_{};
+   std::atomic<uint64_t>   txFetched_{};
+   LatencyStats            txFetchStats_;
 
    std::unordered_set<ArmoryCallbackTarget *>   activeTargets_;
+   // Immutable copy of activeTargets_ shared with the maintenance thread
+   std::shared_ptr<const TargetsList>           targetsList_;
+
+   struct TargetRoutes
+   {
+      std::unordered_set<std::string>  ids;
+      std::unordered_set<BinaryData, BinaryDataHash>  addresses;
+   };
+   std::unordered_map<ArmoryCallbackTarget *, TargetRoutes>  targetRoutes_;
+   // Wallet and registration IDs (as binary strings)
+   std::unordered_map<std::string, std::unordered_set<ArmoryCallbackTarget *>>   idRoutes_;
+   // Registration IDs with the time their route was added, routes whose
+   // refresh never arrives are dropped after a timeout
+   std::unordered_map<std::string, std::chrono::steady_clock::time_point>  registrationIds_;
+   // Recent refresh IDs not claimed by any target: a registration route added
+   // after its refresh was already delivered is not added at all
+   std::unordered_set<std::string>              unroutedRefreshIds_;
+   std::deque<std::string>                      unroutedRefreshOrder_;
+   std::unordered_map<BinaryData, std::unordered_set<ArmoryCallbackTarget *>, BinaryDataHash> addressRoutes_;
 
    std::thread    regThread_;
    std::mutex     regMutex_;
    std::condition_variable regCV_;
 
-   std::deque<CallbackQueueCb>   actQueue_;
+   std::deque<EmptyCb>           actQueue_;
    std::deque<EmptyCb>           runQueue_;
    std::thread    maintThread_;
    std::condition_variable actCV_;
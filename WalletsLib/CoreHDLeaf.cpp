@@ -8,6 +8,8 @@
 **********************************************************************************
 
 */
+#include <exception>
+#include <thread>
 #include <unordered_map>
 #include <spdlog/spdlog.h>
 #include "CheckRecipSigner.h"
@@ -18,6 +20,28 @@
 
 using namespace bs::core;
 
+namespace {
+   // Addresses looked up past the used part of each chain when indexing
+   const unsigned kChainScanGapLimit = 100;
+
+   // Smaller batches are not worth starting a thread for
+   const unsigned kMinDerivationsPerThread = 64;
+
+   bs::hd::Path pathForAssetID(const BinaryData &assetID)
+   {
+      //assetID: BIP32 root ID (4 bytes) | BIP32 node id (4 bytes) | asset index (4 bytes)
+      BinaryRefReader brr(assetID);
+      brr.get_uint32_t(); //skip root id
+      auto nodeid = brr.get_uint32_t(BE);
+      auto indexid = brr.get_uint32_t(BE);
+
+      bs::hd::Path addrPath;
+      addrPath.append(nodeid);
+      addrPath.append(indexid);
+      return addrPath;
+   }
+}  // namespace
+
 hd::Leaf::Leaf(NetworkType netType,
    std::shared_ptr<spdlog::logger> logger, 
    wallet::Type type)
@@ -199,7 +223,7 @@ void hd::Leaf::topUpAddressPool(size_t count, bool intExt)
    else
       accountID = accountPtr_->getInnerAccountID();
 
-   auto accMap = accountPtr_->getAccountMap();
+   const auto &accMap = accountPtr_->getAccountMap();
    auto iter = accMap.find(accountID);
    if (iter == accMap.end())
       throw AccountException("unexpected account id");
@@ -207,30 +231,46 @@ void hd::Leaf::topUpAddressPool(size_t count, bool intExt)
    iter->second->extendPublicChain(count);
 }
 
-std::vector<bs::Address> hd::Leaf::extendAddressChain(unsigned count, bool extInt)
+std::vector<std::pair<bs::Address, std::string>> hd::Leaf::extendAddressChain(
+   unsigned count, bool extInt)
 {
-   //get previous hash map
-   auto addrHashMap_orig = accountPtr_->getAddressHashMap();
+   const auto &accountID = extInt ? accountPtr_->getOuterAccountID()
+      : accountPtr_->getInnerAccountID();
+   const auto &accMap = accountPtr_->getAccountMap();
+   const auto iter = accMap.find(accountID);
+   if (iter == accMap.end())
+      throw AccountException("unexpected account id");
+   const auto &assetAccount = iter->second;
+   const auto addrTypes = accountPtr_->getAddressTypeSet();
+
+   /***
+   Asset IDs are prefixed with the account ID and end with the big endian
+   asset index, so assets added by the extension always come after the
+   last known one - no need to copy and diff the whole address map.
+   ***/
+   BinaryData lastAssetID;
+   {
+      const auto &addrHashMap = assetAccount->getAddressHashMap(addrTypes);
+      if (!addrHashMap.empty())
+         lastAssetID = addrHashMap.rbegin()->first;
+   }
 
    //extend
    topUpAddressPool(count, extInt);
 
-   //get new hash map
-   auto& addrHashMap_new = accountPtr_->getAddressHashMap();
-
-   //get diff
-   std::map<BinaryData, std::pair<BinaryData, AddressEntryType>> diffMap;
-   std::set_difference(
-      addrHashMap_new.begin(), addrHashMap_new.end(),
-      addrHashMap_orig.begin(), addrHashMap_orig.end(),
-      std::inserter(diffMap, diffMap.begin()));
+   //convert new assets to addresses, the path is known from the asset ID
+   //so callers don't need to look up each address in the account again
+   const auto &addrHashMap = assetAccount->getAddressHashMap(addrTypes);
+   auto itNew = lastAssetID.empty() ? addrHashMap.begin()
+      : addrHashMap.upper_bound(lastAssetID);
 
-   //convert to address
-   std::vector<bs::Address> result;
-   for (auto& hashPair : diffMap)
+   std::vector<std::pair<bs::Address, std::string>> result;
+   result.reserve(count * addrTypes.size());
+   for (; itNew != addrHashMap.end(); ++itNew)
    {
-      auto&& addr = bs::Address::fromHash(hashPair.first);
-      result.emplace_back(addr);
+      const auto index = pathForAssetID(itNew->first).toString();
+      for (const auto &addrPair : itNew->second)
+         result.emplace_back(bs::Address::fromHash(addrPair.second), index);
    }
 
    return result;
@@ -268,18 +308,7 @@ bs::hd::Path hd::Leaf::getPathForAddress(const bs::Address &addr) const
    try
    {
       auto& assetIDPair = accountPtr_->getAssetIDPairForAddr(addr.prefixed());
-
-      //assetID: BIP32 root ID (4 bytes) | BIP32 node id (4 bytes) | asset index (4 bytes)
-      BinaryRefReader brr(assetIDPair.first);
-      brr.get_uint32_t(); //skip root id
-      auto nodeid = brr.get_uint32_t(BE);
-      auto indexid = brr.get_uint32_t(BE);
-
-      bs::hd::Path addrPath;
-      addrPath.append(nodeid);
-      addrPath.append(indexid);
-
-      return addrPath;
+      return pathForAssetID(assetIDPair.first);
    }
    catch (std::exception&) {
       return {};
@@ -430,6 +459,29 @@ std::pair<std::shared_ptr<hd::Leaf>, BinaryData> hd::Leaf::deserialize(
 
 std::shared_ptr<ResolverFeed> hd::Leaf::getResolver() const
 {
+   class CachingResolver : public ResolverFeed_AssetWalletSingle
+   {
+   public:
+      CachingResolver(const std::shared_ptr<AssetWallet_Single> &walletPtr
+         , const std::shared_ptr<wallet::KeyCache> &keyCache)
+         : ResolverFeed_AssetWalletSingle(walletPtr), keyCache_(keyCache) { }
+
+      const SecureBinaryData &getPrivKeyForPubkey(const BinaryData &pk) override
+      {
+         const auto privKey = keyCache_->find(pk);
+         if (privKey) {
+            return *privKey;
+         }
+         return keyCache_->add(pk, ResolverFeed_AssetWalletSingle::getPrivKeyForPubkey(pk));
+      }
+
+   private:
+      std::shared_ptr<wallet::KeyCache>   keyCache_;
+   };
+
+   if (keyCache_) {
+      return std::make_shared<CachingResolver>(walletPtr_, keyCache_);
+   }
    return std::make_shared<ResolverFeed_AssetWalletSingle>(walletPtr_);
 }
 
@@ -635,12 +687,14 @@ std::pair<bs::Address, bool> hd::Leaf::synchronizeUsedAddressChain(
 std::map<BinaryData, bs::hd::Path> hd::Leaf::indexPath(const std::set<BinaryData> &addrSet)
 {
    std::map<BinaryData, bs::hd::Path> result;
+   std::set<BinaryData> unknownAddrs;
    auto& addrHashMap = accountPtr_->getAddressHashMap();
 
    for (const auto &addr : addrSet) {
       auto iter = addrHashMap.find(addr);
       if (iter == addrHashMap.end()) {
-         throw AccountException("unknown scrAddr");
+         unknownAddrs.insert(addr);
+         continue;
       }
       bs::hd::Path path;
 
@@ -660,6 +714,121 @@ std::map<BinaryData, bs::hd::Path> hd::Leaf::indexPath(const std::set<BinaryData
       result.emplace(std::move(addr), std::move(path));
    }
 
+   //addresses used past the account pool, derive them from the chain xpubs
+   //instead of making the caller extend the chain and retry
+   if (!unknownAddrs.empty()) {
+      auto scanned = scanAddressChains(unknownAddrs, kChainScanGapLimit);
+      if (scanned.size() != unknownAddrs.size()) {
+         throw AccountException("unknown scrAddr");
+      }
+      result.insert(scanned.begin(), scanned.end());
+   }
+
+   return result;
+}
+
+BIP32_Node hd::Leaf::chainNode(bool ext) const
+{
+   const auto &accountID = ext ? accountPtr_->getOuterAccountID()
+      : accountPtr_->getInnerAccountID();
+   const auto &accMap = accountPtr_->getAccountMap();
+   const auto iter = accMap.find(accountID);
+   if (iter == accMap.end())
+      throw AccountException("unexpected account id");
+
+   //asset account root is the chain node, its assets are the non-hardened children
+   const auto root = std::dynamic_pointer_cast<AssetEntry_BIP32Root>(iter->second->getRoot());
+   if (root == nullptr)
+      throw AccountException("unexpected chain root type");
+
+   BIP32_Node node;
+   node.initFromPublicKey(root->getDepth(), root->getLeafID(), root->getFingerPrint()
+      , root->getPubKey()->getCompressedKey(), root->getChaincode());
+   return node;
+}
+
+std::vector<BinaryData> hd::Leaf::deriveAddressHashes(bool ext, unsigned start
+   , unsigned count, unsigned nbThreads) const
+{
+   const auto node = chainNode(ext);
+   const auto aet = addressType();
+
+   if (nbThreads == 0)
+      nbThreads = std::max(1u, std::thread::hardware_concurrency());
+   nbThreads = std::max(1u, std::min(nbThreads, count / kMinDerivationsPerThread));
+
+   //children are independent - each thread derives a contiguous range
+   //from its own copy of the chain node into its own slots of the result
+   std::vector<BinaryData> result(count);
+   const auto deriveRange = [&node, &result, aet, start](unsigned from, unsigned to)
+   {
+      for (auto i = from; i < to; ++i) {
+         auto child = node;
+         child.derivePublic(start + i);
+         result[i] = bs::Address::fromPubKey(child.getPublicKey(), aet).prefixed();
+      }
+   };
+
+   if (nbThreads == 1) {
+      deriveRange(0, count);
+      return result;
+   }
+
+   std::vector<std::thread> threads;
+   std::vector<std::exception_ptr> errors(nbThreads);
+   threads.reserve(nbThreads);
+   const auto perThread = count / nbThreads;
+   for (unsigned t = 0; t < nbThreads; ++t) {
+      const auto from = t * perThread;
+      const auto to = (t == nbThreads - 1) ? count : from + perThread;
+      threads.emplace_back([&deriveRange, &errors, t, from, to] {
+         try {
+            deriveRange(from, to);
+         }
+         catch (...) {
+            errors[t] = std::current_exception();
+         }
+      });
+   }
+   for (auto &thread : threads)
+      thread.join();
+   for (const auto &error : errors) {
+      if (error)
+         std::rethrow_exception(error);
+   }
+   return result;
+}
+
+std::map<BinaryData, bs::hd::Path> hd::Leaf::scanAddressChains(
+   const std::set<BinaryData> &addrSet, unsigned gapLimit, unsigned nbThreads) const
+{
+   std::map<BinaryData, bs::hd::Path> result;
+   if (addrSet.empty() || (gapLimit == 0))
+      return result;
+
+   std::vector<bool> chains = { true };
+   if (!hasExtOnlyAddresses())
+      chains.push_back(false);
+
+   for (const bool ext : chains) {
+      auto start = static_cast<unsigned>(ext ? getExtAddressCount() : getIntAddressCount());
+      while (result.size() < addrSet.size()) {
+         const auto hashes = deriveAddressHashes(ext, start, gapLimit, nbThreads);
+         bool found = false;
+         for (unsigned i = 0; i < hashes.size(); ++i) {
+            if (addrSet.find(hashes[i]) == addrSet.end())
+               continue;
+            bs::hd::Path path;
+            path.append(ext ? addrTypeExternal_ : addrTypeInternal_);
+            path.append(start + i);
+            result[hashes[i]] = path;
+            found = true;
+         }
+         if (!found)
+            break;
+         start += gapLimit;
+      }
+   }
    return result;
 }
 
@@ -89,8 +89,10 @@ namespace bs {
             bs::Address getAddressByIndex(unsigned int index, bool ext) const;
 
             SecureBinaryData getPublicKeyFor(const bs::Address &) override;
+            // Resolver takes private keys from the key cache if one is set
             std::shared_ptr<ResolverFeed> getResolver(void) const;
             std::shared_ptr<ResolverFeed> getPublicResolver(void) const;
+            void setKeyCache(const std::shared_ptr<wallet::KeyCache> &keyCache) { keyCache_ = keyCache; }
             ReentrantLock lockDecryptedContainer() override;
 
             const bs::hd::Path &path() const { return path_; }
@@ -103,10 +105,22 @@ namespace bs {
 
             void shutdown(void);
             std::string getFilename(void) const;
-            std::vector<bs::Address> extendAddressChain(unsigned count, bool extInt) override;
+            std::vector<std::pair<bs::Address, std::string>> extendAddressChain(
+               unsigned count, bool extInt) override;
 
+            // Addresses missing from Armory account pool are looked up with scanAddressChains
             std::map<BinaryData, bs::hd::Path> indexPath(const std::set<BinaryData>&) override;
 
+            // Prefixed hashes of chain addresses [start, start + count) derived from the
+            // chain's public node - Armory account is not extended. Derivation is split
+            // between nbThreads threads (hardware concurrency if 0).
+            std::vector<BinaryData> deriveAddressHashes(bool ext, unsigned start, unsigned count
+               , unsigned nbThreads = 0) const;
+            // Paths of addresses past the used part of the chains. Each chain is scanned
+            // in batches of gapLimit addresses until a batch matches none of the set.
+            std::map<BinaryData, bs::hd::Path> scanAddressChains(const std::set<BinaryData> &
+               , unsigned gapLimit, unsigned nbThreads = 0) const;
+
             virtual bs::hd::Path::Elem getExtPath(void) const { return addrTypeExternal_; }
             virtual bs::hd::Path::Elem getIntPath(void) const { return addrTypeInternal_; }
 
@@ -145,9 +159,11 @@ namespace bs {
             const NetworkType netType_;
             std::shared_ptr<::AddressAccount> accountPtr_;
             std::shared_ptr<AssetWallet_Single> walletPtr_;
+            std::shared_ptr<wallet::KeyCache>   keyCache_;
 
          private:
             void topUpAddressPool(size_t count, bool intExt);
+            BIP32_Node chainNode(bool ext) const;
             bs::hd::Path::Elem getLastAddrPoolIndex() const;
          };
 
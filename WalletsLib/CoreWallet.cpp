@@ -20,10 +20,31 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
 #include <sstream>
+#include <thread>
 
 using namespace bs::core;
 
+namespace {
+   size_t varIntSize(uint64_t value)
+   {
+      if (value < 0xfd) {
+         return 1;
+      }
+      if (value <= 0xffff) {
+         return 3;
+      }
+      if (value <= 0xffffffff) {
+         return 5;
+      }
+      return 9;
+   }
+}
+
 std::shared_ptr<wallet::AssetEntryMeta> wallet::AssetEntryMeta::deserialize(int, BinaryDataRef value)
 {
    BinaryRefReader brr(value);
@@ -314,38 +335,309 @@ Signer wallet::TXSignRequest::getSigner(const std::shared_ptr<ResolverFeed> &res
    return signer;
 }
 
-static UtxoSelection computeSizeAndFee(const std::vector<UTXO> &inUTXOs, const PaymentStruct &inPS)
+bool wallet::TXSignRequest::signerCacheMatches(const std::shared_ptr<ResolverFeed> &resolver) const
 {
-   auto usedUTXOCopy{ inUTXOs };
-   UtxoSelection selection{ usedUTXOCopy };
+   const auto &cache = caches_.signer;
+   // Expired weak pointer doesn't match a new resolver allocated at the same address
+   if (!cache.valid || (cache.hasResolver != (resolver != nullptr))
+      || (resolver && (cache.resolver.lock() != resolver))) {
+      return false;
+   }
+   if ((cache.RBF != RBF) || (cache.populateUTXOs != populateUTXOs)
+      || (cache.outSortOrder != outSortOrder) || (cache.changeValue != change.value)
+      || (change.value && !(cache.changeAddress == change.address))
+      || (cache.prevStates != prevStates)) {
+      return false;
+   }
+   if ((cache.inputs.size() != inputs.size()) || (cache.recipients.size() != recipients.size())) {
+      return false;
+   }
+   for (size_t i = 0; i < inputs.size(); ++i) {
+      const auto &cached = cache.inputs[i];
+      const auto &utxo = inputs[i];
+      if ((cached.getTxOutIndex() != utxo.getTxOutIndex()) || (cached.getValue() != utxo.getValue())
+         || (cached.getTxHash() != utxo.getTxHash()) || (cached.getScript() != utxo.getScript())) {
+         return false;
+      }
+   }
+   for (size_t i = 0; i < recipients.size(); ++i) {
+      if ((cache.recipients[i].first != recipients[i])
+         || (cache.recipients[i].second != recipients[i]->getValue())) {
+         return false;
+      }
+   }
+   return true;
+}
 
+const wallet::TXSignRequest::SignerCache &wallet::TXSignRequest::updateSignerCache(
+   const std::shared_ptr<ResolverFeed> &resolver) const
+{
+   auto &cache = caches_.signer;
+   if (signerCacheMatches(resolver)) {
+      return cache;
+   }
+   const auto signer = getSigner(resolver);
+   cache = {};
+   cache.state = signer.serializeState();
    try {
-      selection.computeSizeAndFee(inPS);
-   } catch (...) {
+      cache.txId = signer.getTxId();
+   }
+   catch (...) {
+      cache.txIdError = std::current_exception();
+   }
+
+   cache.RBF = RBF;
+   cache.populateUTXOs = populateUTXOs;
+   cache.outSortOrder = outSortOrder;
+   cache.prevStates = prevStates;
+   cache.inputs = inputs;
+   cache.recipients.reserve(recipients.size());
+   for (const auto &recip : recipients) {
+      cache.recipients.emplace_back(recip, recip->getValue());
+   }
+   cache.changeValue = change.value;
+   cache.changeAddress = change.address;
+   cache.hasResolver = (resolver != nullptr);
+   cache.resolver = resolver;
+   cache.valid = true;
+   return cache;
+}
+
+BinaryData wallet::TXSignRequest::serializeState(const std::shared_ptr<ResolverFeed> &resolver) const
+{
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   return updateSignerCache(resolver).state;
+}
+
+BinaryData wallet::TXSignRequest::txId(const std::shared_ptr<ResolverFeed> &resolver) const
+{
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   const auto &cache = updateSignerCache(resolver);
+   if (cache.txIdError) {
+      std::rethrow_exception(cache.txIdError);
    }
-   return selection;
+   return cache.txId;
 }
 
-static size_t getVirtSize(const UtxoSelection &inUTXOSel)
+wallet::TXSignRequest::Caches::Caches(const Caches &other)
 {
-   const size_t nonWitSize = inUTXOSel.size_ - inUTXOSel.witnessSize_;
-   return std::ceil(static_cast<float>(3 * nonWitSize + inUTXOSel.size_) / 4.0f);
+   std::lock_guard<std::mutex> lock(other.mutex);
+   inputSizes = other.inputSizes;
+   sizeTotals = other.sizeTotals;
+   signer = other.signer;
+}
+
+wallet::TXSignRequest::Caches &wallet::TXSignRequest::Caches::operator=(const Caches &other)
+{
+   if (this != &other) {
+      std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+      std::unique_lock<std::mutex> lockOther(other.mutex, std::defer_lock);
+      std::lock(lock, lockOther);
+      inputSizes = other.inputSizes;
+      sizeTotals = other.sizeTotals;
+      signer = other.signer;
+   }
+   return *this;
+}
+
+void wallet::TXSignRequest::SizeTotals::add(const InputSize &inputSize, bool adding)
+{
+   const bool isSegWit = (inputSize.witnessSize != UINT32_MAX);
+   if (adding) {
+      inputsSize += inputSize.inputSize;
+      if (isSegWit) {
+         witnessSize += inputSize.witnessSize;
+         nbSegWitInputs++;
+      }
+   }
+   else {
+      inputsSize -= inputSize.inputSize;
+      if (isSegWit) {
+         witnessSize -= inputSize.witnessSize;
+         nbSegWitInputs--;
+      }
+   }
+}
+
+bool wallet::TXSignRequest::sizeTotalsValid() const
+{
+   const auto &totals = caches_.sizeTotals;
+   return (totals.valid && (totals.version == version_) && (totals.nbInputs == inputs.size())
+      && (totals.nbRecipients == recipients.size()));
+}
+
+void wallet::TXSignRequest::updateSizeCache() const
+{
+   auto &inputSizes = caches_.inputSizes;
+   auto &totals = caches_.sizeTotals;
+   totals = {};
+   inputSizes.resize(inputs.size());
+   for (size_t i = 0; i < inputs.size(); ++i) {
+      auto &inputSize = inputSizes[i];
+      const auto &script = inputs[i].getScript();
+      if (inputSize.script.empty() || (inputSize.script != script)) {
+         const auto addr = bs::Address::fromUTXO(inputs[i]);
+         inputSize.script = script;
+         inputSize.inputSize = addr.getInputSize();
+         inputSize.witnessSize = addr.getWitnessDataSize();
+      }
+      totals.add(inputSize);
+   }
+   for (const auto &recip : recipients) {
+      totals.outputsSize += recip->getSize();
+   }
+   totals.nbInputs = inputs.size();
+   totals.nbRecipients = recipients.size();
+   totals.version = version_;
+   totals.valid = true;
+}
+
+void wallet::TXSignRequest::addInput(const UTXO &utxo)
+{
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   const bool inSync = sizeTotalsValid();
+   inputs.push_back(utxo);
+   version_++;
+   if (!inSync) {
+      return;
+   }
+   const auto addr = bs::Address::fromUTXO(utxo);
+   caches_.inputSizes.push_back({ utxo.getScript(), addr.getInputSize(), addr.getWitnessDataSize() });
+   auto &totals = caches_.sizeTotals;
+   totals.add(caches_.inputSizes.back());
+   totals.nbInputs++;
+   totals.version = version_;
+}
+
+bool wallet::TXSignRequest::removeInput(const UTXO &utxo)
+{
+   const auto it = std::find(inputs.begin(), inputs.end(), utxo);
+   if (it == inputs.end()) {
+      return false;
+   }
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   const bool inSync = sizeTotalsValid();
+   const auto index = static_cast<size_t>(it - inputs.begin());
+   inputs.erase(it);
+   version_++;
+   if (!inSync) {
+      return true;
+   }
+   auto &totals = caches_.sizeTotals;
+   totals.add(caches_.inputSizes[index], false);
+   caches_.inputSizes.erase(caches_.inputSizes.begin() + index);
+   totals.nbInputs--;
+   totals.version = version_;
+   return true;
+}
+
+void wallet::TXSignRequest::setInput(size_t index, const UTXO &utxo)
+{
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   const bool inSync = sizeTotalsValid();
+   inputs.at(index) = utxo;
+   version_++;
+   if (!inSync) {
+      return;
+   }
+   auto &totals = caches_.sizeTotals;
+   auto &inputSize = caches_.inputSizes[index];
+   if (inputSize.script != utxo.getScript()) {
+      totals.add(inputSize, false);
+      const auto addr = bs::Address::fromUTXO(utxo);
+      inputSize = { utxo.getScript(), addr.getInputSize(), addr.getWitnessDataSize() };
+      totals.add(inputSize);
+   }
+   totals.version = version_;
+}
+
+void wallet::TXSignRequest::addRecipient(const std::shared_ptr<ScriptRecipient> &recip)
+{
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   const bool inSync = sizeTotalsValid();
+   recipients.push_back(recip);
+   version_++;
+   if (!inSync) {
+      return;
+   }
+   auto &totals = caches_.sizeTotals;
+   totals.outputsSize += recip->getSize();
+   totals.nbRecipients++;
+   totals.version = version_;
+}
+
+bool wallet::TXSignRequest::removeRecipient(const std::shared_ptr<ScriptRecipient> &recip)
+{
+   const auto it = std::find(recipients.begin(), recipients.end(), recip);
+   if (it == recipients.end()) {
+      return false;
+   }
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   const bool inSync = sizeTotalsValid();
+   const auto size = (*it)->getSize();
+   recipients.erase(it);
+   version_++;
+   if (!inSync) {
+      return true;
+   }
+   auto &totals = caches_.sizeTotals;
+   totals.outputsSize -= size;
+   totals.nbRecipients--;
+   totals.version = version_;
+   return true;
+}
+
+void wallet::TXSignRequest::setRecipient(size_t index, const std::shared_ptr<ScriptRecipient> &recip)
+{
+   std::lock_guard<std::mutex> lock(caches_.mutex);
+   const bool inSync = sizeTotalsValid();
+   auto &prevRecip = recipients.at(index);
+   const auto prevSize = prevRecip->getSize();
+   prevRecip = recip;
+   version_++;
+   if (!inSync) {
+      return;
+   }
+   auto &totals = caches_.sizeTotals;
+   totals.outputsSize = totals.outputsSize - prevSize + recip->getSize();
+   totals.version = version_;
 }
 
 size_t wallet::TXSignRequest::estimateTxVirtSize() const
-{   // another implementation based on Armory and TransactionData code
-   auto transactions = bs::Address::decorateUTXOsCopy(inputs);
-   std::map<unsigned int, std::shared_ptr<ScriptRecipient>> recipientsMap;
-   for (unsigned int i = 0; i < recipients.size(); ++i) {
-      recipientsMap[i] = recipients[i];
+{   // input sizes are the same as in bs::Address::decorateUTXOs
+   SizeTotals totals;
+   {
+      std::lock_guard<std::mutex> lock(caches_.mutex);
+      if (!sizeTotalsValid()) {
+         updateSizeCache();
+      }
+      totals = caches_.sizeTotals;
    }
 
-   try {
-      const PaymentStruct payment(recipientsMap, fee, 0, 0);
-      return getVirtSize(computeSizeAndFee(transactions, payment));
+   size_t nbOutputs = totals.nbRecipients;
+   size_t outputsSize = totals.outputsSize;
+   if (change.value) {
+      const auto changeRecip = change.address.getRecipient(bs::XBTAmount{ change.value });
+      if (changeRecip) {
+         outputsSize += changeRecip->getSize();
+         nbOutputs++;
+      }
    }
-   catch (const std::exception &) {}
-   return 0;
+
+   //version, locktime, txin & txout count + inputs and outputs size
+   const size_t nonWitSize = 8 + varIntSize(totals.nbInputs) + varIntSize(nbOutputs)
+      + totals.inputsSize + outputsSize;
+   size_t witnessSize = totals.witnessSize;
+   if (totals.nbSegWitInputs) {
+      // marker & flag, non-SegWit inputs get empty witness
+      witnessSize += 2 + (totals.nbInputs - totals.nbSegWitInputs);
+   }
+   return (4 * nonWitSize + witnessSize + 3) / 4;
+}
+
+uint64_t wallet::TXSignRequest::estimateFee(float feePerByte) const
+{
+   return static_cast<uint64_t>(std::ceil(estimateTxVirtSize() * feePerByte));
 }
 
 uint64_t wallet::TXSignRequest::amount(const wallet::TXSignRequest::ContainsAddressCb &containsAddressCb) const
@@ -1137,6 +1429,111 @@ BinaryData bs::core::SignMultiInputTX(const bs::core::wallet::TXMultiSignRequest
    }
 }
 
+const SecureBinaryData *wallet::KeyCache::find(const BinaryData &pubKey) const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   const auto itKey = keys_.find(pubKey);
+   if (itKey == keys_.end()) {
+      return nullptr;
+   }
+   return &itKey->second;
+}
+
+const SecureBinaryData &wallet::KeyCache::add(const BinaryData &pubKey
+   , const SecureBinaryData &privKey)
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return keys_.emplace(pubKey, privKey).first->second;
+}
+
+void wallet::KeyCache::clear()
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   keys_.clear();
+}
+
+size_t wallet::KeyCache::size() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return keys_.size();
+}
+
+wallet::BatchSignResult bs::core::SignTXRequests(const SignBatch &batch, bool partial
+   , unsigned int maxThreads)
+{
+   const auto started = std::chrono::steady_clock::now();
+   wallet::BatchSignResult result;
+   result.signedTXs.resize(batch.size());
+   result.errors.resize(batch.size());
+
+   // Decrypted keys are accessible only from the thread holding the container
+   // lock, so the work is split by wallet rather than by request or input
+   std::vector<std::vector<size_t>> groups;
+   {
+      std::map<Wallet *, size_t> groupIndex;
+      for (size_t i = 0; i < batch.size(); ++i) {
+         if (!batch[i].first) {
+            result.errors[i] = "missing wallet";
+            continue;
+         }
+         const auto itGroup = groupIndex.emplace(batch[i].first.get(), groups.size());
+         if (itGroup.second) {
+            groups.push_back({});
+         }
+         groups[itGroup.first->second].push_back(i);
+      }
+   }
+
+   std::atomic<size_t> nextGroup{ 0 };
+   const auto signGroups = [&batch, &result, &groups, &nextGroup, partial] {
+      for (auto groupIdx = nextGroup++; groupIdx < groups.size(); groupIdx = nextGroup++) {
+         const auto &group = groups[groupIdx];
+         const auto &wallet = batch[group.front()].first;
+         try {
+            if (wallet->isWatchingOnly()) {
+               throw std::logic_error("Won't sign with watching-only wallet");
+            }
+            const auto lock = wallet->lockDecryptedContainer();
+            for (const auto idx : group) {
+               try {
+                  result.signedTXs[idx] = partial ? wallet->signPartialTXRequest(batch[idx].second)
+                     : wallet->signTXRequest(batch[idx].second);
+               }
+               catch (const std::exception &e) {
+                  result.errors[idx] = e.what();
+               }
+            }
+         }
+         catch (const std::exception &e) {
+            for (const auto idx : group) {
+               result.errors[idx] = e.what();
+            }
+         }
+      }
+   };
+
+   const size_t nbThreads = std::min<size_t>(groups.size()
+      , maxThreads ? maxThreads : std::max(1u, std::thread::hardware_concurrency()));
+   std::vector<std::future<void>> futures;
+   for (size_t i = 1; i < nbThreads; ++i) {
+      futures.push_back(std::async(std::launch::async, signGroups));
+   }
+   signGroups();
+   for (auto &fut : futures) {
+      fut.get();
+   }
+
+   for (size_t i = 0; i < batch.size(); ++i) {
+      if (!result.signedTXs[i].empty()) {
+         result.nbSigned++;
+         result.nbInputs += batch[i].second.inputs.size();
+      }
+   }
+   result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started);
+   return result;
+}
+
 
 BinaryData wallet::computeID(const BinaryData &input)
 {
@@ -12,6 +12,9 @@
 #define BS_CORE_WALLET_H
 
 #include <array>
+#include <chrono>
+#include <exception>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -271,13 +274,25 @@ namespace bs {
             std::string comment;
 
             bool isValid() const noexcept;
-            BinaryData serializeState(const std::shared_ptr<ResolverFeed> &resolver = nullptr) const {
-               return getSigner(resolver).serializeState();
-            }
-            BinaryData txId(const std::shared_ptr<ResolverFeed> &resolver=nullptr) const {
-               return getSigner(resolver).getTxId();
-            }
+            // Both are memoized until inputs, outputs or resolver change, so
+            // the Signer is built and the TX serialized only once for them
+            BinaryData serializeState(const std::shared_ptr<ResolverFeed> &resolver = nullptr) const;
+            BinaryData txId(const std::shared_ptr<ResolverFeed> &resolver=nullptr) const;
+            // Doesn't build a Signer. Size totals kept up to date by the mutators
+            // below are used in O(1). Otherwise (inputs or recipients changed
+            // directly, detected by their count or markChanged()) input sizes are
+            // re-checked by position and recomputed only where the spent script differs
             size_t estimateTxVirtSize() const;
+            uint64_t estimateFee(float feePerByte) const;
+
+            void addInput(const UTXO &);
+            bool removeInput(const UTXO &);
+            void setInput(size_t index, const UTXO &);
+            void addRecipient(const std::shared_ptr<ScriptRecipient> &);
+            bool removeRecipient(const std::shared_ptr<ScriptRecipient> &);
+            void setRecipient(size_t index, const std::shared_ptr<ScriptRecipient> &);
+            // Should be called after in-place changes of inputs or recipients
+            void markChanged() { version_++; }
 
             using ContainsAddressCb = std::function<bool(const bs::Address &address)>;
             uint64_t amount(const ContainsAddressCb &containsAddressCb) const;
@@ -301,6 +316,74 @@ namespace bs {
 
          private:
             Signer getSigner(const std::shared_ptr<ResolverFeed> &resolver = nullptr) const;
+
+            struct InputSize
+            {
+               BinaryData  script;        // both sizes depend only on the spent script
+               size_t      inputSize{};   // non-witness part
+               size_t      witnessSize{}; // UINT32_MAX if not SegWit
+            };
+
+            // Sums of inputSizes and recipient sizes, valid for the request version
+            struct SizeTotals
+            {
+               bool     valid{};
+               uint64_t version{};
+               size_t   nbInputs{};
+               size_t   nbRecipients{};
+               size_t   inputsSize{};
+               size_t   witnessSize{};
+               size_t   nbSegWitInputs{};
+               size_t   outputsSize{};
+
+               void add(const InputSize &, bool adding = true);
+            };
+
+            // Copy of everything getSigner() output depends on, compared field by
+            // field instead of serializing the request. Recipients are compared by
+            // pointer and value - their scripts don't change after construction.
+            struct SignerCache
+            {
+               bool        valid{};
+               bool        RBF{};
+               bool        populateUTXOs{};
+               OutputSortOrder         outSortOrder{};
+               std::vector<BinaryData> prevStates;
+               std::vector<UTXO>       inputs;
+               std::vector<std::pair<std::shared_ptr<ScriptRecipient>, uint64_t>>  recipients;
+               uint64_t    changeValue{};
+               bs::Address changeAddress;
+               bool        hasResolver{};
+               std::weak_ptr<ResolverFeed>   resolver;
+
+               BinaryData  state;
+               BinaryData  txId;
+               std::exception_ptr   txIdError;
+            };
+
+            // Data derived from the public fields and memoized by const methods,
+            // so it has its own lock. Copies get a copy of the data.
+            struct Caches
+            {
+               Caches() = default;
+               Caches(const Caches &);
+               Caches &operator=(const Caches &);
+
+               mutable std::mutex      mutex;
+               std::vector<InputSize>  inputSizes;    // same order as inputs
+               SizeTotals              sizeTotals;
+               SignerCache             signer;
+            };
+            // caches_.mutex should be locked for all of them
+            bool sizeTotalsValid() const;
+            void updateSizeCache() const;
+            bool signerCacheMatches(const std::shared_ptr<ResolverFeed> &) const;
+            const SignerCache &updateSignerCache(const std::shared_ptr<ResolverFeed> &) const;
+
+            mutable Caches caches_;
+            // Bumped by each mutator
+            uint64_t version_{};
+
          };
 
 
@@ -316,6 +399,34 @@ namespace bs {
          };
 
 
+         struct BatchSignResult
+         {
+            std::vector<BinaryData>    signedTXs;  // in the order of requests, empty if failed
+            std::vector<std::string>   errors;     // in the order of requests, empty if succeeded
+            size_t   nbSigned{};
+            size_t   nbInputs{};                   // of successfully signed requests
+            std::chrono::microseconds  elapsed{};
+         };
+
+
+         // Decrypted private keys by public key. Filled by leaf resolvers while
+         // attached (see hd::Leaf::setKeyCache), so that repeated signing with the
+         // same keys doesn't decrypt them again. Keys are wiped when cleared or
+         // when the cache is destroyed.
+         class KeyCache
+         {
+         public:
+            const SecureBinaryData *find(const BinaryData &pubKey) const;
+            const SecureBinaryData &add(const BinaryData &pubKey, const SecureBinaryData &privKey);
+            void clear();
+            size_t size() const;
+
+         private:
+            mutable std::mutex   mutex_;
+            std::map<BinaryData, SecureBinaryData> keys_;
+         };
+
+
          struct SettlementData
          {
             BinaryData  settlementId;
@@ -416,8 +527,10 @@ namespace bs {
          /***
          Called by the sign container in reponse to sync wallet's topUpAddressPool
          Will result in public address chain extention on the relevant Armory address account
+         Returns new pooled addresses along with their indices
          ***/
-         virtual std::vector<bs::Address> extendAddressChain(unsigned count, bool extInt) = 0;
+         virtual std::vector<std::pair<bs::Address, std::string>> extendAddressChain(
+            unsigned count, bool extInt) = 0;
 
          virtual std::shared_ptr<ResolverFeed> getResolver(void) const = 0;
          virtual std::shared_ptr<ResolverFeed> getPublicResolver(void) const = 0;
@@ -459,6 +572,16 @@ namespace bs {
       using WalletMap = std::unordered_map<std::string, std::shared_ptr<Wallet>>;   // key is wallet id
       BinaryData SignMultiInputTX(const wallet::TXMultiSignRequest &, const WalletMap &, bool partial = false);
 
+      // Signs requests of several wallets in parallel, one worker per wallet (up to
+      // maxThreads, hardware concurrency if 0). Requests of the same wallet are signed
+      // serially by one worker inside a single lockDecryptedContainer() scope, so the
+      // decrypted keys are reused between them. Wallets sharing the same decrypted
+      // container (leaves of one HD wallet) are serialized by its lock.
+      // Failure of one request doesn't stop the others.
+      using SignBatch = std::vector<std::pair<std::shared_ptr<Wallet>, wallet::TXSignRequest>>;
+      wallet::BatchSignResult SignTXRequests(const SignBatch &, bool partial = false
+         , unsigned int maxThreads = 0);
+
    }  //namespace core
 }  //namespace bs
 
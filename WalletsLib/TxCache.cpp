@@ -0,0 +1,88 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "TxCache.h"
+
+#include <algorithm>
+
+TxCache::TxCache(size_t capacity, size_t shardCount)
+   : shardCapacity_(std::max<size_t>(1, capacity / std::max<size_t>(1, shardCount)))
+{
+   shardCount = std::max<size_t>(1, shardCount);
+   shards_.reserve(shardCount);
+   for (size_t i = 0; i < shardCount; ++i) {
+      shards_.push_back(std::make_unique<Shard>());
+   }
+}
+
+TxCache::Shard &TxCache::shard(const BinaryData &hash) const
+{
+   return *shards_[BinaryDataHash{}(hash) % shards_.size()];
+}
+
+std::shared_ptr<const Tx> TxCache::get(const BinaryData &hash)
+{
+   auto &s = shard(hash);
+   std::lock_guard<std::mutex> lock(s.mutex);
+   const auto it = s.index.find(hash);
+   if (it == s.index.end()) {
+      misses_++;
+      return nullptr;
+   }
+   s.lru.splice(s.lru.begin(), s.lru, it->second);
+   hits_++;
+   return it->second->second;
+}
+
+void TxCache::put(const BinaryData &hash, const std::shared_ptr<const Tx> &tx)
+{
+   if (!tx || !tx->isInitialized()) {
+      return;
+   }
+   auto &s = shard(hash);
+   std::lock_guard<std::mutex> lock(s.mutex);
+   const auto it = s.index.find(hash);
+   if (it != s.index.end()) {
+      it->second->second = tx;
+      s.lru.splice(s.lru.begin(), s.lru, it->second);
+      return;
+   }
+
+   s.lru.emplace_front(hash, tx);
+   s.index.emplace(hash, s.lru.begin());
+
+   while (s.lru.size() > shardCapacity_) {
+      s.index.erase(s.lru.back().first);
+      s.lru.pop_back();
+      evictions_++;
+   }
+}
+
+void TxCache::clear()
+{
+   for (auto &s : shards_) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->index.clear();
+      s->lru.clear();
+   }
+}
+
+TxCache::Stats TxCache::stats() const
+{
+   Stats result;
+   result.hits = hits_;
+   result.misses = misses_;
+   result.evictions = evictions_;
+   for (const auto &s : shards_) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      result.size += s->lru.size();
+   }
+   return result;
+}
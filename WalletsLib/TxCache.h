@@ -0,0 +1,71 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#ifndef __TX_CACHE_H__
+#define __TX_CACHE_H__
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Address.h"
+#include "TxClasses.h"
+
+// Thread-safe in-memory LRU of transactions fetched from Armory.
+// Entries are split between independently locked shards (by tx hash),
+// each shard evicts its least recently used entries when full.
+class TxCache
+{
+public:
+   struct Stats
+   {
+      uint64_t hits{};
+      uint64_t misses{};
+      uint64_t evictions{};
+      size_t   size{};
+   };
+
+   explicit TxCache(size_t capacity = 16384, size_t shardCount = 16);
+
+   TxCache(const TxCache&) = delete;
+   TxCache& operator = (const TxCache&) = delete;
+
+   // Returns nullptr if not found
+   std::shared_ptr<const Tx> get(const BinaryData &hash);
+   void put(const BinaryData &hash, const std::shared_ptr<const Tx> &);
+   void clear();
+
+   Stats stats() const;
+
+private:
+   using Entry = std::pair<BinaryData, std::shared_ptr<const Tx>>;
+
+   struct Shard
+   {
+      std::mutex  mutex;
+      // Most recently used entries first
+      std::list<Entry>  lru;
+      std::unordered_map<BinaryData, std::list<Entry>::iterator, BinaryDataHash> index;
+   };
+
+   Shard &shard(const BinaryData &hash) const;
+
+   const size_t   shardCapacity_;
+   std::vector<std::unique_ptr<Shard>> shards_;
+
+   std::atomic<uint64_t>   hits_{};
+   std::atomic<uint64_t>   misses_{};
+   std::atomic<uint64_t>   evictions_{};
+};
+
+#endif // __TX_CACHE_H__
@@ -10,25 +10,38 @@
 */
 #include "UtxoReservation.h"
 
+#include <algorithm>
 #include <thread>
 #include <spdlog/spdlog.h>
 
 using namespace bs;
 
+namespace {
+   // How often reserve() and filter() look for stale reservations
+   const auto kExpiryCheckInterval = std::chrono::minutes(1);
+}
 
 // Global UTXO reservation singleton.
 static std::shared_ptr<bs::UtxoReservation> utxoResInstance_;
 
-bs::UtxoReservation::UtxoReservation(const std::shared_ptr<spdlog::logger> &logger)
-   : logger_(logger)
+bs::UtxoReservation::UtxoReservation(const std::shared_ptr<spdlog::logger> &logger
+   , std::chrono::seconds expiry, size_t shardCount)
+   : expiry_(expiry)
+   , logger_(logger)
 {
+   shardCount = std::max<size_t>(1, shardCount);
+   shards_.reserve(shardCount);
+   for (size_t i = 0; i < shardCount; ++i) {
+      shards_.push_back(std::make_unique<Shard>());
+   }
 }
 
 // Singleton reservation.
-void bs::UtxoReservation::init(const std::shared_ptr<spdlog::logger> &logger)
+void bs::UtxoReservation::init(const std::shared_ptr<spdlog::logger> &logger
+   , std::chrono::seconds expiry)
 {
    assert(!utxoResInstance_);
-   utxoResInstance_ = std::shared_ptr<bs::UtxoReservation>(new bs::UtxoReservation(logger));
+   utxoResInstance_ = std::shared_ptr<bs::UtxoReservation>(new bs::UtxoReservation(logger, expiry));
 }
 
 void UtxoReservation::shutdownCheck()
@@ -41,11 +54,54 @@ void UtxoReservation::shutdownCheck()
    }
 }
 
+UtxoReservation::Outpoint UtxoReservation::outpoint(const UTXO &utxo)
+{
+   BinaryWriter bw;
+   bw.put_BinaryData(utxo.getTxHash());
+   bw.put_uint32_t(utxo.getTxOutIndex());
+   return bw.getData();
+}
+
+UtxoReservation::Shard &UtxoReservation::shard(const Outpoint &op) const
+{
+   return *shards_[BinaryDataHash{}(op) % shards_.size()];
+}
+
+std::unique_lock<std::mutex> UtxoReservation::lockShard(const Shard &s) const
+{
+   std::unique_lock<std::mutex> lock(s.mutex, std::try_to_lock);
+   if (!lock.owns_lock()) {
+      contended_++;
+      lock.lock();
+   }
+   return lock;
+}
+
+bool UtxoReservation::isReserved(const UTXO &utxo) const
+{
+   const auto op = outpoint(utxo);
+   const auto &s = shard(op);
+   const auto lock = lockShard(s);
+   return (s.reserved.find(op) != s.reserved.end());
+}
+
+void UtxoReservation::unreserveUtxos(const UTXOs &utxos)
+{
+   for (const auto &utxo : utxos) {
+      const auto op = outpoint(utxo);
+      auto &s = shard(op);
+      const auto lock = lockShard(s);
+      s.reserved.erase(op);
+   }
+}
+
 // Reserve a set of UTXOs for a wallet and reservation ID. Reserve across all
 // active adapters.
 void bs::UtxoReservation::reserve(const std::string &reserveId
    , const std::vector<UTXO> &utxos)
 {
+   checkExpiry();
+
    const auto curTime = std::chrono::steady_clock::now();
    std::lock_guard<std::mutex> lock(mutex_);
 
@@ -59,7 +115,10 @@ void bs::UtxoReservation::reserve(const std::string &reserveId
    reserveTime_[reserveId] = curTime;
 
    for (const auto &utxo : utxos) {
-      auto result = reserved_.insert(utxo);
+      auto op = outpoint(utxo);
+      auto &s = shard(op);
+      const auto shardLock = lockShard(s);
+      auto result = s.reserved.insert(std::move(op));
       if (!result.second) {
          SPDLOG_LOGGER_ERROR(logger_, "found duplicated reserved UTXO!");
       }
@@ -76,9 +135,7 @@ bool bs::UtxoReservation::unreserve(const std::string &reserveId)
       return false;
    }
 
-   for (const auto &utxo : it->second) {
-      reserved_.erase(utxo);
-   }
+   unreserveUtxos(it->second);
 
    byReserveId_.erase(it);
    reserveTime_.erase(reserveId);
@@ -99,27 +156,22 @@ std::vector<UTXO> bs::UtxoReservation::get(const std::string &reserveId) const
 }
 
 // For a given wallet ID, filter out all associated UTXOs from a list of UTXOs.
-// True if success, false if failure.
-void bs::UtxoReservation::filter(std::vector<UTXO> &utxos) const
+// Order of the remaining UTXOs is kept.
+void bs::UtxoReservation::filter(std::vector<UTXO> &utxos)
 {
-   std::lock_guard<std::mutex> lock(mutex_);
+   checkExpiry();
 
-   auto it = utxos.begin();
-   while (it != utxos.end()) {
-      if (reserved_.find(*it) != reserved_.end()) {
-         it = utxos.erase(it);
-      } else {
-         ++it;
-      }
-   }
+   lookups_ += utxos.size();
+   utxos.erase(std::remove_if(utxos.begin(), utxos.end(), [this](const UTXO &utxo) {
+      return isReserved(utxo);
+   }), utxos.end());
 }
 
 bool bs::UtxoReservation::containsReservedUTXO(const std::vector<UTXO> &utxos) const
 {
-   std::lock_guard<std::mutex> lock(mutex_);
-
-   for ( auto it = utxos.begin(); it != utxos.end(); ++it) {
-      if (reserved_.find(*it) != reserved_.end()) {
+   for (const auto &utxo : utxos) {
+      lookups_++;
+      if (isReserved(utxo)) {
          return true;
       }
    }
@@ -127,6 +179,69 @@ bool bs::UtxoReservation::containsReservedUTXO(const std::vector<UTXO> &utxos) c
    return false;
 }
 
+size_t UtxoReservation::expireStale()
+{
+   if (expiry_ <= std::chrono::seconds::zero()) {
+      return 0;
+   }
+   const auto minTime = std::chrono::steady_clock::now() - expiry_;
+   size_t result = 0;
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   for (auto it = reserveTime_.begin(); it != reserveTime_.end(); ) {
+      if (it->second >= minTime) {
+         ++it;
+         continue;
+      }
+      const auto itUtxos = byReserveId_.find(it->first);
+      if (itUtxos != byReserveId_.end()) {
+         SPDLOG_LOGGER_WARN(logger_, "UTXO reservation {} ({} UTXO[s]) expired", it->first
+            , itUtxos->second.size());
+         unreserveUtxos(itUtxos->second);
+         byReserveId_.erase(itUtxos);
+      }
+      it = reserveTime_.erase(it);
+      result++;
+   }
+   expired_ += result;
+   return result;
+}
+
+void UtxoReservation::checkExpiry()
+{
+   if (expiry_ <= std::chrono::seconds::zero()) {
+      return;
+   }
+   const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+   auto nextCheck = nextExpiryCheck_.load();
+   if (now < nextCheck) {
+      return;
+   }
+   const auto next = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      kExpiryCheckInterval).count();
+   // Only one of concurrent callers does the check
+   if (nextExpiryCheck_.compare_exchange_strong(nextCheck, next)) {
+      expireStale();
+   }
+}
+
+UtxoReservation::Stats UtxoReservation::stats() const
+{
+   Stats result;
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      result.reservations = byReserveId_.size();
+   }
+   for (const auto &s : shards_) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      result.reservedUtxos += s->reserved.size();
+   }
+   result.lookups = lookups_;
+   result.contended = contended_;
+   result.expired = expired_;
+   return result;
+}
+
 UtxoReservation *UtxoReservation::instance()
 {
    return utxoResInstance_.get();
@@ -14,8 +14,11 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <mutex>
 #include <unordered_set>
 #include <unordered_map>
+#include <vector>
+#include "Address.h"
 #include "TxClasses.h"
 
 namespace spdlog {
@@ -30,12 +33,28 @@ namespace bs {
    //
    // NB: This is a global singleton that shouldn't be accessed directly. Use an
    // Adapter object to access the singleton and do all the heavy lifting.
+   //
+   // Reserved outpoints are split between independently locked shards, so
+   // filtering UTXO lists (on every coin selection) doesn't serialize on a
+   // single lock. Optionally (non-zero expiry), reservations older than expiry
+   // are treated as leaked and dropped automatically - only enable it if no
+   // reservation can legitimately outlive it. Expiry is off by default.
    class UtxoReservation
    {
    public:
+      struct Stats
+      {
+         size_t   reservations{};
+         size_t   reservedUtxos{};
+         uint64_t lookups{};     // UTXOs checked against reservations
+         uint64_t contended{};   // shard locks that had to wait for other thread
+         uint64_t expired{};     // reservations dropped by expiry
+      };
+
       // Create the singleton. Use only once!
       // Destroying disabled as it's broken, see BST-2362 for details
-      static void init(const std::shared_ptr<spdlog::logger> &logger);
+      static void init(const std::shared_ptr<spdlog::logger> &logger
+         , std::chrono::seconds expiry = std::chrono::seconds::zero());
 
       // Reserve/Unreserve UTXOs. Used as needed. User supplies the wallet ID,
       // a reservation ID, and the UTXOs to reserve.
@@ -47,20 +66,41 @@ namespace bs {
 
       // Pass in a vector of UTXOs. If any of the UTXOs are in the wallet ID
       // being queried, remove the UTXOs from the vector.
-      void filter(std::vector<UTXO> &utxos) const;
+      void filter(std::vector<UTXO> &utxos);
 
       bool containsReservedUTXO(const std::vector<UTXO> &utxos) const;
 
+      // Drop reservations older than expiry, returns number of dropped ones.
+      // Also called periodically from reserve() and filter(). No-op if expiry is off.
+      size_t expireStale();
+
       // Check that all reservations have been cleared
       void shutdownCheck();
 
+      Stats stats() const;
+
       static UtxoReservation *instance();
 
-      explicit UtxoReservation(const std::shared_ptr<spdlog::logger> &logger);
+      explicit UtxoReservation(const std::shared_ptr<spdlog::logger> &logger
+         , std::chrono::seconds expiry = std::chrono::seconds::zero(), size_t shardCount = 16);
 
    private:
       using UTXOs = std::vector<UTXO>;
       using IdList = std::unordered_set<std::string>;
+      using Outpoint = BinaryData;     // TX hash | output index
+
+      struct Shard
+      {
+         mutable std::mutex   mutex;
+         std::unordered_set<Outpoint, BinaryDataHash> reserved;
+      };
+
+      static Outpoint outpoint(const UTXO &);
+      Shard &shard(const Outpoint &) const;
+      std::unique_lock<std::mutex> lockShard(const Shard &) const;
+      bool isReserved(const UTXO &) const;
+      void unreserveUtxos(const UTXOs &);
+      void checkExpiry();
 
       mutable std::mutex mutex_;
 
@@ -70,7 +110,14 @@ namespace bs {
       // Reservation ID, time of reservation
       std::unordered_map<std::string, std::chrono::steady_clock::time_point> reserveTime_;
 
-      std::set<UTXO> reserved_;
+      std::vector<std::unique_ptr<Shard>> shards_;
+
+      const std::chrono::seconds expiry_;    // zero if reservations never expire
+      std::atomic<std::chrono::steady_clock::rep>  nextExpiryCheck_{};
+
+      mutable std::atomic<uint64_t> lookups_{};
+      mutable std::atomic<uint64_t> contended_{};
+      std::atomic<uint64_t> expired_{};
 
       std::shared_ptr<spdlog::logger> logger_;
    };
@@ -0,0 +1,326 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#include "UtxoSelector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include "Address.h"
+
+using namespace bs;
+
+namespace {
+   // vbytes of a change output, P2SH (32) or native SegWit (31)
+   const size_t kChangeOutputSize = 32;
+
+   // vbytes to spend the change later (P2WPKH input), part of the cost of
+   // creating change which a changeless match saves
+   const size_t kChangeSpendSize = 68;
+
+   const size_t kMaxBnBTries = 100000;
+   const size_t kKnapsackIterations = 1000;
+
+   // version, locktime, txin & txout count - same as bs::Address::getFeeForMaxVal
+   const size_t kTxOverheadSize = 10;
+   const size_t kSegWitOverheadSize = 2;
+}
+
+bool UtxoSelector::setUtxos(const std::vector<UTXO> &utxos)
+{
+   uint64_t hash = 14695981039346656037ULL;
+   const auto &hashAdd = [&hash](uint64_t value) {
+      hash ^= value;
+      hash *= 1099511628211ULL;
+   };
+   for (const auto &utxo : utxos) {
+      hashAdd(BinaryDataHash{}(utxo.getTxHash()));
+      hashAdd(utxo.getTxOutIndex());
+      hashAdd(utxo.getValue());
+   }
+   if (!inputs_.empty() && (inputs_.size() == utxos.size()) && (hash == poolHash_)) {
+      return false;
+   }
+
+   poolHash_ = hash;
+   utxos_ = utxos;
+   inputs_.clear();
+   inputs_.reserve(utxos_.size());
+   hasSegWit_ = false;
+   for (const auto &utxo : utxos_) {
+      Input input;
+      input.value = utxo.getValue();
+      // Same size accounting as getFeeForMaxVal: witness inputs add a byte
+      // to the base size and their witness data at a quarter of the rate
+      input.weight = 4 * utxo.getInputRedeemSize();
+      if (utxo.isSegWit()) {
+         input.weight += 4 + utxo.getWitnessDataSize();
+         hasSegWit_ = true;
+      }
+      inputs_.push_back(input);
+   }
+   sorted_ = false;
+   hasLast_ = false;
+   return true;
+}
+
+uint64_t UtxoSelector::feeForWeight(size_t weight, float feePerByte) const
+{
+   return static_cast<uint64_t>(std::ceil(static_cast<double>(weight) * feePerByte / 4));
+}
+
+void UtxoSelector::sortCandidates(float feePerByte, bool fixedFee)
+{
+   if (sorted_ && (sortedFixedFee_ == fixedFee) && (fixedFee || (sortedFeePerByte_ == feePerByte))) {
+      return;
+   }
+   candidates_.clear();
+   candidates_.reserve(inputs_.size());
+   for (size_t i = 0; i < inputs_.size(); ++i) {
+      Candidate candidate;
+      candidate.index = i;
+      candidate.fee = fixedFee ? 0 : feeForWeight(inputs_[i].weight, feePerByte);
+      if (inputs_[i].value <= candidate.fee) {
+         continue;      // costs more to spend than it's worth
+      }
+      candidate.effValue = inputs_[i].value - candidate.fee;
+      candidates_.push_back(candidate);
+   }
+   std::sort(candidates_.begin(), candidates_.end(), [](const Candidate &a, const Candidate &b) {
+      if (a.effValue != b.effValue) {
+         return (a.effValue > b.effValue);
+      }
+      return (a.fee < b.fee);
+   });
+   sorted_ = true;
+   sortedFeePerByte_ = feePerByte;
+   sortedFixedFee_ = fixedFee;
+   stats_.resorts++;
+}
+
+UtxoSelector::Result UtxoSelector::select(const Params &params)
+{
+   stats_.selections++;
+   if (hasLast_ && (lastParams_.target == params.target) && (lastParams_.feePerByte == params.feePerByte)
+      && (lastParams_.totalFee == params.totalFee) && (lastParams_.txOutSize == params.txOutSize)) {
+      stats_.cached++;
+      return lastResult_;
+   }
+
+   const bool fixedFee = (params.totalFee > 0) || (params.feePerByte <= 0);
+   sortCandidates(params.feePerByte, fixedFee);
+
+   const size_t baseSize = kTxOverheadSize + params.txOutSize + (hasSegWit_ ? kSegWitOverheadSize : 0);
+   const uint64_t baseFee = fixedFee ? params.totalFee : feeForWeight(4 * baseSize, params.feePerByte);
+   const uint64_t changeFee = fixedFee ? 0 : feeForWeight(4 * kChangeOutputSize, params.feePerByte);
+   const uint64_t dust = bs::Address::getNativeSegwitDustAmount();
+   // Excess below this is cheaper to give to miners than to create change for
+   const uint64_t costOfChange = fixedFee ? dust
+      : changeFee + feeForWeight(4 * kChangeSpendSize, params.feePerByte);
+
+   const uint64_t target = params.target + baseFee;
+   std::vector<size_t> selection;
+   if (selectBnB(target, costOfChange, selection)) {
+      stats_.bnbMatches++;
+   }
+   else if (!selectKnapsack(target + changeFee + dust, selection)
+      && !selectKnapsack(target, selection)) {
+      selection.clear();
+   }
+
+   lastParams_ = params;
+   lastResult_ = makeResult(selection, params, baseFee);
+   hasLast_ = true;
+   return lastResult_;
+}
+
+// Depth-first search over inputs sorted by effective value for a set that
+// covers the target with excess below the cost of change, keeping the one
+// with the least excess
+bool UtxoSelector::selectBnB(uint64_t target, uint64_t costOfChange, std::vector<size_t> &result)
+{
+   uint64_t available = 0;
+   for (const auto &candidate : candidates_) {
+      available += candidate.effValue;
+   }
+   if (available < target) {
+      return false;
+   }
+
+   std::vector<bool> current;
+   current.reserve(candidates_.size());
+   std::vector<bool> best;
+   uint64_t bestExcess = std::numeric_limits<uint64_t>::max();
+   uint64_t value = 0;
+
+   for (size_t tries = 0; tries < kMaxBnBTries; ++tries) {
+      stats_.bnbTries++;
+      bool backtrack = false;
+      if ((value + available < target) || (value > target + costOfChange)) {
+         backtrack = true;
+      }
+      else if (value >= target) {
+         const auto excess = value - target;
+         if (excess < bestExcess) {
+            best = current;
+            bestExcess = excess;
+            if (!excess) {
+               break;
+            }
+         }
+         backtrack = true;
+      }
+
+      if (backtrack) {
+         // Walk back to the last included input to try its omission branch
+         while (!current.empty() && !current.back()) {
+            current.pop_back();
+            available += candidates_[current.size()].effValue;
+         }
+         if (current.empty()) {
+            break;
+         }
+         current.back() = false;
+         value -= candidates_[current.size() - 1].effValue;
+      }
+      else {
+         const auto &candidate = candidates_[current.size()];
+         available -= candidate.effValue;
+         // Including an input equal to just omitted one leads to the same sets
+         if (!current.empty() && !current.back()
+            && (candidate.effValue == candidates_[current.size() - 1].effValue)
+            && (candidate.fee == candidates_[current.size() - 1].fee)) {
+            current.push_back(false);
+         }
+         else {
+            current.push_back(true);
+            value += candidate.effValue;
+         }
+      }
+   }
+
+   if (best.empty()) {
+      return false;
+   }
+   result.clear();
+   for (size_t i = 0; i < best.size(); ++i) {
+      if (best[i]) {
+         result.push_back(i);
+      }
+   }
+   return true;
+}
+
+// Smallest single input covering the target or the best random approximation
+// from smaller inputs, whichever leaves less excess
+bool UtxoSelector::selectKnapsack(uint64_t target, std::vector<size_t> &result) const
+{
+   std::vector<size_t> lower;
+   uint64_t totalLower = 0;
+   size_t lowestLarger = candidates_.size();
+   for (size_t i = 0; i < candidates_.size(); ++i) {
+      const auto effValue = candidates_[i].effValue;
+      if (effValue == target) {
+         result = { i };
+         return true;
+      }
+      if (effValue > target) {
+         lowestLarger = i;     // sorted descending - the last one is the lowest
+      }
+      else {
+         lower.push_back(i);
+         totalLower += effValue;
+      }
+   }
+
+   if (totalLower <= target) {
+      if (totalLower == target) {
+         result = lower;
+         return true;
+      }
+      if (lowestLarger == candidates_.size()) {
+         return false;
+      }
+      result = { lowestLarger };
+      return true;
+   }
+
+   std::mt19937 rng(static_cast<uint32_t>(target));
+   std::vector<bool> best(lower.size(), true);
+   uint64_t bestValue = totalLower;
+   for (size_t rep = 0; (rep < kKnapsackIterations) && (bestValue != target); ++rep) {
+      std::vector<bool> included(lower.size(), false);
+      uint64_t value = 0;
+      bool reachedTarget = false;
+      for (int pass = 0; (pass < 2) && !reachedTarget; ++pass) {
+         for (size_t i = 0; i < lower.size(); ++i) {
+            // First pass picks randomly, second one fills up with the rest
+            if ((pass == 0) ? (rng() & 1) : !included[i]) {
+               value += candidates_[lower[i]].effValue;
+               included[i] = true;
+               if (value >= target) {
+                  reachedTarget = true;
+                  if (value < bestValue) {
+                     bestValue = value;
+                     best = included;
+                  }
+                  value -= candidates_[lower[i]].effValue;
+                  included[i] = false;
+               }
+            }
+         }
+      }
+   }
+
+   if ((lowestLarger != candidates_.size()) && (candidates_[lowestLarger].effValue <= bestValue)) {
+      result = { lowestLarger };
+      return true;
+   }
+   result.clear();
+   for (size_t i = 0; i < lower.size(); ++i) {
+      if (best[i]) {
+         result.push_back(lower[i]);
+      }
+   }
+   return true;
+}
+
+UtxoSelector::Result UtxoSelector::makeResult(const std::vector<size_t> &selection
+   , const Params &params, uint64_t baseFee) const
+{
+   Result result;
+   if (selection.empty()) {
+      return result;
+   }
+   const bool fixedFee = (params.totalFee > 0) || (params.feePerByte <= 0);
+   uint64_t fee = baseFee;
+   for (const auto idx : selection) {
+      const auto &candidate = candidates_[idx];
+      result.utxos.push_back(utxos_[candidate.index]);
+      result.value += inputs_[candidate.index].value;
+      fee += candidate.fee;
+   }
+   if (result.value < params.target + fee) {
+      return {};
+   }
+
+   const uint64_t changeFee = fixedFee ? 0 : feeForWeight(4 * kChangeOutputSize, params.feePerByte);
+   const auto excess = result.value - params.target - fee;
+   if (excess > changeFee + bs::Address::getNativeSegwitDustAmount()) {
+      result.hasChange = true;
+      result.fee = fee + changeFee;
+   }
+   else {
+      result.fee = fee + excess;    // not worth creating change
+   }
+   result.valid = true;
+   return result;
+}
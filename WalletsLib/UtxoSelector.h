@@ -0,0 +1,102 @@
+/*
+
+***********************************************************************************
+* Copyright (C) 2016 - , BlockSettle AB
+* Distributed under the GNU Affero General Public License (AGPL v3)
+* See LICENSE or http://www.gnu.org/licenses/agpl.html
+*
+**********************************************************************************
+
+*/
+#ifndef __UTXO_SELECTOR_H__
+#define __UTXO_SELECTOR_H__
+
+#include <cstdint>
+#include <vector>
+#include "TxClasses.h"
+
+namespace bs {
+   // Native coin selection over a pool of decorated UTXOs (see
+   // bs::Address::decorateUTXOs). Tries a branch-and-bound search for an input
+   // set that pays the target without change first, falls back to knapsack
+   // over effective values (value minus the fee to spend the input).
+   // Input sizes and the effective value order are kept between calls, so
+   // changing only the amount or fee doesn't re-process the whole pool.
+   // Not thread-safe.
+   class UtxoSelector
+   {
+   public:
+      struct Params
+      {
+         uint64_t target{};         // total value of recipients
+         float    feePerByte{};
+         uint64_t totalFee{};       // fixed fee, feePerByte is ignored if set
+         size_t   txOutSize{};      // serialized size of recipient outputs
+      };
+
+      struct Result
+      {
+         bool     valid{};
+         std::vector<UTXO> utxos;
+         uint64_t value{};
+         uint64_t fee{};
+         bool     hasChange{};
+      };
+
+      struct Stats
+      {
+         uint64_t selections{};
+         uint64_t cached{};         // same params and pool as the last time
+         uint64_t resorts{};        // pool or fee rate change
+         uint64_t bnbMatches{};
+         uint64_t bnbTries{};
+      };
+
+      // Returns false if the pool is the same as before
+      bool setUtxos(const std::vector<UTXO> &);
+      Result select(const Params &);
+
+      Stats stats() const { return stats_; }
+
+   private:
+      struct Input
+      {
+         uint64_t value{};
+         size_t   weight{};   // in weight units, i.e. vbytes * 4
+      };
+
+      // Candidate input with its effective value at the current fee rate
+      struct Candidate
+      {
+         size_t   index{};
+         uint64_t effValue{};
+         uint64_t fee{};
+      };
+
+      void sortCandidates(float feePerByte, bool fixedFee);
+      uint64_t feeForWeight(size_t weight, float feePerByte) const;
+      bool selectBnB(uint64_t target, uint64_t costOfChange, std::vector<size_t> &);
+      bool selectKnapsack(uint64_t target, std::vector<size_t> &) const;
+      Result makeResult(const std::vector<size_t> &, const Params &, uint64_t baseFee) const;
+
+      std::vector<UTXO>    utxos_;
+      std::vector<Input>   inputs_;
+      uint64_t poolHash_{};
+      bool     hasSegWit_{};
+
+      // Sorted by effective value, descending
+      std::vector<Candidate>  candidates_;
+      bool     sorted_{};
+      float    sortedFeePerByte_{};
+      bool     sortedFixedFee_{};
+
+      bool     hasLast_{};
+      Params   lastParams_;
+      Result   lastResult_;
+
+      Stats    stats_;
+   };
+
+}  //namespace bs
+
+#endif //__UTXO_SELECTOR_H__